@@ -0,0 +1,95 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Vec3.h"
+#include "Ray.h"
+
+//An axis aligned bounding box
+struct AABB
+{
+	Vec3	min;
+	Vec3	max;
+
+	//An empty box, growing it by anything yields that thing's bounds
+	inline void Reset()
+	{
+		min.SetVector(FARFAR_AWAY, FARFAR_AWAY, FARFAR_AWAY);
+		max.SetVector(-FARFAR_AWAY, -FARFAR_AWAY, -FARFAR_AWAY);
+	}
+
+	inline void Grow(const Vec3& p)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (p[i] < min[i]) min[i] = p[i];
+			if (p[i] > max[i]) max[i] = p[i];
+		}
+	}
+
+	inline void Grow(const AABB& box)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (box.min[i] < min[i]) min[i] = box.min[i];
+			if (box.max[i] > max[i]) max[i] = box.max[i];
+		}
+	}
+
+	inline bool IsEmpty() const
+	{
+		return min[0] > max[0] || min[1] > max[1] || min[2] > max[2];
+	}
+
+	inline Vec3 Centroid() const
+	{
+		return Vec3((min[0] + max[0]) * 0.5, (min[1] + max[1]) * 0.5, (min[2] + max[2]) * 0.5);
+	}
+
+	inline Real SurfaceArea() const
+	{
+		if (IsEmpty())
+			return 0.0;
+
+		Real dx = max[0] - min[0];
+		Real dy = max[1] - min[1];
+		Real dz = max[2] - min[2];
+
+		return 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	//Slab test, tnear receives the entry distance (clamped to the ray's tmin) if the ray enters
+	//the box before tmax
+	inline bool IntersectByRay(Ray& ray, Real tmax, Real& tnear) const
+	{
+		const Vec3& start = ray.GetRayStart();
+		const Vec3& invdir = ray.GetInvRay();
+
+		Real t0 = ray.GetTMin();
+		Real t1 = tmax;
+
+		for (int i = 0; i < 3; i++)
+		{
+			//the near plane of each slab by the sign of the direction, which gives the values
+			//the swap of the two distances would
+			int sign = ray.GetSign(i);
+			Real tmin_i = ((sign ? max : min)[i] - start[i]) * invdir[i];
+			Real tmax_i = ((sign ? min : max)[i] - start[i]) * invdir[i];
+
+			//written so that a NaN (ray in the slab plane) leaves the interval untouched
+			t0 = tmin_i > t0 ? tmin_i : t0;
+			t1 = tmax_i < t1 ? tmax_i : t1;
+		}
+
+		tnear = t0;
+
+		return t0 <= t1;
+	}
+};
@@ -0,0 +1,90 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "PrimitiveStore.h"
+
+class ThreadPool;
+
+//The structure Scene::Intersect and Scene::Occluded find the bounded objects through
+enum AcceleratorType
+{
+	ACCELERATOR_BVH,		//the scene's own BVH (or WideBVH), the default
+	ACCELERATOR_GRID,		//a UniformGrid
+	ACCELERATOR_KDTREE,		//a KDTree
+};
+
+//Direct mapped slots, a power of two
+#define ACCEL_MAILBOX_SIZE	64
+
+//The items one ray has been tested against. Grids and kd-trees put an item into every cell or
+//leaf it overlaps, and a ray walking through several of them would test it again in each.
+//The mailbox lives on the stack of one query, so concurrent rays never share it; two items
+//in the same slot only cost a repeated test, never a missed one.
+struct RayMailbox
+{
+	int		items[ACCEL_MAILBOX_SIZE];
+
+	inline RayMailbox()
+	{
+		for (int i = 0; i < ACCEL_MAILBOX_SIZE; i++)
+		{
+			items[i] = -1;
+		}
+	}
+
+	//True if item was tested before, otherwise it is noted as tested now
+	inline bool TestedBefore(int item)
+	{
+		int& slot = items[item & (ACCEL_MAILBOX_SIZE - 1)];
+
+		if (slot == item)
+		{
+			return true;
+		}
+
+		slot = item;
+
+		return false;
+	}
+};
+
+//A spatial index over the bounded objects of a scene other than its BVH, see Scene::SetAccelerator.
+//It is built over the boxes of the items and answers single ray queries against them; the items
+//are tested through the scene's PrimitiveStore, the planes stay with the scene.
+class Accelerator
+{
+	public:
+		virtual ~Accelerator() {}
+
+		virtual const char* GetName() const = 0;
+
+		//Build over bounds, one box per item. The grid and the k-d tree build on the calling
+		//thread alone and ignore pool, which is there for builds that can share the work.
+		virtual void Build(const std::vector<AABB>& bounds, ThreadPool* pool = nullptr) = 0;
+
+		//Closest hit among the items, which map item indices to primitives: hit is updated if an
+		//item is hit closer than hit.t
+		virtual void Intersect(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			RayHit& hit) const = 0;
+
+		//True if an item that casts shadows lies on the ray before maxDistance
+		virtual bool Occluded(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			Real maxDistance) const = 0;
+
+		//Seconds the last Build took
+		virtual double GetBuildSeconds() const = 0;
+
+		//Bytes allocated by the structure
+		virtual size_t GetMemoryUsage() const = 0;
+};
@@ -0,0 +1,797 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "BVH.h"
+#include "ThreadPool.h"
+
+//Relative costs of visiting a node and of testing an item, used by the surface area heuristic
+#define SAH_TRAVERSAL_COST		1.0
+#define SAH_INTERSECTION_COST	1.0
+
+//Leaves are never made larger than this unless the tree gets too deep
+#define BVH_MAX_LEAF_SIZE		8
+
+//Nodes of up to BVH_SWEEP_SIZE items try every split position, larger ones BVH_BIN_COUNT per axis
+#define BVH_SWEEP_SIZE			32
+#define BVH_BIN_COUNT			32
+
+//With a thread pool, nodes of more than BVH_PARALLEL_SIZE items are binned and partitioned
+//BVH_CHUNK_SIZE items per task, and subtrees of more than BVH_TASK_SIZE items are built as tasks
+#define BVH_PARALLEL_SIZE		65536
+#define BVH_CHUNK_SIZE			16384
+#define BVH_TASK_SIZE			4096
+
+struct BVH::BuildContext
+{
+	const std::vector<AABB>*	bounds;
+	ThreadPool*					pool;			//nullptr builds on the calling thread only
+	ThreadPool::TaskGroup		subtrees;
+	std::atomic<int>			nodeCount;
+};
+
+//The items of a node counted into bins along each axis
+struct BVHBins
+{
+	AABB	bounds[3][BVH_BIN_COUNT];
+	int		counts[3][BVH_BIN_COUNT];
+
+	inline void Reset()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (int b = 0; b < BVH_BIN_COUNT; b++)
+			{
+				bounds[axis][b].Reset();
+				counts[axis][b] = 0;
+			}
+		}
+	}
+};
+
+//The weight of a node's surface area in the SAH cost of a tree
+static inline double NodeCost(const BVHNode& node)
+{
+	return node.count > 0 ? SAH_INTERSECTION_COST * node.count : SAH_TRAVERSAL_COST;
+}
+
+//The bin of a centroid coordinate c, for bins starting at binMin that are 1 / binScale wide
+static inline int BinIndex(Real c, Real binMin, double binScale)
+{
+	int bin = (int)((c - binMin) * binScale);
+
+	return bin < BVH_BIN_COUNT - 1 ? bin : BVH_BIN_COUNT - 1;
+}
+
+BVH::BVH()
+{
+	m_report = BVHBuildReport();
+	m_nodeData = nullptr;
+	m_itemData = nullptr;
+	m_nodeCount = 0;
+	m_itemCount = 0;
+	m_weightedArea = 0.0;
+	m_refitCount = 0;
+}
+
+BVH::~BVH()
+{
+}
+
+void BVH::Clear()
+{
+	m_nodes.clear();
+	m_items.clear();
+	m_parents.clear();
+	m_itemLeaf.clear();
+	m_nodeData = nullptr;
+	m_itemData = nullptr;
+	m_nodeCount = 0;
+	m_itemCount = 0;
+	m_weightedArea = 0.0;
+	m_refitCount = 0;
+	m_report = BVHBuildReport();
+}
+
+void BVH::UseOwnArrays()
+{
+	m_nodeData = m_nodes.empty() ? nullptr : m_nodes.data();
+	m_itemData = m_items.empty() ? nullptr : m_items.data();
+	m_nodeCount = (int)m_nodes.size();
+	m_itemCount = (int)m_items.size();
+}
+
+void BVH::Attach(const BVHNode* nodes, int nodeCount, const int* items, int itemCount, const BVHBuildReport& report)
+{
+	Clear();
+
+	if (nodeCount == 0)
+	{
+		return;
+	}
+
+	m_nodeData = nodes;
+	m_itemData = items;
+	m_nodeCount = nodeCount;
+	m_itemCount = itemCount;
+	m_report = report;
+
+	//what Refit keeps up to date, as ComputeReport would have found it
+	m_weightedArea = report.sahCost * nodes[0].bounds.SurfaceArea();
+}
+
+void BVH::Build(const std::vector<AABB>& bounds, ThreadPool* pool)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	Clear();
+
+	int count = (int)bounds.size();
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	//a pool of one thread would only add the cost of the tasks
+	if (pool && pool->GetThreadCount() < 2)
+	{
+		pool = nullptr;
+	}
+
+	BuildContext ctx;
+	ctx.bounds = &bounds;
+	ctx.pool = pool;
+	ctx.nodeCount = 1;
+
+	m_items.resize(count);
+	m_centroids.resize(count);
+	m_scratch.resize(count);
+
+	auto initItems = [this, &bounds](int first, int end)
+	{
+		for (int i = first; i < end; i++)
+		{
+			m_items[i] = i;
+			m_centroids[i] = bounds[i].Centroid();
+		}
+	};
+
+	if (pool)
+	{
+		pool->ParallelFor(0, count, BVH_CHUNK_SIZE, initItems);
+	}
+	else
+	{
+		initItems(0, count);
+	}
+
+	//a binary tree over n items has at most 2n - 1 nodes; the threads take the nodes they
+	//need from ctx.nodeCount, so they are all there from the start
+	m_nodes.resize(2 * count - 1);
+
+	BuildNode(0, 0, count, 1, ctx, nullptr);
+
+	if (pool)
+	{
+		pool->Wait(ctx.subtrees);
+	}
+
+	//the allocation assumed single item leaves
+	m_nodes.resize(ctx.nodeCount);
+	m_nodes.shrink_to_fit();
+	m_centroids.clear();
+	m_centroids.shrink_to_fit();
+	m_scratch.clear();
+	m_scratch.shrink_to_fit();
+
+	UseOwnArrays();
+	ComputeReport();
+	m_report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	m_report.threads = pool ? pool->GetThreadCount() : 1;
+}
+
+//known, if given, are the bounds of the items, as the split of the parent found them
+void BVH::BuildNode(int nodeIndex, int first, int count, int depth, BuildContext& ctx, const RangeBounds* known)
+{
+	RangeBounds range;
+
+	if (known)
+	{
+		range = *known;
+	}
+	else
+	{
+		ComputeRangeBounds(first, count, ctx, range);
+	}
+
+	m_nodes[nodeIndex].bounds = range.items;
+	m_nodes[nodeIndex].leftFirst = first;
+	m_nodes[nodeIndex].count = count;
+
+	if (count <= 1 || depth >= BVH_MAX_DEPTH)
+	{
+		return;
+	}
+
+	int split = 0;
+	double cost = FARFAR_AWAY;
+	bool found;
+
+	//the children of a binned split know their bounds from the bins and the partition
+	RangeBounds children[2];
+	const RangeBounds* leftKnown = nullptr;
+	const RangeBounds* rightKnown = nullptr;
+
+	if (count <= BVH_SWEEP_SIZE)
+	{
+		found = FindSweepSplit(first, count, ctx, range.items.SurfaceArea(), split, cost);
+	}
+	else
+	{
+		found = FindBinnedSplit(first, count, ctx, range, split, cost, children);
+
+		if (!children[0].items.IsEmpty())
+		{
+			leftKnown = &children[0];
+			rightKnown = &children[1];
+		}
+	}
+
+	double leafCost = SAH_INTERSECTION_COST * count;
+
+	if (!found || (cost >= leafCost && count <= BVH_MAX_LEAF_SIZE))
+	{
+		return;
+	}
+
+	int left = ctx.nodeCount.fetch_add(2);
+
+	m_nodes[nodeIndex].leftFirst = left;
+	m_nodes[nodeIndex].count = 0;
+
+	if (ctx.pool && count > BVH_TASK_SIZE)
+	{
+		//another thread may take the left subtree while this one goes on with the right
+		BuildContext* pCtx = &ctx;
+		RangeBounds leftBounds = children[0];
+		bool haveBounds = leftKnown != nullptr;
+
+		ctx.pool->Submit(ctx.subtrees, [this, pCtx, left, first, split, depth, leftBounds, haveBounds]()
+		{
+			BuildNode(left, first, split, depth + 1, *pCtx, haveBounds ? &leftBounds : nullptr);
+		});
+	}
+	else
+	{
+		BuildNode(left, first, split, depth + 1, ctx, leftKnown);
+	}
+
+	BuildNode(left + 1, first + split, count - split, depth + 1, ctx, rightKnown);
+}
+
+void BVH::ComputeRangeBounds(int first, int count, BuildContext& ctx, RangeBounds& range)
+{
+	const std::vector<AABB>& bounds = *ctx.bounds;
+
+	auto grow = [this, &bounds](int begin, int end, AABB& box, AABB& centroidBox)
+	{
+		box.Reset();
+		centroidBox.Reset();
+
+		for (int i = begin; i < end; i++)
+		{
+			box.Grow(bounds[m_items[i]]);
+			centroidBox.Grow(m_centroids[m_items[i]]);
+		}
+	};
+
+	if (!ctx.pool || count <= BVH_PARALLEL_SIZE)
+	{
+		grow(first, first + count, range.items, range.centroids);
+		return;
+	}
+
+	int chunks = (count + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+	std::vector<AABB> chunkBounds(chunks * 2);
+
+	ctx.pool->ParallelFor(0, chunks, 1, [first, count, &chunkBounds, &grow](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			int chunkEnd = (c + 1) * BVH_CHUNK_SIZE < count ? (c + 1) * BVH_CHUNK_SIZE : count;
+			grow(first + c * BVH_CHUNK_SIZE, first + chunkEnd, chunkBounds[c * 2], chunkBounds[c * 2 + 1]);
+		}
+	});
+
+	range.items.Reset();
+	range.centroids.Reset();
+
+	for (int c = 0; c < chunks; c++)
+	{
+		range.items.Grow(chunkBounds[c * 2]);
+		range.centroids.Grow(chunkBounds[c * 2 + 1]);
+	}
+}
+
+bool BVH::FindSweepSplit(int first, int count, const BuildContext& ctx, Real parentArea, int& split, double& cost)
+{
+	const std::vector<AABB>& bounds = *ctx.bounds;
+
+	//Sweep every axis with the items sorted by centroid; rightArea[i] is the area of
+	//the box around items [i, count) so each split position costs one Grow
+	int bestAxis = -1;
+	double rightArea[BVH_SWEEP_SIZE];
+	std::vector<int>::iterator begin = m_items.begin() + first;
+	std::vector<int>::iterator end = begin + count;
+
+	for (int axis = 0; axis < 3 && parentArea > 0.0; axis++)
+	{
+		std::sort(begin, end, [this, axis](int a, int b) { return m_centroids[a][axis] < m_centroids[b][axis]; });
+
+		AABB sweep;
+		sweep.Reset();
+
+		for (int i = count - 1; i > 0; i--)
+		{
+			sweep.Grow(bounds[m_items[first + i]]);
+			rightArea[i] = sweep.SurfaceArea();
+		}
+
+		sweep.Reset();
+
+		for (int i = 1; i < count; i++)
+		{
+			sweep.Grow(bounds[m_items[first + i - 1]]);
+
+			double splitCost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST *
+				(sweep.SurfaceArea() * i + rightArea[i] * (count - i)) / parentArea;
+
+			if (splitCost < cost)
+			{
+				cost = splitCost;
+				bestAxis = axis;
+				split = i;
+			}
+		}
+	}
+
+	//items without any extent give the heuristic nothing to work with, split them in half
+	if (parentArea <= 0.0)
+	{
+		bestAxis = 0;
+		split = count / 2;
+		cost = 0.0;
+	}
+
+	if (bestAxis < 0)
+	{
+		return false;
+	}
+
+	if (bestAxis != 2 || parentArea <= 0.0)
+	{
+		std::sort(begin, end, [this, bestAxis](int a, int b) { return m_centroids[a][bestAxis] < m_centroids[b][bestAxis]; });
+	}
+
+	return true;
+}
+
+//children receives the bounds of both sides of the split, or empty boxes if they are not known
+bool BVH::FindBinnedSplit(int first, int count, BuildContext& ctx, const RangeBounds& range, int& split,
+	double& cost, RangeBounds children[2])
+{
+	const std::vector<AABB>& bounds = *ctx.bounds;
+	const AABB& centroidBounds = range.centroids;
+	Real parentArea = range.items.SurfaceArea();
+
+	children[0].items.Reset();
+	children[0].centroids.Reset();
+	children[1].items.Reset();
+	children[1].centroids.Reset();
+
+	std::vector<int>::iterator begin = m_items.begin() + first;
+	std::vector<int>::iterator end = begin + count;
+
+	Real binMin[3];
+	double binScale[3];
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+
+		binMin[axis] = centroidBounds.min[axis];
+		binScale[axis] = extent > 0.0 ? BVH_BIN_COUNT / (double)extent : 0.0;
+	}
+
+	auto fillBins = [this, &bounds, &binMin, &binScale](int rangeBegin, int rangeEnd, BVHBins& bins)
+	{
+		bins.Reset();
+
+		for (int i = rangeBegin; i < rangeEnd; i++)
+		{
+			int item = m_items[i];
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				int b = BinIndex(m_centroids[item][axis], binMin[axis], binScale[axis]);
+
+				AABB& bin = bins.bounds[axis][b];
+				bin.min = bin.min.Min(bounds[item].min);
+				bin.max = bin.max.Max(bounds[item].max);
+				bins.counts[axis][b]++;
+			}
+		}
+	};
+
+	BVHBins bins;
+
+	if (!ctx.pool || count <= BVH_PARALLEL_SIZE)
+	{
+		fillBins(first, first + count, bins);
+	}
+	else
+	{
+		int chunks = (count + BVH_CHUNK_SIZE - 1) / BVH_CHUNK_SIZE;
+		std::vector<BVHBins> chunkBins(chunks);
+
+		ctx.pool->ParallelFor(0, chunks, 1, [first, count, &chunkBins, &fillBins](int rangeBegin, int rangeEnd)
+		{
+			for (int c = rangeBegin; c < rangeEnd; c++)
+			{
+				int chunkEnd = (c + 1) * BVH_CHUNK_SIZE < count ? (c + 1) * BVH_CHUNK_SIZE : count;
+				fillBins(first + c * BVH_CHUNK_SIZE, first + chunkEnd, chunkBins[c]);
+			}
+		});
+
+		bins = chunkBins[0];
+
+		for (int c = 1; c < chunks; c++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (int b = 0; b < BVH_BIN_COUNT; b++)
+				{
+					bins.bounds[axis][b].Grow(chunkBins[c].bounds[axis][b]);
+					bins.counts[axis][b] += chunkBins[c].counts[axis][b];
+				}
+			}
+		}
+	}
+
+	//the split between bins b - 1 and b, for every axis whose centroids are spread at all
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	for (int axis = 0; axis < 3 && parentArea > 0.0; axis++)
+	{
+		if (binScale[axis] == 0.0)
+		{
+			continue;
+		}
+
+		AABB rightBox[BVH_BIN_COUNT];
+		int rightCount[BVH_BIN_COUNT];
+
+		AABB sweep;
+		sweep.Reset();
+		int sweepCount = 0;
+
+		for (int b = BVH_BIN_COUNT - 1; b > 0; b--)
+		{
+			sweep.Grow(bins.bounds[axis][b]);
+			sweepCount += bins.counts[axis][b];
+			rightBox[b] = sweep;
+			rightCount[b] = sweepCount;
+		}
+
+		sweep.Reset();
+		sweepCount = 0;
+
+		for (int b = 1; b < BVH_BIN_COUNT; b++)
+		{
+			sweep.Grow(bins.bounds[axis][b - 1]);
+			sweepCount += bins.counts[axis][b - 1];
+
+			if (sweepCount == 0 || rightCount[b] == 0)
+			{
+				continue;
+			}
+
+			double splitCost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST *
+				(sweep.SurfaceArea() * sweepCount + rightBox[b].SurfaceArea() * rightCount[b]) / parentArea;
+
+			if (splitCost < cost)
+			{
+				cost = splitCost;
+				bestAxis = axis;
+				bestBin = b;
+				split = sweepCount;
+				children[0].items = sweep;
+				children[1].items = rightBox[b];
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+	{
+		//flat or coincident items give the heuristic nothing to work with: split them in half
+		//along the axis their centroids spread most, if they spread at all
+		int axis = 0;
+
+		for (int i = 1; i < 3; i++)
+		{
+			Real extent = centroidBounds.max[i] - centroidBounds.min[i];
+
+			if (extent > centroidBounds.max[axis] - centroidBounds.min[axis])
+			{
+				axis = i;
+			}
+		}
+
+		split = count / 2;
+		cost = 0.0;
+
+		std::nth_element(begin, begin + split, end, [this, axis](int a, int b) { return m_centroids[a][axis] < m_centroids[b][axis]; });
+
+		return true;
+	}
+
+	//a stable partition through m_scratch: the items of every chunk that go left are written
+	//after those of the chunks before it, and the ones that go right after all of these.
+	//The centroid bounds of both sides are gathered on the way.
+	int chunkSize = ctx.pool && count > BVH_PARALLEL_SIZE ? BVH_CHUNK_SIZE : count;
+	int chunks = (count + chunkSize - 1) / chunkSize;
+	std::vector<int> leftBefore(chunks + 1, 0);
+	std::vector<AABB> chunkCentroids(chunks * 2);
+
+	Real axisMin = binMin[bestAxis];
+	double axisScale = binScale[bestAxis];
+
+	auto goesLeft = [this, bestAxis, bestBin, axisMin, axisScale](int item)
+	{
+		return BinIndex(m_centroids[item][bestAxis], axisMin, axisScale) < bestBin;
+	};
+
+	auto countLeft = [this, first, count, chunkSize, &leftBefore, &goesLeft](int rangeBegin, int rangeEnd)
+	{
+		for (int c = rangeBegin; c < rangeEnd; c++)
+		{
+			int chunkEnd = (c + 1) * chunkSize < count ? (c + 1) * chunkSize : count;
+			int left = 0;
+
+			for (int i = first + c * chunkSize; i < first + chunkEnd; i++)
+			{
+				left += goesLeft(m_items[i]) ? 1 : 0;
+			}
+
+			leftBefore[c + 1] = left;
+		}
+	};
+
+	auto scatter = [this, first, count, chunkSize, split, &leftBefore, &chunkCentroids, &goesLeft](int rangeBegin, int rangeEnd)
+	{
+		for (int c = rangeBegin; c < rangeEnd; c++)
+		{
+			int chunkEnd = (c + 1) * chunkSize < count ? (c + 1) * chunkSize : count;
+			int left = first + leftBefore[c];
+			int right = first + split + c * chunkSize - leftBefore[c];
+
+			AABB& leftCentroids = chunkCentroids[c * 2];
+			AABB& rightCentroids = chunkCentroids[c * 2 + 1];
+			leftCentroids.Reset();
+			rightCentroids.Reset();
+
+			for (int i = first + c * chunkSize; i < first + chunkEnd; i++)
+			{
+				int item = m_items[i];
+
+				if (goesLeft(item))
+				{
+					m_scratch[left++] = item;
+					leftCentroids.Grow(m_centroids[item]);
+				}
+				else
+				{
+					m_scratch[right++] = item;
+					rightCentroids.Grow(m_centroids[item]);
+				}
+			}
+		}
+	};
+
+	auto copyBack = [this, first, count, chunkSize](int rangeBegin, int rangeEnd)
+	{
+		for (int c = rangeBegin; c < rangeEnd; c++)
+		{
+			int chunkEnd = (c + 1) * chunkSize < count ? (c + 1) * chunkSize : count;
+			std::copy(m_scratch.begin() + first + c * chunkSize, m_scratch.begin() + first + chunkEnd, m_items.begin() + first + c * chunkSize);
+		}
+	};
+
+	if (chunks == 1)
+	{
+		countLeft(0, 1);
+		scatter(0, 1);
+		copyBack(0, 1);
+	}
+	else
+	{
+		ctx.pool->ParallelFor(0, chunks, 1, countLeft);
+
+		for (int c = 0; c < chunks; c++)
+		{
+			leftBefore[c + 1] += leftBefore[c];
+		}
+
+		ctx.pool->ParallelFor(0, chunks, 1, scatter);
+		ctx.pool->ParallelFor(0, chunks, 1, copyBack);
+	}
+
+	for (int c = 0; c < chunks; c++)
+	{
+		children[0].centroids.Grow(chunkCentroids[c * 2]);
+		children[1].centroids.Grow(chunkCentroids[c * 2 + 1]);
+	}
+
+	return true;
+}
+
+void BVH::ComputeReport()
+{
+	m_report.items = (int)m_items.size();
+	m_report.nodes = (int)m_nodes.size();
+	m_report.leaves = 0;
+	m_report.maxDepth = 0;
+	m_weightedArea = 0.0;
+	m_refitCount = 0;
+
+	int stack[BVH_MAX_DEPTH + 1];
+	int depth[BVH_MAX_DEPTH + 1];
+	int stackSize = 1;
+
+	stack[0] = 0;
+	depth[0] = 1;
+
+	while (stackSize > 0)
+	{
+		stackSize--;
+
+		const BVHNode& node = m_nodes[stack[stackSize]];
+		int nodeDepth = depth[stackSize];
+
+		m_weightedArea += node.bounds.SurfaceArea() * NodeCost(node);
+
+		if (node.count > 0)
+		{
+			m_report.leaves++;
+			m_report.maxDepth = nodeDepth > m_report.maxDepth ? nodeDepth : m_report.maxDepth;
+			continue;
+		}
+
+		stack[stackSize] = node.leftFirst;
+		depth[stackSize++] = nodeDepth + 1;
+		stack[stackSize] = node.leftFirst + 1;
+		depth[stackSize++] = nodeDepth + 1;
+	}
+
+	m_report.sahCost = GetSAHCost();
+}
+
+double BVH::GetSAHCost() const
+{
+	if (m_nodeCount == 0)
+	{
+		return 0.0;
+	}
+
+	//a tree over items without extent costs one visit of every node
+	double rootArea = m_nodeData[0].bounds.SurfaceArea();
+
+	return rootArea > 0.0 ? m_weightedArea / rootArea : (double)m_nodeCount;
+}
+
+void BVH::LinkNodes()
+{
+	m_parents.assign(m_nodes.size(), -1);
+	m_itemLeaf.assign(m_items.size(), -1);
+
+	for (int i = 0; i < (int)m_nodes.size(); i++)
+	{
+		const BVHNode& node = m_nodes[i];
+
+		if (node.count > 0)
+		{
+			for (int k = 0; k < node.count; k++)
+			{
+				m_itemLeaf[m_items[node.leftFirst + k]] = i;
+			}
+		}
+		else
+		{
+			m_parents[node.leftFirst] = i;
+			m_parents[node.leftFirst + 1] = i;
+		}
+	}
+}
+
+void BVH::Refit(const std::vector<AABB>& bounds, const std::vector<int>& items, std::vector<int>* changedNodes)
+{
+	if (m_nodeCount == 0)
+	{
+		return;
+	}
+
+	//an attached tree is read only, refit a copy of it
+	if (IsAttached())
+	{
+		m_nodes.assign(m_nodeData, m_nodeData + m_nodeCount);
+		m_items.assign(m_itemData, m_itemData + m_itemCount);
+		UseOwnArrays();
+	}
+
+	if (m_parents.empty())
+	{
+		LinkNodes();
+	}
+
+	for (int item : items)
+	{
+		int nodeIndex = m_itemLeaf[item];
+
+		//up to the first node whose box does not change, the ones above it were made from it
+		while (nodeIndex >= 0)
+		{
+			BVHNode& node = m_nodes[nodeIndex];
+			AABB box;
+
+			if (node.count > 0)
+			{
+				box.Reset();
+
+				for (int k = 0; k < node.count; k++)
+				{
+					box.Grow(bounds[m_items[node.leftFirst + k]]);
+				}
+			}
+			else
+			{
+				box = m_nodes[node.leftFirst].bounds;
+				box.Grow(m_nodes[node.leftFirst + 1].bounds);
+			}
+
+			bool same = true;
+
+			for (int i = 0; i < 3; i++)
+			{
+				same = same && box.min[i] == node.bounds.min[i] && box.max[i] == node.bounds.max[i];
+			}
+
+			if (same)
+			{
+				break;
+			}
+
+			m_weightedArea += (box.SurfaceArea() - node.bounds.SurfaceArea()) * NodeCost(node);
+			node.bounds = box;
+
+			if (changedNodes)
+			{
+				changedNodes->push_back(nodeIndex);
+			}
+
+			nodeIndex = m_parents[nodeIndex];
+		}
+	}
+
+	m_refitCount++;
+}
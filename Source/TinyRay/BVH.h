@@ -0,0 +1,484 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Ray.h"
+
+#define BVH_MAX_DEPTH	64
+
+class ThreadPool;
+
+struct BVHNode
+{
+	AABB		bounds;
+	int			leftFirst;		//interior: index of the left child, the right child follows it; leaf: first entry in the item list
+	int			count;			//number of items in a leaf, 0 for an interior node
+};
+
+//What traversals cost, summed over the rays that were given the same stats: the nodes
+//entered, the boxes tested, the bytes of node data read for them and the items tested
+struct BVHTraversalStats
+{
+	long long	nodes;
+	long long	boxes;
+	long long	bytes;
+	long long	items;
+};
+
+//What the last BVH::Build made and how long it took
+struct BVHBuildReport
+{
+	int			items;
+	int			nodes;
+	int			leaves;
+	int			maxDepth;		//of a leaf, the root is at depth 1
+	double		sahCost;		//expected cost of a ray through the tree in item tests, see SAH_INTERSECTION_COST
+	double		seconds;
+	int			threads;
+};
+
+//A bounding volume hierarchy over a set of items that are only known by their bounding boxes.
+//The tree is built top down with the surface area heuristic; the caller supplies the
+//item test during traversal so the same tree works for any kind of geometry.
+//
+//Large nodes are split at the best of a few dozen bins per axis, small ones at the best
+//position of an exact sweep over their sorted items. Given a ThreadPool, the binning and
+//partitioning of the top levels is spread over the threads and the subtrees below are built
+//as tasks of their own; the tree is the same whatever the number of threads.
+//
+//Traversal reads the nodes and items through plain pointers, so a tree can also be used in
+//place from memory it does not own, e.g. a mapped cache file, see Attach.
+class BVH
+{
+	private:
+		struct BuildContext;
+
+		//The box around a range of items and the box around their centroids
+		struct RangeBounds
+		{
+			AABB	items;
+			AABB	centroids;
+		};
+
+		std::vector<BVHNode>	m_nodes;		//m_nodes[0] is the root
+		std::vector<int>		m_items;		//item indices, every leaf owns a contiguous range
+		BVHBuildReport			m_report;
+
+		//The tree traversal walks: m_nodes and m_items, or the arrays given to Attach
+		const BVHNode*			m_nodeData;
+		const int*				m_itemData;
+		int						m_nodeCount;
+		int						m_itemCount;
+
+		//For Refit, made on its first call after a build: the parent of every node (-1 for the
+		//root) and the leaf of every item
+		std::vector<int>		m_parents;
+		std::vector<int>		m_itemLeaf;
+		double					m_weightedArea;	//the SAH cost times the area of the root
+		int						m_refitCount;
+
+		std::vector<Vec3>	m_centroids;	//only valid during Build()
+		std::vector<int>	m_scratch;		//only valid during Build(), the partitions of m_items go through it
+
+		void		BuildNode(int nodeIndex, int first, int count, int depth, BuildContext& ctx, const RangeBounds* known);
+		void		ComputeRangeBounds(int first, int count, BuildContext& ctx, RangeBounds& range);
+		bool		FindSweepSplit(int first, int count, const BuildContext& ctx, Real parentArea, int& split, double& cost);
+		bool		FindBinnedSplit(int first, int count, BuildContext& ctx, const RangeBounds& range, int& split,
+						double& cost, RangeBounds children[2]);
+		void		ComputeReport();
+		void		LinkNodes();
+		void		UseOwnArrays();
+
+	public:
+		BVH();
+		~BVH();
+
+		//Build the tree over bounds, on the threads of pool if one is given
+		void		Build(const std::vector<AABB>& bounds, ThreadPool* pool = nullptr);
+		void		Clear();
+
+		//Use a tree stored elsewhere, as GetNodes and GetItems gave it out, without copying it.
+		//The arrays must stay valid until the next Build, Clear or Attach; the first Refit
+		//copies them, the tree is never written through these pointers.
+		void		Attach(const BVHNode* nodes, int nodeCount, const int* items, int itemCount,
+						const BVHBuildReport& report);
+
+		//True if the tree is the one given to Attach
+		inline bool IsAttached() const
+		{
+			return m_nodeData != nullptr && m_nodeData != m_nodes.data();
+		}
+
+		inline const BVHNode* GetNodes() const
+		{
+			return m_nodeData;
+		}
+
+		inline const int* GetItems() const
+		{
+			return m_itemData;
+		}
+
+		inline int GetItemCount() const
+		{
+			return m_itemCount;
+		}
+
+		inline const BVHBuildReport& GetBuildReport() const
+		{
+			return m_report;
+		}
+
+		//Fit the boxes of the tree around items whose bounds changed; bounds holds the current
+		//bounds of every item, as Build took them. Only the leaves of items and the nodes above
+		//them are visited, but the tree keeps its shape, so it gets worse the further the items
+		//move from where it was built, see GetSAHCost. The nodes whose boxes changed are added
+		//to changedNodes if it is given.
+		void		Refit(const std::vector<AABB>& bounds, const std::vector<int>& items,
+						std::vector<int>* changedNodes = nullptr);
+
+		//The SAH cost of the tree as it is after any refits; GetBuildReport().sahCost is the
+		//cost it was built with
+		double		GetSAHCost() const;
+
+		//Number of Refit calls since the last build
+		inline int GetRefitCount() const
+		{
+			return m_refitCount;
+		}
+
+		inline bool IsEmpty() const
+		{
+			return m_nodeCount == 0;
+		}
+
+		inline int GetNodeCount() const
+		{
+			return m_nodeCount;
+		}
+
+		//Bytes allocated by the tree, nothing for the arrays of an attached one
+		inline size_t GetMemoryUsage() const
+		{
+			return m_nodes.capacity() * sizeof(BVHNode) + (m_items.capacity() + m_parents.capacity() + m_itemLeaf.capacity()) * sizeof(int);
+		}
+
+		//Closest hit traversal. The nearer child is visited first and any subtree entered beyond
+		//tmax is skipped; intersectItem(item) tests one item and lowers tmax when it finds a closer hit.
+		//stats, if given, is increased by what the walk cost.
+		template<typename ItemFunc>
+		void		Traverse(Ray& ray, Real& tmax, ItemFunc intersectItem, BVHTraversalStats* stats = nullptr) const;
+
+		//Closest hit traversal for a packet of rays sharing one walk through the tree. Every node
+		//carries the set of rays (Packet::LaneMask) that entered it, so each ray meets exactly
+		//the boxes Traverse would test it against. Packet must provide:
+		//  AllLanes()                             - the rays of the packet to trace
+		//  IntersectBox(box, lanes, hit, tnear)   - hit receives the rays of lanes that enter box
+		//                                           before their closest hit, tnear the nearest entry;
+		//                                           false if there are none
+		//  GetMaxT(lanes)                         - the farthest closest hit among lanes
+		//intersectItem(item, lanes) tests one item against the rays in lanes.
+		template<typename Packet, typename ItemFunc>
+		void		TraversePacket(Packet& packet, ItemFunc intersectItem) const;
+
+		//The same for the rays of lanes only, e.g. the rays that reached an object with a BVH of its own
+		template<typename Packet, typename ItemFunc>
+		void		TraversePacket(Packet& packet, typename Packet::LaneMask lanes, ItemFunc intersectItem) const;
+
+		//Any hit traversal for occlusion queries, the children are visited in no particular order and
+		//the walk stops as soon as blocksRay(item) reports an item that blocks the ray before tmax
+		template<typename ItemFunc>
+		bool		TraverseAny(Ray& ray, Real tmax, ItemFunc blocksRay, BVHTraversalStats* stats = nullptr) const;
+};
+
+template<typename ItemFunc>
+void BVH::Traverse(Ray& ray, Real& tmax, ItemFunc intersectItem, BVHTraversalStats* stats) const
+{
+	struct StackEntry
+	{
+		int		node;
+		Real	tnear;
+	};
+
+	Real tnear;
+
+	if (stats)
+	{
+		stats->boxes++;
+		stats->bytes += sizeof(BVHNode);
+	}
+
+	if (m_nodeCount == 0 || !m_nodeData[0].bounds.IntersectByRay(ray, tmax, tnear))
+	{
+		return;
+	}
+
+	StackEntry stack[BVH_MAX_DEPTH];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true)
+	{
+		const BVHNode& node = m_nodeData[nodeIndex];
+
+		if (stats)
+		{
+			//a leaf tests its items, an interior node reads both children
+			stats->nodes++;
+			stats->items += node.count;
+			stats->boxes += node.count > 0 ? 0 : 2;
+			stats->bytes += node.count > 0 ? 0 : 2 * sizeof(BVHNode);
+		}
+
+		if (node.count > 0)
+		{
+			for (int i = 0; i < node.count; i++)
+			{
+				intersectItem(m_itemData[node.leftFirst + i]);
+			}
+		}
+		else
+		{
+			Real tleft, tright;
+			bool hitLeft = m_nodeData[node.leftFirst].bounds.IntersectByRay(ray, tmax, tleft);
+			bool hitRight = m_nodeData[node.leftFirst + 1].bounds.IntersectByRay(ray, tmax, tright);
+
+			if (hitLeft && hitRight)
+			{
+				//descend into the nearer child, come back for the other one later
+				if (tleft <= tright)
+				{
+					stack[stackSize].node = node.leftFirst + 1;
+					stack[stackSize].tnear = tright;
+					nodeIndex = node.leftFirst;
+				}
+				else
+				{
+					stack[stackSize].node = node.leftFirst;
+					stack[stackSize].tnear = tleft;
+					nodeIndex = node.leftFirst + 1;
+				}
+
+				stackSize++;
+				continue;
+			}
+
+			if (hitLeft)
+			{
+				nodeIndex = node.leftFirst;
+				continue;
+			}
+
+			if (hitRight)
+			{
+				nodeIndex = node.leftFirst + 1;
+				continue;
+			}
+		}
+
+		//pop the next subtree that can still contain a closer hit
+		while (stackSize > 0 && stack[stackSize - 1].tnear > tmax)
+		{
+			stackSize--;
+		}
+
+		if (stackSize == 0)
+		{
+			return;
+		}
+
+		nodeIndex = stack[--stackSize].node;
+	}
+}
+
+template<typename Packet, typename ItemFunc>
+void BVH::TraversePacket(Packet& packet, ItemFunc intersectItem) const
+{
+	TraversePacket(packet, packet.AllLanes(), intersectItem);
+}
+
+template<typename Packet, typename ItemFunc>
+void BVH::TraversePacket(Packet& packet, typename Packet::LaneMask rootLanes, ItemFunc intersectItem) const
+{
+	typedef typename Packet::LaneMask LaneMask;
+
+	struct StackEntry
+	{
+		int			node;
+		Real		tnear;
+		LaneMask	lanes;
+	};
+
+	Real tnear;
+	LaneMask lanes;
+
+	if (m_nodeCount == 0 || !packet.IntersectBox(m_nodeData[0].bounds, rootLanes, lanes, tnear))
+	{
+		return;
+	}
+
+	StackEntry stack[BVH_MAX_DEPTH];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true)
+	{
+		const BVHNode& node = m_nodeData[nodeIndex];
+
+		if (node.count > 0)
+		{
+			for (int i = 0; i < node.count; i++)
+			{
+				intersectItem(m_itemData[node.leftFirst + i], lanes);
+			}
+		}
+		else
+		{
+			Real tleft = 0.0, tright = 0.0;
+			LaneMask leftLanes, rightLanes;
+			bool hitLeft = packet.IntersectBox(m_nodeData[node.leftFirst].bounds, lanes, leftLanes, tleft);
+			bool hitRight = packet.IntersectBox(m_nodeData[node.leftFirst + 1].bounds, lanes, rightLanes, tright);
+
+			if (hitLeft && hitRight)
+			{
+				//the child the packet reaches first goes first, as in Traverse
+				if (tleft <= tright)
+				{
+					stack[stackSize].node = node.leftFirst + 1;
+					stack[stackSize].tnear = tright;
+					stack[stackSize].lanes = rightLanes;
+					nodeIndex = node.leftFirst;
+					lanes = leftLanes;
+				}
+				else
+				{
+					stack[stackSize].node = node.leftFirst;
+					stack[stackSize].tnear = tleft;
+					stack[stackSize].lanes = leftLanes;
+					nodeIndex = node.leftFirst + 1;
+					lanes = rightLanes;
+				}
+
+				stackSize++;
+				continue;
+			}
+
+			if (hitLeft)
+			{
+				nodeIndex = node.leftFirst;
+				lanes = leftLanes;
+				continue;
+			}
+
+			if (hitRight)
+			{
+				nodeIndex = node.leftFirst + 1;
+				lanes = rightLanes;
+				continue;
+			}
+		}
+
+		//pop the next subtree that can still contain a closer hit for one of its rays
+		while (stackSize > 0 && stack[stackSize - 1].tnear > packet.GetMaxT(stack[stackSize - 1].lanes))
+		{
+			stackSize--;
+		}
+
+		if (stackSize == 0)
+		{
+			return;
+		}
+
+		stackSize--;
+		nodeIndex = stack[stackSize].node;
+		lanes = stack[stackSize].lanes;
+	}
+}
+
+template<typename ItemFunc>
+bool BVH::TraverseAny(Ray& ray, Real tmax, ItemFunc blocksRay, BVHTraversalStats* stats) const
+{
+	Real tnear;
+
+	if (stats)
+	{
+		stats->boxes++;
+		stats->bytes += sizeof(BVHNode);
+	}
+
+	if (m_nodeCount == 0 || !m_nodeData[0].bounds.IntersectByRay(ray, tmax, tnear))
+	{
+		return false;
+	}
+
+	int stack[BVH_MAX_DEPTH];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true)
+	{
+		const BVHNode& node = m_nodeData[nodeIndex];
+
+		if (stats)
+		{
+			stats->nodes++;
+			stats->boxes += node.count > 0 ? 0 : 2;
+			stats->bytes += node.count > 0 ? 0 : 2 * sizeof(BVHNode);
+		}
+
+		if (node.count > 0)
+		{
+			for (int i = 0; i < node.count; i++)
+			{
+				if (stats)
+				{
+					stats->items++;
+				}
+
+				if (blocksRay(m_itemData[node.leftFirst + i]))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			bool hitLeft = m_nodeData[node.leftFirst].bounds.IntersectByRay(ray, tmax, tnear);
+			bool hitRight = m_nodeData[node.leftFirst + 1].bounds.IntersectByRay(ray, tmax, tnear);
+
+			if (hitLeft)
+			{
+				if (hitRight)
+				{
+					stack[stackSize++] = node.leftFirst + 1;
+				}
+
+				nodeIndex = node.leftFirst;
+				continue;
+			}
+
+			if (hitRight)
+			{
+				nodeIndex = node.leftFirst + 1;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return false;
+		}
+
+		nodeIndex = stack[--stackSize];
+	}
+}
@@ -0,0 +1,2571 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "Box.h"
+#include "Triangle.h"
+#include "TriangleMesh.h"
+#include "MeshIO.h"
+#include "MeshCache.h"
+#include "WideBVH.h"
+#include "Instance.h"
+#include "PacketTracer.h"
+#include "RayTracer.h"
+#include "ThreadPool.h"
+#include "Texture.h"
+
+typedef std::chrono::high_resolution_clock BenchClock;
+
+static double SecondsSince(BenchClock::time_point begin)
+{
+	return std::chrono::duration<double>(BenchClock::now() - begin).count();
+}
+
+static Vec3 RandomDirection(std::mt19937& rng)
+{
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	Vec3 dir((Real)gauss(rng), (Real)gauss(rng), (Real)gauss(rng));
+
+	return dir.Normalise();
+}
+
+//Fill scene with count spheres scattered through a cube, the density stays constant as count grows
+static void MakeSphereCloud(Scene& scene, int count, std::mt19937& rng)
+{
+	scene.CleanupScene();
+
+	double extent = 10.0 * cbrt((double)count);
+	std::uniform_real_distribution<double> position(-extent, extent);
+
+	Material* mat = new Material();
+
+	for (int i = 0; i < count; i++)
+	{
+		Primitive* sphere = new Sphere(position(rng), position(rng), position(rng), 1.0);
+
+		scene.AddObject(sphere, i == 0 ? mat : nullptr);
+		sphere->SetMaterial(mat);
+	}
+}
+
+//The closest hit loop Scene::IntersectByRay used before it had a BVH
+static RayHitResult IntersectLinear(Scene& scene, Ray& ray)
+{
+	const PrimitiveStore& store = scene.GetPrimitives();
+	RayHit hit = Ray::s_defaultHit;
+
+	for (int type = 0; type < Primitive::PRIMTYPE_COUNT; type++)
+	{
+		for (int i = 0; i < store.GetCount(type); i++)
+		{
+			PrimHandle prim = { type, i };
+			store.Intersect(prim, ray, hit);
+		}
+	}
+
+	return scene.GetSurface(ray, hit);
+}
+
+//BVH against the linear loop for growing object counts
+static int BenchmarkBVH()
+{
+	const int sizes[] = { 1000, 4000, 16000, 64000, 256000 };
+	const int linearRays = 500;
+	const int bvhRays = 20000;
+
+	std::mt19937 rng(1234);
+	int failures = 0;
+
+	printf("%10s %12s %14s %14s %10s\n", "objects", "build (ms)", "linear (us)", "bvh (us)", "speedup");
+
+	for (int size : sizes)
+	{
+		Scene scene;
+		MakeSphereCloud(scene, size, rng);
+
+		BenchClock::time_point begin = BenchClock::now();
+		scene.UpdateAccelerationStructure();
+		double buildTime = SecondsSince(begin);
+
+		double extent = 10.0 * cbrt((double)size);
+		std::uniform_real_distribution<double> position(-extent, extent);
+
+		std::vector<Ray> rays(bvhRays);
+
+		for (int i = 0; i < bvhRays; i++)
+		{
+			rays[i].SetRay(Vec3(position(rng), position(rng), position(rng)), RandomDirection(rng));
+		}
+
+		//both loops have to agree on every hit
+		begin = BenchClock::now();
+		std::vector<double> linearT(linearRays);
+
+		for (int i = 0; i < linearRays; i++)
+		{
+			linearT[i] = IntersectLinear(scene, rays[i]).t;
+		}
+
+		double linearTime = SecondsSince(begin) / linearRays;
+
+		begin = BenchClock::now();
+		double checksum = 0.0;
+
+		for (int i = 0; i < bvhRays; i++)
+		{
+			checksum += scene.IntersectByRay(rays[i]).t;
+		}
+
+		double bvhTime = SecondsSince(begin) / bvhRays;
+
+		for (int i = 0; i < linearRays; i++)
+		{
+			if (scene.IntersectByRay(rays[i]).t != linearT[i])
+			{
+				failures++;
+			}
+		}
+
+		printf("%10d %12.2f %14.3f %14.3f %9.1fx\n", size, buildTime * 1.0e3,
+			linearTime * 1.0e6, bvhTime * 1.0e6, linearTime / bvhTime);
+	}
+
+	if (failures)
+	{
+		printf("FAILED: %d rays found a different closest hit\n", failures);
+		return 1;
+	}
+
+	printf("All BVH hits match the linear loop\n");
+
+	return 0;
+}
+
+//The edge-plane test Triangle::IntersectByRay used before the Moller-Trumbore kernel,
+//kept here as the reference for the triangle benchmark
+struct LegacyTriangle
+{
+	Vec3	vertices[3];
+	Vec3	normal;
+
+	void Set(const Vec3& v0, const Vec3& v1, const Vec3& v2)
+	{
+		vertices[0] = v0;
+		vertices[1] = v1;
+		vertices[2] = v2;
+
+		Vec3 NormalA = vertices[1] - vertices[0];
+		Vec3 NormalB = vertices[2] - vertices[0];
+		normal = NormalA.CrossProduct(NormalB);
+		normal.Normalise();
+	}
+
+	RayHitResult IntersectByRay(Ray& ray)
+	{
+		RayHitResult result = Ray::s_defaultHitResult;
+
+		Vec3 P = ray.GetRayStart() + ray.GetRay();
+		Real D = -(vertices[0]).DotProduct(normal);
+
+		Vec3 Vert0 = vertices[0] - P;
+		Vec3 Vert1 = vertices[1] - P;
+		Vec3 Vert2 = vertices[2] - P;
+
+		Vec3 N0 = Vert1.CrossProduct(Vert0);
+		Vec3 N1 = Vert2.CrossProduct(Vert1);
+		Vec3 N2 = Vert0.CrossProduct(Vert2);
+
+		N0.Normalise();
+		N1.Normalise();
+		N2.Normalise();
+
+		Real D0 = -ray.GetRayStart().DotProduct(N0);
+		Real D1 = -ray.GetRayStart().DotProduct(N1);
+		Real D2 = -ray.GetRayStart().DotProduct(N2);
+
+		if ((P.DotProduct(N0) + D0) < 0 || (P.DotProduct(N1) + D1) < 0 || (P.DotProduct(N2) + D2) < 0)
+		{
+			return result;
+		}
+
+		Real t = -(ray.GetRayStart().DotProduct(normal) + D) / ray.GetRay().DotProduct(normal);
+
+		if (t > 0 && t < FARFAR_AWAY)
+		{
+			result.t = t;
+			result.normal = normal;
+			result.point = ray.GetRayStart() + ray.GetRay()*t;
+		}
+
+		return result;
+	}
+};
+
+//ns per ray/triangle test of the Moller-Trumbore kernel against the legacy edge-plane test
+static int BenchmarkTriangle()
+{
+	const int numTriangles = 1024;
+	const int numRays = 2048;
+
+	std::mt19937 rng(4321);
+	std::uniform_real_distribution<double> unit(-1.0, 1.0);
+
+	PrimitiveStore store;
+	std::vector<LegacyTriangle> legacy(numTriangles);
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		Vec3 v0(unit(rng), unit(rng), unit(rng));
+		Vec3 v1(unit(rng), unit(rng), unit(rng));
+		Vec3 v2(unit(rng), unit(rng), unit(rng));
+
+		Triangle triangle(v0, v1, v2);
+		store.Add(&triangle);
+		legacy[i].Set(v0, v1, v2);
+	}
+
+	const TriangleArray& triangles = store.triangles;
+	Real u, v;
+
+	//rays from outside the unit cube aimed at random points inside it, so a fair share of tests hit
+	std::vector<Ray> rays(numRays);
+
+	for (int i = 0; i < numRays; i++)
+	{
+		Vec3 start = RandomDirection(rng) * 4.0;
+		Vec3 target(unit(rng) * 0.5, unit(rng) * 0.5, unit(rng) * 0.5);
+
+		rays[i].SetRay(start, (target - start).Normalise());
+	}
+
+	double tests = (double)numTriangles * numRays;
+	double checksum = 0.0;
+	int hits = 0;
+
+	BenchClock::time_point begin = BenchClock::now();
+
+	for (int r = 0; r < numRays; r++)
+	{
+		for (int i = 0; i < numTriangles; i++)
+		{
+			Real t = triangles.IntersectDistance(i, rays[r], u, v);
+
+			if (t < FARFAR_AWAY)
+			{
+				checksum += t;
+				hits++;
+			}
+		}
+	}
+
+	double mtTime = SecondsSince(begin);
+
+	int legacyHits = 0;
+	begin = BenchClock::now();
+
+	for (int r = 0; r < numRays; r++)
+	{
+		for (int i = 0; i < numTriangles; i++)
+		{
+			RayHitResult result = legacy[i].IntersectByRay(rays[r]);
+
+			if (result.t < FARFAR_AWAY)
+			{
+				checksum += result.t;
+				legacyHits++;
+			}
+		}
+	}
+
+	double legacyTime = SecondsSince(begin);
+
+	//the two tests must agree on the distance wherever both report a hit,
+	// within what the tracer's precision can resolve
+	const Real tolerance = sizeof(Real) == sizeof(float) ? (Real)1.0e-3 : (Real)1.0e-6;
+	int mismatches = 0;
+
+	for (int r = 0; r < numRays; r += 16)
+	{
+		for (int i = 0; i < numTriangles; i++)
+		{
+			Real t = triangles.IntersectDistance(i, rays[r], u, v);
+			RayHitResult result = legacy[i].IntersectByRay(rays[r]);
+
+			if (t < FARFAR_AWAY && result.t < FARFAR_AWAY && fabs(t - result.t) > tolerance * t)
+			{
+				mismatches++;
+			}
+		}
+	}
+
+	printf("%-20s %12s %10s\n", "kernel", "ns/test", "hit rate");
+	printf("%-20s %12.2f %9.2f%%\n", "legacy edge planes", legacyTime * 1.0e9 / tests, 100.0 * legacyHits / tests);
+	printf("%-20s %12.2f %9.2f%%\n", "moller-trumbore", mtTime * 1.0e9 / tests, 100.0 * hits / tests);
+	printf("speedup %.1fx (checksum %g)\n", legacyTime / mtTime, checksum);
+
+	if (mismatches)
+	{
+		printf("FAILED: %d hits at different distances\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
+
+//One ray per pixel of a width x height image seen by the scene's camera
+static void MakeCameraRays(Scene& scene, int width, int height, std::vector<Ray>& rays)
+{
+	Camera* cam = scene.GetSceneCamera();
+	Vec3 right = cam->GetRightVector();
+	Vec3 up = cam->GetUpVector();
+	Vec3 position = cam->GetPosition();
+	Real viewWidth = (Real)scene.GetSceneWidth();
+	Real viewHeight = (Real)scene.GetSceneHeight();
+
+	Vec3 corner = cam->GetViewCentre() - (right * viewWidth + up * viewHeight) * 0.5;
+
+	rays.resize(width * height);
+
+	for (int i = 0; i < height; i++)
+	{
+		for (int j = 0; j < width; j++)
+		{
+			Vec3 pixel = corner + up * ((i + 0.5) * viewHeight / height) + right * ((j + 0.5) * viewWidth / width);
+			rays[i * width + j].SetRay(position, (pixel - position).Normalise());
+		}
+	}
+}
+
+//Camera ray visibility through each packet kernel against Scene::Intersect
+static int BenchmarkPacket()
+{
+	const int width = 1920;
+	const int height = 1080;
+
+	std::mt19937 rng(1234);
+	int failures = 0;
+
+	int kernelCount;
+	const PacketKernel* kernels = GetPacketKernels(kernelCount);
+
+	for (int sceneIndex = 0; sceneIndex < 2; sceneIndex++)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+
+		if (sceneIndex == 1)
+		{
+			//a dense cloud seen from outside, most rays run through many BVH nodes
+			MakeSphereCloud(scene, 64000, rng);
+
+			double extent = 10.0 * cbrt(64000.0);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 3.0 * extent), Vec3(0.0, 0.0, 0.0));
+		}
+
+		scene.UpdateAccelerationStructure();
+
+		std::vector<Ray> rays;
+		MakeCameraRays(scene, width, height, rays);
+
+		int count = (int)rays.size();
+		std::vector<RayHit> reference(count);
+
+		BenchClock::time_point begin = BenchClock::now();
+
+		for (int i = 0; i < count; i++)
+		{
+			reference[i] = Ray::s_defaultHit;
+			scene.Intersect(rays[i], reference[i]);
+		}
+
+		double scalarTime = SecondsSince(begin);
+
+		printf("%s, %dx%d camera rays\n", sceneIndex == 0 ? "default scene" : "64000 spheres", width, height);
+		printf("  %-10s %6s %12s %10s %12s\n", "kernel", "width", "Mrays/s", "speedup", "mismatches");
+		printf("  %-10s %6d %12.2f %9.1fx %12s\n", "scalar", 1, count / scalarTime * 1.0e-6, 1.0, "-");
+
+		std::vector<RayHit> hits(count);
+
+		for (int k = 0; k < kernelCount; k++)
+		{
+			if (!kernels[k].supported)
+			{
+				printf("  %-10s %6d %12s\n", kernels[k].name, kernels[k].width, "not supported");
+				continue;
+			}
+
+			begin = BenchClock::now();
+			kernels[k].intersect(&scene, rays.data(), count, hits.data());
+			double packetTime = SecondsSince(begin);
+
+			//every ray must find the same object at the same distance
+			int mismatches = 0;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (hits[i].prim != reference[i].prim || hits[i].t != reference[i].t)
+				{
+					mismatches++;
+				}
+			}
+
+			printf("  %-10s %6d %12.2f %9.1fx %12d\n", kernels[k].name, kernels[k].width,
+				count / packetTime * 1.0e-6, scalarTime / packetTime, mismatches);
+
+			failures += mismatches;
+		}
+	}
+
+	if (failures)
+	{
+		printf("FAILED: %d rays found a different closest hit\n", failures);
+		return 1;
+	}
+
+	printf("All packet hits match the single ray path\n");
+
+	return 0;
+}
+
+//Full F6 renders through the recursive and the wavefront renderer, which must agree pixel for pixel
+static int BenchmarkWavefront()
+{
+	const int width = 1280;
+	const int height = 720;
+
+	std::mt19937 rng(1234);
+	int failures = 0;
+
+	for (int sceneIndex = 0; sceneIndex < 2; sceneIndex++)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+
+		if (sceneIndex == 1)
+		{
+			//every sphere reflects, the secondary rays bounce around inside the cloud
+			MakeSphereCloud(scene, 64000, rng);
+
+			double extent = 10.0 * cbrt(64000.0);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 1.5 * extent), Vec3(0.0, 0.0, 0.0));
+
+			Light* light = new Light();
+			light->SetLightPosition(extent, 2.0 * extent, 2.0 * extent);
+			scene.GetLightList()->push_back(light);
+		}
+
+		printf("%s, %dx%d, all effects\n", sceneIndex == 0 ? "default scene" : "64000 spheres", width, height);
+		printf("  %-22s %10s %12s %12s %12s\n", "renderer", "seconds", "Mrays/s", "rays/pixel", "mismatches");
+
+		std::vector<float> reference;
+
+		//the recursive renderer first, it is the reference for the others
+		const struct { const char* name; bool wavefront; int tileSize; } configs[] =
+		{
+			{ "recursive", false, 16 },
+			{ "wavefront", true, 16 },
+			{ "wavefront, 64px tiles", true, 64 },
+		};
+
+		for (const auto& config : configs)
+		{
+			RayTracer tracer(width, height);
+			tracer.m_traceflag = RayTracer::GetPresetTraceFlag(6);
+			tracer.SetWavefront(config.wavefront);
+			tracer.SetTileSize(config.tileSize);
+
+			BenchClock::time_point begin = BenchClock::now();
+			tracer.DoRayTrace(&scene);
+			double seconds = SecondsSince(begin);
+
+			const float* image = tracer.GetFramebuffer();
+			int pixels = width * height;
+			int mismatches = 0;
+
+			if (reference.empty())
+			{
+				reference.assign(image, image + pixels * 3);
+			}
+			else
+			{
+				for (int i = 0; i < pixels; i++)
+				{
+					if (memcmp(&image[i * 3], &reference[i * 3], 3 * sizeof(float)) != 0)
+					{
+						mismatches++;
+					}
+				}
+			}
+
+			printf("  %-22s %10.3f %12.2f %12.2f %12d\n", config.name, seconds,
+				tracer.GetRayCount() / seconds * 1.0e-6, (double)tracer.GetRayCount() / pixels, mismatches);
+
+			failures += mismatches;
+		}
+	}
+
+	if (failures)
+	{
+		printf("FAILED: %d pixels differ from the recursive renderer\n", failures);
+		return 1;
+	}
+
+	printf("All renderers produce the same image\n");
+
+	return 0;
+}
+
+//A torus of nu x nv quads, two triangles each, as positions and three vertex indices per triangle
+static void MakeTorus(int nu, int nv, std::vector<Vec3>& positions, std::vector<int>& indices)
+{
+	const double pi = 3.14159265358979323846;
+
+	positions.clear();
+	indices.clear();
+
+	for (int i = 0; i < nu; i++)
+	{
+		for (int j = 0; j < nv; j++)
+		{
+			double a = 2.0 * pi * i / nu;
+			double b = 2.0 * pi * j / nv;
+			double ring = 2.0 + 0.8 * cos(b);
+
+			positions.push_back(Vec3((Real)(ring * cos(a)), (Real)(0.8 * sin(b)), (Real)(ring * sin(a))));
+
+			int v00 = i * nv + j;
+			int v10 = ((i + 1) % nu) * nv + j;
+			int v11 = ((i + 1) % nu) * nv + (j + 1) % nv;
+			int v01 = i * nv + (j + 1) % nv;
+
+			indices.push_back(v00); indices.push_back(v01); indices.push_back(v11);
+			indices.push_back(v00); indices.push_back(v11); indices.push_back(v10);
+		}
+	}
+}
+
+//Positions are written with enough digits to read back the exact values
+static bool WriteOBJ(const char* filename, const std::vector<Vec3>& positions, const std::vector<int>& indices)
+{
+	FILE* fp = fopen(filename, "w");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		fprintf(fp, "v %.17g %.17g %.17g\n", (double)positions[i][0], (double)positions[i][1], (double)positions[i][2]);
+	}
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		fprintf(fp, "f %d %d %d\n", indices[i] + 1, indices[i + 1] + 1, indices[i + 2] + 1);
+	}
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+
+	return ok;
+}
+
+//One camera ray per pixel through the scene with Scene::Intersect, returns the time taken
+static double TraceCameraRays(Scene& scene, const std::vector<Ray>& cameraRays, std::vector<RayHit>& hits)
+{
+	std::vector<Ray> rays = cameraRays;
+	hits.resize(rays.size());
+
+	BenchClock::time_point begin = BenchClock::now();
+
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		hits[i] = Ray::s_defaultHit;
+		scene.Intersect(rays[i], hits[i]);
+	}
+
+	return SecondsSince(begin);
+}
+
+//A tessellated torus read from an OBJ file into one TriangleMesh, against the same triangles
+//added to the scene one Triangle object each
+static int BenchmarkMesh()
+{
+	const int sizes[][2] = { { 128, 64 }, { 512, 256 }, { 1024, 512 } };
+	const int width = 640;
+	const int height = 480;
+	const char* filename = "tinyray_bench_mesh.obj";
+
+	int failures = 0;
+
+	printf("%10s %-10s %10s %12s %12s %12s %12s\n", "triangles", "storage", "MB", "load (ms)", "build (ms)", "Mrays/s", "mismatches");
+
+	for (const auto& size : sizes)
+	{
+		std::vector<Vec3> positions;
+		std::vector<int> indices;
+		MakeTorus(size[0], size[1], positions, indices);
+
+		int triangles = (int)indices.size() / 3;
+
+		if (!WriteOBJ(filename, positions, indices))
+		{
+			printf("FAILED: cannot write %s\n", filename);
+			return 1;
+		}
+
+		std::vector<Ray> cameraRays;
+		std::vector<RayHit> meshHits, triangleHits;
+
+		//the mesh
+		{
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 3.0, 5.0), Vec3(0.0, 0.0, 0.0));
+
+			BenchClock::time_point begin = BenchClock::now();
+			TriangleMesh* mesh = new TriangleMesh();
+			bool loaded = LoadOBJ(filename, mesh);
+			double loadTime = SecondsSince(begin);
+
+			if (!loaded || mesh->GetTriangleCount() != triangles)
+			{
+				printf("FAILED: %s did not load back\n", filename);
+				delete mesh;
+				remove(filename);
+				return 1;
+			}
+
+			scene.AddObject(mesh, new Material());
+
+			begin = BenchClock::now();
+			scene.UpdateAccelerationStructure();
+			double buildTime = SecondsSince(begin);
+
+			MakeCameraRays(scene, width, height, cameraRays);
+			double traceTime = TraceCameraRays(scene, cameraRays, meshHits);
+
+			printf("%10d %-10s %10.1f %12.1f %12.1f %12.2f %12s\n", triangles, "mesh", mesh->GetMemoryUsage() / 1048576.0,
+				loadTime * 1000.0, buildTime * 1000.0, cameraRays.size() / traceTime * 1.0e-6, "-");
+		}
+
+		//a Triangle per face
+		{
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 3.0, 5.0), Vec3(0.0, 0.0, 0.0));
+
+			Material* mat = new Material();
+
+			for (int i = 0; i < triangles; i++)
+			{
+				Primitive* triangle = new Triangle(positions[indices[i * 3]], positions[indices[i * 3 + 1]], positions[indices[i * 3 + 2]]);
+
+				//the scene takes ownership of the material once, with the first triangle
+				scene.AddObject(triangle, i == 0 ? mat : nullptr);
+				triangle->SetMaterial(mat);
+			}
+
+			BenchClock::time_point begin = BenchClock::now();
+			scene.UpdateAccelerationStructure();
+			double buildTime = SecondsSince(begin);
+
+			double traceTime = TraceCameraRays(scene, cameraRays, triangleHits);
+
+			//the objects, the scene's copy of them in its PrimitiveStore and the BVH
+			size_t bytes = (size_t)triangles * (sizeof(Triangle) + sizeof(Primitive*) + sizeof(PrimHandle));
+			bytes += (size_t)triangles * (9 * sizeof(Real) + sizeof(Vec3) + sizeof(MaterialId));
+			bytes += scene.GetBVH().GetMemoryUsage();
+
+			//both find the same triangle at the same distance: the BVHs are built over the same
+			//boxes in the same order
+			int mismatches = 0;
+
+			for (size_t i = 0; i < cameraRays.size(); i++)
+			{
+				bool same = triangleHits[i].t == meshHits[i].t &&
+					(!meshHits[i].prim.IsValid() || triangleHits[i].prim.index == meshHits[i].face);
+
+				mismatches += same ? 0 : 1;
+			}
+
+			printf("%10d %-10s %10.1f %12s %12.1f %12.2f %12d\n", triangles, "triangles", bytes / 1048576.0,
+				"-", buildTime * 1000.0, cameraRays.size() / traceTime * 1.0e-6, mismatches);
+
+			failures += mismatches;
+		}
+	}
+
+	remove(filename);
+
+	if (failures)
+	{
+		printf("FAILED: %d rays found a different closest hit\n", failures);
+		return 1;
+	}
+
+	printf("All mesh hits match the Triangle objects\n");
+
+	return 0;
+}
+
+//count placements of a torus on a square grid in the xz plane, each turned about the vertical
+static Transform PlaceOnGrid(int i, int count, Real turn)
+{
+	int side = (int)ceil(sqrt((double)count));
+	Real spacing = 6.0;
+	Vec3 offset((i % side - side * 0.5) * spacing, 0.0, (i / side - side * 0.5) * spacing);
+
+	return Transform::Translation(offset) * Transform::RotationY(turn * (i + 1));
+}
+
+//Many placements of one mesh: Instances sharing the mesh against a TriangleMesh with its own
+//copy of the transformed vertices per placement, which is what a scene without instancing holds
+static int BenchmarkInstancing()
+{
+	const int counts[] = { 100, 1000, 10000 };
+	const int maxCopies = 100;		//the copies of larger counts would not fit in memory
+	const int width = 640;
+	const int height = 480;
+
+	std::vector<Vec3> positions;
+	std::vector<int> indices;
+	MakeTorus(128, 64, positions, indices);
+
+	int triangles = (int)indices.size() / 3;
+	int failures = 0;
+
+	printf("torus of %d triangles, %dx%d camera rays\n", triangles, width, height);
+	printf("%10s %-10s %10s %12s %14s %12s %12s\n", "placements", "storage", "MB", "build (ms)", "re-place (ms)",
+		"Mrays/s", "mismatches");
+
+	for (int count : counts)
+	{
+		std::vector<RayHit> instanceHits;
+		std::vector<Ray> cameraRays;
+		int side = (int)ceil(sqrt((double)count));
+		Vec3 eye(0.0, 2.0 * side, 4.0 * side);
+
+		//the instances
+		{
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(eye, Vec3(0.0, 0.0, 0.0));
+
+			TriangleMesh* mesh = new TriangleMesh();
+
+			for (const Vec3& p : positions)
+			{
+				mesh->AddVertex(p);
+			}
+
+			for (int i = 0; i < triangles; i++)
+			{
+				mesh->AddTriangle(indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2]);
+			}
+
+			scene.AddGeometry(mesh);
+
+			Material* mat = new Material();
+			std::vector<Instance*> placed;
+
+			for (int i = 0; i < count; i++)
+			{
+				placed.push_back(new Instance(mesh, PlaceOnGrid(i, count, 0.3)));
+				placed.back()->SetMaterial(mat);
+				scene.AddObject(placed.back(), i == 0 ? mat : nullptr);
+			}
+
+			BenchClock::time_point begin = BenchClock::now();
+			scene.UpdateAccelerationStructure();
+			double buildTime = SecondsSince(begin);
+
+			//move every instance, the mesh BVH is kept and only the top level is rebuilt
+			for (int i = 0; i < count; i++)
+			{
+				placed[i]->SetTransform(PlaceOnGrid(i, count, 0.7));
+			}
+
+			begin = BenchClock::now();
+			scene.InvalidateAccelerationStructure();
+			scene.UpdateAccelerationStructure();
+			double replaceTime = SecondsSince(begin);
+
+			MakeCameraRays(scene, width, height, cameraRays);
+			double traceTime = TraceCameraRays(scene, cameraRays, instanceHits);
+
+			size_t bytes = mesh->GetMemoryUsage() + scene.GetBVH().GetMemoryUsage();
+			bytes += (size_t)count * (sizeof(Instance) + sizeof(Primitive*) + sizeof(PrimHandle));
+			bytes += (size_t)count * (sizeof(Transform) + sizeof(TriangleMesh*) + sizeof(MaterialId));
+
+			printf("%10d %-10s %10.1f %12.1f %14.1f %12.2f %12s\n", count, "instances", bytes / 1048576.0,
+				buildTime * 1000.0, replaceTime * 1000.0, cameraRays.size() / traceTime * 1.0e-6, "-");
+		}
+
+		//a copy per placement, estimated from one copy where there would be too many
+		{
+			int copies = count < maxCopies ? count : maxCopies;
+
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(eye, Vec3(0.0, 0.0, 0.0));
+
+			Material* mat = new Material();
+			size_t copyBytes = 0;
+
+			for (int i = 0; i < copies; i++)
+			{
+				Transform place = PlaceOnGrid(i, count, 0.7);
+				TriangleMesh* copy = new TriangleMesh();
+
+				for (const Vec3& p : positions)
+				{
+					copy->AddVertex(place.TransformPoint(p));
+				}
+
+				for (int tri = 0; tri < triangles; tri++)
+				{
+					copy->AddTriangle(indices[tri * 3], indices[tri * 3 + 1], indices[tri * 3 + 2]);
+				}
+
+				copy->SetMaterial(mat);
+				scene.AddObject(copy, i == 0 ? mat : nullptr);
+			}
+
+			BenchClock::time_point begin = BenchClock::now();
+			scene.UpdateAccelerationStructure();
+			double buildTime = SecondsSince(begin);
+
+			for (Primitive* copy : *scene.GetObjectList())
+			{
+				copyBytes += static_cast<TriangleMesh*>(copy)->GetMemoryUsage();
+			}
+
+			double bytes = (double)copyBytes / copies * count + scene.GetBVH().GetMemoryUsage();
+
+			if (copies < count)
+			{
+				printf("%10d %-10s %10.1f %12s %14s %12s %12s\n", count, "copies", bytes / 1048576.0, "-", "-", "-", "-");
+				continue;
+			}
+
+			std::vector<RayHit> copyHits;
+			double traceTime = TraceCameraRays(scene, cameraRays, copyHits);
+
+			//the copies have their vertices transformed once and the instances the rays, so the
+			//distances agree to rounding only; a ray that meets a different copy or misses it
+			//altogether is a mismatch
+			int mismatches = 0;
+
+			for (size_t i = 0; i < cameraRays.size(); i++)
+			{
+				const RayHit& a = instanceHits[i];
+				const RayHit& b = copyHits[i];
+
+				bool same = a.prim.IsValid() == b.prim.IsValid() &&
+					(!a.prim.IsValid() || (a.prim.index == b.prim.index && fabs(a.t - b.t) <= 1.0e-6 * a.t));
+
+				mismatches += same ? 0 : 1;
+			}
+
+			printf("%10d %-10s %10.1f %12.1f %14s %12.2f %12d\n", count, "copies", bytes / 1048576.0,
+				buildTime * 1000.0, "-", cameraRays.size() / traceTime * 1.0e-6, mismatches);
+
+			//a few rays may graze a silhouette and fall either way
+			if (mismatches > (int)cameraRays.size() / 1000)
+			{
+				failures++;
+			}
+		}
+	}
+
+	if (failures)
+	{
+		printf("FAILED: the instances and the copies disagree\n");
+		return 1;
+	}
+
+	printf("The instances agree with the copies\n");
+
+	return 0;
+}
+
+//BVH builds over the triangles of large meshes, on one thread and on a pool
+static int BenchmarkBuild()
+{
+	const int sizes[][2] = { { 1024, 512 }, { 1024, 1024 }, { 2048, 1024 } };
+
+	std::vector<int> threadCounts;
+	int hardware = (int)std::thread::hardware_concurrency();
+
+	threadCounts.push_back(1);
+	threadCounts.push_back(4);
+
+	if (hardware > 4)
+	{
+		threadCounts.push_back(hardware);
+	}
+
+	int failures = 0;
+
+	printf("%10s %8s %12s %14s %10s %8s %10s\n", "triangles", "threads", "build (ms)", "ms/Mtriangles", "nodes", "depth", "SAH cost");
+
+	for (const auto& size : sizes)
+	{
+		std::vector<AABB> bounds;
+
+		{
+			std::vector<Vec3> positions;
+			std::vector<int> indices;
+			MakeTorus(size[0], size[1], positions, indices);
+
+			bounds.resize(indices.size() / 3);
+
+			for (size_t tri = 0; tri < bounds.size(); tri++)
+			{
+				bounds[tri].Reset();
+
+				for (int k = 0; k < 3; k++)
+				{
+					bounds[tri].Grow(positions[indices[tri * 3 + k]]);
+				}
+			}
+		}
+
+		int count = (int)bounds.size();
+		BVHBuildReport serial = BVHBuildReport();
+
+		for (int threads : threadCounts)
+		{
+			ThreadPool* pool = threads > 1 ? new ThreadPool(threads) : nullptr;
+
+			BVH bvh;
+			bvh.Build(bounds, pool);
+
+			const BVHBuildReport& report = bvh.GetBuildReport();
+
+			printf("%10d %8d %12.1f %14.1f %10d %8d %10.2f\n", count, threads, report.seconds * 1000.0,
+				report.seconds * 1000.0 / (count * 1.0e-6), report.nodes, report.maxDepth, report.sahCost);
+
+			//the threads must build the very same tree
+			if (threads == 1)
+			{
+				serial = report;
+			}
+			else if (report.nodes != serial.nodes || report.leaves != serial.leaves ||
+				report.maxDepth != serial.maxDepth || report.sahCost != serial.sahCost)
+			{
+				failures++;
+			}
+
+			delete pool;
+		}
+	}
+
+	if (hardware < 4)
+	{
+		printf("Only %d hardware thread(s): the pools share them, their times show the overhead only\n", hardware);
+	}
+
+	if (failures)
+	{
+		printf("FAILED: %d parallel builds differ from the serial one\n", failures);
+		return 1;
+	}
+
+	printf("Every parallel build matches the serial one\n");
+
+	return 0;
+}
+
+//Frames of a sphere cloud in which some of the spheres bounce, with the BVH refit and rebuilt
+//as the rebuild threshold decides against rebuilding it every frame; the same again with an
+//8-bit WideBVH collapsed from it
+static int BenchmarkRefit()
+{
+	const int sphereCount = 64000;
+	const int movingCounts[] = { 64, 640, 6400 };
+	const int frames = 20;
+	const int width = 320;
+	const int height = 240;
+
+	int failures = 0;
+
+	printf("%d spheres, %d frames of %dx%d camera rays\n", sphereCount, frames, width, height);
+	printf("%8s %-12s %14s %14s %10s %12s\n", "moving", "update", "update (ms)", "trace (ms)", "rebuilds", "SAH growth");
+
+	for (int moving : movingCounts)
+	{
+		const char* modeNames[] = { "refit", "rebuild", "wide refit", "wide rebuild" };
+		std::vector<RayHit> finalHits[4];
+
+		for (int mode = 0; mode < 4; mode++)
+		{
+			std::mt19937 rng(1234);
+			Scene scene;
+			scene.SetSceneWidth((Real)width / height);
+			MakeSphereCloud(scene, sphereCount, rng);
+
+			double extent = 10.0 * cbrt((double)sphereCount);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 3.0 * extent), Vec3(0.0, 0.0, 0.0));
+			scene.SetRebuildThreshold(mode % 2 == 0 ? 1.3 : 0.0);
+			scene.SetWideBVH(mode >= 2 ? WIDEBVH_QUANT8 : WIDEBVH_NONE);
+			scene.UpdateAccelerationStructure();
+
+			//every moving sphere bounces about where it started, out of step with the others
+			std::vector<Sphere*> spheres;
+			std::vector<Vec3> rest;
+			std::uniform_real_distribution<double> phase(0.0, 3.14159265358979323846);
+			std::vector<double> phases;
+
+			for (int i = 0; i < moving; i++)
+			{
+				Sphere* sphere = static_cast<Sphere*>((*scene.GetObjectList())[i * (sphereCount / moving)]);
+
+				spheres.push_back(sphere);
+				rest.push_back(sphere->GetCentre());
+				phases.push_back(phase(rng));
+			}
+
+			std::vector<Ray> rays;
+			MakeCameraRays(scene, width, height, rays);
+
+			double updateTime = 0.0;
+			double traceTime = 0.0;
+			int rebuilds = 0;
+			double buildCost = scene.GetBVH().GetBuildReport().sahCost;
+			double worstGrowth = 1.0;
+
+			for (int frame = 1; frame <= frames; frame++)
+			{
+				for (int i = 0; i < moving; i++)
+				{
+					double lift = 0.1 * extent * fabs(sin(phases[i] + 0.3 * frame));
+
+					spheres[i]->SetSphere(rest[i][0], rest[i][1] + (Real)lift, rest[i][2], spheres[i]->GetRadius());
+					scene.UpdateObject(spheres[i]);
+				}
+
+				BenchClock::time_point begin = BenchClock::now();
+				scene.UpdateAccelerationStructure();
+				updateTime += SecondsSince(begin);
+
+				const BVH& bvh = scene.GetBVH();
+
+				if (bvh.GetRefitCount() == 0)
+				{
+					rebuilds++;
+					buildCost = bvh.GetBuildReport().sahCost;
+				}
+				else
+				{
+					worstGrowth = std::max(worstGrowth, bvh.GetSAHCost() / buildCost);
+				}
+
+				traceTime += TraceCameraRays(scene, rays, finalHits[mode]);
+			}
+
+			printf("%8d %-12s %14.2f %14.2f %10d %11.2fx\n", moving, modeNames[mode],
+				updateTime * 1000.0 / frames, traceTime * 1000.0 / frames, rebuilds, worstGrowth);
+		}
+
+		//the last frame must look the same whatever the tree
+		int mismatches = 0;
+
+		for (size_t i = 0; i < finalHits[0].size(); i++)
+		{
+			if (finalHits[0][i].prim != finalHits[1][i].prim || finalHits[0][i].t != finalHits[1][i].t)
+			{
+				mismatches++;
+			}
+		}
+
+		if (mismatches)
+		{
+			printf("FAILED: %d rays of the last frame hit something else in the refit tree\n", mismatches);
+			failures++;
+		}
+
+		//a wide tree may find grazing hits the binary one culls, see WideBVH, but none farther
+		int missed = 0;
+
+		for (size_t i = 0; i < finalHits[2].size(); i++)
+		{
+			missed += finalHits[2][i].t > finalHits[0][i].t ? 1 : 0;
+		}
+
+		if (missed)
+		{
+			printf("FAILED: %d rays of the last frame missed a hit of the binary tree in the refit wide tree\n", missed);
+			failures++;
+		}
+	}
+
+	if (failures)
+	{
+		return 1;
+	}
+
+	printf("The refit trees find the same hits as the rebuilt ones\n");
+
+	return 0;
+}
+
+//The cold start of a large OBJ model: read and built, against mapped from a mesh cache file
+//written by the first run. The first frame of the mapped mesh pays for its page faults.
+static int BenchmarkCache()
+{
+	const int sizes[][2] = { { 512, 256 }, { 1024, 1024 }, { 2560, 1024 } };
+	const int width = 640;
+	const int height = 480;
+	const char* filename = "tinyray_bench_cache.obj";
+
+	int failures = 0;
+
+	printf("%10s %10s %10s %10s %10s %10s %10s %12s %12s %10s\n", "triangles", "file MB", "load (ms)", "build (ms)",
+		"save (ms)", "key (ms)", "map (ms)", "frame (ms)", "mapped (ms)", "mismatches");
+
+	for (const auto& size : sizes)
+	{
+		int triangles;
+
+		{
+			std::vector<Vec3> positions;
+			std::vector<int> indices;
+			MakeTorus(size[0], size[1], positions, indices);
+			triangles = (int)indices.size() / 3;
+
+			if (!WriteOBJ(filename, positions, indices))
+			{
+				printf("FAILED: cannot write %s\n", filename);
+				return 1;
+			}
+		}
+
+		uint64_t key = 0;
+		HashFile(filename, key);
+		std::string cacheFile = MeshCachePath(".", key);
+
+		std::vector<Ray> cameraRays;
+		std::vector<RayHit> builtHits, mappedHits;
+		double loadTime, buildTime, saveTime, builtFrame;
+		double fileSize = 0.0;
+
+		//the first run: read, build and write the cache
+		{
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 3.0, 5.0), Vec3(0.0, 0.0, 0.0));
+
+			BenchClock::time_point begin = BenchClock::now();
+			TriangleMesh* mesh = new TriangleMesh();
+			bool loaded = LoadOBJ(filename, mesh);
+			loadTime = SecondsSince(begin);
+
+			if (!loaded)
+			{
+				printf("FAILED: %s did not load back\n", filename);
+				delete mesh;
+				remove(filename);
+				return 1;
+			}
+
+			scene.AddObject(mesh, new Material());
+
+			begin = BenchClock::now();
+			scene.UpdateAccelerationStructure();
+			buildTime = SecondsSince(begin);
+
+			MakeCameraRays(scene, width, height, cameraRays);
+			builtFrame = TraceCameraRays(scene, cameraRays, builtHits);
+
+			begin = BenchClock::now();
+			bool saved = SaveMeshCache(cacheFile.c_str(), key, *mesh);
+			saveTime = SecondsSince(begin);
+
+			FILE* fp = saved ? fopen(cacheFile.c_str(), "rb") : nullptr;
+
+			if (!fp)
+			{
+				printf("FAILED: cannot write %s\n", cacheFile.c_str());
+				remove(filename);
+				return 1;
+			}
+
+			fseek(fp, 0, SEEK_END);
+			fileSize = (double)ftell(fp);
+			fclose(fp);
+		}
+
+		//the next run: the key from the model file, then the cache mapped
+		{
+			Scene scene;
+			scene.CleanupScene();
+			scene.SetSceneWidth((Real)width / height);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 3.0, 5.0), Vec3(0.0, 0.0, 0.0));
+
+			BenchClock::time_point begin = BenchClock::now();
+			uint64_t runKey = 0;
+			HashFile(filename, runKey);
+			double keyTime = SecondsSince(begin);
+
+			begin = BenchClock::now();
+			TriangleMesh* mesh = new TriangleMesh();
+			bool mapped = runKey == key && LoadMeshCache(cacheFile.c_str(), runKey, mesh);
+			scene.AddObject(mesh, new Material());
+			scene.UpdateAccelerationStructure();
+			double mapTime = SecondsSince(begin);
+
+			if (!mapped || mesh->GetTriangleCount() != triangles)
+			{
+				printf("FAILED: %s did not map back\n", cacheFile.c_str());
+				remove(cacheFile.c_str());
+				remove(filename);
+				return 1;
+			}
+
+			double mappedFrame = TraceCameraRays(scene, cameraRays, mappedHits);
+
+			//the very same tree over the very same triangles
+			int mismatches = 0;
+
+			for (size_t i = 0; i < cameraRays.size(); i++)
+			{
+				bool same = builtHits[i].t == mappedHits[i].t && builtHits[i].face == mappedHits[i].face &&
+					builtHits[i].prim == mappedHits[i].prim;
+
+				mismatches += same ? 0 : 1;
+			}
+
+			printf("%10d %10.1f %10.1f %10.1f %10.1f %10.1f %10.2f %12.1f %12.1f %10d\n", triangles, fileSize / 1048576.0,
+				loadTime * 1000.0, buildTime * 1000.0, saveTime * 1000.0, keyTime * 1000.0, mapTime * 1000.0,
+				builtFrame * 1000.0, mappedFrame * 1000.0, mismatches);
+
+			failures += mismatches;
+		}
+
+		remove(cacheFile.c_str());
+	}
+
+	remove(filename);
+
+	if (failures)
+	{
+		printf("FAILED: %d rays found a different closest hit in the mapped mesh\n", failures);
+		return 1;
+	}
+
+	printf("The mapped meshes find the same hits as the built ones\n");
+
+	return 0;
+}
+
+//What the closest hit walks of rays through bvh cost, or through wide if it is not empty.
+//test(item, ray, hit) intersects one item and returns true if it lowered hit.t.
+template<typename ItemTest>
+static BVHTraversalStats MeasureTraversal(const BVH& bvh, const WideBVH& wide, const std::vector<Ray>& rays, ItemTest test)
+{
+	BVHTraversalStats stats = BVHTraversalStats();
+
+	for (size_t i = 0; i < rays.size(); i++)
+	{
+		Ray ray = rays[i];
+		RayHit hit = Ray::s_defaultHit;
+		Real tmax = hit.t;
+
+		auto intersectItem = [&test, &ray, &hit, &tmax](int item)
+		{
+			if (test(item, ray, hit))
+			{
+				tmax = hit.t;
+			}
+		};
+
+		if (wide.IsEmpty())
+		{
+			bvh.Traverse(ray, tmax, intersectItem, &stats);
+		}
+		else
+		{
+			wide.Traverse(ray, tmax, intersectItem, &stats);
+		}
+	}
+
+	return stats;
+}
+
+//Camera and shadow rays through the binary BVH against the wide layouts, on a sphere cloud
+//where the scene's tree does the work and on a large mesh where the mesh's tree does
+static int BenchmarkWide()
+{
+	const int width = 640;
+	const int height = 480;
+	const int repeats = 3;
+	const char* layouts[] = { "binary", "wide", "wide16", "wide8" };
+	const WideBVHFormat formats[] = { WIDEBVH_NONE, WIDEBVH_FLOAT, WIDEBVH_QUANT16, WIDEBVH_QUANT8 };
+
+	int failures = 0;
+
+	printf("%-8s %-8s %6s %9s %10s %10s %10s %10s %10s %10s %8s %8s\n", "scene", "layout", "node B", "tree MB",
+		"nodes/ray", "boxes/ray", "bytes/ray", "items/ray", "Mrays/s", "shadow", "missed", "extra");
+
+	for (int workload = 0; workload < 2; workload++)
+	{
+		std::mt19937 rng(1234);
+		Scene scene;
+		TriangleMesh* mesh = nullptr;
+		Vec3 light;
+
+		if (workload == 0)
+		{
+			MakeSphereCloud(scene, 64000, rng);
+
+			double extent = 10.0 * cbrt(64000.0);
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 3.0 * extent), Vec3(0.0, 0.0, 0.0));
+			light = Vec3((Real)extent, (Real)(2.0 * extent), (Real)(2.0 * extent));
+		}
+		else
+		{
+			std::vector<Vec3> positions;
+			std::vector<int> indices;
+			MakeTorus(1024, 1024, positions, indices);
+
+			scene.CleanupScene();
+			scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 3.0, 5.0), Vec3(0.0, 0.0, 0.0));
+			light = Vec3(4.0, 6.0, 2.0);
+			mesh = new TriangleMesh();
+
+			for (size_t i = 0; i < positions.size(); i++)
+			{
+				mesh->AddVertex(positions[i]);
+			}
+
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				mesh->AddTriangle(indices[i], indices[i + 1], indices[i + 2]);
+			}
+
+			scene.AddObject(mesh, new Material());
+		}
+
+		scene.SetSceneWidth((Real)width / height);
+		scene.UpdateAccelerationStructure();
+
+		std::vector<Ray> cameraRays;
+		MakeCameraRays(scene, width, height, cameraRays);
+
+		std::vector<RayHit> binaryHits;
+		std::vector<Ray> shadowRays;
+		std::vector<Real> shadowDistance;
+		std::vector<char> binaryShadow;
+
+		for (int l = 0; l < 4; l++)
+		{
+			scene.SetWideBVH(formats[l]);
+			scene.UpdateAccelerationStructure();
+
+			std::vector<RayHit> hits;
+			double traceTime = FARFAR_AWAY;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				traceTime = std::min(traceTime, TraceCameraRays(scene, cameraRays, hits));
+			}
+
+			//from the light to every point the camera sees
+			if (l == 0)
+			{
+				binaryHits = hits;
+
+				for (size_t i = 0; i < cameraRays.size(); i++)
+				{
+					if (hits[i].prim.IsValid())
+					{
+						Ray ray = cameraRays[i];
+						Vec3 point = ray.GetRayStart() + ray.GetRay() * hits[i].t;
+						Vec3 toPoint = point - light;
+						Real distance = toPoint.Length();
+
+						Ray shadow;
+						shadow.SetRay(light, toPoint * ((Real)1.0 / distance));
+						shadowRays.push_back(shadow);
+						shadowDistance.push_back(distance * (Real)0.999);
+					}
+				}
+			}
+
+			std::vector<char> shadowed(shadowRays.size());
+			double shadowTime = FARFAR_AWAY;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				BenchClock::time_point begin = BenchClock::now();
+
+				for (size_t i = 0; i < shadowRays.size(); i++)
+				{
+					Ray ray = shadowRays[i];
+					shadowed[i] = scene.Occluded(ray, shadowDistance[i]) ? 1 : 0;
+				}
+
+				shadowTime = std::min(shadowTime, SecondsSince(begin));
+			}
+
+			if (l == 0)
+			{
+				binaryShadow = shadowed;
+			}
+
+			//every hit and shadow of the binary tree has to be found. The larger boxes of the
+			//wide trees can let through the odd grazing hit that the item test reports just
+			//outside the item's box, which the binary tree culls; these are counted apart.
+			int missed = 0;
+			int extra = 0;
+
+			for (size_t i = 0; i < cameraRays.size(); i++)
+			{
+				missed += hits[i].t > binaryHits[i].t ? 1 : 0;
+				extra += hits[i].t < binaryHits[i].t ? 1 : 0;
+			}
+
+			for (size_t i = 0; i < shadowRays.size(); i++)
+			{
+				missed += shadowed[i] < binaryShadow[i] ? 1 : 0;
+				extra += shadowed[i] > binaryShadow[i] ? 1 : 0;
+			}
+
+			//the tree that does the work
+			BVHTraversalStats stats;
+			size_t treeBytes;
+			int nodeBytes = l == 0 ? (int)sizeof(BVHNode) : 0;
+
+			if (mesh)
+			{
+				stats = MeasureTraversal(mesh->GetBVH(), mesh->GetWideBVH(), cameraRays, [mesh](int tri, Ray& ray, RayHit& hit)
+				{
+					Real u, v;
+					Real t = mesh->IntersectTriangle(tri, ray, u, v);
+
+					if (t < hit.t)
+					{
+						hit.t = t;
+						return true;
+					}
+
+					return false;
+				});
+
+				treeBytes = l == 0 ? mesh->GetBVH().GetMemoryUsage() : mesh->GetWideBVH().GetMemoryUsage();
+				nodeBytes = l == 0 ? nodeBytes : (int)mesh->GetWideBVH().GetNodeSize();
+			}
+			else
+			{
+				const PrimitiveStore& store = scene.GetPrimitives();
+				const std::vector<PrimHandle>& objects = scene.GetBoundedObjects();
+
+				stats = MeasureTraversal(scene.GetBVH(), scene.GetWideBVH(), cameraRays, [&store, &objects](int item, Ray& ray, RayHit& hit)
+				{
+					return store.Intersect(objects[item], ray, hit);
+				});
+
+				treeBytes = l == 0 ? scene.GetBVH().GetMemoryUsage() : scene.GetWideBVH().GetMemoryUsage();
+				nodeBytes = l == 0 ? nodeBytes : (int)scene.GetWideBVH().GetNodeSize();
+			}
+
+			double rays = (double)cameraRays.size();
+
+			printf("%-8s %-8s %6d %9.1f %10.1f %10.1f %10.0f %10.1f %10.2f %10.2f %8d %8d\n", workload == 0 ? "spheres" : "mesh",
+				layouts[l], nodeBytes, treeBytes / 1048576.0, stats.nodes / rays, stats.boxes / rays, stats.bytes / rays,
+				stats.items / rays, rays / traceTime * 1.0e-6, shadowRays.size() / shadowTime * 1.0e-6, missed, extra);
+
+			failures += missed;
+		}
+	}
+
+	printf("Mrays/s: camera rays through Scene::Intersect, shadow: rays from a light through Scene::Occluded\n");
+
+	if (failures)
+	{
+		printf("FAILED: %d rays missed a hit or shadow of the binary tree in a wide tree\n", failures);
+		return 1;
+	}
+
+	printf("The wide trees find every hit and shadow the binary ones find\n");
+
+	return 0;
+}
+
+//Fill scene with workload 0, 1 or 2 of BenchmarkAccelerators and place its camera and light
+static void MakeAcceleratorScene(Scene& scene, int workload, std::mt19937& rng, Vec3& light)
+{
+	Material* mat = new Material();
+
+	scene.CleanupScene();
+
+	if (workload == 0)
+	{
+		MakeSphereCloud(scene, 64000, rng);
+
+		double extent = 10.0 * cbrt(64000.0);
+		scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 3.0 * extent), Vec3(0.0, 0.0, 0.0));
+		light = Vec3((Real)extent, (Real)(2.0 * extent), (Real)(2.0 * extent));
+
+		delete mat;
+		return;
+	}
+
+	if (workload == 1)
+	{
+		//the teapot in a stadium: a dense cluster of small spheres in the middle of a ring of
+		//large boxes, nearly all objects in a tiny part of the scene's box
+		std::uniform_real_distribution<double> position(-1.0, 1.0);
+
+		for (int i = 0; i < 10000; i++)
+		{
+			Primitive* sphere = new Sphere(position(rng), position(rng), position(rng), 0.03);
+
+			scene.AddObject(sphere, i == 0 ? mat : nullptr);
+			sphere->SetMaterial(mat);
+		}
+
+		for (int i = 0; i < 200; i++)
+		{
+			double angle = i * 2.0 * 3.14159265358979 / 200;
+			Primitive* box = new Box(Vec3((Real)(100.0 * cos(angle)), 0.0, (Real)(100.0 * sin(angle))), 3.0, 20.0, 3.0);
+
+			scene.AddObject(box, nullptr);
+			box->SetMaterial(mat);
+		}
+
+		scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 1.5, 3.0), Vec3(0.0, 0.0, 0.0));
+		light = Vec3(2.0, 10.0, 5.0);
+
+		return;
+	}
+
+	//a city: blocks of buildings on a regular plan, a few of them tall, seen from above one corner
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	for (int i = 0; i < 128 * 128; i++)
+	{
+		double footprint = 5.0 + 3.0 * unit(rng);
+		double height = 5.0 + 10.0 * unit(rng);
+
+		height *= unit(rng) < 0.05 ? 6.0 : 1.0;
+
+		Primitive* box = new Box(Vec3((Real)((i % 128) * 10.0), (Real)(height * 0.5), (Real)((i / 128) * 10.0)),
+			(Real)footprint, (Real)height, (Real)footprint);
+
+		scene.AddObject(box, i == 0 ? mat : nullptr);
+		box->SetMaterial(mat);
+	}
+
+	scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(-100.0, 150.0, -100.0), Vec3(640.0, 0.0, 640.0));
+	light = Vec3(2000.0, 3000.0, 1000.0);
+}
+
+//Single rays through the BVH, the uniform grid and the kd-tree on scenes that suit them
+//differently: evenly spread spheres, a dense cluster in a large empty space and a city of boxes
+static int BenchmarkAccelerators()
+{
+	const int width = 640;
+	const int height = 480;
+	const int repeats = 3;
+	const char* workloads[] = { "uniform", "stadium", "city" };
+	const AcceleratorType types[] = { ACCELERATOR_BVH, ACCELERATOR_GRID, ACCELERATOR_KDTREE };
+
+	int failures = 0;
+
+	printf("%-8s %-8s %8s %10s %10s %10s %8s\n", "scene", "accel", "objects", "build ms", "memory MB", "Mrays/s", "shadow");
+
+	for (int workload = 0; workload < 3; workload++)
+	{
+		std::mt19937 rng(1234);
+		Scene scene;
+		Vec3 light;
+
+		MakeAcceleratorScene(scene, workload, rng, light);
+		scene.SetSceneWidth((Real)width / height);
+
+		std::vector<Ray> cameraRays;
+		MakeCameraRays(scene, width, height, cameraRays);
+
+		std::vector<RayHit> bvhHits;
+		std::vector<Ray> shadowRays;
+		std::vector<Real> shadowDistance;
+		std::vector<char> bvhShadow;
+
+		for (int a = 0; a < 3; a++)
+		{
+			scene.SetAccelerator(types[a]);
+			scene.UpdateAccelerationStructure();
+
+			const Accelerator* accel = scene.GetAccelerator();
+			double buildTime = accel ? accel->GetBuildSeconds() : scene.GetBVH().GetBuildReport().seconds;
+			size_t memory = accel ? accel->GetMemoryUsage() : scene.GetBVH().GetMemoryUsage();
+
+			std::vector<RayHit> hits;
+			double traceTime = FARFAR_AWAY;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				traceTime = std::min(traceTime, TraceCameraRays(scene, cameraRays, hits));
+			}
+
+			//from the light to every point the camera sees
+			if (a == 0)
+			{
+				bvhHits = hits;
+
+				for (size_t i = 0; i < cameraRays.size(); i++)
+				{
+					if (hits[i].prim.IsValid())
+					{
+						Ray ray = cameraRays[i];
+						Vec3 point = ray.GetRayStart() + ray.GetRay() * hits[i].t;
+						Vec3 toPoint = point - light;
+						Real distance = toPoint.Length();
+
+						Ray shadow;
+						shadow.SetRay(light, toPoint * ((Real)1.0 / distance));
+						shadowRays.push_back(shadow);
+						shadowDistance.push_back(distance * (Real)0.999);
+					}
+				}
+			}
+
+			std::vector<char> shadowed(shadowRays.size());
+			double shadowTime = FARFAR_AWAY;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				BenchClock::time_point begin = BenchClock::now();
+
+				for (size_t i = 0; i < shadowRays.size(); i++)
+				{
+					Ray ray = shadowRays[i];
+					shadowed[i] = scene.Occluded(ray, shadowDistance[i]) ? 1 : 0;
+				}
+
+				shadowTime = std::min(shadowTime, SecondsSince(begin));
+			}
+
+			if (a == 0)
+			{
+				bvhShadow = shadowed;
+			}
+
+			//every structure has to find the same closest hits and shadows
+			for (size_t i = 0; i < cameraRays.size(); i++)
+			{
+				failures += hits[i].t != bvhHits[i].t ? 1 : 0;
+			}
+
+			for (size_t i = 0; i < shadowRays.size(); i++)
+			{
+				failures += shadowed[i] != bvhShadow[i] ? 1 : 0;
+			}
+
+			printf("%-8s %-8s %8d %10.2f %10.2f %10.2f %8.2f\n", workloads[workload], accel ? accel->GetName() : "bvh",
+				(int)scene.GetBoundedObjects().size(), buildTime * 1000.0, memory / 1048576.0,
+				cameraRays.size() / traceTime * 1.0e-6, shadowRays.size() / shadowTime * 1.0e-6);
+		}
+	}
+
+	printf("Mrays/s: camera rays through Scene::Intersect, shadow: rays from a light through Scene::Occluded\n");
+
+	if (failures)
+	{
+		printf("FAILED: %d rays found a different hit or shadow than through the BVH\n", failures);
+		return 1;
+	}
+
+	printf("The grid and the kd-tree find every hit and shadow the BVH finds\n");
+
+	return 0;
+}
+
+//Rays from eye at the middle of the diagonal that every quad of a MakeTorus mesh splits into
+//two triangles, with the vertices rounded to float if asFloat, and how far to it. Diagonals on
+//the silhouette or seen edge-on are left out, a ray may pass them by without a crack.
+static void MakeDiagonalRays(const TriangleMesh& mesh, const Vec3& eye, bool asFloat, std::vector<Ray>& rays,
+	std::vector<Real>& distances)
+{
+	const TriangleMeshArrays& a = mesh.GetArrays();
+
+	rays.clear();
+	distances.clear();
+
+	for (int tri = 0; tri + 1 < a.triangleCount; tri += 2)
+	{
+		//triangle tri is v00, v01, v11 and the next one v00, v11, v10
+		const int* index = &a.indices[tri * 3];
+		Vec3 p[4];
+
+		for (int k = 0; k < 3; k++)
+		{
+			int v = index[k];
+			p[k] = asFloat ? Vec3((float)a.px[v], (float)a.py[v], (float)a.pz[v]) : Vec3(a.px[v], a.py[v], a.pz[v]);
+		}
+
+		int v10 = a.indices[tri * 3 + 5];
+		p[3] = asFloat ? Vec3((float)a.px[v10], (float)a.py[v10], (float)a.pz[v10]) : Vec3(a.px[v10], a.py[v10], a.pz[v10]);
+
+		Vec3 target = (p[0] + p[2]) * 0.5;
+		Vec3 toTarget = target - eye;
+		Real distance = toTarget.Length();
+		Vec3 dir = toTarget * ((Real)1.0 / distance);
+
+		Real cos0 = dir.DotProduct((p[1] - p[0]).CrossProduct(p[2] - p[0]).Normalise());
+		Real cos1 = dir.DotProduct((p[2] - p[0]).CrossProduct(p[3] - p[0]).Normalise());
+
+		if (cos0 * cos1 <= 0.0 || fabs(cos0) < 0.05 || fabs(cos1) < 0.05)
+		{
+			continue;
+		}
+
+		Ray ray;
+		ray.SetRay(eye, dir);
+		rays.push_back(ray);
+		distances.push_back(distance);
+	}
+}
+
+//The default scene with a finely tessellated torus on the floor, its triangles tested by
+//Moller-Trumbore in Real and by the watertight test in float. Besides the speed it counts the
+//rays that slip through the mesh where they aim at an edge shared by two triangles, and the
+//rays leaving the mesh that find the triangle they start on again, from OffsetRayStart for the
+//float test.
+static int BenchmarkPrecision()
+{
+	const int width = 640;
+	const int height = 480;
+	const int repeats = 3;
+	const char* tests[] = { "real", "float" };
+	const TriangleTest types[] = { TRIANGLE_TEST_REAL, TRIANGLE_TEST_FLOAT };
+
+	Scene scene;
+	scene.SetSceneWidth((Real)width / height);
+
+	std::vector<Vec3> positions;
+	std::vector<int> indices;
+	MakeTorus(512, 512, positions, indices);
+
+	TriangleMesh* mesh = new TriangleMesh();
+
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		mesh->AddVertex(positions[i]);
+	}
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		mesh->AddTriangle(indices[i], indices[i + 1], indices[i + 2]);
+	}
+
+	//where the command line puts a model
+	AABB spot;
+	spot.min.SetVector(3.0, -1.0, -4.0);
+	spot.max.SetVector(8.0, 4.0, 1.0);
+	mesh->FitToBox(spot);
+
+	Material* mat = new Material();
+	mat->SetDiffuseColour(0.8, 0.8, 0.8);
+	scene.AddObject(mesh, mat);
+
+	Vec3 light = (*scene.GetLightList())[0]->GetLightPosition();
+	Vec3 eye = scene.GetSceneCamera()->GetPosition();
+
+	std::vector<Ray> cameraRays;
+	MakeCameraRays(scene, width, height, cameraRays);
+
+	std::vector<Ray> targetRays;
+	std::vector<Real> targetDistance;
+
+	printf("Real is %s, the rest of the scene is traced in it whatever the triangle test\n",
+		sizeof(Real) == sizeof(float) ? "float" : "double");
+	printf("%-6s %10s %10s %8s %10s %10s %10s\n", "test", "mesh MB", "Mrays/s", "shadow", "differ", "cracks", "self hits");
+
+	std::vector<RayHit> realHits;
+	int failures = 0;
+
+	for (int k = 0; k < 2; k++)
+	{
+		scene.SetTriangleTest(types[k]);
+		scene.UpdateAccelerationStructure();
+
+		std::vector<RayHit> hits;
+		double traceTime = FARFAR_AWAY;
+
+		for (int r = 0; r < repeats; r++)
+		{
+			traceTime = std::min(traceTime, TraceCameraRays(scene, cameraRays, hits));
+		}
+
+		if (k == 0)
+		{
+			realHits = hits;
+		}
+
+		//camera rays that end on another primitive or triangle than with the real test
+		int differ = 0;
+
+		for (size_t i = 0; i < hits.size(); i++)
+		{
+			differ += hits[i].prim != realHits[i].prim || hits[i].face != realHits[i].face ? 1 : 0;
+		}
+
+		//from the light to every point the camera sees, and from every point on the mesh in the
+		//mirror direction; a flat triangle cannot be hit again by a ray that leaves it
+		std::vector<Ray> shadowRays;
+		std::vector<Real> shadowDistance;
+		int selfHits = 0;
+
+		for (size_t i = 0; i < cameraRays.size(); i++)
+		{
+			if (!hits[i].prim.IsValid())
+			{
+				continue;
+			}
+
+			Ray ray = cameraRays[i];
+			RayHitResult surface = scene.GetSurface(ray, hits[i]);
+			Vec3 toPoint = surface.point - light;
+			Real distance = toPoint.Length();
+
+			Ray shadow;
+			shadow.SetRay(light, toPoint * ((Real)1.0 / distance));
+			shadowRays.push_back(shadow);
+			shadowDistance.push_back(distance * (Real)0.999);
+
+			if (hits[i].prim.type == Primitive::PRIMTYPE_Mesh)
+			{
+				Vec3 dir = ray.GetRay();
+				Vec3 mirror = dir - surface.normal * (2.0 * dir.DotProduct(surface.normal));
+				Ray leaving;
+				RayHit again = Ray::s_defaultHit;
+
+				//the float test is only watertight from a start its rounding cannot put behind the
+				//surface; the real test leaves from the point as the tracer does
+				Vec3 start = types[k] == TRIANGLE_TEST_FLOAT ? OffsetRayStart(surface.point, surface.normal, mirror) : surface.point;
+				leaving.SetRay(start, mirror);
+				scene.Intersect(leaving, again);
+				selfHits += again.prim == hits[i].prim && again.face == hits[i].face ? 1 : 0;
+			}
+		}
+
+		double shadowTime = FARFAR_AWAY;
+
+		for (int r = 0; r < repeats; r++)
+		{
+			BenchClock::time_point begin = BenchClock::now();
+
+			for (size_t i = 0; i < shadowRays.size(); i++)
+			{
+				Ray ray = shadowRays[i];
+				scene.Occluded(ray, shadowDistance[i]);
+			}
+
+			shadowTime = std::min(shadowTime, SecondsSince(begin));
+		}
+
+		//a ray at an edge inside the mesh has to stop there at the latest, at the edge of the
+		//triangles the test sees
+		MakeDiagonalRays(*mesh, eye, types[k] == TRIANGLE_TEST_FLOAT, targetRays, targetDistance);
+		int cracks = 0;
+
+		for (size_t i = 0; i < targetRays.size(); i++)
+		{
+			Ray ray = targetRays[i];
+			RayHit hit = Ray::s_defaultHit;
+
+			scene.Intersect(ray, hit);
+			cracks += hit.t > targetDistance[i] * (Real)(1.0 + 1.0e-5) ? 1 : 0;
+		}
+
+		printf("%-6s %10.1f %10.2f %8.2f %10d %10d %10d\n", tests[k], mesh->GetMemoryUsage() / 1048576.0,
+			cameraRays.size() / traceTime * 1.0e-6, shadowRays.size() / shadowTime * 1.0e-6, differ, cracks, selfHits);
+
+		if (types[k] == TRIANGLE_TEST_FLOAT)
+		{
+			failures += cracks + selfHits;
+		}
+	}
+
+	printf("Mrays/s: camera rays through Scene::Intersect, shadow: rays from the light through Scene::Occluded\n");
+	printf("differ: camera rays ending on another triangle than with the real test, cracks: of %d rays at\n",
+		(int)targetRays.size());
+	printf("shared edges, self hits: rays leaving the mesh in the mirror direction that hit their own triangle\n");
+
+	if (failures)
+	{
+		printf("FAILED: the float test let rays through the mesh or hit the triangles they left\n");
+		return 1;
+	}
+
+	printf("The float test is watertight and never finds the triangle a ray leaves\n");
+
+	return 0;
+}
+
+//The default scene lit by rigs of small white lights under the ceiling, of the same total
+//power whatever their number, rendered with every light and with a few drawn from the light
+//tree per shading point. The sampled images are compared with the exhaustive ones for noise
+//and for brightness, which must agree on average, and the recursive and the wavefront
+//renderer have to draw the same lights.
+static int BenchmarkLights()
+{
+	const int width = 160;
+	const int height = 120;
+	const int samples = 8;
+	const int rigs[] = { 16, 256, 4096 };
+
+	std::mt19937 rng(4321);
+	int failures = 0;
+
+	printf("%dx%d, full lighting with shadows, %d lights drawn per shading point\n", width, height, samples);
+	printf("%8s %-10s %10s %12s %10s %10s %10s\n", "lights", "lighting", "seconds", "tree nodes", "rms error",
+		"brightness", "mismatches");
+
+	for (int rig : rigs)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+
+		std::vector<Light*>* lights = scene.GetLightList();
+
+		for (Light* light : *lights)
+		{
+			delete light;
+		}
+
+		lights->clear();
+
+		std::uniform_real_distribution<double> x(-18.0, 18.0), y(14.0, 20.0), z(-30.0, 10.0);
+
+		for (int i = 0; i < rig; i++)
+		{
+			Light* light = new Light();
+			light->SetLightPosition(x(rng), y(rng), z(rng));
+			light->SetLightColour(1.2 / rig, 1.2 / rig, 1.2 / rig);
+			lights->push_back(light);
+		}
+
+		std::vector<float> reference;
+		double referenceSum = 0.0;
+
+		const struct { const char* name; int samples; bool wavefront; } configs[] =
+		{
+			{ "every", 0, false },
+			{ "sampled", samples, false },
+			{ "sampled", samples, true },
+		};
+
+		std::vector<float> sampled;
+
+		for (const auto& config : configs)
+		{
+			scene.SetLightSamples(config.samples);
+
+			RayTracer tracer(width, height);
+			tracer.m_traceflag = RayTracer::GetPresetTraceFlag(3);
+			tracer.SetWavefront(config.wavefront);
+
+			BenchClock::time_point begin = BenchClock::now();
+			tracer.DoRayTrace(&scene);
+			double seconds = SecondsSince(begin);
+
+			const float* image = tracer.GetFramebuffer();
+			int values = width * height * 3;
+
+			if (reference.empty())
+			{
+				reference.assign(image, image + values);
+
+				for (int i = 0; i < values; i++)
+				{
+					referenceSum += reference[i];
+				}
+
+				printf("%8d %-10s %10.3f %12s %10s %10s %10s\n", rig, config.name, seconds, "-", "-", "-", "-");
+
+				continue;
+			}
+
+			//the wavefront image has to be the recursive one
+			int mismatches = 0;
+
+			if (sampled.empty())
+			{
+				sampled.assign(image, image + values);
+			}
+			else
+			{
+				for (int i = 0; i < values; i += 3)
+				{
+					mismatches += memcmp(&image[i], &sampled[i], 3 * sizeof(float)) != 0 ? 1 : 0;
+				}
+			}
+
+			double sum = 0.0;
+			double error = 0.0;
+
+			for (int i = 0; i < values; i++)
+			{
+				sum += image[i];
+				error += (image[i] - reference[i]) * (double)(image[i] - reference[i]);
+			}
+
+			double brightness = sum / referenceSum;
+
+			printf("%8d %-10s %10.3f %12d %10.4f %10.4f %10d\n", rig, config.wavefront ? "wavefront" : config.name,
+				seconds, scene.GetLightTree().GetNodeCount(), sqrt(error / values), brightness, mismatches);
+
+			failures += mismatches;
+			failures += fabs(brightness - 1.0) > 0.02 ? 1 : 0;
+		}
+	}
+
+	printf("rms error: per channel against the image lit by every light, brightness: the sum of the\n");
+	printf("sampled image over the sum of that one, mismatches: wavefront pixels unlike the recursive ones\n");
+
+	if (failures)
+	{
+		printf("FAILED: the sampled images are biased or the renderers drew different lights\n");
+		return 1;
+	}
+
+	printf("Sampling the lights keeps the brightness and both renderers draw the same lights\n");
+
+	return 0;
+}
+
+//Full lighting without shadows at one hit, the way RayTracer::CalculateLighting did it before
+//the light buffer: one Light object at a time, with Vec3::Normalise and pow. As there, a light
+//behind the surface adds no specular term.
+static Colour LightOneByOne(Scene& scene, const Vec3& campos, const RayHitResult& hit)
+{
+	const MaterialRecord& mat = scene.GetMaterial(hit.prim);
+	Colour outcolour = mat.ambient;
+	std::vector<Light*>* lights = scene.GetLightList();
+
+	//the checker pattern of the planes
+	if (hit.prim.type == Primitive::PRIMTYPE_Plane)
+	{
+		int dx = (hit.point[0] / 2.0);
+		int dy = (hit.point[1] / 2.0);
+		int dz = (hit.point[2] / 2.0);
+		float checker = (dx % 2 || dy % 2 || dz % 2) ? 1.0f : 0.0f;
+
+		outcolour.red = outcolour.green = outcolour.blue = checker;
+	}
+
+	for (Light* light : *lights)
+	{
+		Vec3 normal = hit.normal;
+		Colour surface_col = mat.diffuse;
+		Colour spec_col = mat.specular;
+		Colour light_intensity = light->GetLightColour();
+		Vec3 toLight = light->GetLightPosition() - hit.point;
+		Vec3 lightDirection = toLight.Normalise();
+		Real theta = lightDirection.DotProduct(normal);
+
+		outcolour.red += (surface_col.red * light_intensity.red) * fmax(0.0, theta);
+		outcolour.green += (surface_col.green * light_intensity.green) * fmax(0.0, theta);
+		outcolour.blue += (surface_col.blue * light_intensity.blue) * fmax(0.0, theta);
+
+		Vec3 camera_dir = (campos - hit.point).Normalise();
+		Vec3 half = (camera_dir + lightDirection).Normalise();
+		Real halfn = normal.DotProduct(half);
+		Real spec = theta > 0.0 ? pow(fmax(0.0, halfn), mat.specPower) : 0.0;
+
+		outcolour.red += (spec_col.red * light_intensity.red) * spec;
+		outcolour.green += (spec_col.green * light_intensity.green) * spec;
+		outcolour.blue += (spec_col.blue * light_intensity.blue) * spec;
+	}
+
+	return outcolour;
+}
+
+//Lighting without shadows at the hits of the camera rays of the default scene, lit by rigs of
+//coloured lights: one Light at a time with pow as before, and from the scene's light buffer
+//one light at a time and a register of lights at a time. The last two must agree to the bit;
+//the fast pow may differ from pow a little.
+static int BenchmarkShading()
+{
+	const int width = 320;
+	const int height = 240;
+	const int repeats = 5;
+	const int rigs[] = { 1, 2, 4, 8, 16, 64 };
+
+	std::mt19937 rng(777);
+	int failures = 0;
+
+	const PacketKernel* kernel = GetBestPacketKernel();
+	printf("Light kernel: %s, %d lights per register\n", kernel ? kernel->name : "none", kernel ? kernel->width : 1);
+	printf("%8s %14s %14s %14s %10s %12s %12s\n", "lights", "one by one ns", "buffer ns", "simd ns", "speedup",
+		"mismatches", "max error");
+
+	for (int rig : rigs)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+
+		std::vector<Light*>* lights = scene.GetLightList();
+		std::uniform_real_distribution<double> x(-18.0, 18.0), y(2.0, 20.0), z(-30.0, 12.0), colour(0.0, 1.0);
+
+		for (int i = 1; i < rig; i++)
+		{
+			Light* light = new Light();
+			light->SetLightPosition(x(rng), y(rng), z(rng));
+			light->SetLightColour(colour(rng) / rig, colour(rng) / rig, colour(rng) / rig);
+			lights->push_back(light);
+		}
+
+		scene.UpdateAccelerationStructure();
+
+		std::vector<Ray> cameraRays;
+		MakeCameraRays(scene, width, height, cameraRays);
+
+		std::vector<RayHitResult> surfaces;
+
+		for (size_t i = 0; i < cameraRays.size(); i++)
+		{
+			Ray ray = cameraRays[i];
+			RayHitResult result = scene.IntersectByRay(ray);
+
+			if (result.prim.IsValid())
+			{
+				surfaces.push_back(result);
+			}
+		}
+
+		Vec3 campos = scene.GetSceneCamera()->GetPosition();
+		std::vector<Colour> colours[3];
+		double seconds[3];
+
+		for (int mode = 0; mode < 3; mode++)
+		{
+			RayTracer tracer(width, height);
+			tracer.m_traceflag = RayTracer::GetPresetTraceFlag(2);
+			tracer.SetSimdShading(mode == 2);
+
+			colours[mode].resize(surfaces.size());
+			seconds[mode] = FARFAR_AWAY;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				BenchClock::time_point begin = BenchClock::now();
+
+				for (size_t i = 0; i < surfaces.size(); i++)
+				{
+					Vec3 start = campos;
+
+					colours[mode][i] = mode == 0 ? LightOneByOne(scene, campos, surfaces[i]) :
+						tracer.CalculateLighting(&scene, &start, &surfaces[i]);
+				}
+
+				seconds[mode] = std::min(seconds[mode], SecondsSince(begin));
+			}
+		}
+
+		int mismatches = 0;
+		double maxError = 0.0;
+
+		for (size_t i = 0; i < surfaces.size(); i++)
+		{
+			mismatches += memcmp(&colours[1][i], &colours[2][i], sizeof(Colour)) != 0 ? 1 : 0;
+
+			maxError = std::max(maxError, (double)fabs(colours[0][i].red - colours[2][i].red));
+			maxError = std::max(maxError, (double)fabs(colours[0][i].green - colours[2][i].green));
+			maxError = std::max(maxError, (double)fabs(colours[0][i].blue - colours[2][i].blue));
+		}
+
+		double hits = (double)surfaces.size();
+
+		printf("%8d %14.1f %14.1f %14.1f %9.1fx %12d %12.2e\n", rig, seconds[0] * 1.0e9 / hits,
+			seconds[1] * 1.0e9 / hits, seconds[2] * 1.0e9 / hits, seconds[0] / seconds[2], mismatches, maxError);
+
+		failures += mismatches;
+		failures += maxError > 1.0e-3 ? 1 : 0;
+	}
+
+	printf("ns: per hit, speedup: simd against one by one, mismatches: hits the simd kernel lights\n");
+	printf("differently from the buffer one light at a time, max error: of a channel against pow\n");
+
+	if (failures)
+	{
+		printf("FAILED: the kernels disagree or the fast pow is too far off\n");
+		return 1;
+	}
+
+	printf("Both light buffer paths give the same colours, within %.0e of pow\n", 1.0e-3);
+
+	return 0;
+}
+
+//A cloud of spheres in rigs of differently coloured materials, rendered with the wavefront
+//renderer under a few lights with the hits of each bounce shaded in ray order and sorted by
+//material. Both must give the same image. The primitives keep a 32-bit material id each
+//instead of a pointer, into a table with one record per material.
+static int BenchmarkMaterials()
+{
+	const int width = 640;
+	const int height = 480;
+	const int spheres = 16000;
+	const int rigs[] = { 1, 64, 4096 };
+
+	std::mt19937 rng(2468);
+	int failures = 0;
+
+	printf("%d spheres, %dx%d, full lighting with shadows and reflection, wavefront renderer\n", spheres, width, height);
+	printf("%10s %10s %12s %12s %10s %12s %12s\n", "materials", "table", "ray order s", "sorted s", "speedup",
+		"id bytes", "mismatches");
+
+	for (int rig : rigs)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+		scene.CleanupScene();
+
+		double extent = 10.0 * cbrt((double)spheres);
+		std::uniform_real_distribution<double> position(-extent, extent), colour(0.0, 1.0), power(4.0, 64.0);
+		std::vector<Material*> materials(rig);
+
+		for (int m = 0; m < rig; m++)
+		{
+			materials[m] = new Material();
+			materials[m]->SetAmbientColour(0.1f * (float)colour(rng), 0.1f * (float)colour(rng), 0.1f * (float)colour(rng));
+			materials[m]->SetDiffuseColour((float)colour(rng), (float)colour(rng), (float)colour(rng));
+			materials[m]->SetSpecularColour(0.5f, 0.5f, 0.5f);
+			materials[m]->SetSpecPower(power(rng));
+		}
+
+		std::uniform_int_distribution<int> pick(0, rig - 1);
+
+		for (int i = 0; i < spheres; i++)
+		{
+			Primitive* sphere = new Sphere(position(rng), position(rng), position(rng), 1.0);
+
+			//the scene takes ownership of each material once, with the first sphere given it
+			Material* mat = i < rig ? materials[i] : materials[pick(rng)];
+			scene.AddObject(sphere, i < rig ? mat : nullptr);
+			sphere->SetMaterial(mat);
+		}
+
+		scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 0.0, 1.5 * extent), Vec3(0.0, 0.0, 0.0));
+
+		for (int l = 0; l < 4; l++)
+		{
+			Light* light = new Light();
+			light->SetLightPosition((l & 1 ? 1.0 : -1.0) * extent, 2.0 * extent, (l & 2 ? 2.0 : 0.5) * extent);
+			light->SetLightColour(0.3f, 0.3f, 0.3f);
+			scene.GetLightList()->push_back(light);
+		}
+
+		scene.UpdateAccelerationStructure();
+
+		double seconds[2];
+		std::vector<float> images[2];
+
+		for (int sorted = 0; sorted < 2; sorted++)
+		{
+			RayTracer tracer(width, height);
+			tracer.m_traceflag = (RayTracer::TraceFlag)(RayTracer::GetPresetTraceFlag(3) | RayTracer::TRACE_REFLECTION);
+			tracer.SetWavefront(true);
+			tracer.SetMaterialSorting(sorted != 0);
+
+			BenchClock::time_point begin = BenchClock::now();
+			tracer.DoRayTrace(&scene);
+			seconds[sorted] = SecondsSince(begin);
+
+			const float* image = tracer.GetFramebuffer();
+			images[sorted].assign(image, image + width * height * 3);
+		}
+
+		int mismatches = 0;
+
+		for (int i = 0; i < width * height; i++)
+		{
+			mismatches += memcmp(&images[0][i * 3], &images[1][i * 3], 3 * sizeof(float)) != 0 ? 1 : 0;
+		}
+
+		int tableCount = scene.GetPrimitives().GetMaterialTable().GetCount();
+
+		printf("%10d %10d %12.3f %12.3f %9.2fx %5d of %3d %12d\n", rig, tableCount, seconds[0], seconds[1],
+			seconds[0] / seconds[1], (int)sizeof(MaterialId), (int)sizeof(Material*), mismatches);
+
+		failures += mismatches;
+		failures += tableCount != rig + 1 ? 1 : 0;
+	}
+
+	printf("table: records, the default one included, id bytes: per primitive for the material, of\n");
+	printf("the bytes of a pointer, mismatches: pixels the sorted shading colours differently\n");
+
+	if (failures)
+	{
+		printf("FAILED: the sorted image differs or the table does not hold each material once\n");
+		return 1;
+	}
+
+	printf("Shading sorted by material gives the same image\n");
+
+	return 0;
+}
+
+//A floor of square patches receding to the horizon, each with a texture of its own read from
+//a tiled file on disk, rendered in a texture cache budget far smaller than the files. Mip levels
+//picked from ray cones are compared with every texture read at full resolution, and the images
+//in small budgets, down to one that has to evict tiles, and rendered on several threads reading
+//a cold cache at once, with the one of a cache that keeps every tile it reads.
+static int BenchmarkTextures()
+{
+	const int width = 640;
+	const int height = 480;
+	const int patches = 4;				//per side of the floor
+	const int textureSize = 4096;
+	const double patchSize = 50.0;
+	const size_t budget = (size_t)64 << 20;
+	const size_t unbounded = (size_t)16 << 30;
+
+	int failures = 0;
+	std::vector<std::string> files;
+	double fileBytes = 0.0;
+
+	//a pattern with detail at every scale, in a colour of its own per texture
+	{
+		std::vector<float> rgb((size_t)textureSize * textureSize * 3);
+
+		for (int t = 0; t < patches * patches; t++)
+		{
+			float hue[3] = { 0.3f + 0.7f * (t % 3) / 2.0f, 0.3f + 0.7f * (t % 5) / 4.0f, 0.3f + 0.7f * (t % 7) / 6.0f };
+
+			for (int y = 0; y < textureSize; y++)
+			{
+				for (int x = 0; x < textureSize; x++)
+				{
+					int bits = (x ^ y) >> 2;
+					float shade = 0.25f + 0.25f * (bits & 1) + 0.25f * ((bits >> 4) & 1) + 0.25f * ((bits >> 8) & 1);
+					float* texel = &rgb[((size_t)y * textureSize + x) * 3];
+
+					texel[0] = hue[0] * shade;
+					texel[1] = hue[1] * shade;
+					texel[2] = hue[2] * shade;
+				}
+			}
+
+			char filename[64];
+			snprintf(filename, sizeof(filename), "tinyray_bench_texture%d.tex", t);
+
+			if (!SaveTexture(filename, rgb.data(), textureSize, textureSize))
+			{
+				printf("FAILED: cannot write %s\n", filename);
+				return 1;
+			}
+
+			files.push_back(filename);
+		}
+	}
+
+	printf("%d textures of %dx%d, %dx%d, full lighting with shadows\n", patches * patches, textureSize, textureSize,
+		width, height);
+	printf("  %-24s %8s %10s %12s %12s %12s %12s %12s\n", "textures", "threads", "seconds", "tiles read", "evictions",
+		"peak MB", "budget MB", "mismatches");
+
+	//every configuration starts from a cold cache in a scene of its own; the threaded ones
+	//read tiles on several threads at once while the others sample
+	const struct { const char* name; bool cones; size_t budget; int threads; } configs[] =
+	{
+		{ "mip levels, every tile", true, unbounded, 1 },
+		{ "mip levels, budget", true, budget, 1 },
+		{ "mip levels, 1 MB", true, (size_t)1 << 20, 1 },
+		{ "mip levels, 1 MB", true, (size_t)1 << 20, 4 },
+		{ "full resolution, budget", false, budget, 1 },
+		{ "full resolution, budget", false, budget, 4 },
+	};
+
+	std::vector<float> reference;
+
+	for (const auto& config : configs)
+	{
+		Scene scene;
+		scene.SetSceneWidth((Real)width / height);
+		scene.CleanupScene();
+
+		TextureCache& cache = scene.GetTextureCache();
+		cache.SetBudget(config.budget);
+
+		Light* light = new Light();
+		light->SetLightPosition(0.0, 40.0, 0.0);
+		scene.GetLightList()->push_back(light);
+
+		for (int t = 0; t < patches * patches; t++)
+		{
+			Texture* texture = cache.Open(files[t].c_str());
+
+			if (!texture)
+			{
+				printf("FAILED: cannot open %s\n", files[t].c_str());
+				return 1;
+			}
+
+			if (reference.empty())
+			{
+				fileBytes += (double)texture->GetTileCount() * TEXTURE_TILE_BYTES;
+			}
+
+			//one patch, its texture repeated twice across it
+			double x0 = (t % patches - patches / 2) * patchSize;
+			double z0 = -(t / patches) * patchSize;
+			Vec3 up(0.0, 1.0, 0.0);
+
+			TriangleMesh* mesh = new TriangleMesh();
+			mesh->AddVertex(Vec3(x0, 0.0, z0), up, 0.0, 0.0);
+			mesh->AddVertex(Vec3(x0 + patchSize, 0.0, z0), up, 2.0, 0.0);
+			mesh->AddVertex(Vec3(x0 + patchSize, 0.0, z0 - patchSize), up, 2.0, 2.0);
+			mesh->AddVertex(Vec3(x0, 0.0, z0 - patchSize), up, 0.0, 2.0);
+			mesh->AddTriangle(0, 1, 2);
+			mesh->AddTriangle(0, 2, 3);
+
+			Material* mat = new Material();
+			mat->SetDiffuseColour(0.9f, 0.9f, 0.9f);
+			mat->SetSpecularColour(0.2f, 0.2f, 0.2f);
+			mat->SetDiffuseTexture(texture);
+
+			scene.AddObject(mesh, mat);
+		}
+
+		scene.GetSceneCamera()->SetPositionAndLookAt(Vec3(0.0, 4.0, 4.0), Vec3(0.0, 0.0, -40.0));
+
+		RayTracer tracer(width, height);
+		tracer.m_traceflag = RayTracer::GetPresetTraceFlag(3);
+		tracer.SetRayCones(config.cones);
+		tracer.SetThreadCount(config.threads);
+
+		BenchClock::time_point begin = BenchClock::now();
+		tracer.DoRayTrace(&scene);
+		double seconds = SecondsSince(begin);
+
+		TextureCacheStats stats = cache.GetStats();
+		const float* image = tracer.GetFramebuffer();
+		int pixels = width * height;
+		int mismatches = 0;
+
+		//the images with mip levels must agree whatever the budget
+		if (reference.empty())
+		{
+			reference.assign(image, image + pixels * 3);
+		}
+		else if (config.cones)
+		{
+			for (int i = 0; i < pixels; i++)
+			{
+				mismatches += memcmp(&image[i * 3], &reference[i * 3], 3 * sizeof(float)) != 0 ? 1 : 0;
+			}
+		}
+
+		printf("  %-24s %8d %10.3f %12llu %12llu %12.1f %12.0f %12d\n", config.name, config.threads, seconds,
+			(unsigned long long)stats.misses, (unsigned long long)stats.evictions, stats.peakBytes / 1048576.0,
+			config.budget < unbounded ? config.budget / 1048576.0 : 0.0, mismatches);
+
+		failures += mismatches;
+		failures += stats.peakBytes <= config.budget && stats.failedReads == 0 ? 0 : 1;
+	}
+
+	for (const std::string& file : files)
+	{
+		remove(file.c_str());
+	}
+
+	printf("%.0f MB of tiles on disk, budget 0: unbounded, mismatches: pixels unlike the unbounded cache's\n",
+		fileBytes / 1048576.0);
+
+	int hardware = (int)std::thread::hardware_concurrency();
+
+	if (hardware < 4)
+	{
+		printf("Only %d hardware thread(s): the threads share them, their times show the overhead only\n", hardware);
+	}
+
+	if (failures)
+	{
+		printf("FAILED: a budget was exceeded, a tile could not be read or eviction changed the image\n");
+		return 1;
+	}
+
+	printf("The textures render in the budget with the same image as with every tile kept\n");
+
+	return 0;
+}
+
+struct BenchmarkEntry
+{
+	const char*		name;
+	const char*		description;
+	int				(*run)();
+};
+
+static const BenchmarkEntry s_benchmarks[] =
+{
+	{ "bvh", "closest hit queries through the BVH against the linear object loop", BenchmarkBVH },
+	{ "triangle", "Moller-Trumbore ray/triangle test against the legacy edge-plane test", BenchmarkTriangle },
+	{ "packet", "camera rays through the SSE/AVX2/AVX-512 packet kernels against single rays", BenchmarkPacket },
+	{ "wavefront", "full renders through the wavefront renderer against the recursive one", BenchmarkWavefront },
+	{ "mesh", "an OBJ model as one TriangleMesh against one Triangle object per face", BenchmarkMesh },
+	{ "build", "BVH build time per million triangles, on one thread and on a thread pool", BenchmarkBuild },
+	{ "refit", "animated spheres with the BVH refit against rebuilt every frame", BenchmarkRefit },
+	{ "instancing", "many placements of a mesh as Instances against a copy of the mesh per placement", BenchmarkInstancing },
+	{ "wide", "4-wide BVH nodes with float and quantised boxes against the binary BVH", BenchmarkWide },
+	{ "cache", "cold start of an OBJ model, read and built against mapped from the mesh cache", BenchmarkCache },
+	{ "accel", "single rays through the BVH, a uniform grid and a kd-tree on differently spread scenes", BenchmarkAccelerators },
+	{ "precision", "mesh triangles by Moller-Trumbore in Real against the watertight test in float", BenchmarkPrecision },
+	{ "lights", "rigs of many lights, every light against a few drawn from the light tree", BenchmarkLights },
+	{ "shading", "Blinn-Phong from the SoA light buffer with SIMD against one Light object at a time", BenchmarkShading },
+	{ "textures", "tiled mip-mapped textures in a small cache budget, mip levels from ray cones against full resolution", BenchmarkTextures },
+	{ "materials", "wavefront hits shaded sorted by material id against in ray order, over many materials", BenchmarkMaterials },
+};
+
+void PrintBenchmarkList()
+{
+	for (const BenchmarkEntry& entry : s_benchmarks)
+	{
+		printf("  %-12s %s\n", entry.name, entry.description);
+	}
+}
+
+int RunBenchmark(const char* name)
+{
+	for (const BenchmarkEntry& entry : s_benchmarks)
+	{
+		if (strcmp(entry.name, name) == 0)
+		{
+			return entry.run();
+		}
+	}
+
+	fprintf(stderr, "Unknown benchmark %s, the available ones are:\n", name);
+	PrintBenchmarkList();
+
+	return 1;
+}
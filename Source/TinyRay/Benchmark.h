@@ -0,0 +1,16 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+//Micro benchmarks and stress tests run by "tinyray --bench <name>"
+//Returns the process exit code, non zero for an unknown benchmark or a failed check
+int RunBenchmark(const char* name);
+
+void PrintBenchmarkList();
@@ -11,7 +11,7 @@
 
 Box::Box()
 {
-	SetBox(Vector4D(0.0, 0.0, 0.0), 1, 1, 1);
+	SetBox(Vec3(0.0, 0.0, 0.0), 1, 1, 1);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
 
@@ -20,19 +20,30 @@ Box::~Box()
 {
 }
 
-Box::Box(Vector4D position, double width, double height, double depth)
+Box::Box(Vec3 position, Real width, Real height, Real depth)
 {
 	SetBox(position, width, height, depth);
 	m_primtype = Primitive::PRIMTYPE_Box;
 }
 
-void Box::SetBox(Vector4D position, double width, double height, double depth)
+//The normal of the triangle v0, v1, v2, exactly as Triangle::SetTriangle computes it
+static Vec3 TriangleNormal(const Vec3& v0, const Vec3& v1, const Vec3& v2)
 {
-	double halfwidth = width*0.5;
-	double halfheight = height*0.5;
-	double halfdepth = depth*0.5;
+	Vec3 NormalA = v1 - v0;
+	Vec3 NormalB = v2 - v0;
+	Vec3 Norm = NormalA.CrossProduct(NormalB);
+	Norm.Normalise();
+
+	return Norm;
+}
+
+void Box::SetBox(Vec3 position, Real width, Real height, Real depth)
+{
+	Real halfwidth = width*0.5;
+	Real halfheight = height*0.5;
+	Real halfdepth = depth*0.5;
 	
-	Vector4D tempVerts[8];
+	Vec3 tempVerts[8];
 
 	tempVerts[0].SetVector(-halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
 	tempVerts[1].SetVector(halfwidth + position[0], -halfheight + position[1], halfdepth + position[2]);
@@ -44,48 +55,17 @@ void Box::SetBox(Vector4D position, double width, double height, double depth)
 	tempVerts[6].SetVector(halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
 	tempVerts[7].SetVector(-halfwidth + position[0], halfheight + position[1], -halfdepth + position[2]);
 
-	m_triangles[0].SetTriangle(tempVerts[0], tempVerts[1], tempVerts[2]);
-	
-	m_triangles[1].SetTriangle(tempVerts[0], tempVerts[2], tempVerts[3]);
-	
-	m_triangles[2].SetTriangle(tempVerts[1], tempVerts[6], tempVerts[2]);
-	
-	m_triangles[3].SetTriangle(tempVerts[1], tempVerts[5], tempVerts[6]);
-	
-	m_triangles[4].SetTriangle(tempVerts[0], tempVerts[3], tempVerts[7]);
-	
-	m_triangles[5].SetTriangle(tempVerts[0], tempVerts[7], tempVerts[4]);
-	
-	m_triangles[6].SetTriangle(tempVerts[4], tempVerts[7], tempVerts[6]);
-	
-	m_triangles[7].SetTriangle(tempVerts[4], tempVerts[6], tempVerts[5]);
-	
-	m_triangles[8].SetTriangle(tempVerts[3], tempVerts[6], tempVerts[7]);
-	
-	m_triangles[9].SetTriangle(tempVerts[3], tempVerts[2], tempVerts[6]);
-	
-	m_triangles[10].SetTriangle(tempVerts[0], tempVerts[4], tempVerts[5]);
-	
-	m_triangles[11].SetTriangle(tempVerts[0], tempVerts[5], tempVerts[1]);
-	
-}
-
-RayHitResult Box::IntersectByRay(Ray& ray)
-{
-	RayHitResult result = Ray::s_defaultHitResult;
+	m_bounds.Reset();
 
-	for (int i = 0; i < 12; i++)
+	for (int i = 0; i < 8; i++)
 	{
-		Primitive* prim = static_cast<Primitive*>(&m_triangles[i]);
-
-		RayHitResult tempresult = prim->IntersectByRay(ray);
-		
-		if (tempresult.t < result.t)
-		{
-			tempresult.data = this;
-			result = tempresult;
-		}
+		m_bounds.Grow(tempVerts[i]);
 	}
 
-	return result;
+	m_faceNormals[0] = TriangleNormal(tempVerts[0], tempVerts[3], tempVerts[7]);	// -x
+	m_faceNormals[1] = TriangleNormal(tempVerts[1], tempVerts[6], tempVerts[2]);	// +x
+	m_faceNormals[2] = TriangleNormal(tempVerts[0], tempVerts[4], tempVerts[5]);	// -y
+	m_faceNormals[3] = TriangleNormal(tempVerts[3], tempVerts[6], tempVerts[7]);	// +y
+	m_faceNormals[4] = TriangleNormal(tempVerts[4], tempVerts[7], tempVerts[6]);	// -z
+	m_faceNormals[5] = TriangleNormal(tempVerts[0], tempVerts[1], tempVerts[2]);	// +z
 }
@@ -9,22 +9,34 @@
 ---------------------------------------------------------------------*/
 #pragma	once
 #include "Primitive.h"
-#include "Vector4D.h"
-#include "Triangle.h"
+#include "Vec3.h"
+#include "Ray.h"
 
 class Box : public Primitive
 {
 	private:
-		Triangle m_triangles[12];
+		AABB m_bounds;
+
+		//Outward normals of the faces in the order -x, +x, -y, +y, -z, +z. They are
+		//computed like the normals of the two triangles that used to make up each face.
+		Vec3 m_faceNormals[6];
 
 	public:
 		Box();
-		Box(Vector4D position, double width, double height, double depth);
+		Box(Vec3 position, Real width, Real height, Real depth);
 		~Box();
 
-		void SetBox(Vector4D position, double width, double height, double depth);
+		void SetBox(Vec3 position, Real width, Real height, Real depth);
+
+		inline AABB GetBoundingBox()
+		{
+			return m_bounds;
+		}
 
-		RayHitResult IntersectByRay(Ray& ray);
+		inline const Vec3& GetFaceNormal(int face) const
+		{
+			return m_faceNormals[face];
+		}
 
 };
 
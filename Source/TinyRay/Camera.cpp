@@ -33,7 +33,7 @@ void Camera::InitDefaultCamera()
 	m_viewCentre = m_position + m_viewVector*m_focalLength;
 }
 
-void Camera::SetPositionAndLookAt( const Vector4D& pos, const Vector4D& lookat)
+void Camera::SetPositionAndLookAt( const Vec3& pos, const Vec3& lookat)
 {
 	m_position = pos;
 	//m_position.SetVector(0.0, 6.0, 13.0);
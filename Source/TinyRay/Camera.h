@@ -9,17 +9,17 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
-#include "Vector4D.h"
+#include "Vec3.h"
 
 class Camera
 {
 	private:
-		Vector4D				m_position;			//aka eye.
-		Vector4D				m_upVector;
-		Vector4D				m_viewVector;
-		Vector4D				m_rightVector;
-		Vector4D				m_viewCentre;		//centre of the near view plane
-		double					m_focalLength;	    //you can think of this as the distance between the eye and the near plane of the view frustum
+		Vec3				m_position;			//aka eye.
+		Vec3				m_upVector;
+		Vec3				m_viewVector;
+		Vec3				m_rightVector;
+		Vec3				m_viewCentre;		//centre of the near view plane
+		Real					m_focalLength;	    //you can think of this as the distance between the eye and the near plane of the view frustum
 
 	public:
 		
@@ -28,34 +28,34 @@ class Camera
 
 		void InitDefaultCamera();
 
-		void SetPositionAndLookAt( const Vector4D& pos, const Vector4D& lookat);
+		void SetPositionAndLookAt( const Vec3& pos, const Vec3& lookat);
 		
-		inline Vector4D&		GetPosition() 
+		inline Vec3&		GetPosition() 
 		{
 			return m_position;
 		}
 
-		inline Vector4D&		GetUpVector() 
+		inline Vec3&		GetUpVector() 
 		{
 			return m_upVector;
 		}
 
-		inline Vector4D&		GetRightVector() 
+		inline Vec3&		GetRightVector() 
 		{
 			return m_rightVector;
 		}
 
-		inline Vector4D&		GetViewVector() 
+		inline Vec3&		GetViewVector() 
 		{
 			return m_viewVector;
 		}
 
-		inline Vector4D&		GetViewCentre() 
+		inline Vec3&		GetViewCentre() 
 		{
 			return m_viewCentre;
 		}
 
-		inline double		GetFocalLength() 
+		inline Real		GetFocalLength() 
 		{
 			return m_focalLength;
 		}
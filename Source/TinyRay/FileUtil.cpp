@@ -0,0 +1,50 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "FileUtil.h"
+
+std::string MakeTempPath(const char* filename)
+{
+	static std::atomic<unsigned int> s_counter(0);
+	char suffix[64];
+
+#ifdef _WIN32
+	unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+	unsigned long pid = (unsigned long)getpid();
+#endif
+
+	snprintf(suffix, sizeof(suffix), ".%lu.%u.tmp", pid, s_counter.fetch_add(1));
+
+	return std::string(filename) + suffix;
+}
+
+bool ReplaceWithTemp(const std::string& temp, const char* filename)
+{
+#ifdef _WIN32
+	remove(filename);
+#endif
+
+	if (rename(temp.c_str(), filename) != 0)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,22 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <string>
+
+//Helpers for the caches that write a file next to its final place and move it there when done
+
+//A name next to filename that no other writer uses at the same time, of this process or another
+std::string MakeTempPath(const char* filename);
+
+//Put the finished file temp in the place of filename, temp is removed if that fails.
+//rename replaces filename at once on POSIX, so a reader finds the old file or the new one;
+//Windows will not rename over a file.
+bool ReplaceWithTemp(const std::string& temp, const char* filename);
@@ -0,0 +1,235 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <utility>
+
+#include "ImageIO.h"
+
+bool WritePPM(const char* filename, const float* rgb, int width, int height)
+{
+	FILE* fp = fopen(filename, "wb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<unsigned char> scanline(width * 3);
+
+	//PPM stores the top row first
+	for (int i = height - 1; i >= 0; i--)
+	{
+		const float* row = rgb + i * width * 3;
+
+		for (int j = 0; j < width * 3; j++)
+		{
+			float c = row[j];
+
+			if (c < 0.0f) c = 0.0f;
+			if (c > 1.0f) c = 1.0f;
+
+			scanline[j] = (unsigned char)(c * 255.0f + 0.5f);
+		}
+
+		fwrite(scanline.data(), 1, scanline.size(), fp);
+	}
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+
+	return ok;
+}
+
+bool WritePFM(const char* filename, const float* rgb, int width, int height)
+{
+	FILE* fp = fopen(filename, "wb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	//a negative scale marks the data as little endian
+	unsigned int probe = 1;
+	bool littleEndian = *(unsigned char*)&probe == 1;
+
+	fprintf(fp, "PF\n%d %d\n%s\n", width, height, littleEndian ? "-1.0" : "1.0");
+
+	//PFM stores the bottom row first, which is the order of the framebuffer
+	fwrite(rgb, sizeof(float), width * height * 3, fp);
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+
+	return ok;
+}
+
+bool WriteImage(const char* filename, const float* rgb, int width, int height)
+{
+	const char* ext = strrchr(filename, '.');
+
+	if (ext && (strcmp(ext, ".pfm") == 0 || strcmp(ext, ".PFM") == 0))
+	{
+		return WritePFM(filename, rgb, width, height);
+	}
+
+	return WritePPM(filename, rgb, width, height);
+}
+
+//The next number of a PNM header, skipping white space and comments
+static bool ReadHeaderNumber(FILE* fp, double& value)
+{
+	int ch = fgetc(fp);
+
+	while (ch == '#' || ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+	{
+		if (ch == '#')
+		{
+			while (ch != '\n' && ch != EOF)
+			{
+				ch = fgetc(fp);
+			}
+		}
+
+		ch = fgetc(fp);
+	}
+
+	if (ch == EOF)
+	{
+		return false;
+	}
+
+	ungetc(ch, fp);
+
+	return fscanf(fp, "%lf", &value) == 1;
+}
+
+bool ReadPPM(const char* filename, std::vector<float>& rgb, int& width, int& height)
+{
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	char magic[2];
+	double w, h, maxValue;
+
+	//a single white space character separates the header from the pixels
+	if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' || magic[1] != '6' || !ReadHeaderNumber(fp, w) ||
+		!ReadHeaderNumber(fp, h) || !ReadHeaderNumber(fp, maxValue) || w < 1.0 || h < 1.0 || maxValue < 1.0 ||
+		maxValue > 65535.0 || fgetc(fp) == EOF)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	width = (int)w;
+	height = (int)h;
+
+	int bytes = maxValue > 255.0 ? 2 : 1;
+	std::vector<unsigned char> scanline((size_t)width * 3 * bytes);
+	rgb.resize((size_t)width * height * 3);
+
+	bool ok = true;
+
+	//PPM stores the top row first
+	for (int i = height - 1; i >= 0 && ok; i--)
+	{
+		float* row = &rgb[(size_t)i * width * 3];
+		ok = fread(scanline.data(), 1, scanline.size(), fp) == scanline.size();
+
+		for (int j = 0; j < width * 3 && ok; j++)
+		{
+			//16-bit values are big endian
+			int value = bytes == 2 ? scanline[j * 2] << 8 | scanline[j * 2 + 1] : scanline[j];
+			row[j] = (float)(value / maxValue);
+		}
+	}
+
+	fclose(fp);
+
+	return ok;
+}
+
+bool ReadPFM(const char* filename, std::vector<float>& rgb, int& width, int& height)
+{
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	char magic[2];
+	double w, h, scale;
+
+	if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' || (magic[1] != 'F' && magic[1] != 'f') ||
+		!ReadHeaderNumber(fp, w) || !ReadHeaderNumber(fp, h) || !ReadHeaderNumber(fp, scale) || w < 1.0 ||
+		h < 1.0 || fgetc(fp) == EOF)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	width = (int)w;
+	height = (int)h;
+
+	int channels = magic[1] == 'F' ? 3 : 1;
+	size_t count = (size_t)width * height * channels;
+	std::vector<float> data(count);
+
+	bool ok = fread(data.data(), sizeof(float), count, fp) == count;
+	fclose(fp);
+
+	//a negative scale marks the data as little endian
+	unsigned int probe = 1;
+	bool littleEndian = *(unsigned char*)&probe == 1;
+
+	if (ok && (scale < 0.0) != littleEndian)
+	{
+		for (float& value : data)
+		{
+			unsigned char* b = (unsigned char*)&value;
+			std::swap(b[0], b[3]);
+			std::swap(b[1], b[2]);
+		}
+	}
+
+	//PFM stores the bottom row first, which is the order of the framebuffer
+	rgb.resize((size_t)width * height * 3);
+
+	for (size_t i = 0; i < (size_t)width * height && ok; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			rgb[i * 3 + c] = data[i * channels + (channels == 3 ? c : 0)];
+		}
+	}
+
+	return ok;
+}
+
+bool ReadImage(const char* filename, std::vector<float>& rgb, int& width, int& height)
+{
+	const char* ext = strrchr(filename, '.');
+
+	if (ext && (strcmp(ext, ".pfm") == 0 || strcmp(ext, ".PFM") == 0))
+	{
+		return ReadPFM(filename, rgb, width, height);
+	}
+
+	return ReadPPM(filename, rgb, width, height);
+}
@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+//Helpers for writing a float RGB framebuffer to disk and reading images back in that layout
+//The pixels are expected in OpenGL order, i.e. the first row is the bottom row of the image
+
+//8 bit binary PPM (P6), colours are clamped to [0, 1]
+bool WritePPM(const char* filename, const float* rgb, int width, int height);
+
+//32 bit binary PFM (PF), the colours are written unclamped
+bool WritePFM(const char* filename, const float* rgb, int width, int height);
+
+//Pick the writer from the file extension, .pfm is a PFM and anything else a PPM
+bool WriteImage(const char* filename, const float* rgb, int width, int height);
+
+//Binary PPM (P6) of up to 16 bits per channel, scaled to [0, 1]
+bool ReadPPM(const char* filename, std::vector<float>& rgb, int& width, int& height);
+
+//Colour or greyscale PFM (PF or Pf) of either byte order, greyscale is spread over the channels
+bool ReadPFM(const char* filename, std::vector<float>& rgb, int& width, int& height);
+
+//Pick the reader from the file extension like WriteImage
+bool ReadImage(const char* filename, std::vector<float>& rgb, int& width, int& height);
@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "Instance.h"
+
+Instance::Instance(TriangleMesh* mesh, const Transform& objectToWorld)
+{
+	m_mesh = mesh;
+	m_primtype = PRIMTYPE_Instance;
+
+	SetTransform(objectToWorld);
+}
+
+Instance::~Instance()
+{
+}
+
+void Instance::SetTransform(const Transform& objectToWorld)
+{
+	m_objectToWorld = objectToWorld;
+	m_worldToObject = objectToWorld.Inverse();
+}
+
+AABB Instance::GetBoundingBox()
+{
+	return m_objectToWorld.TransformBox(m_mesh->GetBoundingBox());
+}
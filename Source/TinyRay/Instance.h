@@ -0,0 +1,54 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Primitive.h"
+#include "Transform.h"
+#include "TriangleMesh.h"
+
+//A placement of a shared TriangleMesh: the mesh and a transform from its object space into the
+//world. Any number of instances can reference one mesh, which is stored and has its BVH built
+//only once, so a scene costs memory for its unique geometry plus a few hundred bytes per
+//placement. The scene's BVH is the top level over the instances and every mesh's own BVH the
+//bottom level; rays are taken into object space on their way from one level to the other.
+//
+//The mesh is not owned by the instance, hand it to Scene::AddGeometry to have the scene delete it.
+class Instance : public Primitive
+{
+	private:
+		TriangleMesh*		m_mesh;
+		Transform			m_objectToWorld;
+		Transform			m_worldToObject;		//its inverse
+
+	public:
+		Instance(TriangleMesh* mesh, const Transform& objectToWorld);
+		~Instance();
+
+		//Move the instance. Call Scene::UpdateObject() afterwards if it is already in a scene.
+		void SetTransform(const Transform& objectToWorld);
+
+		inline TriangleMesh* GetMesh()
+		{
+			return m_mesh;
+		}
+
+		inline const Transform& GetTransform() const
+		{
+			return m_objectToWorld;
+		}
+
+		inline const Transform& GetInverseTransform() const
+		{
+			return m_worldToObject;
+		}
+
+		//The world space bounds of the mesh's bounding box, the mesh has to be built
+		AABB GetBoundingBox();
+};
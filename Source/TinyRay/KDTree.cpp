@@ -0,0 +1,366 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "KDTree.h"
+#include "Material.h"
+
+//Relative costs of a step through a node and of testing an item, for the surface area
+//heuristic, and the share of the item tests that a split cutting off empty space is credited
+#define KDTREE_TRAVERSAL_COST		1.0
+#define KDTREE_INTERSECTION_COST	1.5
+#define KDTREE_EMPTY_BONUS			0.5
+
+//Nodes of this many items or fewer are leaves
+#define KDTREE_LEAF_SIZE			1
+
+//Splits that cost more than the leaf they replace are allowed this many times along a path
+//down the tree, in case a better one follows
+#define KDTREE_BAD_REFINES			3
+
+//A side of an item's box along the axis being split
+struct KDTree::Edge
+{
+	Real	t;
+	int		item;
+	bool	end;			//the upper side, sorted after a lower side at the same position
+
+	inline bool operator < (const Edge& rhs) const
+	{
+		return t < rhs.t || (t == rhs.t && !end && rhs.end);
+	}
+};
+
+KDTree::KDTree()
+{
+	m_bounds.Reset();
+	m_maxDepth = 0;
+	m_seconds = 0.0;
+}
+
+void KDTree::Build(const std::vector<AABB>& bounds, ThreadPool*)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<int> items;
+	std::vector<Edge> edges;
+
+	m_nodes.clear();
+	m_items.clear();
+	m_bounds.Reset();
+	m_maxDepth = 0;
+
+	for (int item = 0; item < (int)bounds.size(); item++)
+	{
+		if (!bounds[item].IsEmpty())
+		{
+			m_bounds.Grow(bounds[item]);
+			items.push_back(item);
+		}
+	}
+
+	if (!items.empty())
+	{
+		//the usual depth limit for n items, 8 + 1.3 log2(n)
+		int maxDepth = (int)(8.0 + 1.3 * log2((double)items.size()) + 0.5);
+
+		edges.reserve(items.size() * 2);
+		BuildNode(bounds, m_bounds, items, 1, maxDepth < KDTREE_MAX_DEPTH ? maxDepth : KDTREE_MAX_DEPTH, 0, edges);
+	}
+
+	m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void KDTree::BuildNode(const std::vector<AABB>& bounds, const AABB& box, std::vector<int>& items, int depth,
+	int maxDepth, int badRefines, std::vector<Edge>& edges)
+{
+	int nodeIndex = (int)m_nodes.size();
+	int count = (int)items.size();
+
+	m_nodes.push_back(KDNode());
+
+	//the best split among the sides of the boxes on all three axes
+	double leafCost = KDTREE_INTERSECTION_COST * count;
+	double bestCost = leafCost;
+	int bestAxis = -1;
+	Real bestSplit = 0.0;
+
+	Real extent[3] = { box.max[0] - box.min[0], box.max[1] - box.min[1], box.max[2] - box.min[2] };
+	Real area = box.SurfaceArea();
+
+	if (count > KDTREE_LEAF_SIZE && depth < maxDepth && area > 0.0)
+	{
+		bestCost = 1e300;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int a1 = (axis + 1) % 3;
+			int a2 = (axis + 2) % 3;
+			Real capArea = extent[a1] * extent[a2];
+			Real sideLength = extent[a1] + extent[a2];
+
+			edges.clear();
+
+			for (int item : items)
+			{
+				Edge lower = { bounds[item].min[axis], item, false };
+				Edge upper = { bounds[item].max[axis], item, true };
+
+				edges.push_back(lower);
+				edges.push_back(upper);
+			}
+
+			std::sort(edges.begin(), edges.end());
+
+			//sweep the planes from below: the items below have their lower side behind the
+			//plane, those above their upper side ahead of it
+			int below = 0;
+			int above = count;
+
+			for (const Edge& edge : edges)
+			{
+				if (edge.end)
+				{
+					above--;
+				}
+
+				if (edge.t > box.min[axis] && edge.t < box.max[axis])
+				{
+					Real belowArea = 2 * (capArea + (edge.t - box.min[axis]) * sideLength);
+					Real aboveArea = 2 * (capArea + (box.max[axis] - edge.t) * sideLength);
+					double bonus = below == 0 || above == 0 ? KDTREE_EMPTY_BONUS : 0.0;
+					double cost = KDTREE_TRAVERSAL_COST + KDTREE_INTERSECTION_COST * (1.0 - bonus) *
+						(belowArea * below + aboveArea * above) / area;
+
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = edge.t;
+					}
+				}
+
+				if (!edge.end)
+				{
+					below++;
+				}
+			}
+		}
+
+		if (bestCost > leafCost)
+		{
+			badRefines++;
+		}
+	}
+
+	if (bestAxis < 0 || badRefines > KDTREE_BAD_REFINES || (bestCost > 4.0 * leafCost && count < 16))
+	{
+		KDNode& leaf = m_nodes[nodeIndex];
+
+		leaf.split = 0.0;
+		leaf.axis = KDTREE_LEAF;
+		leaf.index = (int)m_items.size();
+		leaf.count = count;
+		m_items.insert(m_items.end(), items.begin(), items.end());
+		m_maxDepth = depth > m_maxDepth ? depth : m_maxDepth;
+
+		return;
+	}
+
+	//an item goes to the side its box reaches into, a box flat in the plane to both
+	std::vector<int> belowItems, aboveItems;
+
+	for (int item : items)
+	{
+		const AABB& b = bounds[item];
+		bool flat = b.min[bestAxis] == bestSplit && b.max[bestAxis] == bestSplit;
+
+		if (b.min[bestAxis] < bestSplit || flat)
+		{
+			belowItems.push_back(item);
+		}
+
+		if (b.max[bestAxis] > bestSplit || flat)
+		{
+			aboveItems.push_back(item);
+		}
+	}
+
+	std::vector<int>().swap(items);
+
+	AABB belowBox = box;
+	AABB aboveBox = box;
+
+	belowBox.max[bestAxis] = bestSplit;
+	aboveBox.min[bestAxis] = bestSplit;
+
+	m_nodes[nodeIndex].split = bestSplit;
+	m_nodes[nodeIndex].axis = bestAxis;
+	m_nodes[nodeIndex].count = 0;
+
+	BuildNode(bounds, belowBox, belowItems, depth + 1, maxDepth, badRefines, edges);
+	m_nodes[nodeIndex].index = (int)m_nodes.size();
+	BuildNode(bounds, aboveBox, aboveItems, depth + 1, maxDepth, badRefines, edges);
+}
+
+template<typename LeafFunc>
+void KDTree::Walk(Ray& ray, const Real& tmax, LeafFunc visitLeaf) const
+{
+	struct StackEntry
+	{
+		int		node;
+		Real	t0, t1;
+	};
+
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	const Vec3& start = ray.GetRayStart();
+	const Vec3& dir = ray.GetRay();
+	const Vec3& invdir = ray.GetInvRay();
+
+	//the part of the ray inside the tree's box, as AABB::IntersectByRay finds it but with the exit too
+	Real t0 = ray.GetTMin();
+	Real t1 = tmax;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real tnear = (m_bounds.min[axis] - start[axis]) * invdir[axis];
+		Real tfar = (m_bounds.max[axis] - start[axis]) * invdir[axis];
+
+		if (tnear > tfar)
+		{
+			Real tmp = tnear;
+			tnear = tfar;
+			tfar = tmp;
+		}
+
+		t0 = tnear > t0 ? tnear : t0;
+		t1 = tfar < t1 ? tfar : t1;
+	}
+
+	if (t0 > t1)
+	{
+		return;
+	}
+
+	StackEntry stack[KDTREE_MAX_DEPTH];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true)
+	{
+		//every node from here on lies beyond the closest hit
+		if (tmax < t0)
+		{
+			return;
+		}
+
+		const KDNode& node = m_nodes[nodeIndex];
+
+		if (node.axis == KDTREE_LEAF)
+		{
+			if (node.count > 0 && visitLeaf(node.index, node.count))
+			{
+				return;
+			}
+
+			if (stackSize == 0)
+			{
+				return;
+			}
+
+			stackSize--;
+			nodeIndex = stack[stackSize].node;
+			t0 = stack[stackSize].t0;
+			t1 = stack[stackSize].t1;
+
+			continue;
+		}
+
+		//the child on the ray's side of the plane comes first; a NaN distance, from a ray lying
+		//in the plane, fails every test below and visits both
+		int axis = node.axis;
+		Real tsplit = (node.split - start[axis]) * invdir[axis];
+		bool belowFirst = start[axis] < node.split || (start[axis] == node.split && dir[axis] <= 0.0);
+		int first = belowFirst ? nodeIndex + 1 : node.index;
+		int second = belowFirst ? node.index : nodeIndex + 1;
+
+		if (tsplit > t1 || tsplit <= 0.0)
+		{
+			nodeIndex = first;
+		}
+		else if (tsplit < t0)
+		{
+			nodeIndex = second;
+		}
+		else
+		{
+			stack[stackSize].node = second;
+			stack[stackSize].t0 = tsplit;
+			stack[stackSize].t1 = t1;
+			stackSize++;
+
+			nodeIndex = first;
+			t1 = tsplit;
+		}
+	}
+}
+
+void KDTree::Intersect(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+	RayHit& hit) const
+{
+	RayMailbox mailbox;
+
+	Walk(ray, hit.t, [this, &store, &items, &ray, &hit, &mailbox](int first, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int item = m_items[first + i];
+
+			if (!mailbox.TestedBefore(item))
+			{
+				store.Intersect(items[item], ray, hit);
+			}
+		}
+
+		return false;
+	});
+}
+
+bool KDTree::Occluded(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+	Real maxDistance) const
+{
+	RayMailbox mailbox;
+	bool blocked = false;
+
+	Walk(ray, maxDistance, [this, &store, &items, &ray, maxDistance, &mailbox, &blocked](int first, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int item = m_items[first + i];
+			PrimHandle prim = items[item];
+
+			if (!mailbox.TestedBefore(item) && store.GetMaterial(prim).castShadow &&
+				store.Occludes(prim, ray, maxDistance))
+			{
+				blocked = true;
+				return true;
+			}
+		}
+
+		return false;
+	});
+
+	return blocked;
+}
@@ -0,0 +1,99 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "Accelerator.h"
+
+//Deepest a tree gets, whatever the number of items
+#define KDTREE_MAX_DEPTH	64
+
+//The axis of a leaf
+#define KDTREE_LEAF			3
+
+struct KDNode
+{
+	Real		split;			//interior: position of the splitting plane
+	int			axis;			//interior: the axis the plane is normal to; KDTREE_LEAF for a leaf
+	int			index;			//interior: the child above the plane, the one below follows the node; leaf: first entry in the item list
+	int			count;			//number of items in a leaf
+};
+
+//A kd-tree over the boxes of the items: every node splits its space in two by an axis aligned
+//plane, chosen with the surface area heuristic among the sides of the boxes, and an item
+//overlapping both halves goes into both. Unlike a BVH the children do not overlap, so a ray
+//visits the leaves in order along its length and stops at the first one that holds a hit
+//within it, and empty space is cut off in large slabs. The price is the items that appear in
+//several leaves, which a ray is kept from testing twice by a RayMailbox.
+class KDTree : public Accelerator
+{
+	private:
+		struct Edge;
+
+		std::vector<KDNode>	m_nodes;			//m_nodes[0] is the root
+		std::vector<int>	m_items;			//item indices, every leaf owns a contiguous range
+		AABB				m_bounds;
+		int					m_maxDepth;			//of a leaf in the last build, the root is at depth 1
+		double				m_seconds;
+
+		//Make node m_nodes.size() at depth over items, which it empties
+		void BuildNode(const std::vector<AABB>& bounds, const AABB& box, std::vector<int>& items, int depth,
+			int maxDepth, int badRefines, std::vector<Edge>& edges);
+
+		//Walk the leaves the ray passes within tmax, front to back. visitLeaf(first, count) tests
+		//the items m_items[first] to [first + count) and returns true to stop the walk; tmax is
+		//read again after every leaf so that a closer hit shortens it.
+		template<typename LeafFunc>
+		void Walk(Ray& ray, const Real& tmax, LeafFunc visitLeaf) const;
+
+	public:
+		KDTree();
+
+		inline const char* GetName() const
+		{
+			return "kdtree";
+		}
+
+		//Built on the calling thread, pool is not used
+		void Build(const std::vector<AABB>& bounds, ThreadPool* pool = nullptr);
+
+		void Intersect(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			RayHit& hit) const;
+
+		bool Occluded(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			Real maxDistance) const;
+
+		inline double GetBuildSeconds() const
+		{
+			return m_seconds;
+		}
+
+		inline size_t GetMemoryUsage() const
+		{
+			return m_nodes.capacity() * sizeof(KDNode) + m_items.capacity() * sizeof(int);
+		}
+
+		inline int GetNodeCount() const
+		{
+			return (int)m_nodes.size();
+		}
+
+		inline int GetMaxDepth() const
+		{
+			return m_maxDepth;
+		}
+
+		//Entries in the leaves, more than the items by those that were split
+		inline int GetItemReferences() const
+		{
+			return (int)m_items.size();
+		}
+};
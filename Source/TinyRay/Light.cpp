@@ -27,14 +27,14 @@ void Light::InitDefaultLight()
 	SetLightPosition(0.0, 20.0, 0.0);
 }
 
-void Light::SetLightColour(double r, double g, double b)
+void Light::SetLightColour(Real r, Real g, Real b)
 {
 	m_colour.red = r;
 	m_colour.green = g;
 	m_colour.blue = b;
 }
 
-void Light::SetLightPosition(double x, double y, double z)
+void Light::SetLightPosition(Real x, Real y, Real z)
 {
 	m_position.SetVector(x, y, z);
 }
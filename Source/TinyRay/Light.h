@@ -9,13 +9,13 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
-#include "Vector4D.h"
+#include "Vec3.h"
 #include "Material.h"
 
 class Light
 {
 	private:
-		Vector4D			m_position;
+		Vec3			m_position;
 		Colour			m_colour;
 
 	public:
@@ -23,10 +23,10 @@ class Light
 		~Light();
 
 		void InitDefaultLight();
-		void SetLightPosition(double x, double y, double z);
-		void SetLightColour(double r, double g, double b);
+		void SetLightPosition(Real x, Real y, Real z);
+		void SetLightColour(Real r, Real g, Real b);
 
-		inline Vector4D& GetLightPosition()
+		inline Vec3& GetLightPosition()
 		{
 			return m_position;
 		}
@@ -0,0 +1,143 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "Light.h"
+
+//The arrays of a LightBuffer and a LightTerms are padded to a multiple of this, the most
+//lanes a SIMD kernel reads at once
+#define LIGHT_BUFFER_LANES	16
+
+//The positions and colours of lights in structure of arrays layout, for the shading kernels to
+//read a register of lights at a time. Past count the arrays hold black lights at the origin.
+struct LightBuffer
+{
+	std::vector<Real>	x, y, z;			//positions
+	std::vector<float>	red, green, blue;	//colours
+	int					count;
+
+	LightBuffer()
+	{
+		count = 0;
+	}
+
+	//The lights, in order
+	inline void Build(const std::vector<Light*>& lights)
+	{
+		Clear();
+
+		for (Light* light : lights)
+		{
+			Push(light->GetLightPosition(), light->GetLightColour());
+		}
+
+		Pad();
+	}
+
+	//Empty the buffer, the arrays keep their capacity
+	inline void Clear()
+	{
+		count = 0;
+	}
+
+	inline void Push(const Vec3& position, const Colour& colour)
+	{
+		if (count == (int)x.size())
+		{
+			Grow(count > 0 ? count * 2 : LIGHT_BUFFER_LANES);
+		}
+
+		x[count] = position[0]; y[count] = position[1]; z[count] = position[2];
+		red[count] = colour.red; green[count] = colour.green; blue[count] = colour.blue;
+		count++;
+	}
+
+	//Fill the arrays with black lights up to the next multiple of LIGHT_BUFFER_LANES, after the last Push
+	inline void Pad()
+	{
+		int padded = (count + LIGHT_BUFFER_LANES - 1) / LIGHT_BUFFER_LANES * LIGHT_BUFFER_LANES;
+
+		if (padded > (int)x.size())
+		{
+			Grow(padded);
+		}
+
+		for (int i = count; i < padded; i++)
+		{
+			x[i] = y[i] = z[i] = 0.0;
+			red[i] = green[i] = blue[i] = 0.0f;
+		}
+	}
+
+	//The three position arrays in the order x, y, z
+	inline void GetPositions(const Real* arrays[3]) const
+	{
+		arrays[0] = x.data();
+		arrays[1] = y.data();
+		arrays[2] = z.data();
+	}
+
+	private:
+		void Grow(int size)
+		{
+			x.resize(size); y.resize(size); z.resize(size);
+			red.resize(size); green.resize(size); blue.resize(size);
+		}
+};
+
+//What the shading kernels need to know of a hit point: where it is, its normal, the unit
+//vector towards the viewer and the specular exponent split into its integer part and the rest
+struct ShadingPoint
+{
+	Real	point[3];
+	Real	normal[3];
+	Real	view[3];
+	int		power;
+	Real	fraction;
+};
+
+//The parts of Blinn-Phong at one hit point that depend on where each light is, one entry per
+//light of a LightBuffer, padded like it
+struct LightTerms
+{
+	std::vector<Real>	distance;			//to the light
+	std::vector<Real>	dx, dy, dz;			//unit vector towards the light
+	std::vector<Real>	diffuse;			//max(0, cos) of the normal and that vector
+	std::vector<Real>	specular;			//of the half vector, see FastPow; 0 behind the surface
+
+	//Room for count lights
+	inline void Reserve(int count)
+	{
+		size_t padded = (count + LIGHT_BUFFER_LANES - 1) / LIGHT_BUFFER_LANES * LIGHT_BUFFER_LANES;
+
+		if (padded > distance.size())
+		{
+			std::vector<Real>* arrays[6] = { &distance, &dx, &dy, &dz, &diffuse, &specular };
+
+			for (int i = 0; i < 6; i++)
+			{
+				arrays[i]->resize(padded);
+			}
+		}
+	}
+
+	//The six arrays in the order distance, dx, dy, dz, diffuse, specular
+	inline void GetArrays(Real* arrays[6])
+	{
+		std::vector<Real>* components[6] = { &distance, &dx, &dy, &dz, &diffuse, &specular };
+
+		for (int i = 0; i < 6; i++)
+		{
+			arrays[i] = components[i]->data();
+		}
+	}
+};
@@ -0,0 +1,203 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <algorithm>
+
+#include "LightTree.h"
+
+//A random number in [0, 1) for every value of x, the finaliser of splitmix64
+static inline Real RandomUnit(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	x ^= x >> 31;
+
+	return (Real)((x >> 11) * (1.0 / 9007199254740992.0));
+}
+
+void LightTree::Build(const std::vector<Light*>& lights)
+{
+	m_nodes.clear();
+
+	if (lights.empty())
+	{
+		return;
+	}
+
+	std::vector<int> order(lights.size());
+
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		order[i] = (int)i;
+	}
+
+	m_nodes.reserve(lights.size() * 2 - 1);
+	m_nodes.push_back(LightTreeNode());
+	BuildNode(0, lights, order.data(), (int)order.size());
+}
+
+void LightTree::Clear()
+{
+	m_nodes.clear();
+}
+
+void LightTree::BuildNode(int index, const std::vector<Light*>& lights, int* order, int count)
+{
+	if (count == 1)
+	{
+		Light* light = lights[order[0]];
+		const Colour& colour = light->GetLightColour();
+		LightTreeNode& leaf = m_nodes[index];
+
+		leaf.bounds.min = leaf.bounds.max = light->GetLightPosition();
+		leaf.power = (colour.red + colour.green + colour.blue) / 3.0f;
+		leaf.leftFirst = order[0];
+		leaf.count = 1;
+
+		return;
+	}
+
+	AABB bounds;
+	bounds.min = bounds.max = lights[order[0]]->GetLightPosition();
+
+	for (int i = 1; i < count; i++)
+	{
+		const Vec3& position = lights[order[i]]->GetLightPosition();
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bounds.min[axis] = std::min(bounds.min[axis], position[axis]);
+			bounds.max[axis] = std::max(bounds.max[axis], position[axis]);
+		}
+	}
+
+	//halve the lights at the median of the longest axis
+	Vec3 extent = bounds.max - bounds.min;
+	int axis = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2) : (extent[1] > extent[2] ? 1 : 2);
+	int half = count / 2;
+
+	std::nth_element(order, order + half, order + count, [&lights, axis](int a, int b)
+	{
+		return lights[a]->GetLightPosition()[axis] < lights[b]->GetLightPosition()[axis];
+	});
+
+	//the two children are placed together, then filled
+	int left = (int)m_nodes.size();
+	m_nodes.push_back(LightTreeNode());
+	m_nodes.push_back(LightTreeNode());
+
+	BuildNode(left, lights, order, half);
+	BuildNode(left + 1, lights, order + half, count - half);
+
+	LightTreeNode& node = m_nodes[index];
+	node.bounds = bounds;
+	node.power = m_nodes[left].power + m_nodes[left + 1].power;
+	node.leftFirst = left;
+	node.count = 0;
+}
+
+Real LightTree::Importance(const LightTreeNode& node, const Vec3& point, const Vec3& normal)
+{
+	if (node.power <= 0.0f)
+	{
+		return 0.0;
+	}
+
+	//the cone from point around the box's bounding sphere; the normal can be as close to any
+	//direction in it as its axis minus its half angle
+	Vec3 centre = (node.bounds.min + node.bounds.max) * 0.5;
+	Vec3 toCentre = centre - point;
+	Real distance2 = toCentre.DotProduct(toCentre);
+	Vec3 halfExtent = node.bounds.max - centre;
+	Real radius2 = halfExtent.DotProduct(halfExtent);
+
+	if (distance2 <= radius2)
+	{
+		return node.power;
+	}
+
+	Real distance = sqrt(distance2);
+	Real cosAxis = normal.DotProduct(toCentre) / distance;
+	Real sinHalf2 = radius2 / distance2;
+	Real cosHalf = sqrt(1.0 - sinHalf2);
+
+	if (cosAxis >= cosHalf)
+	{
+		return node.power;
+	}
+
+	//cos(axis - half) = cos(axis) cos(half) + sin(axis) sin(half)
+	Real sinAxis = sqrt(std::max((Real)0.0, (Real)1.0 - cosAxis * cosAxis));
+	Real cosBound = cosAxis * cosHalf + sinAxis * sqrt(sinHalf2);
+
+	return cosBound > 0.0 ? node.power * cosBound : 0.0;
+}
+
+int LightTree::Sample(const Vec3& point, const Vec3& normal, int count, uint64_t seed, LightSample* samples) const
+{
+	if (m_nodes.empty())
+	{
+		return 0;
+	}
+
+	count = std::min(count, LIGHT_TREE_MAX_SAMPLES);
+
+	int drawn = 0;
+
+	for (int s = 0; s < count; s++)
+	{
+		//one number picks the whole path: whatever is left of it after a choice is rescaled
+		//to [0, 1) and picks the next
+		Real u = RandomUnit(seed + s);
+		Real probability = 1.0;
+		int index = 0;
+
+		while (m_nodes[index].count == 0)
+		{
+			int left = m_nodes[index].leftFirst;
+			Real importanceLeft = Importance(m_nodes[left], point, normal);
+			Real importanceRight = Importance(m_nodes[left + 1], point, normal);
+			Real total = importanceLeft + importanceRight;
+
+			if (total <= 0.0)
+			{
+				index = -1;
+				break;
+			}
+
+			Real pLeft = importanceLeft / total;
+
+			if (u < pLeft)
+			{
+				u = u / pLeft;
+				probability *= pLeft;
+				index = left;
+			}
+			else
+			{
+				u = (u - pLeft) / (1.0 - pLeft);
+				probability *= 1.0 - pLeft;
+				index = left + 1;
+			}
+
+			u = std::min(u, (Real)0.99999994);
+		}
+
+		if (index >= 0 && Importance(m_nodes[index], point, normal) > 0.0)
+		{
+			samples[drawn].light = m_nodes[index].leftFirst;
+			samples[drawn].weight = (Real)1.0 / (probability * count);
+			drawn++;
+		}
+	}
+
+	return drawn;
+}
@@ -0,0 +1,96 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "AABB.h"
+#include "Light.h"
+
+//Most lights a shading point can be given by LightTree::Sample
+#define LIGHT_TREE_MAX_SAMPLES	64
+
+struct LightTreeNode
+{
+	AABB		bounds;			//of the positions of the lights below
+	float		power;			//sum of their mean colour
+	int			leftFirst;		//interior: index of the left child, the right child follows it; leaf: the light
+	int			count;			//1 for a leaf, 0 for an interior node
+};
+
+//A light chosen for a shading point, and its weight: one over the probability it was chosen
+//with times the number of lights chosen, so the weighted sum over the chosen lights estimates
+//the sum over all of them without bias
+struct LightSample
+{
+	int			light;
+	Real		weight;
+};
+
+//The lights a shading point is lit by: every light of the scene with weight 1, or a few
+//samples drawn from the light tree
+struct LightSelection
+{
+	int			count;
+	bool		sampled;
+	LightSample	samples[LIGHT_TREE_MAX_SAMPLES];
+
+	inline int GetLight(int slot) const
+	{
+		return sampled ? samples[slot].light : slot;
+	}
+
+	inline Real GetWeight(int slot) const
+	{
+		return sampled ? samples[slot].weight : (Real)1.0;
+	}
+};
+
+//A binary tree over the point lights of a scene that picks lights for a shading point in
+//proportion to how much they can contribute there. A node's importance is its power times a
+//bound on the cosine between the surface normal and any direction into its box, so a cluster
+//of lights behind the surface is never chosen and one straight above it is chosen the most.
+//The shading gives such lights no specular term either, so the estimate is unbiased.
+//The lights of the tracer do not fall off with distance, so distance only enters through the
+//angle the box spans. Drawing a light costs time in the depth of the tree, not in the number
+//of lights.
+class LightTree
+{
+	private:
+		std::vector<LightTreeNode>	m_nodes;		//node 0 is the root
+
+		//Fill node index with the count lights in order, which it reorders
+		void BuildNode(int index, const std::vector<Light*>& lights, int* order, int count);
+
+		//Power times the cosine bound of node at point with normal
+		static Real Importance(const LightTreeNode& node, const Vec3& point, const Vec3& normal);
+
+	public:
+		//Build the tree over lights, an empty tree if there are none
+		void Build(const std::vector<Light*>& lights);
+
+		void Clear();
+
+		inline bool IsEmpty() const
+		{
+			return m_nodes.empty();
+		}
+
+		inline int GetNodeCount() const
+		{
+			return (int)m_nodes.size();
+		}
+
+		//Draw count lights, at most LIGHT_TREE_MAX_SAMPLES, for the surface at point with normal
+		//into samples, each by walking down from the root with one random number from seed.
+		//Returns how many were drawn, fewer than count where no light can reach the surface.
+		int Sample(const Vec3& point, const Vec3& normal, int count, uint64_t seed, LightSample* samples) const;
+};
@@ -32,6 +32,8 @@ void Material::SetDefaultMaterial()
 	SetSpecularColour(1.0, 1.0, 1.0);
 	SetSpecPower(10.0);
 	m_castShadow = true;
+	m_diffuseMap = nullptr;
+	m_specularMap = nullptr;
 }
 
 void Material::SetAmbientColour(float r, float g, float b)
@@ -59,3 +61,57 @@ void Material::SetSpecPower(double spow)
 {
 	m_specpower = spow;
 }
+
+//A record of the parameters of mat
+static MaterialRecord MakeRecord(Material& mat)
+{
+	MaterialRecord record;
+
+	record.ambient = mat.GetAmbientColour();
+	record.diffuse = mat.GetDiffuseColour();
+	record.specular = mat.GetSpecularColour();
+	record.specPower = mat.GetSpecPower();
+	record.castShadow = mat.CastShadow();
+	record.diffuseMap = mat.GetDiffuseTexture();
+	record.specularMap = mat.GetSpecularTexture();
+
+	return record;
+}
+
+MaterialTable::MaterialTable()
+{
+	Clear();
+}
+
+MaterialId MaterialTable::Add(Material* mat)
+{
+	if (!mat)
+	{
+		return 0;
+	}
+
+	std::unordered_map<const Material*, MaterialId>::iterator found = m_ids.find(mat);
+
+	if (found != m_ids.end())
+	{
+		m_records[found->second] = MakeRecord(*mat);
+
+		return found->second;
+	}
+
+	MaterialId id = (MaterialId)m_records.size();
+
+	m_records.push_back(MakeRecord(*mat));
+	m_ids[mat] = id;
+
+	return id;
+}
+
+void MaterialTable::Clear()
+{
+	Material defaultMaterial;
+
+	m_records.clear();
+	m_ids.clear();
+	m_records.push_back(MakeRecord(defaultMaterial));
+}
@@ -9,6 +9,11 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
+#include <vector>
+#include <unordered_map>
+
+#include "Ray.h"
+
 struct Colour
 {
 	float red;
@@ -16,6 +21,8 @@ struct Colour
 	float blue;
 };
 
+class Texture;
+
 class Material
 {
 	private:
@@ -24,6 +31,8 @@ class Material
 		Colour m_specular;
 		double m_specpower;
 		bool m_castShadow;
+		Texture* m_diffuseMap;		//nullptr for none, owned by a TextureCache
+		Texture* m_specularMap;
 
 	public:
 		
@@ -65,5 +74,70 @@ class Material
 		{
 			return m_castShadow;
 		}
+
+		//Image textures the diffuse and specular colours are multiplied by where the surface
+		//has texture coordinates, nullptr for none
+		inline void SetDiffuseTexture(Texture* texture)
+		{
+			m_diffuseMap = texture;
+		}
+
+		inline void SetSpecularTexture(Texture* texture)
+		{
+			m_specularMap = texture;
+		}
+
+		inline Texture* GetDiffuseTexture()
+		{
+			return m_diffuseMap;
+		}
+
+		inline Texture* GetSpecularTexture()
+		{
+			return m_specularMap;
+		}
+};
+
+
+//The parameters of a Material as the tracer shades with them, an entry of a MaterialTable
+struct MaterialRecord
+{
+	Colour	ambient;
+	Colour	diffuse;
+	Colour	specular;
+	double	specPower;
+	bool	castShadow;
+	const Texture*	diffuseMap;
+	const Texture*	specularMap;
 };
 
+//The materials of a scene copied into one array, each given once however many objects share
+//it, so that the hits of a frame read their materials from a few cache lines and can be
+//grouped by a small integer instead of a pointer. Id 0 is the default material, which
+//objects without one are shaded with.
+class MaterialTable
+{
+	private:
+		std::vector<MaterialRecord>					m_records;
+		std::unordered_map<const Material*, MaterialId>	m_ids;
+
+	public:
+		MaterialTable();
+
+		//The id of mat, copied into the table the first time and copied again over its entry
+		//every time after, so that the entry has its current parameters
+		MaterialId Add(Material* mat);
+
+		//Only the default material is left
+		void Clear();
+
+		inline const MaterialRecord& Get(MaterialId id) const
+		{
+			return m_records[id];
+		}
+
+		inline int GetCount() const
+		{
+			return (int)m_records.size();
+		}
+};
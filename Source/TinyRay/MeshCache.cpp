@@ -0,0 +1,475 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MeshCache.h"
+#include "FileUtil.h"
+
+#define MESH_CACHE_VERSION		1
+#define MESH_CACHE_BYTE_ORDER	0x01020304u
+
+//Every array starts at a multiple of this from the start of the file, which mmap puts on a
+//page boundary, so the arrays are as aligned as new would have made them
+#define MESH_CACHE_ALIGNMENT	64
+
+static const char s_meshCacheMagic[8] = { 'T', 'R', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+//The arrays of a cache file, in file order
+enum MeshCacheSection
+{
+	SECTION_PX, SECTION_PY, SECTION_PZ,
+	SECTION_NX, SECTION_NY, SECTION_NZ,
+	SECTION_TU, SECTION_TV,
+	SECTION_INDICES,
+	SECTION_NODES,
+	SECTION_ITEMS,
+	SECTION_COUNT
+};
+
+struct MeshCacheHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byteOrder;			//MESH_CACHE_BYTE_ORDER as the writer stored it
+	uint32_t	realSize;			//sizeof(Real) and sizeof(BVHNode) of the writer
+	uint32_t	nodeSize;
+	uint64_t	key;
+	uint64_t	fileSize;
+
+	int32_t		vertexCount;
+	int32_t		triangleCount;
+	int32_t		nodeCount;
+	int32_t		reportLeaves;		//the BVHBuildReport of the tree, items and nodes are the counts above
+	int32_t		reportMaxDepth;
+	int32_t		reportThreads;
+	double		reportSAHCost;
+	double		reportSeconds;
+	double		bounds[6];			//min then max
+
+	uint64_t	offsets[SECTION_COUNT];	//from the start of the file, 0 for an array the mesh does not have
+	uint64_t	sizes[SECTION_COUNT];	//in bytes
+};
+
+//A read only mapping of a whole file, kept alive by the meshes attached to it
+class MappedFile
+{
+	private:
+		const char*		m_data;
+		size_t			m_size;
+#ifdef _WIN32
+		HANDLE			m_mapping;
+#endif
+
+	public:
+		MappedFile()
+		{
+			m_data = nullptr;
+			m_size = 0;
+#ifdef _WIN32
+			m_mapping = NULL;
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (m_data)
+			{
+				UnmapViewOfFile(m_data);
+			}
+
+			if (m_mapping)
+			{
+				CloseHandle(m_mapping);
+			}
+#else
+			if (m_data)
+			{
+				munmap((void*)m_data, m_size);
+			}
+#endif
+		}
+
+		bool Open(const char* filename)
+		{
+#ifdef _WIN32
+			HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+
+			LARGE_INTEGER size;
+
+			if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+			{
+				m_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			}
+
+			//the mapping keeps the file open
+			CloseHandle(file);
+
+			if (!m_mapping)
+			{
+				return false;
+			}
+
+			m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+			m_size = (size_t)size.QuadPart;
+#else
+			int fd = open(filename, O_RDONLY);
+
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			struct stat info;
+
+			if (fstat(fd, &info) == 0 && info.st_size > 0)
+			{
+				void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+				if (data != MAP_FAILED)
+				{
+					m_data = (const char*)data;
+					m_size = (size_t)info.st_size;
+				}
+			}
+
+			//the mapping keeps the file open
+			close(fd);
+#endif
+			return m_data != nullptr;
+		}
+
+		inline const char* GetData() const
+		{
+			return m_data;
+		}
+
+		inline size_t GetSize() const
+		{
+			return m_size;
+		}
+};
+
+//Mixes a word into the hash, after MurmurHash64A
+static inline uint64_t MixWord(uint64_t hash, uint64_t word)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ull;
+
+	word *= m;
+	word ^= word >> 47;
+	word *= m;
+
+	return (hash ^ word) * m;
+}
+
+static inline uint64_t FinishHash(uint64_t hash, uint64_t size)
+{
+	hash = MixWord(hash, size);
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+//The whole words of data into hash, returns the number of bytes used
+static size_t HashWords(const unsigned char* data, size_t size, uint64_t& hash)
+{
+	size_t words = size / 8;
+
+	for (size_t i = 0; i < words; i++)
+	{
+		uint64_t word;
+		memcpy(&word, data + i * 8, 8);
+		hash = MixWord(hash, word);
+	}
+
+	return words * 8;
+}
+
+//The tail of fewer than 8 bytes, zero padded
+static uint64_t HashTail(const unsigned char* data, size_t size, uint64_t hash)
+{
+	if (size > 0)
+	{
+		uint64_t word = 0;
+		memcpy(&word, data, size);
+		hash = MixWord(hash, word);
+	}
+
+	return hash;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = seed ^ 0x9e3779b97f4a7c15ull;
+	size_t used = HashWords(bytes, size, hash);
+
+	return FinishHash(HashTail(bytes + used, size - used, hash), size);
+}
+
+bool HashFile(const char* filename, uint64_t& hash, uint64_t seed)
+{
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	//blocks of whole words, so the hash is the one HashBytes gives for the same bytes
+	std::vector<unsigned char> block(1 << 20);
+	uint64_t state = seed ^ 0x9e3779b97f4a7c15ull;
+	uint64_t total = 0;
+	size_t read;
+
+	while ((read = fread(block.data(), 1, block.size(), fp)) > 0)
+	{
+		size_t used = HashWords(block.data(), read, state);
+		total += read;
+
+		if (used < read)
+		{
+			state = HashTail(block.data() + used, read - used, state);
+			break;
+		}
+	}
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+
+	hash = FinishHash(state, total);
+
+	return ok;
+}
+
+std::string MeshCachePath(const char* dir, uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.trmesh", (unsigned long long)key);
+
+	std::string path = dir;
+
+	if (!path.empty() && path.back() != '/' && path.back() != '\\')
+	{
+		path += '/';
+	}
+
+	return path + name;
+}
+
+bool SaveMeshCache(const char* filename, uint64_t key, const TriangleMesh& mesh)
+{
+	if (!mesh.IsBuilt() || mesh.GetBVH().IsEmpty())
+	{
+		return false;
+	}
+
+	const TriangleMeshArrays& arrays = mesh.GetArrays();
+	const BVH& bvh = mesh.GetBVH();
+	const BVHBuildReport& report = bvh.GetBuildReport();
+	//the box of the root is the one around every triangle
+	const AABB& bounds = bvh.GetNodes()[0].bounds;
+
+	size_t vertexBytes = (size_t)arrays.vertexCount * sizeof(Real);
+
+	const void* data[SECTION_COUNT] = { arrays.px, arrays.py, arrays.pz, arrays.nx, arrays.ny, arrays.nz,
+		arrays.tu, arrays.tv, arrays.indices, bvh.GetNodes(), bvh.GetItems() };
+
+	size_t sizes[SECTION_COUNT] = { vertexBytes, vertexBytes, vertexBytes, vertexBytes, vertexBytes, vertexBytes,
+		vertexBytes, vertexBytes, (size_t)arrays.triangleCount * 3 * sizeof(int),
+		(size_t)bvh.GetNodeCount() * sizeof(BVHNode), (size_t)bvh.GetItemCount() * sizeof(int) };
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, s_meshCacheMagic, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.byteOrder = MESH_CACHE_BYTE_ORDER;
+	header.realSize = sizeof(Real);
+	header.nodeSize = sizeof(BVHNode);
+	header.key = key;
+	header.vertexCount = arrays.vertexCount;
+	header.triangleCount = arrays.triangleCount;
+	header.nodeCount = bvh.GetNodeCount();
+	header.reportLeaves = report.leaves;
+	header.reportMaxDepth = report.maxDepth;
+	header.reportThreads = report.threads;
+	header.reportSAHCost = report.sahCost;
+	header.reportSeconds = report.seconds;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		header.bounds[axis] = bounds.min[axis];
+		header.bounds[axis + 3] = bounds.max[axis];
+	}
+
+	uint64_t offset = sizeof(MeshCacheHeader);
+
+	for (int s = 0; s < SECTION_COUNT; s++)
+	{
+		if (!data[s] || sizes[s] == 0)
+		{
+			continue;
+		}
+
+		offset = (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+		header.offsets[s] = offset;
+		header.sizes[s] = sizes[s];
+		offset += sizes[s];
+	}
+
+	header.fileSize = offset;
+
+	std::string temp = MakeTempPath(filename);
+	FILE* fp = fopen(temp.c_str(), "wb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	uint64_t written = sizeof(header);
+
+	for (int s = 0; s < SECTION_COUNT && ok; s++)
+	{
+		if (header.offsets[s] == 0)
+		{
+			continue;
+		}
+
+		size_t padding = (size_t)(header.offsets[s] - written);
+		ok = fwrite(zeros, 1, padding, fp) == padding && fwrite(data[s], 1, sizes[s], fp) == sizes[s];
+		written = header.offsets[s] + sizes[s];
+	}
+
+	ok = fclose(fp) == 0 && ok;
+
+	if (!ok)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+
+	return ReplaceWithTemp(temp, filename);
+}
+
+bool LoadMeshCache(const char* filename, uint64_t key, TriangleMesh* mesh)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+
+	if (!file->Open(filename) || file->GetSize() < sizeof(MeshCacheHeader))
+	{
+		return false;
+	}
+
+	const char* base = file->GetData();
+	const MeshCacheHeader& header = *(const MeshCacheHeader*)base;
+
+	if (memcmp(header.magic, s_meshCacheMagic, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION ||
+		header.byteOrder != MESH_CACHE_BYTE_ORDER || header.realSize != sizeof(Real) || header.nodeSize != sizeof(BVHNode) ||
+		header.key != key || header.fileSize != file->GetSize())
+	{
+		return false;
+	}
+
+	if (header.vertexCount <= 0 || header.triangleCount <= 0 || header.nodeCount <= 0)
+	{
+		return false;
+	}
+
+	size_t vertexBytes = (size_t)header.vertexCount * sizeof(Real);
+
+	size_t expected[SECTION_COUNT] = { vertexBytes, vertexBytes, vertexBytes, vertexBytes, vertexBytes, vertexBytes,
+		vertexBytes, vertexBytes, (size_t)header.triangleCount * 3 * sizeof(int),
+		(size_t)header.nodeCount * sizeof(BVHNode), (size_t)header.triangleCount * sizeof(int) };
+
+	const void* data[SECTION_COUNT];
+
+	for (int s = 0; s < SECTION_COUNT; s++)
+	{
+		data[s] = nullptr;
+
+		if (header.offsets[s] == 0)
+		{
+			continue;
+		}
+
+		if (header.sizes[s] != expected[s] || header.offsets[s] % MESH_CACHE_ALIGNMENT != 0 ||
+			header.offsets[s] > header.fileSize || header.sizes[s] > header.fileSize - header.offsets[s])
+		{
+			return false;
+		}
+
+		data[s] = base + header.offsets[s];
+	}
+
+	//positions, indices and the tree are always there, normals and texture coordinates come
+	//in complete sets or not at all
+	bool normals = data[SECTION_NX] && data[SECTION_NY] && data[SECTION_NZ];
+	bool texcoords = data[SECTION_TU] && data[SECTION_TV];
+
+	if (!data[SECTION_PX] || !data[SECTION_PY] || !data[SECTION_PZ] || !data[SECTION_INDICES] ||
+		!data[SECTION_NODES] || !data[SECTION_ITEMS] ||
+		(!normals && (data[SECTION_NX] || data[SECTION_NY] || data[SECTION_NZ])) ||
+		(!texcoords && (data[SECTION_TU] || data[SECTION_TV])))
+	{
+		return false;
+	}
+
+	TriangleMeshArrays arrays;
+	arrays.vertexCount = header.vertexCount;
+	arrays.triangleCount = header.triangleCount;
+	arrays.px = (const Real*)data[SECTION_PX];
+	arrays.py = (const Real*)data[SECTION_PY];
+	arrays.pz = (const Real*)data[SECTION_PZ];
+	arrays.nx = (const Real*)data[SECTION_NX];
+	arrays.ny = (const Real*)data[SECTION_NY];
+	arrays.nz = (const Real*)data[SECTION_NZ];
+	arrays.tu = (const Real*)data[SECTION_TU];
+	arrays.tv = (const Real*)data[SECTION_TV];
+	arrays.indices = (const int*)data[SECTION_INDICES];
+
+	AABB bounds;
+	bounds.min.SetVector((Real)header.bounds[0], (Real)header.bounds[1], (Real)header.bounds[2]);
+	bounds.max.SetVector((Real)header.bounds[3], (Real)header.bounds[4], (Real)header.bounds[5]);
+
+	BVHBuildReport report;
+	report.items = header.triangleCount;
+	report.nodes = header.nodeCount;
+	report.leaves = header.reportLeaves;
+	report.maxDepth = header.reportMaxDepth;
+	report.sahCost = header.reportSAHCost;
+	report.seconds = header.reportSeconds;
+	report.threads = header.reportThreads;
+
+	mesh->Attach(arrays, bounds, (const BVHNode*)data[SECTION_NODES], header.nodeCount, (const int*)data[SECTION_ITEMS],
+		report, file);
+
+	return true;
+}
@@ -0,0 +1,45 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "TriangleMesh.h"
+
+//A cache of built meshes on disk. A mesh and its BVH are written as they are in memory, at
+//fixed offsets from the start of the file, so a later run maps the file and attaches the mesh
+//to it (TriangleMesh::Attach) instead of reading the model and building the tree again: only
+//the pages the traversal touches are ever read.
+//
+//A file is tagged with a key the caller makes from what the mesh was made of, e.g. the bytes
+//of the model file and the box it was fitted into, and only loads under the same key. Files
+//are specific to the build that wrote them: a different format version, Real or BVHNode
+//layout is rejected just like a different key.
+
+//64-bit hashes for cache keys, seed chains several inputs into one key
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+//The same over the contents of a file, false if it cannot be read
+bool HashFile(const char* filename, uint64_t& hash, uint64_t seed = 0);
+
+//The file of key in the directory dir
+std::string MeshCachePath(const char* dir, uint64_t key);
+
+//Write mesh, which must be built, and its BVH to filename under key. The file is written
+//under a name of its own next to filename first and then renamed over it, so a reader never
+//maps a half written one or finds none, and writers of the same file do not collide.
+bool SaveMeshCache(const char* filename, uint64_t key, const TriangleMesh& mesh);
+
+//Map filename and attach mesh to it. False, with mesh unchanged, if there is no such file or
+//it was written under another key, by another build or its header does not describe the file:
+//every section must lie within it, aligned and of the size the counts give. The contents are
+//taken as SaveMeshCache wrote them, reading them all to check them would read every page.
+bool LoadMeshCache(const char* filename, uint64_t key, TriangleMesh* mesh);
@@ -0,0 +1,270 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshIO.h"
+
+//A face corner: the position, texture coordinate and normal it refers to, 0-based, -1 for none
+struct ObjCorner
+{
+	int v, vt, vn;
+
+	inline bool operator == (const ObjCorner& rhs) const
+	{
+		return v == rhs.v && vt == rhs.vt && vn == rhs.vn;
+	}
+};
+
+struct ObjCornerHash
+{
+	inline size_t operator () (const ObjCorner& c) const
+	{
+		return ((size_t)c.v * 73856093) ^ ((size_t)c.vt * 19349663) ^ ((size_t)c.vn * 83492791);
+	}
+};
+
+//An OBJ index is 1-based, or counts back from the last element read if negative
+static int ResolveIndex(long index, int count)
+{
+	if (index > 0 && index <= count)
+	{
+		return (int)index - 1;
+	}
+
+	if (index < 0 && -index <= count)
+	{
+		return count + (int)index;
+	}
+
+	return -2;
+}
+
+//Parse one v, v/vt, v//vn or v/vt/vn corner at text, false if it is malformed
+static bool ParseCorner(char*& text, int positions, int texcoords, int normals, ObjCorner& corner)
+{
+	char* end;
+
+	corner.v = ResolveIndex(strtol(text, &end, 10), positions);
+	corner.vt = corner.vn = -1;
+
+	if (end == text || corner.v < 0)
+	{
+		return false;
+	}
+
+	text = end;
+
+	if (*text == '/')
+	{
+		text++;
+
+		if (*text != '/')
+		{
+			corner.vt = ResolveIndex(strtol(text, &end, 10), texcoords);
+
+			if (end == text || corner.vt < 0)
+			{
+				return false;
+			}
+
+			text = end;
+		}
+
+		if (*text == '/')
+		{
+			text++;
+			corner.vn = ResolveIndex(strtol(text, &end, 10), normals);
+
+			if (end == text || corner.vn < 0)
+			{
+				return false;
+			}
+
+			text = end;
+		}
+	}
+
+	return true;
+}
+
+bool LoadOBJ(const char* filename, TriangleMesh* mesh)
+{
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	std::vector<Vec3> positions;
+	std::vector<Vec3> normals;
+	std::vector<Real> texcoords;		//u, v pairs
+	std::vector<ObjCorner> corners;		//three per triangle
+	std::vector<ObjCorner> polygon;
+
+	bool ok = true;
+	char line[4096];
+
+	while (ok && fgets(line, sizeof(line), fp))
+	{
+		char* text = line;
+
+		while (*text == ' ' || *text == '\t')
+		{
+			text++;
+		}
+
+		if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			char* end;
+			Real x = (Real)strtod(text + 2, &end);
+			Real y = (Real)strtod(end, &end);
+			Real z = (Real)strtod(end, &end);
+
+			positions.push_back(Vec3(x, y, z));
+		}
+		else if (text[0] == 'v' && text[1] == 'n')
+		{
+			char* end;
+			Real x = (Real)strtod(text + 2, &end);
+			Real y = (Real)strtod(end, &end);
+			Real z = (Real)strtod(end, &end);
+
+			normals.push_back(Vec3(x, y, z));
+		}
+		else if (text[0] == 'v' && text[1] == 't')
+		{
+			char* end;
+			Real u = (Real)strtod(text + 2, &end);
+			Real v = (Real)strtod(end, &end);
+
+			texcoords.push_back(u);
+			texcoords.push_back(v);
+		}
+		else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			polygon.clear();
+			text++;
+
+			while (true)
+			{
+				while (*text == ' ' || *text == '\t')
+				{
+					text++;
+				}
+
+				if (*text == '\0' || *text == '\r' || *text == '\n' || *text == '#')
+				{
+					break;
+				}
+
+				ObjCorner corner;
+
+				if (!ParseCorner(text, (int)positions.size(), (int)texcoords.size() / 2, (int)normals.size(), corner))
+				{
+					ok = false;
+					break;
+				}
+
+				polygon.push_back(corner);
+			}
+
+			//a fan around the first corner
+			for (size_t i = 2; ok && i < polygon.size(); i++)
+			{
+				corners.push_back(polygon[0]);
+				corners.push_back(polygon[i - 1]);
+				corners.push_back(polygon[i]);
+			}
+		}
+	}
+
+	ok = ok && !ferror(fp);
+	fclose(fp);
+
+	if (!ok)
+	{
+		return false;
+	}
+
+	bool withNormals = !corners.empty();
+	bool withTexCoords = !corners.empty();
+
+	for (size_t i = 0; i < corners.size(); i++)
+	{
+		withNormals = withNormals && corners[i].vn >= 0;
+		withTexCoords = withTexCoords && corners[i].vt >= 0;
+	}
+
+	mesh->Clear();
+
+	if (!withNormals && !withTexCoords)
+	{
+		//one mesh vertex per position
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			mesh->AddVertex(positions[i]);
+		}
+
+		for (size_t i = 0; i < corners.size(); i += 3)
+		{
+			mesh->AddTriangle(corners[i].v, corners[i + 1].v, corners[i + 2].v);
+		}
+
+		return true;
+	}
+
+	//one mesh vertex per distinct combination of position, texture coordinate and normal
+	std::unordered_map<ObjCorner, int, ObjCornerHash> vertices;
+	int triangle[3];
+
+	for (size_t i = 0; i < corners.size(); i++)
+	{
+		ObjCorner corner = corners[i];
+
+		corner.vt = withTexCoords ? corner.vt : -1;
+		corner.vn = withNormals ? corner.vn : -1;
+
+		std::unordered_map<ObjCorner, int, ObjCornerHash>::iterator found = vertices.find(corner);
+
+		if (found == vertices.end())
+		{
+			int index;
+
+			if (!withTexCoords)
+			{
+				index = mesh->AddVertex(positions[corner.v], normals[corner.vn]);
+			}
+			else if (!withNormals)
+			{
+				index = mesh->AddVertex(positions[corner.v], texcoords[corner.vt * 2], texcoords[corner.vt * 2 + 1]);
+			}
+			else
+			{
+				index = mesh->AddVertex(positions[corner.v], normals[corner.vn], texcoords[corner.vt * 2], texcoords[corner.vt * 2 + 1]);
+			}
+
+			found = vertices.insert(std::make_pair(corner, index)).first;
+		}
+
+		triangle[i % 3] = found->second;
+
+		if (i % 3 == 2)
+		{
+			mesh->AddTriangle(triangle[0], triangle[1], triangle[2]);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,20 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "TriangleMesh.h"
+
+//Helpers for reading triangle meshes from disk
+
+//Wavefront OBJ. The v, vt, vn and f statements are read, polygons are split into triangle
+//fans and everything else (objects, groups, materials, smoothing) is ignored. A vertex gets
+//a normal or texture coordinates only if every face corner of the file refers to one.
+//The mesh is cleared first; false if the file cannot be read or refers to missing vertices.
+bool LoadOBJ(const char* filename, TriangleMesh* mesh);
@@ -144,6 +144,11 @@ void OGLWindow::Render()
 {
 	m_pRayTracer->DoRayTrace(m_pScene);
 
+	//Copy the traced image to the window in one go
+	glRasterPos2i(0, 0);
+	glDrawPixels(m_pRayTracer->GetBufferWidth(), m_pRayTracer->GetBufferHeight(),
+		GL_RGB, GL_FLOAT, m_pRayTracer->GetFramebuffer());
+
 	glFlush();
 
 	SwapBuffers(m_hdc);
@@ -196,26 +201,12 @@ BOOL OGLWindow::KeyUp(WPARAM key)
 	switch (key)
 	{
 	case VK_F1:
-		m_pRayTracer->m_traceflag = RayTracer::TRACE_AMBIENT;
-		break;
 	case VK_F2:
-		m_pRayTracer->m_traceflag = (RayTracer::TraceFlag)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC);
-		break;
 	case VK_F3:
-		m_pRayTracer->m_traceflag = (RayTracer::TraceFlag)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
-			| RayTracer::TRACE_SHADOW);
-		break;
 	case VK_F4:
-		m_pRayTracer->m_traceflag = (RayTracer::TraceFlag)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
-			| RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW);
-		break;
 	case VK_F5:
-		m_pRayTracer->m_traceflag = (RayTracer::TraceFlag)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
-			| RayTracer::TRACE_REFRACTION);
-		break;
 	case VK_F6:
-		m_pRayTracer->m_traceflag = (RayTracer::TraceFlag)(RayTracer::TRACE_AMBIENT | RayTracer::TRACE_DIFFUSE_AND_SPEC
-			| RayTracer::TRACE_REFRACTION | RayTracer::TRACE_REFLECTION | RayTracer::TRACE_SHADOW);
+		m_pRayTracer->m_traceflag = RayTracer::GetPresetTraceFlag((int)(key - VK_F1) + 1);
 		break;
 	}
 
@@ -0,0 +1,66 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+// PacketAVX2.cpp : the packet tracer for AVX2, built with -mavx2 (/arch:AVX2).
+// Only PacketTracer.cpp calls into this file, and only after checking the CPU.
+
+#include "PacketTracer.h"
+
+#if defined(__AVX2__)
+
+#include "PacketKernels.h"
+
+static void IntersectPacketsAVX2(Scene* pScene, Ray* rays, int count, RayHit* hits)
+{
+	IntersectPackets<SimdAVX2>(pScene, rays, count, hits);
+}
+
+static void IntersectStreamAVX2(Scene* pScene, const Real* const stream[9], int count, RayHit* hits)
+{
+	IntersectStream<SimdAVX2>(pScene, stream, count, hits);
+}
+
+static void ComputeLightTermsAVX2(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6])
+{
+	ComputeLightTerms<SimdAVX2>(lights, count, shading, terms);
+}
+
+PacketIntersectFunc GetPacketIntersectAVX2()
+{
+	return IntersectPacketsAVX2;
+}
+
+PacketStreamFunc GetPacketStreamAVX2()
+{
+	return IntersectStreamAVX2;
+}
+
+PacketLightFunc GetPacketLightAVX2()
+{
+	return ComputeLightTermsAVX2;
+}
+
+#else
+
+PacketIntersectFunc GetPacketIntersectAVX2()
+{
+	return nullptr;
+}
+
+PacketStreamFunc GetPacketStreamAVX2()
+{
+	return nullptr;
+}
+
+PacketLightFunc GetPacketLightAVX2()
+{
+	return nullptr;
+}
+
+#endif
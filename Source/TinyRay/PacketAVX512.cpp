@@ -0,0 +1,66 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+// PacketAVX512.cpp : the packet tracer for AVX-512F, built with -mavx512f (/arch:AVX512).
+// Only PacketTracer.cpp calls into this file, and only after checking the CPU.
+
+#include "PacketTracer.h"
+
+#if defined(__AVX512F__)
+
+#include "PacketKernels.h"
+
+static void IntersectPacketsAVX512(Scene* pScene, Ray* rays, int count, RayHit* hits)
+{
+	IntersectPackets<SimdAVX512>(pScene, rays, count, hits);
+}
+
+static void IntersectStreamAVX512(Scene* pScene, const Real* const stream[9], int count, RayHit* hits)
+{
+	IntersectStream<SimdAVX512>(pScene, stream, count, hits);
+}
+
+static void ComputeLightTermsAVX512(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6])
+{
+	ComputeLightTerms<SimdAVX512>(lights, count, shading, terms);
+}
+
+PacketIntersectFunc GetPacketIntersectAVX512()
+{
+	return IntersectPacketsAVX512;
+}
+
+PacketStreamFunc GetPacketStreamAVX512()
+{
+	return IntersectStreamAVX512;
+}
+
+PacketLightFunc GetPacketLightAVX512()
+{
+	return ComputeLightTermsAVX512;
+}
+
+#else
+
+PacketIntersectFunc GetPacketIntersectAVX512()
+{
+	return nullptr;
+}
+
+PacketStreamFunc GetPacketStreamAVX512()
+{
+	return nullptr;
+}
+
+PacketLightFunc GetPacketLightAVX512()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,648 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Simd.h"
+#include "Scene.h"
+
+//The packet tracer, written once for any wrapper S from Simd.h. Each PacketXXX.cpp includes
+//this header and instantiates IntersectPackets<S> for its own instruction set.
+//
+//The kernels repeat the arithmetic of the scalar primitive tests operation for operation, so
+//a packet finds the same closest hit as Scene::Intersect. Of the shared classes only the
+//arrays of the PrimitiveStore and trivial accessors are used here: this code is compiled with
+//instruction sets the rest of the tracer is not, and nothing from it may be shared with
+//baseline code at link time.
+
+namespace
+{
+
+template<typename S>
+struct RayPacket
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+	typedef M LaneMask;
+
+	enum { WIDTH = S::WIDTH };
+
+	V ox, oy, oz;		//ray starts
+	V dx, dy, dz;		//ray directions
+	V ix, iy, iz;		//component-wise reciprocals of the directions
+
+	//the closest hit of every ray so far, in the layout of RayHit
+	V t;
+	V u, v;
+	V face;
+	V type, prim;		//the PrimHandle
+
+	M valid;			//the lanes with a direction, as Scene::Intersect tests them
+
+	//Start a packet from nine arrays of WIDTH Reals: the starts, directions and reciprocals
+	inline void Load(const Real* const lanes[9])
+	{
+		ox = S::Load(lanes[0]); oy = S::Load(lanes[1]); oz = S::Load(lanes[2]);
+		dx = S::Load(lanes[3]); dy = S::Load(lanes[4]); dz = S::Load(lanes[5]);
+		ix = S::Load(lanes[6]); iy = S::Load(lanes[7]); iz = S::Load(lanes[8]);
+
+		t = S::Set1(FARFAR_AWAY);
+		u = v = face = type = S::Set1(0.0);
+		prim = S::Set1(-1.0);
+
+		valid = (dx == dx) & (dy == dy) & (dz == dz);
+	}
+
+	//Gather the lanes from WIDTH rays
+	inline void Load(Ray** laneRays)
+	{
+		Real lanes[9][WIDTH];
+
+		for (int k = 0; k < WIDTH; k++)
+		{
+			const Vec3& start = laneRays[k]->GetRayStart();
+			const Vec3& dir = laneRays[k]->GetRay();
+			const Vec3& inv = laneRays[k]->GetInvRay();
+
+			for (int i = 0; i < 3; i++)
+			{
+				lanes[i][k] = start[i];
+				lanes[3 + i][k] = dir[i];
+				lanes[6 + i][k] = inv[i];
+			}
+		}
+
+		const Real* arrays[9];
+
+		for (int i = 0; i < 9; i++)
+		{
+			arrays[i] = lanes[i];
+		}
+
+		Load(arrays);
+	}
+
+	//Load rays first to first + count - 1 of the component arrays of a RayStream,
+	//a short packet repeats its last ray
+	inline void Load(const Real* const stream[9], int first, int count)
+	{
+		const Real* arrays[9];
+
+		if (count == WIDTH)
+		{
+			for (int i = 0; i < 9; i++)
+			{
+				arrays[i] = stream[i] + first;
+			}
+
+			Load(arrays);
+			return;
+		}
+
+		Real lanes[9][WIDTH];
+
+		for (int i = 0; i < 9; i++)
+		{
+			for (int k = 0; k < WIDTH; k++)
+			{
+				lanes[i][k] = stream[i][first + (k < count ? k : count - 1)];
+			}
+
+			arrays[i] = lanes[i];
+		}
+
+		Load(arrays);
+	}
+
+	//Keep tHit as the closest hit of the lanes in closer, with the surface parameters given
+	inline void Record(M closer, V tHit, V uHit, V vHit, V faceHit, int primType, int primIndex)
+	{
+		t = S::Select(closer, tHit, t);
+		u = S::Select(closer, uHit, u);
+		v = S::Select(closer, vHit, v);
+		face = S::Select(closer, faceHit, face);
+		type = S::Select(closer, S::Set1((Real)primType), type);
+		prim = S::Select(closer, S::Set1((Real)primIndex), prim);
+	}
+
+	//The lanes of active whose test returned tHit and which it brings closer than their closest
+	//hit so far, with the same t > 0 && t < FARFAR_AWAY acceptance as the scalar tests
+	inline M Closer(M active, V tHit) const
+	{
+		return active & (tHit > S::Set1(0.0)) & (tHit < S::Set1(FARFAR_AWAY)) & (tHit < t);
+	}
+
+	inline M AllLanes() const
+	{
+		return valid;
+	}
+
+	inline Real GetMaxT(M lanes) const
+	{
+		Real values[WIDTH];
+		S::Store(values, t);
+
+		int bits = lanes.Bits();
+		Real tmax = -FARFAR_AWAY;
+
+		for (int k = 0; k < WIDTH; k++)
+		{
+			if ((bits >> k) & 1)
+			{
+				tmax = values[k] > tmax ? values[k] : tmax;
+			}
+		}
+
+		return tmax;
+	}
+
+	//AABB::IntersectByRay for the lanes of active, against each lane's closest hit
+	inline bool IntersectBox(const AABB& box, M active, M& hit, Real& tnear) const
+	{
+		V t0 = S::Set1(0.0);
+		V t1 = t;
+
+		const V* origin[3] = { &ox, &oy, &oz };
+		const V* inv[3] = { &ix, &iy, &iz };
+
+		for (int i = 0; i < 3; i++)
+		{
+			V tmin_i = (S::Set1(box.min[i]) - *origin[i]) * *inv[i];
+			V tmax_i = (S::Set1(box.max[i]) - *origin[i]) * *inv[i];
+
+			M swap = tmin_i > tmax_i;
+			V lo = S::Select(swap, tmax_i, tmin_i);
+			V hi = S::Select(swap, tmin_i, tmax_i);
+
+			//a NaN lane leaves the interval untouched
+			t0 = S::Select(lo > t0, lo, t0);
+			t1 = S::Select(hi < t1, hi, t1);
+		}
+
+		hit = active & (t0 <= t1);
+
+		if (!hit.Any())
+		{
+			return false;
+		}
+
+		Real lanes[WIDTH];
+		S::Store(lanes, S::Select(hit, t0, S::Set1(FARFAR_AWAY)));
+
+		tnear = lanes[0];
+
+		for (int k = 1; k < WIDTH; k++)
+		{
+			tnear = lanes[k] < tnear ? lanes[k] : tnear;
+		}
+
+		return true;
+	}
+};
+
+//SphereArray::IntersectDistance
+template<typename S>
+inline void IntersectSphere(RayPacket<S>& packet, typename S::VMask active, const SphereArray& spheres, int i)
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+
+	Real radius = spheres.radius[i];
+
+	V sx = packet.ox - S::Set1(spheres.cx[i]);
+	V sy = packet.oy - S::Set1(spheres.cy[i]);
+	V sz = packet.oz - S::Set1(spheres.cz[i]);
+
+	V rayDotSmC = packet.dx * sx + packet.dy * sy + packet.dz * sz;
+	V rayDotProd = packet.dx * packet.dx + packet.dy * packet.dy + packet.dz * packet.dz;
+	V sDotS = sx * sx + sy * sy + sz * sz;
+
+	V det = rayDotSmC * rayDotSmC - (rayDotProd * (sDotS - S::Set1(radius * radius)));
+	M real = active & (det >= S::Set1(0.0));
+
+	if (!real.Any())
+	{
+		return;
+	}
+
+	V root = S::Sqrt(det);
+	V t_pos = (-rayDotSmC + root) / rayDotProd;
+	V t_neg = (-rayDotSmC - root) / rayDotProd;
+
+	V t = S::Select(det == S::Set1(0.0), -rayDotSmC / rayDotProd, S::Select(t_pos < t_neg, t_pos, t_neg));
+	M closer = real & packet.Closer(active, t);
+
+	if (closer.Any())
+	{
+		V zero = S::Set1(0.0);
+		packet.Record(closer, t, zero, zero, zero, Primitive::PRIMTYPE_Sphere, i);
+	}
+}
+
+//PlaneArray::IntersectDistance
+template<typename S>
+inline void IntersectPlane(RayPacket<S>& packet, typename S::VMask active, const PlaneArray& planes, int i)
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+
+	V nx = S::Set1(planes.nx[i]);
+	V ny = S::Set1(planes.ny[i]);
+	V nz = S::Set1(planes.nz[i]);
+
+	V startDotN = packet.ox * nx + packet.oy * ny + packet.oz * nz;
+	V rayDotN = packet.dx * nx + packet.dy * ny + packet.dz * nz;
+
+	V t = -(startDotN + S::Set1(planes.offset[i])) / rayDotN;
+	M closer = packet.Closer(active, t);
+
+	if (closer.Any())
+	{
+		V zero = S::Set1(0.0);
+		packet.Record(closer, t, zero, zero, zero, Primitive::PRIMTYPE_Plane, i);
+	}
+}
+
+//IntersectTriangleMT, a hit is recorded as face of prim
+template<typename S>
+inline void IntersectTriangleMT(RayPacket<S>& packet, typename S::VMask active, const Real v0[3], const Real edge1[3],
+	const Real edge2[3], PrimHandle prim, int face)
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+
+	V e1x = S::Set1(edge1[0]), e1y = S::Set1(edge1[1]), e1z = S::Set1(edge1[2]);
+	V e2x = S::Set1(edge2[0]), e2y = S::Set1(edge2[1]), e2z = S::Set1(edge2[2]);
+
+	//p = dir x edge2
+	V px = packet.dy * e2z - packet.dz * e2y;
+	V py = packet.dz * e2x - packet.dx * e2z;
+	V pz = packet.dx * e2y - packet.dy * e2x;
+
+	V det = e1x * px + e1y * py + e1z * pz;
+	M valid = S::Abs(det) >= S::Set1(1.0e-12);
+
+	if (!valid.Any())
+	{
+		return;
+	}
+
+	V invDet = S::Set1(1.0) / det;
+
+	V sx = packet.ox - S::Set1(v0[0]);
+	V sy = packet.oy - S::Set1(v0[1]);
+	V sz = packet.oz - S::Set1(v0[2]);
+
+	V u = (sx * px + sy * py + sz * pz) * invDet;
+	valid = valid & (u >= S::Set1(0.0)) & (u <= S::Set1(1.0));
+
+	if (!valid.Any())
+	{
+		return;
+	}
+
+	//q = s x edge1
+	V qx = sy * e1z - sz * e1y;
+	V qy = sz * e1x - sx * e1z;
+	V qz = sx * e1y - sy * e1x;
+
+	V v = (packet.dx * qx + packet.dy * qy + packet.dz * qz) * invDet;
+	valid = valid & (v >= S::Set1(0.0)) & (u + v <= S::Set1(1.0));
+
+	V t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+	M closer = valid & packet.Closer(active, t);
+
+	if (closer.Any())
+	{
+		packet.Record(closer, t, u, v, S::Set1((Real)face), prim.type, prim.index);
+	}
+}
+
+//TriangleArray::IntersectDistance
+template<typename S>
+inline void IntersectTriangle(RayPacket<S>& packet, typename S::VMask active, const TriangleArray& triangles, int i)
+{
+	const Real v0[3] = { triangles.v0x[i], triangles.v0y[i], triangles.v0z[i] };
+	const Real edge1[3] = { triangles.e1x[i], triangles.e1y[i], triangles.e1z[i] };
+	const Real edge2[3] = { triangles.e2x[i], triangles.e2y[i], triangles.e2z[i] };
+	PrimHandle prim = { Primitive::PRIMTYPE_Triangle, i };
+
+	IntersectTriangleMT<S>(packet, active, v0, edge1, edge2, prim, 0);
+}
+
+//TriangleMesh::Intersect, the lanes of active walk the mesh's BVH together
+template<typename S>
+inline void IntersectMesh(RayPacket<S>& packet, typename S::VMask active, const TriangleMesh* mesh, int i)
+{
+	PrimHandle prim = { Primitive::PRIMTYPE_Mesh, i };
+
+	mesh->GetBVH().TraversePacket(packet, active, [&packet, mesh, prim](int tri, typename S::VMask lanes)
+	{
+		Real v0[3], edge1[3], edge2[3];
+		mesh->GetTriangle(tri, v0, edge1, edge2);
+
+		IntersectTriangleMT<S>(packet, lanes, v0, edge1, edge2, prim, tri);
+	});
+}
+
+//InstanceArray::Intersect: the packet is taken into the instance's object space, with the
+//arithmetic of Transform, and walks the mesh's BVH there
+template<typename S>
+inline void IntersectInstance(RayPacket<S>& packet, typename S::VMask active, const InstanceArray& instances, int i)
+{
+	typedef typename S::VReal V;
+
+	const Real (*m)[4] = instances.worldToObject[i].m;
+	const TriangleMesh* mesh = instances.mesh[i];
+	PrimHandle prim = { Primitive::PRIMTYPE_Instance, i };
+
+	RayPacket<S> local = packet;
+
+	V m00 = S::Set1(m[0][0]), m01 = S::Set1(m[0][1]), m02 = S::Set1(m[0][2]);
+	V m10 = S::Set1(m[1][0]), m11 = S::Set1(m[1][1]), m12 = S::Set1(m[1][2]);
+	V m20 = S::Set1(m[2][0]), m21 = S::Set1(m[2][1]), m22 = S::Set1(m[2][2]);
+
+	local.ox = m00 * packet.ox + m01 * packet.oy + m02 * packet.oz + S::Set1(m[0][3]);
+	local.oy = m10 * packet.ox + m11 * packet.oy + m12 * packet.oz + S::Set1(m[1][3]);
+	local.oz = m20 * packet.ox + m21 * packet.oy + m22 * packet.oz + S::Set1(m[2][3]);
+
+	local.dx = m00 * packet.dx + m01 * packet.dy + m02 * packet.dz;
+	local.dy = m10 * packet.dx + m11 * packet.dy + m12 * packet.dz;
+	local.dz = m20 * packet.dx + m21 * packet.dy + m22 * packet.dz;
+
+	local.ix = S::Set1(1.0) / local.dx;
+	local.iy = S::Set1(1.0) / local.dy;
+	local.iz = S::Set1(1.0) / local.dz;
+
+	mesh->GetBVH().TraversePacket(local, active, [&local, mesh, prim](int tri, typename S::VMask lanes)
+	{
+		Real v0[3], edge1[3], edge2[3];
+		mesh->GetTriangle(tri, v0, edge1, edge2);
+
+		IntersectTriangleMT<S>(local, lanes, v0, edge1, edge2, prim, tri);
+	});
+
+	//the closest hits carry over, the rays stay in world space
+	packet.t = local.t;
+	packet.u = local.u;
+	packet.v = local.v;
+	packet.face = local.face;
+	packet.type = local.type;
+	packet.prim = local.prim;
+}
+
+//BoxArray::IntersectDistance
+template<typename S>
+inline void IntersectBox(RayPacket<S>& packet, typename S::VMask active, const BoxArray& boxes, int i)
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+
+	const Real bmin[3] = { boxes.minx[i], boxes.miny[i], boxes.minz[i] };
+	const Real bmax[3] = { boxes.maxx[i], boxes.maxy[i], boxes.maxz[i] };
+
+	const V* origin[3] = { &packet.ox, &packet.oy, &packet.oz };
+	const V* inv[3] = { &packet.ix, &packet.iy, &packet.iz };
+
+	V zero = S::Set1(0.0);
+	V tnear = S::Set1(-FARFAR_AWAY);
+	V tfar = S::Set1(FARFAR_AWAY);
+	V nearFace = zero;
+	V farFace = zero;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		V tmin = (S::Set1(bmin[axis]) - *origin[axis]) * *inv[axis];
+		V tmax = (S::Set1(bmax[axis]) - *origin[axis]) * *inv[axis];
+		M negative = *inv[axis] < zero;
+
+		V t0 = S::Select(negative, tmax, tmin);
+		V t1 = S::Select(negative, tmin, tmax);
+
+		M entry = t0 > tnear;
+		tnear = S::Select(entry, t0, tnear);
+		nearFace = S::Select(entry, S::Select(negative, S::Set1(axis * 2 + 1), S::Set1(axis * 2)), nearFace);
+
+		M exit = t1 < tfar;
+		tfar = S::Select(exit, t1, tfar);
+		farFace = S::Select(exit, S::Select(negative, S::Set1(axis * 2), S::Set1(axis * 2 + 1)), farFace);
+	}
+
+	M overlap = tnear <= tfar;
+
+	//the entry point if it lies ahead, otherwise the ray starts inside and leaves through tfar
+	M ahead = tnear > zero;
+	V t = S::Select(ahead, tnear, tfar);
+	V hitFace = S::Select(ahead, nearFace, farFace);
+
+	M closer = overlap & packet.Closer(active, t);
+
+	if (closer.Any())
+	{
+		packet.Record(closer, t, zero, zero, hitFace, Primitive::PRIMTYPE_Box, i);
+	}
+}
+
+template<typename S>
+inline void IntersectPrimitive(RayPacket<S>& packet, typename S::VMask active, const PrimitiveStore& store, PrimHandle prim)
+{
+	switch (prim.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		IntersectSphere<S>(packet, active, store.spheres, prim.index);
+		break;
+	case Primitive::PRIMTYPE_Plane:
+		IntersectPlane<S>(packet, active, store.planes, prim.index);
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		IntersectTriangle<S>(packet, active, store.triangles, prim.index);
+		break;
+	case Primitive::PRIMTYPE_Mesh:
+		IntersectMesh<S>(packet, active, store.meshes[prim.index], prim.index);
+		break;
+	case Primitive::PRIMTYPE_Instance:
+		IntersectInstance<S>(packet, active, store.instances, prim.index);
+		break;
+	default:
+		IntersectBox<S>(packet, active, store.boxes, prim.index);
+		break;
+	}
+}
+
+//Scene::Intersect for the rays loaded into packet; the first count lanes are stored to hits
+template<typename S>
+inline void IntersectPacket(Scene* pScene, RayPacket<S>& packet, int count, RayHit* hits)
+{
+	enum { WIDTH = S::WIDTH };
+
+	const PrimitiveStore& store = pScene->GetPrimitives();
+	const std::vector<PrimHandle>& bounded = pScene->GetBoundedObjects();
+
+	//the planes go first, like in Scene::Intersect
+	for (int i = 0; i < store.planes.Size(); i++)
+	{
+		IntersectPlane<S>(packet, packet.AllLanes(), store.planes, i);
+	}
+
+	pScene->GetBVH().TraversePacket(packet, [&packet, &store, &bounded](int item, typename S::VMask lanes)
+	{
+		IntersectPrimitive<S>(packet, lanes, store, bounded[item]);
+	});
+
+	Real t[WIDTH], u[WIDTH], v[WIDTH], face[WIDTH], types[WIDTH], ids[WIDTH];
+
+	S::Store(t, packet.t);
+	S::Store(u, packet.u);
+	S::Store(v, packet.v);
+	S::Store(face, packet.face);
+	S::Store(types, packet.type);
+	S::Store(ids, packet.prim);
+
+	for (int k = 0; k < count; k++)
+	{
+		RayHit& hit = hits[k];
+
+		hit.t = t[k];
+		hit.u = u[k];
+		hit.v = v[k];
+		hit.face = (int)face[k];
+		hit.prim.type = (int)types[k];
+		hit.prim.index = (int)ids[k];
+	}
+}
+
+//Scene::Intersect for count rays, S::WIDTH at a time. A short last packet repeats its last ray.
+template<typename S>
+void IntersectPackets(Scene* pScene, Ray* rays, int count, RayHit* hits)
+{
+	enum { WIDTH = S::WIDTH };
+
+	RayPacket<S> packet;
+	Ray* laneRays[WIDTH];
+
+	for (int first = 0; first < count; first += WIDTH)
+	{
+		int lanes = count - first < WIDTH ? count - first : WIDTH;
+
+		for (int k = 0; k < WIDTH; k++)
+		{
+			laneRays[k] = &rays[first + (k < lanes ? k : lanes - 1)];
+		}
+
+		packet.Load(laneRays);
+		IntersectPacket<S>(pScene, packet, lanes, hits + first);
+	}
+}
+
+//The same for count rays given as the component arrays of a RayStream
+template<typename S>
+void IntersectStream(Scene* pScene, const Real* const stream[9], int count, RayHit* hits)
+{
+	enum { WIDTH = S::WIDTH };
+
+	RayPacket<S> packet;
+
+	for (int first = 0; first < count; first += WIDTH)
+	{
+		int lanes = count - first < WIDTH ? count - first : WIDTH;
+
+		packet.Load(stream, first, lanes);
+		IntersectPacket<S>(pScene, packet, lanes, hits + first);
+	}
+}
+
+//x to the power shading.power times the approximation of x to the power shading.fraction,
+//the arithmetic of FastPow in RayTracer.cpp
+template<typename S>
+inline typename S::VReal FastPowLanes(typename S::VReal x, const ShadingPoint& shading)
+{
+	typedef typename S::VReal V;
+
+	V result = S::Set1(1.0);
+	V base = x;
+
+	for (int e = shading.power; e != 0; e >>= 1)
+	{
+		if (e & 1)
+		{
+			result = result * base;
+		}
+
+		base = base * base;
+	}
+
+	if (shading.fraction > 0.0)
+	{
+		V f = S::Set1(shading.fraction);
+		result = result * (x / (f - f * x + x));
+	}
+
+	return result;
+}
+
+//The LightTerms of shading for the first count lights of a LightBuffer, given as its position
+//arrays, WIDTH lights at a time; the arrays are padded, so every register is loaded whole.
+//Each term repeats the scalar arithmetic of ComputeLightTerms in RayTracer.cpp.
+template<typename S>
+void ComputeLightTerms(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6])
+{
+	typedef typename S::VReal V;
+	typedef typename S::VMask M;
+
+	enum { WIDTH = S::WIDTH };
+
+	V px = S::Set1(shading.point[0]), py = S::Set1(shading.point[1]), pz = S::Set1(shading.point[2]);
+	V nx = S::Set1(shading.normal[0]), ny = S::Set1(shading.normal[1]), nz = S::Set1(shading.normal[2]);
+	V cx = S::Set1(shading.view[0]), cy = S::Set1(shading.view[1]), cz = S::Set1(shading.view[2]);
+	V zero = S::Set1(0.0);
+	V one = S::Set1(1.0);
+	V tiny = S::Set1((Real)1.0e-8);
+
+	for (int first = 0; first < count; first += WIDTH)
+	{
+		//the light direction and distance, Vec3::Length and Vec3::Normalise
+		V tx = S::Load(lights[0] + first) - px;
+		V ty = S::Load(lights[1] + first) - py;
+		V tz = S::Load(lights[2] + first) - pz;
+
+		V distance = S::Sqrt(tx * tx + ty * ty + tz * tz);
+		M normalise = distance > tiny;
+		V inv = one / distance;
+
+		V dx = S::Select(normalise, tx * inv, tx);
+		V dy = S::Select(normalise, ty * inv, ty);
+		V dz = S::Select(normalise, tz * inv, tz);
+
+		V theta = dx * nx + dy * ny + dz * nz;
+
+		//the half vector between the viewer and the light
+		V hx = cx + dx;
+		V hy = cy + dy;
+		V hz = cz + dz;
+
+		V length = S::Sqrt(hx * hx + hy * hy + hz * hz);
+		M normaliseHalf = length > tiny;
+		V invLength = one / length;
+
+		hx = S::Select(normaliseHalf, hx * invLength, hx);
+		hy = S::Select(normaliseHalf, hy * invLength, hy);
+		hz = S::Select(normaliseHalf, hz * invLength, hz);
+
+		V halfn = nx * hx + ny * hy + nz * hz;
+
+		S::Store(terms[0] + first, distance);
+		S::Store(terms[1] + first, dx);
+		S::Store(terms[2] + first, dy);
+		S::Store(terms[3] + first, dz);
+		S::Store(terms[4] + first, S::Select(theta > zero, theta, zero));
+		S::Store(terms[5] + first, S::Select(theta > zero, FastPowLanes<S>(S::Select(halfn > zero, halfn, zero), shading), zero));
+	}
+}
+
+}
@@ -0,0 +1,66 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+// PacketSSE.cpp : the packet tracer for SSE2, every x86-64 CPU has it.
+// Only PacketTracer.cpp calls into this file, and only after checking the CPU.
+
+#include "PacketTracer.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+#include "PacketKernels.h"
+
+static void IntersectPacketsSSE(Scene* pScene, Ray* rays, int count, RayHit* hits)
+{
+	IntersectPackets<SimdSSE>(pScene, rays, count, hits);
+}
+
+static void IntersectStreamSSE(Scene* pScene, const Real* const stream[9], int count, RayHit* hits)
+{
+	IntersectStream<SimdSSE>(pScene, stream, count, hits);
+}
+
+static void ComputeLightTermsSSE(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6])
+{
+	ComputeLightTerms<SimdSSE>(lights, count, shading, terms);
+}
+
+PacketIntersectFunc GetPacketIntersectSSE()
+{
+	return IntersectPacketsSSE;
+}
+
+PacketStreamFunc GetPacketStreamSSE()
+{
+	return IntersectStreamSSE;
+}
+
+PacketLightFunc GetPacketLightSSE()
+{
+	return ComputeLightTermsSSE;
+}
+
+#else
+
+PacketIntersectFunc GetPacketIntersectSSE()
+{
+	return nullptr;
+}
+
+PacketStreamFunc GetPacketStreamSSE()
+{
+	return nullptr;
+}
+
+PacketLightFunc GetPacketLightSSE()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+// PacketTracer.cpp : picks the packet kernel for the CPU the tracer runs on.
+
+#include "PacketTracer.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+enum CpuFeature
+{
+	CPU_SSE2,
+	CPU_AVX2,
+	CPU_AVX512F
+};
+
+static bool CpuSupports(CpuFeature feature)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	//also checks that the OS saves the wider registers
+	__builtin_cpu_init();
+
+	switch (feature)
+	{
+	case CPU_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case CPU_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case CPU_AVX512F:
+		return __builtin_cpu_supports("avx512f");
+	}
+
+	return false;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	bool avx512f = (info[1] & (1 << 16)) != 0;
+
+	//the OS has to save the ymm (bits 1, 2) and zmm (bits 5 - 7) state on a context switch
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool osAVX = (xcr0 & 0x6) == 0x6;
+	bool osAVX512 = (xcr0 & 0xe6) == 0xe6;
+
+	switch (feature)
+	{
+	case CPU_SSE2:
+		return sse2;
+	case CPU_AVX2:
+		return avx && avx2 && osAVX;
+	case CPU_AVX512F:
+		return avx512f && osAVX512;
+	}
+
+	return false;
+#else
+	(void)feature;
+	return false;
+#endif
+}
+
+static PacketKernel MakeKernel(const char* name, int registerBytes, CpuFeature feature, PacketIntersectFunc (*getIntersect)(),
+	PacketStreamFunc (*getStream)(), PacketLightFunc (*getLight)())
+{
+	PacketKernel kernel;
+
+	kernel.name = name;
+	kernel.width = registerBytes / (int)sizeof(Real);
+	kernel.supported = CpuSupports(feature);
+
+	//the entry points are compiled for their instruction set, do not even call them otherwise
+	kernel.intersect = kernel.supported ? getIntersect() : nullptr;
+	kernel.intersectStream = kernel.supported ? getStream() : nullptr;
+	kernel.lightTerms = kernel.supported ? getLight() : nullptr;
+	kernel.supported = kernel.intersect != nullptr && kernel.intersectStream != nullptr && kernel.lightTerms != nullptr;
+
+	return kernel;
+}
+
+#define PACKET_KERNEL_COUNT 3
+
+struct PacketKernelTable
+{
+	PacketKernel kernels[PACKET_KERNEL_COUNT];
+
+	PacketKernelTable()
+	{
+		kernels[0] = MakeKernel("sse2", 16, CPU_SSE2, GetPacketIntersectSSE, GetPacketStreamSSE, GetPacketLightSSE);
+		kernels[1] = MakeKernel("avx2", 32, CPU_AVX2, GetPacketIntersectAVX2, GetPacketStreamAVX2, GetPacketLightAVX2);
+		kernels[2] = MakeKernel("avx512", 64, CPU_AVX512F, GetPacketIntersectAVX512, GetPacketStreamAVX512,
+			GetPacketLightAVX512);
+	}
+};
+
+static const PacketKernelTable& GetKernelTable()
+{
+	//filled in on first use, thread safe
+	static PacketKernelTable table;
+
+	return table;
+}
+
+const PacketKernel* GetPacketKernels(int& count)
+{
+	count = PACKET_KERNEL_COUNT;
+
+	return GetKernelTable().kernels;
+}
+
+const PacketKernel* GetBestPacketKernel()
+{
+	const PacketKernelTable& table = GetKernelTable();
+
+	for (int i = PACKET_KERNEL_COUNT - 1; i >= 0; i--)
+	{
+		if (table.kernels[i].supported)
+		{
+			return &table.kernels[i];
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,56 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Ray.h"
+#include "LightBuffer.h"
+
+class Scene;
+
+//Closest hits of count rays, traced a packet of PacketKernel::width rays at a time with SIMD.
+//hits[i] receives what Scene::Intersect would report for rays[i]. The scene's acceleration
+//structure has to be up to date.
+typedef void (*PacketIntersectFunc)(Scene* pScene, Ray* rays, int count, RayHit* hits);
+
+//The same for the first count rays of a RayStream, passed as its component arrays (see
+//RayStream::GetArrays) so that the kernels never touch the container itself
+typedef void (*PacketStreamFunc)(Scene* pScene, const Real* const stream[9], int count, RayHit* hits);
+
+//The LightTerms at shading of the first count lights of a LightBuffer, passed as its position
+//arrays (see LightBuffer::GetPositions), into the arrays of a LightTerms (see LightTerms::GetArrays)
+typedef void (*PacketLightFunc)(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6]);
+
+struct PacketKernel
+{
+	const char*				name;			//instruction set, e.g. "avx2"
+	int						width;			//rays per packet
+	PacketIntersectFunc		intersect;		//nullptr if this build has no kernel for the instruction set
+	PacketStreamFunc		intersectStream;
+	PacketLightFunc			lightTerms;
+	bool					supported;		//the kernel exists and the CPU can run it
+};
+
+//Every instruction set the packet tracer knows, narrowest first
+const PacketKernel* GetPacketKernels(int& count);
+
+//The widest kernel this CPU supports, nullptr if there is none
+const PacketKernel* GetBestPacketKernel();
+
+//Entry points of PacketSSE.cpp, PacketAVX2.cpp and PacketAVX512.cpp. Each of them is compiled
+//for its own instruction set and returns nullptr if the compiler could not target it.
+PacketIntersectFunc GetPacketIntersectSSE();
+PacketIntersectFunc GetPacketIntersectAVX2();
+PacketIntersectFunc GetPacketIntersectAVX512();
+PacketStreamFunc GetPacketStreamSSE();
+PacketStreamFunc GetPacketStreamAVX2();
+PacketStreamFunc GetPacketStreamAVX512();
+PacketLightFunc GetPacketLightSSE();
+PacketLightFunc GetPacketLightAVX2();
+PacketLightFunc GetPacketLightAVX512();
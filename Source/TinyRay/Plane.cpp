@@ -25,39 +25,17 @@ Plane::~Plane()
 {
 }
 
-RayHitResult Plane::IntersectByRay(Ray& ray)
+AABB Plane::GetBoundingBox()
 {
-	RayHitResult result = Ray::s_defaultHitResult;
-	double t = FARFAR_AWAY;
-	Vector4D intersection_point;
-	
-	//TODO: Calculate the intersection the input ray and this plane
-	// Store the parametric result in t
-	// The plane equation is a*x + a*y + a*z + d = 0, where
-	// a = m_normal[0], b = m_normal[1], c = m_normal[2] and d = m_offset
-	//
-	// Note: 
-	// Some additional checks can make the test more robust
-	// 1. You should check if the ray is parallel to plane
-	// 2. Check if the ray intersects the plane from the front or the back
+	AABB box;
 
-	
-	//Calculate the exact location of the intersection using the result of t
-	t = -(ray.GetRayStart().DotProduct(m_normal) + m_offset) / ray.GetRay().DotProduct(m_normal);
-	intersection_point = ray.GetRayStart() + ray.GetRay()*t;
-	
-	if (t>0.0 && t < FARFAR_AWAY)
-	{
-		result.normal = m_normal;
-		result.t = t;
-		result.data = this;
-		result.point = intersection_point;
-	}
+	box.min.SetVector(-FARFAR_AWAY, -FARFAR_AWAY, -FARFAR_AWAY);
+	box.max.SetVector(FARFAR_AWAY, FARFAR_AWAY, FARFAR_AWAY);
 
-	return result;
+	return box;
 }
 
-void Plane::SetPlane(const Vector4D& normal, double offset)
+void Plane::SetPlane(const Vec3& normal, Real offset)
 {
 	m_normal = normal;
 	m_offset = -offset;
@@ -9,21 +9,34 @@
 ---------------------------------------------------------------------*/
 #pragma once
 #include "Primitive.h"
-#include "Vector4D.h"
+#include "Vec3.h"
 #include "Ray.h"
 
 class Plane : public Primitive
 {
 	private:
-		Vector4D			m_normal;  //normal of the plane
-		double			m_offset;  //displacement along the normal
+		Vec3			m_normal;  //normal of the plane
+		Real			m_offset;  //displacement along the normal
 
 	public:
 						Plane();
 						~Plane();
 
-		RayHitResult	IntersectByRay(Ray& ray);
+		//a plane is infinite and is never put into a BVH
+		bool			IsBounded() { return false; }
+		AABB			GetBoundingBox();
 
-		void SetPlane(const Vector4D& normal, double offset);
+		void SetPlane(const Vec3& normal, Real offset);
+
+		inline const Vec3& GetNormal() const
+		{
+			return m_normal;
+		}
+
+		//d in n.p + d = 0
+		inline Real GetOffset() const
+		{
+			return m_offset;
+		}
 };
 
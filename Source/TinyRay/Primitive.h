@@ -10,9 +10,13 @@
 #pragma once
 
 #include "Ray.h"
+#include "AABB.h"
 
 class Material;
 
+//The description of an object handed to Scene::AddObject. The scene copies the geometry of
+//every primitive into its PrimitiveStore, where the intersection tests live, whenever it
+//rebuilds its acceleration structure.
 class Primitive
 {
 	private:
@@ -24,7 +28,10 @@ class Primitive
 			PRIMTYPE_Plane = 0,
 			PRIMTYPE_Sphere,
 			PRIMTYPE_Triangle,
-			PRIMTYPE_Box
+			PRIMTYPE_Box,
+			PRIMTYPE_Mesh,
+			PRIMTYPE_Instance,
+			PRIMTYPE_COUNT
 		};
 
 		PRIMTYPE				m_primtype;
@@ -32,8 +39,10 @@ class Primitive
 								Primitive(){ m_pMaterial = nullptr; }
 		virtual					~Primitive(){ ; }
 
-
-		virtual RayHitResult			IntersectByRay(Ray& ray) = 0;
+		//Primitives with a finite extent go into the scene's BVH. Planes are the only ones without,
+		//the scene tests them one by one.
+		virtual bool			IsBounded() { return true; }
+		virtual AABB			GetBoundingBox() = 0;
 
 		inline void				SetMaterial(Material* pMat)
 		{
@@ -0,0 +1,205 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "PrimitiveStore.h"
+#include "Sphere.h"
+#include "Plane.h"
+#include "Triangle.h"
+#include "Box.h"
+#include "TriangleMesh.h"
+#include "Instance.h"
+
+void PrimitiveStore::Clear()
+{
+	spheres = SphereArray();
+	planes = PlaneArray();
+	triangles = TriangleArray();
+	boxes = BoxArray();
+	meshes.clear();
+	instances = InstanceArray();
+
+	for (int type = 0; type < Primitive::PRIMTYPE_COUNT; type++)
+	{
+		m_materialIds[type].clear();
+	}
+
+	m_materialTable.Clear();
+}
+
+PrimHandle PrimitiveStore::Add(Primitive* prim)
+{
+	PrimHandle handle;
+	handle.type = prim->m_primtype;
+	handle.index = GetCount(handle.type);
+
+	//room at the end of the arrays of the type, Update fills it in
+	switch (handle.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		spheres.Resize(handle.index + 1);
+		break;
+	case Primitive::PRIMTYPE_Plane:
+		planes.Resize(handle.index + 1);
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		triangles.Resize(handle.index + 1);
+		break;
+	case Primitive::PRIMTYPE_Mesh:
+		meshes.resize(handle.index + 1);
+		break;
+	case Primitive::PRIMTYPE_Instance:
+		instances.Resize(handle.index + 1);
+		break;
+	default:
+		boxes.Resize(handle.index + 1);
+		break;
+	}
+
+	m_materialIds[handle.type].resize(handle.index + 1);
+
+	Update(handle, prim);
+
+	return handle;
+}
+
+void PrimitiveStore::Update(PrimHandle handle, Primitive* prim)
+{
+	int i = handle.index;
+
+	switch (handle.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+	{
+		Sphere* sphere = static_cast<Sphere*>(prim);
+		const Vec3& centre = sphere->GetCentre();
+
+		spheres.cx[i] = centre[0];
+		spheres.cy[i] = centre[1];
+		spheres.cz[i] = centre[2];
+		spheres.radius[i] = sphere->GetRadius();
+		break;
+	}
+	case Primitive::PRIMTYPE_Plane:
+	{
+		Plane* plane = static_cast<Plane*>(prim);
+		const Vec3& normal = plane->GetNormal();
+
+		planes.nx[i] = normal[0];
+		planes.ny[i] = normal[1];
+		planes.nz[i] = normal[2];
+		planes.offset[i] = plane->GetOffset();
+		break;
+	}
+	case Primitive::PRIMTYPE_Triangle:
+	{
+		Triangle* triangle = static_cast<Triangle*>(prim);
+		const Vec3& v0 = triangle->GetVertex(0);
+		const Vec3& edge1 = triangle->GetEdge1();
+		const Vec3& edge2 = triangle->GetEdge2();
+
+		triangles.v0x[i] = v0[0];
+		triangles.v0y[i] = v0[1];
+		triangles.v0z[i] = v0[2];
+		triangles.e1x[i] = edge1[0];
+		triangles.e1y[i] = edge1[1];
+		triangles.e1z[i] = edge1[2];
+		triangles.e2x[i] = edge2[0];
+		triangles.e2y[i] = edge2[1];
+		triangles.e2z[i] = edge2[2];
+		triangles.normal[i] = triangle->GetNormal();
+		break;
+	}
+	case Primitive::PRIMTYPE_Mesh:
+	{
+		TriangleMesh* mesh = static_cast<TriangleMesh*>(prim);
+		mesh->Build();
+
+		meshes[i] = mesh;
+		break;
+	}
+	case Primitive::PRIMTYPE_Instance:
+	{
+		Instance* instance = static_cast<Instance*>(prim);
+		instance->GetMesh()->Build();
+
+		instances.mesh[i] = instance->GetMesh();
+		instances.worldToObject[i] = instance->GetInverseTransform();
+		break;
+	}
+	default:
+	{
+		Box* box = static_cast<Box*>(prim);
+		AABB bounds = box->GetBoundingBox();
+
+		boxes.minx[i] = bounds.min[0];
+		boxes.miny[i] = bounds.min[1];
+		boxes.minz[i] = bounds.min[2];
+		boxes.maxx[i] = bounds.max[0];
+		boxes.maxy[i] = bounds.max[1];
+		boxes.maxz[i] = bounds.max[2];
+
+		for (int face = 0; face < 6; face++)
+		{
+			boxes.faceNormals[i * 6 + face] = box->GetFaceNormal(face);
+		}
+		break;
+	}
+	}
+
+	m_materialIds[handle.type][i] = m_materialTable.Add(prim->GetMaterial());
+}
+
+void PrimitiveStore::ComputeSurface(Ray& ray, const RayHit& hit, RayHitResult& result) const
+{
+	int i = hit.prim.index;
+
+	result.t = hit.t;
+	result.u = hit.u;
+	result.v = hit.v;
+	result.prim = hit.prim;
+	result.material = m_materialIds[hit.prim.type][i];
+	result.footprint = 0.0;
+	result.uvDensity = 0.0;
+	result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+
+	switch (hit.prim.type)
+	{
+	case Primitive::PRIMTYPE_Sphere:
+		//normals vary across the surface of a sphere, they point from the centre to the hit
+		result.normal = (result.point - Vec3(spheres.cx[i], spheres.cy[i], spheres.cz[i])).Normalise();
+		break;
+	case Primitive::PRIMTYPE_Plane:
+		result.normal = Vec3(planes.nx[i], planes.ny[i], planes.nz[i]);
+		break;
+	case Primitive::PRIMTYPE_Triangle:
+		result.normal = triangles.normal[i];
+		break;
+	case Primitive::PRIMTYPE_Mesh:
+		meshes[i]->ComputeSurface(ray, hit, result);
+		break;
+	case Primitive::PRIMTYPE_Instance:
+	{
+		//the surface of the mesh in object space, its normal taken back into the world
+		Ray local;
+		instances.ToObjectSpace(i, ray, local);
+		instances.mesh[i]->ComputeSurface(local, hit, result);
+
+		result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+		result.normal = instances.worldToObject[i].TransformNormalByInverse(result.normal).Normalise();
+
+		//the local ray covers the same t, so its length is the object space length of a unit
+		//in the world, exactly so for a uniform scale
+		result.uvDensity *= local.GetRay().Length();
+		break;
+	}
+	default:
+		result.normal = boxes.faceNormals[i * 6 + hit.face];
+		break;
+	}
+}
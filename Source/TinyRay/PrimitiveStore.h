@@ -0,0 +1,451 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <math.h>
+#include <vector>
+
+#include "Primitive.h"
+#include "Material.h"
+#include "Triangle.h"
+#include "TriangleMesh.h"
+#include "Transform.h"
+
+//The scene's primitives in structure of arrays layout, one set of arrays per type, so that
+//the intersection loops read consecutive primitives of one kind without a virtual call or a
+//pointer to follow. A primitive is known by its PrimHandle: its type and its index in the
+//arrays of that type. The tests repeat the arithmetic the primitive classes always used,
+//operation for operation, so they give the same hits. Meshes keep their own buffers and are
+//only referenced, as are the meshes of instances.
+
+struct SphereArray
+{
+	std::vector<Real>	cx, cy, cz;		//centres
+	std::vector<Real>	radius;
+
+	inline int Size() const
+	{
+		return (int)radius.size();
+	}
+
+	inline void Resize(int count)
+	{
+		cx.resize(count); cy.resize(count); cz.resize(count);
+		radius.resize(count);
+	}
+
+	//Parametric distance to the closest intersection with sphere i, FARFAR_AWAY if there is none
+	inline Real IntersectDistance(int i, Ray& ray) const
+	{
+		const Vec3& start = ray.GetRayStart();
+		const Vec3& dir = ray.GetRay();
+
+		Real sx = start[0] - cx[i];
+		Real sy = start[1] - cy[i];
+		Real sz = start[2] - cz[i];
+
+		Real rayDotSmC = dir[0] * sx + dir[1] * sy + dir[2] * sz;
+		Real rayDotProd = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+		Real sDotS = sx * sx + sy * sy + sz * sz;
+
+		Real det = rayDotSmC * rayDotSmC - (rayDotProd * (sDotS - radius[i] * radius[i]));
+
+		if (det < 0)
+		{
+			return FARFAR_AWAY;
+		}
+
+		Real t;
+
+		if (det == 0)
+		{
+			t = -rayDotSmC / rayDotProd;
+		}
+		else
+		{
+			Real root = sqrt(det);
+			Real t_pos = (-rayDotSmC + root) / rayDotProd;
+			Real t_neg = (-rayDotSmC - root) / rayDotProd;
+
+			t = t_pos < t_neg ? t_pos : t_neg;
+		}
+
+		if (t > ray.GetTMin() && t < ray.GetTMax())
+		{
+			return t;
+		}
+
+		return FARFAR_AWAY;
+	}
+};
+
+struct PlaneArray
+{
+	std::vector<Real>	nx, ny, nz;		//normals
+	std::vector<Real>	offset;			//d in n.p + d = 0
+
+	inline int Size() const
+	{
+		return (int)offset.size();
+	}
+
+	inline void Resize(int count)
+	{
+		nx.resize(count); ny.resize(count); nz.resize(count);
+		offset.resize(count);
+	}
+
+	inline Real IntersectDistance(int i, Ray& ray) const
+	{
+		const Vec3& start = ray.GetRayStart();
+		const Vec3& dir = ray.GetRay();
+
+		Real startDotN = start[0] * nx[i] + start[1] * ny[i] + start[2] * nz[i];
+		Real rayDotN = dir[0] * nx[i] + dir[1] * ny[i] + dir[2] * nz[i];
+
+		Real t = -(startDotN + offset[i]) / rayDotN;
+
+		if (t > ray.GetTMin() && t < ray.GetTMax())
+		{
+			return t;
+		}
+
+		return FARFAR_AWAY;
+	}
+};
+
+struct TriangleArray
+{
+	std::vector<Real>	v0x, v0y, v0z;		//first vertices
+	std::vector<Real>	e1x, e1y, e1z;		//v1 - v0
+	std::vector<Real>	e2x, e2y, e2z;		//v2 - v0
+	std::vector<Vec3>	normal;				//only read for the closest hit
+
+	inline int Size() const
+	{
+		return (int)normal.size();
+	}
+
+	inline void Resize(int count)
+	{
+		v0x.resize(count); v0y.resize(count); v0z.resize(count);
+		e1x.resize(count); e1y.resize(count); e1z.resize(count);
+		e2x.resize(count); e2y.resize(count); e2z.resize(count);
+		normal.resize(count);
+	}
+
+	//See IntersectTriangleMT
+	inline Real IntersectDistance(int i, Ray& ray, Real& u, Real& v) const
+	{
+		const Real v0[3] = { v0x[i], v0y[i], v0z[i] };
+		const Real edge1[3] = { e1x[i], e1y[i], e1z[i] };
+		const Real edge2[3] = { e2x[i], e2y[i], e2z[i] };
+
+		return IntersectTriangleMT(ray.GetRayStart(), ray.GetRay(), v0, edge1, edge2, ray.GetTMin(), ray.GetTMax(), u, v);
+	}
+};
+
+struct BoxArray
+{
+	std::vector<Real>	minx, miny, minz;
+	std::vector<Real>	maxx, maxy, maxz;
+	std::vector<Vec3>	faceNormals;		//six per box, in the order of Box::GetFaceNormal
+
+	inline int Size() const
+	{
+		return (int)minx.size();
+	}
+
+	inline void Resize(int count)
+	{
+		minx.resize(count); miny.resize(count); minz.resize(count);
+		maxx.resize(count); maxy.resize(count); maxz.resize(count);
+		faceNormals.resize(count * 6);
+	}
+
+	//Slab test against box i, face receives the index of the face that is hit
+	inline Real IntersectDistance(int i, Ray& ray, int& face) const
+	{
+		const Vec3& start = ray.GetRayStart();
+		const Vec3& invdir = ray.GetInvRay();
+
+		const Real bmin[3] = { minx[i], miny[i], minz[i] };
+		const Real bmax[3] = { maxx[i], maxy[i], maxz[i] };
+
+		Real tnear = -FARFAR_AWAY;
+		Real tfar = FARFAR_AWAY;
+		int nearFace = 0;
+		int farFace = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			//distances to the min and max planes of this slab, swapped so that t0 is the entry
+			Real tmin = (bmin[axis] - start[axis]) * invdir[axis];
+			Real tmax = (bmax[axis] - start[axis]) * invdir[axis];
+			bool negative = ray.GetSign(axis) != 0;
+
+			Real t0 = negative ? tmax : tmin;
+			Real t1 = negative ? tmin : tmax;
+
+			//a NaN (ray inside the plane of a slab) fails both tests and leaves the interval alone
+			if (t0 > tnear)
+			{
+				tnear = t0;
+				nearFace = axis * 2 + (negative ? 1 : 0);
+			}
+
+			if (t1 < tfar)
+			{
+				tfar = t1;
+				farFace = axis * 2 + (negative ? 0 : 1);
+			}
+		}
+
+		if (tnear > tfar)
+		{
+			return FARFAR_AWAY;
+		}
+
+		//the entry point if it lies ahead, otherwise the ray starts inside and leaves through tfar
+		if (tnear > ray.GetTMin())
+		{
+			if (tnear >= ray.GetTMax())
+			{
+				return FARFAR_AWAY;
+			}
+
+			face = nearFace;
+			return tnear;
+		}
+
+		if (tfar > ray.GetTMin() && tfar < ray.GetTMax())
+		{
+			face = farFace;
+			return tfar;
+		}
+
+		return FARFAR_AWAY;
+	}
+};
+
+//Instances of shared meshes, see Instance. A ray is taken into the object space of the
+//instance and traced through the mesh's BVH; its direction is not renormalised there, so the
+//distances found are the distances along the world space ray.
+struct InstanceArray
+{
+	std::vector<const TriangleMesh*>	mesh;
+	std::vector<Transform>				worldToObject;
+
+	inline int Size() const
+	{
+		return (int)mesh.size();
+	}
+
+	inline void Resize(int count)
+	{
+		mesh.resize(count);
+		worldToObject.resize(count);
+	}
+
+	inline void ToObjectSpace(int i, Ray& ray, Ray& local) const
+	{
+		local.SetRay(worldToObject[i].TransformPoint(ray.GetRayStart()), worldToObject[i].TransformVector(ray.GetRay()));
+		local.SetInterval(ray.GetTMin(), ray.GetTMax());
+	}
+
+	//TriangleMesh::Intersect in the object space of instance i
+	inline bool Intersect(int i, Ray& ray, RayHit& hit) const
+	{
+		Ray local;
+		ToObjectSpace(i, ray, local);
+
+		return mesh[i]->Intersect(local, hit);
+	}
+
+	inline bool Occluded(int i, Ray& ray, Real maxDistance) const
+	{
+		Ray local;
+		ToObjectSpace(i, ray, local);
+
+		return mesh[i]->Occluded(local, maxDistance);
+	}
+};
+
+class PrimitiveStore
+{
+	private:
+		std::vector<MaterialId>	m_materialIds[Primitive::PRIMTYPE_COUNT];	//per type, in the order of its arrays
+		MaterialTable			m_materialTable;
+
+	public:
+		SphereArray		spheres;
+		PlaneArray		planes;
+		TriangleArray	triangles;
+		BoxArray		boxes;
+		std::vector<const TriangleMesh*>	meshes;		//owned by the scene
+		InstanceArray	instances;
+
+		void Clear();
+
+		//Number of primitives of type, a Primitive::PRIMTYPE
+		inline int GetCount(int type) const
+		{
+			switch (type)
+			{
+			case Primitive::PRIMTYPE_Sphere:
+				return spheres.Size();
+			case Primitive::PRIMTYPE_Plane:
+				return planes.Size();
+			case Primitive::PRIMTYPE_Triangle:
+				return triangles.Size();
+			case Primitive::PRIMTYPE_Mesh:
+				return (int)meshes.size();
+			case Primitive::PRIMTYPE_Instance:
+				return instances.Size();
+			default:
+				return boxes.Size();
+			}
+		}
+
+		//Copy the geometry of prim to the end of the arrays of its type and its material into
+		//the material table. A mesh, also that of an instance, is built if it has to be and only
+		//its pointer is kept.
+		PrimHandle Add(Primitive* prim);
+
+		//Copy prim over the primitive it was added as, after it moved or changed otherwise, and
+		//its material over the material's entry
+		void Update(PrimHandle handle, Primitive* prim);
+
+		//Closest hit test against one primitive, see Primitive::Intersect
+		inline bool Intersect(PrimHandle prim, Ray& ray, RayHit& hit) const
+		{
+			Real t;
+			Real u = 0.0, v = 0.0;
+			int face = 0;
+
+			switch (prim.type)
+			{
+			case Primitive::PRIMTYPE_Sphere:
+				t = spheres.IntersectDistance(prim.index, ray);
+				break;
+			case Primitive::PRIMTYPE_Plane:
+				t = planes.IntersectDistance(prim.index, ray);
+				break;
+			case Primitive::PRIMTYPE_Triangle:
+				t = triangles.IntersectDistance(prim.index, ray, u, v);
+				break;
+			case Primitive::PRIMTYPE_Mesh:
+				if (!meshes[prim.index]->Intersect(ray, hit))
+				{
+					return false;
+				}
+
+				hit.prim = prim;
+				return true;
+			case Primitive::PRIMTYPE_Instance:
+				if (!instances.Intersect(prim.index, ray, hit))
+				{
+					return false;
+				}
+
+				hit.prim = prim;
+				return true;
+			default:
+				t = boxes.IntersectDistance(prim.index, ray, face);
+				break;
+			}
+
+			if (t >= hit.t)
+			{
+				return false;
+			}
+
+			hit.t = t;
+			hit.u = u;
+			hit.v = v;
+			hit.face = face;
+			hit.prim = prim;
+
+			return true;
+		}
+
+		//Only the distance, FARFAR_AWAY if prim is not hit
+		inline Real IntersectDistance(PrimHandle prim, Ray& ray) const
+		{
+			Real u, v;
+			int face;
+
+			switch (prim.type)
+			{
+			case Primitive::PRIMTYPE_Sphere:
+				return spheres.IntersectDistance(prim.index, ray);
+			case Primitive::PRIMTYPE_Plane:
+				return planes.IntersectDistance(prim.index, ray);
+			case Primitive::PRIMTYPE_Triangle:
+				return triangles.IntersectDistance(prim.index, ray, u, v);
+			case Primitive::PRIMTYPE_Mesh:
+			{
+				RayHit hit = Ray::s_defaultHit;
+				meshes[prim.index]->Intersect(ray, hit);
+
+				return hit.t;
+			}
+			case Primitive::PRIMTYPE_Instance:
+			{
+				RayHit hit = Ray::s_defaultHit;
+				instances.Intersect(prim.index, ray, hit);
+
+				return hit.t;
+			}
+			default:
+				return boxes.IntersectDistance(prim.index, ray, face);
+			}
+		}
+
+		//True if prim lies on the ray before maxDistance, for shadow rays
+		inline bool Occludes(PrimHandle prim, Ray& ray, Real maxDistance) const
+		{
+			if (prim.type == Primitive::PRIMTYPE_Mesh)
+			{
+				return meshes[prim.index]->Occluded(ray, maxDistance);
+			}
+
+			if (prim.type == Primitive::PRIMTYPE_Instance)
+			{
+				return instances.Occluded(prim.index, ray, maxDistance);
+			}
+
+			return IntersectDistance(prim, ray) < maxDistance;
+		}
+
+		//The point and normal of a hit on hit.prim, the rest of the result is taken from hit
+		void ComputeSurface(Ray& ray, const RayHit& hit, RayHitResult& result) const;
+
+		inline MaterialId GetMaterialId(PrimHandle prim) const
+		{
+			return m_materialIds[prim.type][prim.index];
+		}
+
+		inline const MaterialRecord& GetMaterial(MaterialId id) const
+		{
+			return m_materialTable.Get(id);
+		}
+
+		inline const MaterialRecord& GetMaterial(PrimHandle prim) const
+		{
+			return m_materialTable.Get(m_materialIds[prim.type][prim.index]);
+		}
+
+		//The materials of the primitives, each once
+		inline const MaterialTable& GetMaterialTable() const
+		{
+			return m_materialTable;
+		}
+};
@@ -9,12 +9,40 @@
 ---------------------------------------------------------------------*/
 #include "Ray.h"
 
-RayHitResult Ray::s_defaultHitResult;
+//Set up once before main() so that rays can be created concurrently
+static RayHitResult MakeDefaultHitResult()
+{
+	RayHitResult result;
+
+	result.prim.type = 0;
+	result.prim.index = -1;
+	result.t = FARFAR_AWAY;
+	result.u = result.v = 0.0;
+	result.material = 0;
+	result.footprint = 0.0;
+	result.uvDensity = 0.0;
+
+	return result;
+}
+
+static RayHit MakeDefaultHit()
+{
+	RayHit hit;
+
+	hit.t = FARFAR_AWAY;
+	hit.u = hit.v = 0.0;
+	hit.face = 0;
+	hit.prim.type = 0;
+	hit.prim.index = -1;
+
+	return hit;
+}
+
+RayHitResult Ray::s_defaultHitResult = MakeDefaultHitResult();
+RayHit Ray::s_defaultHit = MakeDefaultHit();
 
 Ray::Ray()
 {
-	s_defaultHitResult.data = nullptr;
-	s_defaultHitResult.t = FARFAR_AWAY;
 }
 
 
@@ -9,45 +9,143 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
-#include "Vector4D.h"
+#include "Vec3.h"
 
-#define FARFAR_AWAY  1000000.0			//let's hope this is reasonably large ;)
+#define FARFAR_AWAY  ((Real)1000000.0)			//let's hope this is reasonably large ;)
+
+//The index of a material in the scene's MaterialTable
+typedef unsigned int MaterialId;
+
+//A primitive of the scene: its type (Primitive::PRIMTYPE) and its index among the scene's
+//primitives of that type, see PrimitiveStore
+struct PrimHandle
+{
+	int type;
+	int index;			//-1 for none
+
+	inline bool IsValid() const
+	{
+		return index >= 0;
+	}
+
+	inline bool operator == (const PrimHandle& rhs) const
+	{
+		return type == rhs.type && index == rhs.index;
+	}
+
+	inline bool operator != (const PrimHandle& rhs) const
+	{
+		return !(*this == rhs);
+	}
+};
 
 //A basic struct for recording a ray hit result
 struct RayHitResult
 {
-	Vector4D	normal;			// the surface normal at the intersection ( e.g. useful for lighting);
-	Vector4D point;			// the exact position of the intersection point
-	double t;				//the parametric value of the resulting intersections
-	void* data;				//a pointer to misc. data, e.g. this could be material data for calculating lighting; or the hit object itself
+	Vec3	normal;			// the surface normal at the intersection ( e.g. useful for lighting);
+	Vec3 point;			// the exact position of the intersection point
+	Real t;				//the parametric value of the resulting intersections
+	Real u, v;			//surface parameters of the hit, e.g. the barycentric coordinates on a triangle
+	PrimHandle prim;		//the primitive that was hit, invalid for a miss
+	MaterialId material;	//the material of prim, 0 for a miss
+	Real footprint;		//the width of the ray's cone where it hits, 0 for a ray without one, see RayTracer
+	Real uvDensity;		//texture coordinate units per unit of length on the surface, 0 without texture coordinates
+};
+
+//What the intersection pass keeps for the closest hit so far. Only the primitive that wins
+//turns it into a full RayHitResult, see PrimitiveStore::ComputeSurface.
+struct RayHit
+{
+	Real t;				//the parametric value of the intersection
+	Real u, v;			//surface parameters of the hit, e.g. the barycentric coordinates on a triangle
+	int face;			//the face that was hit on primitives made of several faces, e.g. a box
+	PrimHandle prim;	//the primitive that was hit, invalid for none
 };
 
+//A ray and what every test against it needs, worked out once when it is set: the reciprocal
+//direction and its signs for the slab tests, and the interval [tmin, tmax] that hits are looked
+//for in. SetRay opens the interval to [0, FARFAR_AWAY], which the tests have always used.
 class Ray
 {
 
 	private:
-		Vector4D				m_start;   //origin of the ray
-		Vector4D				m_ray;     //direct of the ray, this must be a unit vector
+		Vec3				m_start;   //origin of the ray
+		Vec3				m_ray;     //direct of the ray, this must be a unit vector
+		Vec3				m_invRay;  //component-wise reciprocal of m_ray for slab tests
+		int					m_sign[3]; //1 where m_invRay is negative (a -0 direction included), 0 elsewhere
+		Real				m_tmin;    //hits are only accepted beyond m_tmin
+		Real				m_tmax;    //and before m_tmax
+
+		inline void SetDerived()
+		{
+			m_sign[0] = m_invRay[0] < 0.0 ? 1 : 0;
+			m_sign[1] = m_invRay[1] < 0.0 ? 1 : 0;
+			m_sign[2] = m_invRay[2] < 0.0 ? 1 : 0;
+			m_tmin = 0.0;
+			m_tmax = FARFAR_AWAY;
+		}
 
 	public:
 			static RayHitResult		s_defaultHitResult; //This is a constant for storing the default ray intersection result, i.e. nothing
+			static RayHit			s_defaultHit;		//The same for the intersection pass, t is FARFAR_AWAY and prim is invalid
 			Ray();
 			~Ray();
 
-			inline void SetRay(Vector4D start, Vector4D ray)
+			inline void SetRay(Vec3 start, Vec3 ray)
+			{
+				m_start = start;
+				m_ray = ray;
+				m_invRay = ray.Reciprocal();
+				SetDerived();
+			}
+
+			//The same for a ray whose reciprocal direction is already known
+			inline void SetRay(const Vec3& start, const Vec3& ray, const Vec3& invRay)
 			{
 				m_start = start;
 				m_ray = ray;
+				m_invRay = invRay;
+				SetDerived();
 			}
 
-			inline Vector4D& GetRay()
+			//Only look for hits with tmin < t < tmax, e.g. to leave a surface without an offset
+			//or to stop at a light; set after SetRay
+			inline void SetInterval(Real tmin, Real tmax)
+			{
+				m_tmin = tmin;
+				m_tmax = tmax;
+			}
+
+			inline Real GetTMin() const
+			{
+				return m_tmin;
+			}
+
+			inline Real GetTMax() const
+			{
+				return m_tmax;
+			}
+
+			//1 if the direction is negative along axis, the index of the near plane of a slab
+			//stored as [min, max]
+			inline int GetSign(int axis) const
+			{
+				return m_sign[axis];
+			}
+
+			inline Vec3& GetRay()
 			{
 				return m_ray;
 			}
 
-			inline Vector4D& GetRayStart()
+			inline Vec3& GetRayStart()
 			{
 				return m_start;
 			}
+
+			inline Vec3& GetInvRay()
+			{
+				return m_invRay;
+			}
 };
 
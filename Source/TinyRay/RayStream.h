@@ -0,0 +1,89 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "Ray.h"
+
+//A queue of rays in structure of arrays layout, one array per component, so that SIMD code
+//loads the same component of consecutive rays with a single instruction. Push gives a ray
+//exactly the values Ray::SetRay would, and GetRay turns it back into a Ray.
+struct RayStream
+{
+	std::vector<Real>	ox, oy, oz;		//ray starts
+	std::vector<Real>	dx, dy, dz;		//ray directions, unit vectors
+	std::vector<Real>	ix, iy, iz;		//component-wise reciprocals of the directions
+	int					count;
+
+	RayStream()
+	{
+		count = 0;
+	}
+
+	//Empty the queue, the arrays keep their capacity
+	inline void Clear()
+	{
+		count = 0;
+	}
+
+	inline void Push(const Vec3& start, const Vec3& dir)
+	{
+		Push(start, dir, dir.Reciprocal());
+	}
+
+	inline void Push(const Vec3& start, const Vec3& dir, const Vec3& inv)
+	{
+		if (count == (int)ox.size())
+		{
+			Grow(count > 0 ? count * 2 : 256);
+		}
+
+		ox[count] = start[0]; oy[count] = start[1]; oz[count] = start[2];
+		dx[count] = dir[0]; dy[count] = dir[1]; dz[count] = dir[2];
+		ix[count] = inv[0]; iy[count] = inv[1]; iz[count] = inv[2];
+		count++;
+	}
+
+	//Copy ray from over ray to, for compacting the queue in place
+	inline void Move(int from, int to)
+	{
+		ox[to] = ox[from]; oy[to] = oy[from]; oz[to] = oz[from];
+		dx[to] = dx[from]; dy[to] = dy[from]; dz[to] = dz[from];
+		ix[to] = ix[from]; iy[to] = iy[from]; iz[to] = iz[from];
+	}
+
+	inline void GetRay(int i, Ray& ray) const
+	{
+		ray.SetRay(Vec3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]), Vec3(ix[i], iy[i], iz[i]));
+	}
+
+	//The nine component arrays in the order ox, oy, oz, dx, dy, dz, ix, iy, iz
+	inline void GetArrays(const Real* arrays[9]) const
+	{
+		const std::vector<Real>* components[9] = { &ox, &oy, &oz, &dx, &dy, &dz, &ix, &iy, &iz };
+
+		for (int i = 0; i < 9; i++)
+		{
+			arrays[i] = components[i]->data();
+		}
+	}
+
+	private:
+		void Grow(int size)
+		{
+			std::vector<Real>* components[9] = { &ox, &oy, &oz, &dx, &dy, &dz, &ix, &iy, &iz };
+
+			for (int i = 0; i < 9; i++)
+			{
+				components[i]->resize(size);
+			}
+		}
+};
@@ -8,36 +8,179 @@
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
 #include <math.h>
-
-#ifdef WIN32
-#include <Windows.h>
-#include <gl/GL.h>
-#endif
-
-#ifdef __APPLE__
-#include <OpenGL/gl.h>
-#endif
+#include <stdio.h>
+#include <algorithm>
 
 #include "RayTracer.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "Camera.h"
+#include "Texture.h"
+
+//Shadow rays start this far towards the light so they do not hit the surface they leave
+#define SHADOW_RAY_OFFSET	1.0e-4
+
+//A ray cone meeting a surface at a grazing angle is taken to be no wider on it than at this
+//cosine, so that the texture is not blurred to its last mip level
+#define TEXTURE_MIN_COSINE	0.125
+
+//Hits lit by at most this many lights are shaded one light at a time straight from the scene's
+//light buffer: gathering so few into the arrays of the kernels costs more than it saves
+#define SHADE_DIRECT_LIGHTS	2
+
+//The secondary rays of a hit, shared by TraceScene and the wavefront renderer so that both
+//compute them with exactly the same arithmetic
+static inline Vec3 ReflectionDirection(const Vec3& dir, const Vec3& normal)
+{
+	Real c = -(normal.DotProduct(dir));
+
+	return dir + (normal * c * 2);
+}
+
+static inline Vec3 RefractionDirection(const Vec3& dir, const Vec3& normal)
+{
+	Real C = -(normal.DotProduct(dir));
+
+	Real n1 = 0.5;
+	Real n2 = 0.2;
+	Real n = n1/n2; // n1/n2
+
+	Real C2 = sqrt(1 - pow(n, 2)) * (1 - pow(C, 2));
+
+	return ((dir * n) + (normal * (C - C2 * n)));
+}
+
+//The shadow ray from surface_point to a light lightDistance away along lightDirection, and
+//how far it has to be clear of occluders
+static inline Real MakeShadowRay(const Vec3& surface_point, const Vec3& lightDirection, Real lightDistance, Ray& shadowray)
+{
+	shadowray.SetRay(surface_point + lightDirection * SHADOW_RAY_OFFSET, lightDirection);
+
+	return lightDistance - SHADOW_RAY_OFFSET;
+}
+
+//x to the power of a specular exponent split into its integer part power and the rest: the
+//integer power by repeated squaring, times x / (f - f x + x) (Schlick's approximation of x to
+//the power f) for a fraction f. The packet kernels repeat this arithmetic, see FastPowLanes.
+static inline Real FastPow(Real x, int power, Real fraction)
+{
+	Real result = 1.0;
+	Real base = x;
+
+	for (int e = power; e != 0; e >>= 1)
+	{
+		if (e & 1)
+		{
+			result = result * base;
+		}
+
+		base = base * base;
+	}
+
+	if (fraction > 0.0)
+	{
+		result = result * (x / (fraction - fraction * x + x));
+	}
+
+	return result;
+}
+
+//The LightTerms of shading for one light at x, y, z, in the order of LightTerms::GetArrays. This
+//is the arithmetic of Vec3::Length, Vec3::Normalise and Vec3::DotProduct that the packet kernels
+//repeat lane by lane, see ComputeLightTerms in PacketKernels.h.
+static inline void ComputeLightTerm(Real x, Real y, Real z, const ShadingPoint& shading, Real term[6])
+{
+	const Real* p = shading.point;
+	const Real* n = shading.normal;
+	const Real* c = shading.view;
+
+	Real tx = x - p[0];
+	Real ty = y - p[1];
+	Real tz = z - p[2];
+
+	Real distance = sqrt(tx * tx + ty * ty + tz * tz);
+	Real inv = (Real)1.0 / distance;
+	bool normalise = distance > (Real)1.0e-8;
+
+	Real dx = normalise ? tx * inv : tx;
+	Real dy = normalise ? ty * inv : ty;
+	Real dz = normalise ? tz * inv : tz;
+
+	Real theta = dx * n[0] + dy * n[1] + dz * n[2];
+
+	Real hx = c[0] + dx;
+	Real hy = c[1] + dy;
+	Real hz = c[2] + dz;
+
+	Real length = sqrt(hx * hx + hy * hy + hz * hz);
+	Real invLength = (Real)1.0 / length;
+	bool normaliseHalf = length > (Real)1.0e-8;
+
+	hx = normaliseHalf ? hx * invLength : hx;
+	hy = normaliseHalf ? hy * invLength : hy;
+	hz = normaliseHalf ? hz * invLength : hz;
+
+	Real halfn = n[0] * hx + n[1] * hy + n[2] * hz;
+
+	term[0] = distance;
+	term[1] = dx;
+	term[2] = dy;
+	term[3] = dz;
+	term[4] = theta > 0.0 ? theta : 0.0;
+	term[5] = theta > 0.0 ? FastPow(halfn > 0.0 ? halfn : 0.0, shading.power, shading.fraction) : 0.0;
+}
+
+//The LightTerms of shading one light at a time, for CPUs without a packet kernel
+static void ComputeLightTerms(const Real* const lights[3], int count, const ShadingPoint& shading, Real* const terms[6])
+{
+	for (int l = 0; l < count; l++)
+	{
+		Real term[6];
+		ComputeLightTerm(lights[0][l], lights[1][l], lights[2][l], shading, term);
+
+		for (int i = 0; i < 6; i++)
+		{
+			terms[i][l] = term[i];
+		}
+	}
+}
 
 RayTracer::RayTracer()
 {
 	m_buffHeight = m_buffWidth = 0.0;
 	m_renderCount = 0;
+	m_pThreadPool = nullptr;
+	SetPacketTracing(true);
+	SetSimdShading(true);
+	SetWavefront(false);
+	SetMaterialSorting(true);
+	SetRayCones(true);
+	m_pixelSpread = 0.0;
+	SetThreadCount(0);
+	SetTileSize(16);
 	SetTraceLevel(5);
+	SetThroughputThreshold(1.0f / 512.0f);
+	m_rayCount = 0;
 	m_traceflag = (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC |
 		TRACE_SHADOW | TRACE_REFLECTION | TRACE_REFRACTION);
 }
 
 RayTracer::RayTracer(int Width, int Height)
 {
-	m_buffWidth = Width;
-	m_buffHeight = Height;
-	m_renderCount = 0;
+	m_buffWidth = m_buffHeight = 0;
+	SetBufferSize(Width, Height);
+	m_pThreadPool = nullptr;
+	SetPacketTracing(true);
+	SetSimdShading(true);
+	SetWavefront(false);
+	SetMaterialSorting(true);
+	SetRayCones(true);
+	m_pixelSpread = 0.0;
+	SetThreadCount(0);
+	SetTileSize(16);
 	SetTraceLevel(5);
+	SetThroughputThreshold(1.0f / 512.0f);
+	m_rayCount = 0;
 	
 	m_traceflag = (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC |
 		TRACE_SHADOW | TRACE_REFLECTION | TRACE_REFRACTION);
@@ -45,201 +188,799 @@ RayTracer::RayTracer(int Width, int Height)
 
 RayTracer::~RayTracer()
 {
+	delete m_pThreadPool;
+}
 
+void RayTracer::SetPacketTracing(bool enable)
+{
+	m_pPacketKernel = enable ? GetBestPacketKernel() : nullptr;
 }
 
-void RayTracer::DoRayTrace( Scene* pScene )
+void RayTracer::SetSimdShading(bool enable)
 {
+	const PacketKernel* kernel = enable ? GetBestPacketKernel() : nullptr;
+
+	m_pLightKernel = kernel ? kernel->lightTerms : nullptr;
+}
+
+void RayTracer::SetThreadCount(int count)
+{
+	if (count <= 0)
+	{
+		count = (int)std::thread::hardware_concurrency();
+	}
+
+	m_threadCount = count > 0 ? count : 1;
+}
+
+RayTracer::TraceFlag RayTracer::GetPresetTraceFlag(int preset)
+{
+	switch (preset)
+	{
+	case 1:
+		return TRACE_AMBIENT;
+	case 2:
+		return (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC);
+	case 3:
+		return (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC | TRACE_SHADOW);
+	case 4:
+		return (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC | TRACE_REFLECTION | TRACE_SHADOW);
+	case 5:
+		return (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC | TRACE_REFRACTION);
+	default:
+		return (TraceFlag)(TRACE_AMBIENT | TRACE_DIFFUSE_AND_SPEC |
+			TRACE_REFRACTION | TRACE_REFLECTION | TRACE_SHADOW);
+	}
+}
+
+void RayTracer::SetBufferSize(int width, int height)
+{
+	m_buffWidth = width;
+	m_buffHeight = height;
+	m_framebuffer.assign(width * height * 3, 0.0f);
+	m_renderCount = 0;
+}
+
+bool RayTracer::DoRayTrace( Scene* pScene )
+{
+	if (m_renderCount != 0)
+	{
+		return false;
+	}
+
+	//the pool outlives the frame, its threads sleep between renders
+	if (m_threadCount != 1 && (!m_pThreadPool || m_pThreadPool->GetThreadCount() != m_threadCount))
+	{
+		delete m_pThreadPool;
+		m_pThreadPool = new ThreadPool(m_threadCount);
+	}
+
+	//build the BVH, with the render threads, before they start using it
+	pScene->UpdateAccelerationStructure(m_threadCount != 1 ? m_pThreadPool : nullptr);
+
 	Camera* cam = pScene->GetSceneCamera();
 	
-	Vector4D camRightVector = cam->GetRightVector();
-	Vector4D camUpVector = cam->GetUpVector();
-	Vector4D camViewVector = cam->GetViewVector();
-	Vector4D centre = cam->GetViewCentre();
-	Vector4D camPosition = cam->GetPosition();
+	Vec3 camRightVector = cam->GetRightVector();
+	Vec3 camUpVector = cam->GetUpVector();
+	Vec3 centre = cam->GetViewCentre();
 
 	double sceneWidth = pScene->GetSceneWidth();
 	double sceneHeight = pScene->GetSceneHeight();
 
-	double pixelDX = sceneWidth / m_buffWidth;
-	double pixelDY = sceneHeight / m_buffHeight;
-	
-	int total = m_buffHeight*m_buffWidth;
-	int done_count = 0;
-	
-	Vector4D start;
+	ViewPlane view;
+
+	view.camUpVector = camUpVector;
+	view.camRightVector = camRightVector;
+	view.camPosition = cam->GetPosition();
+	view.pixelDX = sceneWidth / m_buffWidth;
+	view.pixelDY = sceneHeight / m_buffHeight;
 
-	start[0] = centre[0] - ((sceneWidth * camRightVector[0])
+	view.start[0] = centre[0] - ((sceneWidth * camRightVector[0])
 		+ (sceneHeight * camUpVector[0])) / 2.0;
-	start[1] = centre[1] - ((sceneWidth * camRightVector[1])
+	view.start[1] = centre[1] - ((sceneWidth * camRightVector[1])
 		+ (sceneHeight * camUpVector[1])) / 2.0;
-	start[2] = centre[2] - ((sceneWidth * camRightVector[2])
+	view.start[2] = centre[2] - ((sceneWidth * camRightVector[2])
 		+ (sceneHeight * camUpVector[2])) / 2.0;
 	
-	Colour scenebg = pScene->GetBackgroundColour();
-
-	if (m_renderCount == 0)
-	{
-		fprintf(stdout, "Trace start.\n");
-
-		glClearColor(0.0, 0.0, 0.0, 0.0);
-		glClear(GL_COLOR_BUFFER_BIT);
-
-		for (int i = 0; i < m_buffHeight; i++) {
-			for (int j = 0; j < m_buffWidth; j++) {
-
-				//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
-				Vector4D pixel;
-
-				pixel[0] = start[0] + (i + 0.5) * camUpVector[0] * pixelDY
-					+ (j + 0.5) * camRightVector[0] * pixelDX;
-				pixel[1] = start[1] + (i + 0.5) * camUpVector[1] * pixelDY
-					+ (j + 0.5) * camRightVector[1] * pixelDX;
-				pixel[2] = start[2] + (i + 0.5) * camUpVector[2] * pixelDY
-					+ (j + 0.5) * camRightVector[2] * pixelDX;
-
-				/*
-				* setup view ray
-				* In perspective projection, each view ray originates from the eye (camera) position 
-				* and pierces through a pixel in the view plane
-				*
-				* TODO: For a little extra credit, set up the view rays to produce orthographic projection
-				*/
-				Ray viewray;
-				viewray.SetRay(camPosition,	(pixel - camPosition).Normalise());
-				
-				//trace the scene using the view ray
-				//the default colour is the background colour, unless something is hit along the way
-				Colour colour = this->TraceScene(pScene, viewray, scenebg, m_traceLevel);
-
-				/*
-				* The only OpenGL code we need
-				* Draw the pixel as a coloured rectangle
-				*/
-				glColor3f(colour.red, colour.green, colour.blue);
-				glRecti(j, i, j + 1, i + 1);
+	view.background = pScene->GetBackgroundColour();
+
+	//the angle between the camera rays of neighbouring pixels, which every ray cone spreads by
+	m_pixelSpread = m_rayCones ? view.pixelDX / (centre - view.camPosition).Length() : 0.0;
+
+	//the flags only change between frames, the whole frame runs the kernel built for them
+	const TraceKernels& kernels = GetTraceKernels(m_traceflag);
+	TraceTileFunc traceTile = m_wavefront ? kernels.traceTileWavefront : kernels.traceTile;
+
+	fprintf(stdout, "Trace start.\n");
+	m_rayCount = 0;
+
+	int tilesX = (m_buffWidth + m_tileSize - 1) / m_tileSize;
+	int tilesY = (m_buffHeight + m_tileSize - 1) / m_tileSize;
+
+	if (m_threadCount == 1)
+	{
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			for (int tx = 0; tx < tilesX; tx++)
+			{
+				(this->*traceTile)(pScene, view, tx * m_tileSize, ty * m_tileSize);
+			}
+		}
+	}
+	else
+	{
+		//one task per tile; tiles covering the reflective objects take far longer than
+		//the ones covering the walls, idle threads steal whatever is still queued
+		ThreadPool::TaskGroup frame;
+		const ViewPlane* pView = &view;
+
+		for (int ty = 0; ty < tilesY; ty++)
+		{
+			for (int tx = 0; tx < tilesX; tx++)
+			{
+				int x0 = tx * m_tileSize;
+				int y0 = ty * m_tileSize;
+
+				m_pThreadPool->Submit(frame, [this, traceTile, pScene, pView, x0, y0]()
+				{
+					(this->*traceTile)(pScene, *pView, x0, y0);
+				});
 			}
-			glFlush();
 		}
 
-		fprintf(stdout, "Done!!!\n");
-		m_renderCount++;
+		m_pThreadPool->Wait(frame);
 	}
-	glFlush();
+
+	fprintf(stdout, "Done!!!\n");
+	m_renderCount++;
+
+	return true;
+}
+
+void RayTracer::MakeViewRay(const ViewPlane& view, int i, int j, Ray& viewray)
+{
+	const Vec3& start = view.start;
+	const Vec3& camUpVector = view.camUpVector;
+	const Vec3& camRightVector = view.camRightVector;
+	const Vec3& camPosition = view.camPosition;
+	Real pixelDX = view.pixelDX;
+	Real pixelDY = view.pixelDY;
+
+	//calculate the metric size of a pixel in the view plane (e.g. framebuffer)
+	Vec3 pixel;
+
+	pixel[0] = start[0] + (i + 0.5) * camUpVector[0] * pixelDY
+		+ (j + 0.5) * camRightVector[0] * pixelDX;
+	pixel[1] = start[1] + (i + 0.5) * camUpVector[1] * pixelDY
+		+ (j + 0.5) * camRightVector[1] * pixelDX;
+	pixel[2] = start[2] + (i + 0.5) * camUpVector[2] * pixelDY
+		+ (j + 0.5) * camRightVector[2] * pixelDX;
+
+	/*
+	* setup view ray
+	* In perspective projection, each view ray originates from the eye (camera) position 
+	* and pierces through a pixel in the view plane
+	*
+	* TODO: For a little extra credit, set up the view rays to produce orthographic projection
+	*/
+	viewray.SetRay(camPosition,	(pixel - camPosition).Normalise());
+}
+
+template<int FLAGS>
+void RayTracer::TraceTile(Scene* pScene, const ViewPlane& view, int x0, int y0)
+{
+	int x1 = x0 + m_tileSize < m_buffWidth ? x0 + m_tileSize : m_buffWidth;
+	int y1 = y0 + m_tileSize < m_buffHeight ? y0 + m_tileSize : m_buffHeight;
+	int rays = 0;
+
+	if (m_pPacketKernel)
+	{
+		//the camera rays of a tile are coherent, they are intersected row by row in packets
+		//and only the shading and the secondary rays are traced one at a time
+		static thread_local std::vector<Ray> viewrays;
+		static thread_local std::vector<RayHit> hits;
+
+		int width = x1 - x0;
+		int count = width * (y1 - y0);
+
+		if ((int)viewrays.size() < count)
+		{
+			viewrays.resize(count);
+			hits.resize(count);
+		}
+
+		for (int i = y0; i < y1; i++)
+		{
+			for (int j = x0; j < x1; j++)
+			{
+				MakeViewRay(view, i, j, viewrays[(i - y0) * width + j - x0]);
+			}
+		}
+
+		m_pPacketKernel->intersect(pScene, viewrays.data(), count, hits.data());
+
+		for (int i = y0; i < y1; i++)
+		{
+			float* row = &m_framebuffer[i * m_buffWidth * 3];
+
+			for (int j = x0; j < x1; j++)
+			{
+				int k = (i - y0) * width + j - x0;
+				Colour colour = TraceSceneKernel<FLAGS>(pScene, viewrays[k], view.background, m_traceLevel, &rays, &hits[k]);
+
+				row[j * 3 + 0] = colour.red;
+				row[j * 3 + 1] = colour.green;
+				row[j * 3 + 2] = colour.blue;
+			}
+		}
+
+		m_rayCount += rays;
+
+		return;
+	}
+
+	for (int i = y0; i < y1; i++) {
+		float* row = &m_framebuffer[i * m_buffWidth * 3];
+
+		for (int j = x0; j < x1; j++) {
+
+			Ray viewray;
+			MakeViewRay(view, i, j, viewray);
+			
+			//trace the scene using the view ray
+			//the default colour is the background colour, unless something is hit along the way
+			Colour colour = TraceSceneKernel<FLAGS>(pScene, viewray, view.background, m_traceLevel, &rays, nullptr);
+
+			//store the pixel, the window copies the whole framebuffer to the screen once it is done
+			row[j * 3 + 0] = colour.red;
+			row[j * 3 + 1] = colour.green;
+			row[j * 3 + 2] = colour.blue;
+		}
+	}
+
+	m_rayCount += rays;
 }
 
-Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray)
+template<int FLAGS>
+void RayTracer::TraceTileWavefront(Scene* pScene, const ViewPlane& view, int x0, int y0)
 {
-	RayHitResult result;
-	Colour outcolour = incolour;
-	std::vector<Light*>* light_list = pScene->GetLightList();
+	int x1 = x0 + m_tileSize < m_buffWidth ? x0 + m_tileSize : m_buffWidth;
+	int y1 = y0 + m_tileSize < m_buffHeight ? y0 + m_tileSize : m_buffHeight;
+	int width = x1 - x0;
+	int rays = 0;
+
+	static thread_local WavefrontBuffers buffers;
+
+	//every ray becomes a node of its pixel's ray tree, which starts out as a miss
+	WavefrontNode miss;
+	miss.colour = view.background;
+	miss.reflection = miss.refraction = -1;
+	miss.pending = m_traceLevel > 0;
+
+	buffers.queue.Clear();
+	buffers.nodes.clear();
 
-	if (tracelevel <= 0) // reach the MAX depth of the recursion.
+	for (int i = y0; i < y1; i++)
 	{
-		return outcolour;
+		for (int j = x0; j < x1; j++)
+		{
+			Ray viewray;
+			MakeViewRay(view, i, j, viewray);
+
+			int pixel = (int)buffers.nodes.size();
+			buffers.nodes.push_back(miss);
+
+			if (m_traceLevel > 0)
+			{
+				buffers.queue.Push(viewray, pixel, m_traceLevel, pixel, 0.0);
+			}
+		}
 	}
 
-	result = pScene->IntersectByRay(ray, shadowray);
+	buffers.pixelState.assign(buffers.nodes.size(), 0);
 
-	if (result.data) //the ray has hit something
+	//one bounce per pass, until no ray spawns another
+	while (buffers.queue.rays.count > 0)
 	{
+		rays += buffers.queue.rays.count;
 
-		Vector4D start = ray.GetRayStart();
-		outcolour = CalculateLighting(light_list,
-			&start,
-			&result);
-		
-		if(m_traceflag & TRACE_REFLECTION)
+		IntersectWavefront(pScene, buffers);
+
+		if ((FLAGS & TRACE_SHADOW) && (FLAGS & TRACE_DIFFUSE_AND_SPEC))
 		{
-			//Only consider reflection for spheres and boxes
-			if (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere ||
-				((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box)
+			ShadowWavefront(pScene, buffers);
+		}
+
+		ShadeWavefront<FLAGS>(pScene, buffers);
+
+		buffers.next.Clear();
+		SpawnWavefront<FLAGS>(buffers, view.background);
+		CullWavefront(buffers, view.background);
+
+		std::swap(buffers.queue, buffers.next);
+	}
+
+	for (int i = y0; i < y1; i++)
+	{
+		float* row = &m_framebuffer[i * m_buffWidth * 3];
+
+		for (int j = x0; j < x1; j++)
+		{
+			//nothing is pending any more, the walk always completes
+			Colour colour;
+			FoldRayTree(buffers.nodes, (i - y0) * width + j - x0, view.background, colour);
+
+			row[j * 3 + 0] = colour.red;
+			row[j * 3 + 1] = colour.green;
+			row[j * 3 + 2] = colour.blue;
+		}
+	}
+
+	m_rayCount += rays;
+}
+
+void RayTracer::IntersectWavefront(Scene* pScene, WavefrontBuffers& buffers)
+{
+	const RayStream& queue = buffers.queue.rays;
+
+	if ((int)buffers.hits.size() < queue.count)
+	{
+		buffers.hits.resize(queue.count);
+	}
+
+	if (m_pPacketKernel)
+	{
+		const Real* arrays[9];
+		queue.GetArrays(arrays);
+
+		m_pPacketKernel->intersectStream(pScene, arrays, queue.count, buffers.hits.data());
+	}
+	else
+	{
+		for (int i = 0; i < queue.count; i++)
+		{
+			Ray ray;
+			queue.GetRay(i, ray);
+
+			buffers.hits[i] = Ray::s_defaultHit;
+			pScene->Intersect(ray, buffers.hits[i]);
+		}
+	}
+
+	//compact the hits, the nodes of the rays that missed keep the background colour
+	buffers.hitRays.clear();
+	buffers.surfaces.clear();
+
+	for (int i = 0; i < queue.count; i++)
+	{
+		buffers.nodes[buffers.queue.node[i]].pending = false;
+
+		if (buffers.hits[i].prim.IsValid())
+		{
+			Ray ray;
+			queue.GetRay(i, ray);
+
+			buffers.hitRays.push_back(i);
+			buffers.surfaces.push_back(pScene->GetSurface(ray, buffers.hits[i]));
+			buffers.surfaces.back().footprint = buffers.queue.cone[i] + m_pixelSpread * buffers.hits[i].t;
+		}
+	}
+}
+
+void RayTracer::ShadowWavefront(Scene* pScene, WavefrontBuffers& buffers)
+{
+	const LightBuffer& lights = pScene->GetLightBuffer();
+	int slotCount = pScene->GetLightSlotCount();
+	int hitCount = (int)buffers.hitRays.size();
+
+	buffers.shadowRays.Clear();
+	buffers.shadowDistance.clear();
+	buffers.shadowLight.clear();
+	buffers.lightVisible.assign(hitCount * slotCount, 0);
+
+	//the same lights, light direction, distance and shadow ray as CalculateLighting; a surface
+	//facing away from the light shadows itself and needs no ray
+	LightSelection selection;
+
+	for (int h = 0; h < hitCount; h++)
+	{
+		const RayHitResult& result = buffers.surfaces[h];
+		pScene->SelectLights(result.point, result.normal, selection);
+
+		for (int s = 0; s < selection.count; s++)
+		{
+			int l = selection.GetLight(s);
+			Vec3 toLight = Vec3(lights.x[l], lights.y[l], lights.z[l]) - result.point;
+			Real lightDistance = toLight.Length();
+			Vec3 lightDirection = toLight.Normalise();
+
+			if (lightDirection.DotProduct(result.normal) > 0.0)
 			{
-				//TODO: Calculate reflection ray based on the current intersection result
-				//Recursively call TraceScene with the reflection ray
-				//Combine the returned colour with the current surface colour 
-				double c = -(result.normal.DotProduct(ray.GetRay()));
-				Vector4D R = ray.GetRay() + (result.normal * c * 2);
+				Ray shadowray;
+				Real maxDistance = MakeShadowRay(result.point, lightDirection, lightDistance, shadowray);
 
-				Ray reflectionRay;
-				reflectionRay.SetRay(result.point, R);
+				buffers.shadowRays.Push(shadowray.GetRayStart(), shadowray.GetRay());
+				buffers.shadowDistance.push_back(maxDistance);
+				buffers.shadowLight.push_back(h * slotCount + s);
+			}
+		}
+	}
+
+	for (int i = 0; i < buffers.shadowRays.count; i++)
+	{
+		Ray shadowray;
+		buffers.shadowRays.GetRay(i, shadowray);
+
+		buffers.lightVisible[buffers.shadowLight[i]] = !pScene->Occluded(shadowray, buffers.shadowDistance[i]);
+	}
+}
+
+template<int FLAGS>
+void RayTracer::ShadeWavefront(Scene* pScene, WavefrontBuffers& buffers)
+{
+	int slotCount = pScene->GetLightSlotCount();
+	bool shadows = (FLAGS & TRACE_SHADOW) && (FLAGS & TRACE_DIFFUSE_AND_SPEC);
+	int hitCount = (int)buffers.hitRays.size();
+
+	//the hits in the order to shade them, grouped by material with the material id in the
+	//high half of each key and the hit in the low half, or as they came without sorting
+	std::vector<uint64_t>& order = buffers.shadeOrder;
+	order.resize(hitCount);
+
+	for (int h = 0; h < hitCount; h++)
+	{
+		order[h] = m_materialSorting ? ((uint64_t)buffers.surfaces[h].material << 32) | (uint32_t)h : (uint64_t)h;
+	}
+
+	if (m_materialSorting)
+	{
+		std::sort(order.begin(), order.end());
+	}
+
+	const RayStream& queue = buffers.queue.rays;
+
+	//one batch per run of hits on the same material, which is looked up once for the batch
+	for (int first = 0; first < hitCount;)
+	{
+		MaterialId id = buffers.surfaces[(uint32_t)order[first]].material;
+		const MaterialRecord& mat = pScene->GetMaterial(id);
+		int last = first;
+
+		while (last < hitCount && buffers.surfaces[(uint32_t)order[last]].material == id)
+		{
+			int h = (int)(uint32_t)order[last];
+			int i = buffers.hitRays[h];
+			Vec3 start(queue.ox[i], queue.oy[i], queue.oz[i]);
+
+			buffers.nodes[buffers.queue.node[i]].colour = ShadeSurface<FLAGS>(pScene, mat, &start, &buffers.surfaces[h],
+				shadows ? &buffers.lightVisible[h * slotCount] : nullptr);
+
+			last++;
+		}
+
+		first = last;
+	}
+}
+
+template<int FLAGS>
+void RayTracer::SpawnWavefront(WavefrontBuffers& buffers, const Colour& background)
+{
+	if (!(FLAGS & (TRACE_REFLECTION | TRACE_REFRACTION)))
+	{
+		return;
+	}
+
+	WavefrontNode miss;
+	miss.colour = background;
+	miss.reflection = miss.refraction = -1;
+
+	for (int h = 0; h < (int)buffers.hitRays.size(); h++)
+	{
+		int i = buffers.hitRays[h];
+		RayHitResult& result = buffers.surfaces[h];
+
+		//the same rule and trace levels as TraceScene
+		bool secondary = result.prim.type == Primitive::PRIMTYPE_Sphere ||
+			result.prim.type == Primitive::PRIMTYPE_Box;
+
+		if (!secondary)
+		{
+			continue;
+		}
 
-				Colour result = TraceScene(pScene, reflectionRay, incolour, --tracelevel, false);
-				outcolour.red *= result.red;
-				outcolour.green *= result.green;
-				outcolour.blue *= result.blue;
+		const RayStream& queue = buffers.queue.rays;
+		Vec3 dir(queue.dx[i], queue.dy[i], queue.dz[i]);
 
-				// Inefficient but it works
-				//outcolour.red *= TraceScene(pScene, reflectionRay, incolour, tracelevel--, false).red;
-				//outcolour.green *= TraceScene(pScene, reflectionRay, incolour, tracelevel--, false).green;
-				//outcolour.blue *= TraceScene(pScene, reflectionRay, incolour, tracelevel--, false).blue;
+		int node = buffers.queue.node[i];
+		int level = buffers.queue.level[i];
+		int pixel = buffers.queue.pixel[i];
 
+		if (FLAGS & TRACE_REFLECTION)
+		{
+			level--;
+
+			int child = (int)buffers.nodes.size();
+			miss.pending = level > 0;
+			buffers.nodes.push_back(miss);
+			buffers.nodes[node].reflection = child;
+
+			if (level > 0)
+			{
+				buffers.next.Push(result.point, ReflectionDirection(dir, result.normal), child, level, pixel,
+					result.footprint);
 			}
 		}
 
-		if (m_traceflag & TRACE_REFRACTION)
+		if (FLAGS & TRACE_REFRACTION)
 		{
-			//Only consider refraction for spheres and boxes
-			if (((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Sphere ||
-				((Primitive*)result.data)->m_primtype == Primitive::PRIMTYPE_Box)
+			int child = (int)buffers.nodes.size();
+			miss.pending = level - 1 > 0;
+			buffers.nodes.push_back(miss);
+			buffers.nodes[node].refraction = child;
+
+			if (level - 1 > 0)
 			{
-				//TODO: Calculate refraction ray based on the current intersection result
-				//Recursively call TraceScene with the reflection ray
-				//Combine the returned colour with the current surface colour
-				double C = -(result.normal.DotProduct(ray.GetRay()));
-
-				double n1 = 0.5;
-				double n2 = 0.2;
-				double n = n1/n2; // n1/n2
-
-				double C2 = sqrt(1 - pow(n, 2)) * (1 - pow(C, 2));
-				Vector4D rr = ((ray.GetRay() * n) + (result.normal * (C - C2 * n)));
-				Ray refraction;
-				refraction.SetRay(result.point, rr);
-
-				Colour result = TraceScene(pScene, refraction, incolour, --tracelevel, false);
-				outcolour.red *= result.red;
-				outcolour.green *= result.green;
-				outcolour.blue *= result.blue;
-
-				/*outcolour.red *= TraceScene(pScene, refraction, incolour, tracelevel, false).red;
-				outcolour.green *= TraceScene(pScene, refraction, incolour, tracelevel, false).green;
-				outcolour.blue *= TraceScene(pScene, refraction, incolour, tracelevel, false).blue;*/
+				buffers.next.Push(result.point, RefractionDirection(dir, result.normal), child, level - 1, pixel,
+					result.footprint);
 			}
 		}
-		
-		//////Check if this is in shadow
-		if ( m_traceflag & TRACE_SHADOW )
+	}
+}
+
+void RayTracer::CullWavefront(WavefrontBuffers& buffers, const Colour& background)
+{
+	//TraceScene stops at the first ray it finds below the throughput threshold and closes
+	//every ray after it. Walking each tree as far as it is traced tells whether that point
+	//has been reached; if so, the pixel's queued rays would never be traced and are dropped.
+	if (m_throughputThreshold <= 0.0f)
+	{
+		return;
+	}
+
+	enum { PIXEL_UNKNOWN, PIXEL_OPEN, PIXEL_CUT };
+
+	WavefrontQueue& next = buffers.next;
+	int kept = 0;
+
+	//the walks only change when a bounce completes, each pixel is walked once per bounce
+	for (int i = 0; i < next.rays.count; i++)
+	{
+		buffers.pixelState[next.pixel[i]] = PIXEL_UNKNOWN;
+	}
+
+	for (int i = 0; i < next.rays.count; i++)
+	{
+		int& state = buffers.pixelState[next.pixel[i]];
+
+		if (state == PIXEL_UNKNOWN)
+		{
+			Colour colour;
+			state = FoldRayTree(buffers.nodes, next.pixel[i], background, colour) ? PIXEL_CUT : PIXEL_OPEN;
+		}
+
+		if (state == PIXEL_OPEN)
 		{
-			std::vector<Light*>::iterator lit_iter = light_list->begin();
-			while (lit_iter != light_list->end())
+			next.Move(i, kept++);
+		}
+	}
+
+	next.Truncate(kept);
+}
+
+bool RayTracer::FoldRayTree(const std::vector<WavefrontNode>& nodes, int root, Colour incolour, Colour& outcolour)
+{
+	//TraceScene's walk over a tree that is already traced: the colours are multiplied and the
+	//throughput threshold applied in the same order, so the result is the same to the bit
+	static thread_local int stack[RAY_STACK_SIZE];
+	int top = 0;
+
+	outcolour.red = outcolour.green = outcolour.blue = 1.0f;
+
+	stack[top++] = root;
+
+	while (top > 0)
+	{
+		if (outcolour.red < m_throughputThreshold && outcolour.green < m_throughputThreshold &&
+			outcolour.blue < m_throughputThreshold)
+		{
+			for (; top > 0; top--)
 			{
-				//TODO: Calculate the shadow ray using the current intersection result and the light position
-				//Recursively call TraceScene with the shadow ray
+				outcolour.red *= incolour.red;
+				outcolour.green *= incolour.green;
+				outcolour.blue *= incolour.blue;
+			}
+
+			break;
+		}
+
+		top--;
+		const WavefrontNode& node = nodes[stack[top]];
+
+		if (node.pending)
+		{
+			return false;
+		}
+
+		if (node.refraction >= 0)
+		{
+			stack[top++] = node.refraction;
+		}
+
+		if (node.reflection >= 0)
+		{
+			stack[top++] = node.reflection;
+		}
+
+		outcolour.red *= node.colour.red;
+		outcolour.green *= node.colour.green;
+		outcolour.blue *= node.colour.blue;
+	}
+
+	return true;
+}
+
+Colour RayTracer::TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, int* raycount,
+	const RayHit* primaryhit)
+{
+	return (this->*GetTraceKernels(m_traceflag).traceScene)(pScene, ray, incolour, tracelevel, raycount, primaryhit);
+}
+
+Colour RayTracer::CalculateLighting(Scene* pScene, Vec3* campos, RayHitResult* hitresult, const char* lightVisible)
+{
+	return (this->*GetTraceKernels(m_traceflag).calculateLighting)(pScene, campos, hitresult, lightVisible);
+}
+
+template<int FLAGS>
+Colour RayTracer::TraceSceneKernel(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, int* raycount,
+	const RayHit* primaryhit)
+{
+	if (!(FLAGS & (TRACE_REFLECTION | TRACE_REFRACTION)))
+	{
+		//without secondary rays the ray tree is ray alone, the walk below reduces to this
+		if (tracelevel <= 0 || (1.0f < m_throughputThreshold))
+		{
+			return incolour;
+		}
+
+		RayHitResult result = primaryhit ? pScene->GetSurface(ray, *primaryhit) : pScene->IntersectByRay(ray);
+		result.footprint = m_pixelSpread * result.t;
 
-				lit_iter++;
+		if (raycount)
+		{
+			*raycount += 1;
+		}
+
+		if (!result.prim.IsValid())
+		{
+			return incolour;
+		}
+
+		Vec3 start = ray.GetRayStart();
+
+		return CalculateLightingKernel<FLAGS>(pScene, &start, &result);
+	}
+
+	//The colour of a ray is the lighting where it hits multiplied by the colours of its
+	//reflection and refraction rays; a ray that misses or runs out of trace levels takes
+	//incolour. The pixel is therefore the product over its whole ray tree, which is walked
+	//depth first on a fixed-size stack instead of by recursion. The product does not depend
+	//on the order, so the running product is the throughput of every ray still waiting:
+	//once it drops below m_throughputThreshold, the waiting rays are closed like rays past
+	//the trace level. Every thread keeps its own stack, built once rather than per pixel.
+	static thread_local RayStackEntry stack[RAY_STACK_SIZE];
+	int top = 0;
+	int rays = 0;
+
+	Colour outcolour;
+	outcolour.red = outcolour.green = outcolour.blue = 1.0f;
+
+	stack[top].ray = ray;
+	stack[top].tracelevel = tracelevel;
+	stack[top].cone = 0.0;
+	top++;
+
+	while (top > 0)
+	{
+		if (outcolour.red < m_throughputThreshold && outcolour.green < m_throughputThreshold &&
+			outcolour.blue < m_throughputThreshold)
+		{
+			for (; top > 0; top--)
+			{
+				outcolour.red *= incolour.red;
+				outcolour.green *= incolour.green;
+				outcolour.blue *= incolour.blue;
+			}
+
+			break;
+		}
+
+		top--;
+		Ray current = stack[top].ray;
+		int level = stack[top].tracelevel;
+		Real cone = stack[top].cone;
+		Colour colour = incolour;
+
+		//only the first ray popped is ray itself
+		const RayHit* knownhit = primaryhit;
+		primaryhit = nullptr;
+
+		if (level > 0) //otherwise the MAX depth is reached
+		{
+			RayHitResult result = knownhit ? pScene->GetSurface(current, *knownhit) : pScene->IntersectByRay(current);
+			result.footprint = cone + m_pixelSpread * result.t;
+			rays++;
+
+			if (result.prim.IsValid()) //the ray has hit something
+			{
+				//shadows (TRACE_SHADOW) are resolved per light inside CalculateLighting
+				Vec3 start = current.GetRayStart();
+				colour = CalculateLightingKernel<FLAGS>(pScene, &start, &result);
+
+				//Only consider reflection and refraction for spheres and boxes
+				bool secondary = result.prim.type == Primitive::PRIMTYPE_Sphere ||
+					result.prim.type == Primitive::PRIMTYPE_Box;
+
+				//the reflection ray is pushed last so that it is traced first, like the recursion did;
+				//it takes one trace level and the refraction ray one more
+				Ray reflectionRay;
+				bool reflect = secondary && (FLAGS & TRACE_REFLECTION);
+
+				if (reflect)
+				{
+					reflectionRay.SetRay(result.point, ReflectionDirection(current.GetRay(), result.normal));
+					level--;
+				}
+
+				if (secondary && (FLAGS & TRACE_REFRACTION))
+				{
+					stack[top].ray.SetRay(result.point, RefractionDirection(current.GetRay(), result.normal));
+					stack[top].tracelevel = level - 1;
+					stack[top].cone = result.footprint;
+					top++;
+				}
+
+				if (reflect)
+				{
+					stack[top].ray = reflectionRay;
+					stack[top].tracelevel = level;
+					stack[top].cone = result.footprint;
+					top++;
+				}
 			}
 		}
+
+		outcolour.red *= colour.red;
+		outcolour.green *= colour.green;
+		outcolour.blue *= colour.blue;
 	}
-		
+
+	if (raycount)
+	{
+		*raycount += rays;
+	}
+
 	return outcolour;
 }
 
-Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector4D* campos, RayHitResult* hitresult)
+template<int FLAGS>
+Colour RayTracer::CalculateLightingKernel(Scene* pScene, Vec3* campos, RayHitResult* hitresult, const char* lightVisible)
 {
-	Colour outcolour;
-	std::vector<Light*>::iterator lit_iter = lights->begin();
+	//Retrive the material for the intersected primitive from the scene's table
+	return ShadeSurface<FLAGS>(pScene, pScene->GetMaterial(hitresult->material), campos, hitresult, lightVisible);
+}
 
-	//Retrive the material for the intersected primitive
-	Primitive* prim = (Primitive*)hitresult->data;
-	Material* mat = prim->GetMaterial();
+template<int FLAGS>
+Colour RayTracer::ShadeSurface(Scene* pScene, const MaterialRecord& mat, Vec3* campos, RayHitResult* hitresult,
+	const char* lightVisible)
+{
+	Colour outcolour;
 
 	//the default output colour is the ambient colour
-	outcolour = mat->GetAmbientColour();
+	outcolour = mat.ambient;
 	
 	//This is a hack to set a checker pattern on the planes
 	//Do not modify it
-	if (((Primitive*)hitresult->data)->m_primtype == Primitive::PRIMTYPE_Plane)
+	if (hitresult->prim.type == Primitive::PRIMTYPE_Plane)
 	{
 		int dx = (hitresult->point[0]/2.0);
 		int dy = (hitresult->point[1]/2.0);
@@ -260,59 +1001,198 @@ Colour RayTracer::CalculateLighting(std::vector<Light*>* lights, Vector4D* campo
 		}
 	}
 
-	////Go through all the light sources in the scene
-	//and calculate the lighting at the intersection point
-	if (m_traceflag & TRACE_DIFFUSE_AND_SPEC)
+	////Go through the light sources chosen for the intersection point, every light in the
+	//scene or a weighted few of them, and calculate the lighting there
+	if (FLAGS & TRACE_DIFFUSE_AND_SPEC)
 	{
-		while (lit_iter != lights->end())
+		Vec3 normal = hitresult->normal; //surface normal at intersection
+		Vec3 surface_point = hitresult->point; //location of the intersection on the surface
+		Vec3 camera_dir = (*campos - surface_point).Normalise();
+
+		LightSelection selection;
+		pScene->SelectLights(surface_point, normal, selection);
+
+		ShadingPoint shading;
+		double spec_power = mat.specPower;
+
+		for (int axis = 0; axis < 3; axis++)
 		{
-			Vector4D light_pos = (*lit_iter)->GetLightPosition();  //position of the light source
-			Vector4D normal = hitresult->normal; //surface normal at intersection
-			Vector4D surface_point = hitresult->point; //location of the intersection on the surface
-			
-			//TODO: Calculate the surface colour using the illumination model from the lecture notes
-			// 1. Compute the diffuse term
-			Colour surface_col = mat->GetDiffuseColour();
-			Colour light_intensity = (*lit_iter)->GetLightColour();
-			Vector4D lightDirection = (light_pos - surface_point).Normalise();
+			shading.point[axis] = surface_point[axis];
+			shading.normal[axis] = normal[axis];
+			shading.view[axis] = camera_dir[axis];
+		}
 
-			double theta = lightDirection.DotProduct(normal);
+		shading.power = spec_power > 0.0 ? (int)spec_power : 0;
+		shading.fraction = spec_power > 0.0 ? (Real)(spec_power - shading.power) : 0.0;
 
-			// Blinn Phong
-			outcolour.red += (surface_col.red * light_intensity.red) * max(0, theta);
-			outcolour.blue += (surface_col.blue * light_intensity.green) * max(0, theta);
-			outcolour.green += (surface_col.green * light_intensity.blue) * max(0, theta);
+		Colour surface_col = mat.diffuse;
+		Colour spec_col = mat.specular;
 
-			/*// Alternate way to calculate it and then add each one to outcolour
-			Colour diffuse_term;
-			diffuse_term.red = (surface_col.red * light_intensity.red) * max(0, theta);
-			diffuse_term.blue = (surface_col.blue * light_intensity.green) * max(0, theta);
-			diffuse_term.green = (surface_col.green * light_intensity.blue) * max(0, theta); */
+		//the texture maps of the material, read at the mip level whose texels are as wide as
+		//the ray cone is where it meets the surface, stretched by the angle it meets it at
+		if ((mat.diffuseMap || mat.specularMap) && hitresult->uvDensity > 0.0)
+		{
+			Real cosine = fabs(normal.DotProduct(camera_dir));
+			Real width = hitresult->footprint / (cosine > TEXTURE_MIN_COSINE ? cosine : TEXTURE_MIN_COSINE) *
+				hitresult->uvDensity;
 
-			//2. Compute the specular term using either the Phong model or the Blinn-Phong model
-			Vector4D camera_dir = (*campos - surface_point).Normalise();
-			Vector4D half = (camera_dir + lightDirection).Normalise();
-			double halfn = normal.DotProduct(half);
+			if (mat.diffuseMap)
+			{
+				Colour texel = mat.diffuseMap->Sample(hitresult->u, hitresult->v, width);
 
-			// Retrieve specular 
-			Colour spec_col = mat->GetSpecularColour();
-			double spec_power = mat->GetSpecPower();
+				surface_col.red *= texel.red;
+				surface_col.green *= texel.green;
+				surface_col.blue *= texel.blue;
+			}
 
-			// 3. store the result in outcolour
-			outcolour.red += (spec_col.red * light_intensity.red) * pow(max(0, halfn), spec_power);
-			outcolour.blue += (spec_col.blue * light_intensity.green) * pow(max(0, halfn), spec_power);
-			outcolour.green += (spec_col.green * light_intensity.blue) * pow(max(0, halfn), spec_power);
+			if (mat.specularMap)
+			{
+				Colour texel = mat.specularMap->Sample(hitresult->u, hitresult->v, width);
 
-			// Alternate way to calculate it and then add each one to outcolour
-			//Colour spec_term;
-			//spec_term.red = (spec_col.red * light_intensity.red) * pow(max(0, halfn), spec_power);
-			//spec_term.blue = (spec_col.blue * light_intensity.green) * pow(max(0, halfn), spec_power);
-			//spec_term.green = (spec_col.green * light_intensity.blue) * pow(max(0, halfn), spec_power);
+				spec_col.red *= texel.red;
+				spec_col.green *= texel.green;
+				spec_col.blue *= texel.blue;
+			}
+		}
+
+		//the light of one slot of the selection, of the given colour, with its terms in the
+		//order of LightTerms::GetArrays
+		auto addLight = [&](int slot, Colour light_intensity, const Real term[6])
+		{
+			Real weight = selection.GetWeight(slot);
+
+			light_intensity.red *= weight;
+			light_intensity.green *= weight;
+			light_intensity.blue *= weight;
+
+			//Check if this is in shadow: a surface facing away from the light shadows itself,
+			//otherwise anything that casts shadows between the surface and the light blocks it
+			if (FLAGS & TRACE_SHADOW)
+			{
+				bool visible;
+
+				if (lightVisible)
+				{
+					visible = lightVisible[slot] != 0;
+				}
+				else
+				{
+					Vec3 lightDirection(term[1], term[2], term[3]);
+					Ray shadowray;
+					Real maxDistance = MakeShadowRay(surface_point, lightDirection, term[0], shadowray);
+
+					visible = term[4] > 0.0 && !pScene->Occluded(shadowray, maxDistance);
+				}
+
+				if (!visible)
+				{
+					return;
+				}
+			}
+
+			// Blinn Phong: the diffuse term, then the specular term of the half vector
+			Real diffuse = term[4];
+			Real specular = term[5];
+
+			outcolour.red += (surface_col.red * light_intensity.red) * diffuse;
+			outcolour.green += (surface_col.green * light_intensity.green) * diffuse;
+			outcolour.blue += (surface_col.blue * light_intensity.blue) * diffuse;
+
+			outcolour.red += (spec_col.red * light_intensity.red) * specular;
+			outcolour.green += (spec_col.green * light_intensity.green) * specular;
+			outcolour.blue += (spec_col.blue * light_intensity.blue) * specular;
+		};
 
+		const LightBuffer& sceneLights = pScene->GetLightBuffer();
 
-			lit_iter++;
+		//a light or two: their terms one at a time, read straight from the scene's buffer
+		if (selection.count <= SHADE_DIRECT_LIGHTS)
+		{
+			for (int slot = 0; slot < selection.count; slot++)
+			{
+				int l = selection.GetLight(slot);
+				Colour colour = { sceneLights.red[l], sceneLights.green[l], sceneLights.blue[l] };
+				Real term[6];
+
+				ComputeLightTerm(sceneLights.x[l], sceneLights.y[l], sceneLights.z[l], shading, term);
+				addLight(slot, colour, term);
+			}
+
+			return outcolour;
+		}
+
+		//more: the light directions, diffuse and specular factors of every light at once, of
+		//the lights as the selection has them, straight from the scene's buffer or copied out
+		//of it for a sample of the lights
+		const LightBuffer* lights = &sceneLights;
+		static thread_local LightBuffer drawn;
+
+		if (selection.sampled)
+		{
+			drawn.Clear();
+
+			for (int slot = 0; slot < selection.count; slot++)
+			{
+				int l = selection.GetLight(slot);
+				Colour colour = { lights->red[l], lights->green[l], lights->blue[l] };
+
+				drawn.Push(Vec3(lights->x[l], lights->y[l], lights->z[l]), colour);
+			}
+
+			drawn.Pad();
+			lights = &drawn;
+		}
+
+		static thread_local LightTerms terms;
+		terms.Reserve(selection.count);
+
+		const Real* positions[3];
+		Real* termArrays[6];
+		lights->GetPositions(positions);
+		terms.GetArrays(termArrays);
+
+		if (m_pLightKernel)
+		{
+			m_pLightKernel(positions, selection.count, shading, termArrays);
+		}
+		else
+		{
+			ComputeLightTerms(positions, selection.count, shading, termArrays);
+		}
+
+		for (int slot = 0; slot < selection.count; slot++)
+		{
+			Colour colour = { lights->red[slot], lights->green[slot], lights->blue[slot] };
+			Real term[6] = { terms.distance[slot], terms.dx[slot], terms.dy[slot], terms.dz[slot], terms.diffuse[slot],
+				terms.specular[slot] };
+
+			addLight(slot, colour, term);
 		}
 	}
 
 	return outcolour;
 }
+
+template<int... FLAGS>
+const RayTracer::TraceKernels* RayTracer::BuildTraceKernels(std::integer_sequence<int, FLAGS...>)
+{
+	static const TraceKernels kernels[] =
+	{
+		{
+			&RayTracer::TraceTile<FLAGS>,
+			&RayTracer::TraceTileWavefront<FLAGS>,
+			&RayTracer::TraceSceneKernel<FLAGS>,
+			&RayTracer::CalculateLightingKernel<FLAGS>
+		}...
+	};
+
+	return kernels;
+}
+
+const RayTracer::TraceKernels& RayTracer::GetTraceKernels(int flags)
+{
+	//one instantiation of every kernel for each of the TRACE_FLAG_COMBINATIONS flag sets
+	static const TraceKernels* kernels = BuildTraceKernels(std::make_integer_sequence<int, TRACE_FLAG_COMBINATIONS>());
+
+	return kernels[flags & (TRACE_FLAG_COMBINATIONS - 1)];
+}
@@ -9,9 +9,24 @@
 ---------------------------------------------------------------------*/
 #pragma once
 
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <utility>
+
 #include "Material.h"
 #include "Ray.h"
 #include "Scene.h"
+#include "ThreadPool.h"
+#include "PacketTracer.h"
+#include "RayStream.h"
+
+//Number of distinct TraceFlag sets, every one of them has its own instantiation of the tracer
+#define TRACE_FLAG_COMBINATIONS	32
+
+//Capacity of the per-trace ray stack. A ray tree never holds more than its trace level plus
+//one rays waiting to be traced, so this also caps the trace level.
+#define RAY_STACK_SIZE	64
 
 class RayTracer
 {
@@ -20,6 +35,183 @@ class RayTracer
 		int				m_buffHeight;
 		int				m_renderCount;
 		int				m_traceLevel;
+		float			m_throughputThreshold;	//a pixel stops spawning rays once its colour falls below this
+		std::atomic<long long>	m_rayCount;		//camera, reflection and refraction rays of the last frame
+
+		std::vector<float>	m_framebuffer;		//m_buffWidth x m_buffHeight RGB triplets, row 0 is the bottom row
+
+		int				m_threadCount;
+		int				m_tileSize;
+		ThreadPool*		m_pThreadPool;		//persistent workers for the tile renderer, created on first use
+
+		const PacketKernel*	m_pPacketKernel;	//SIMD kernel for the camera rays, nullptr traces them one by one
+		PacketLightFunc		m_pLightKernel;		//SIMD kernel for the lights of a hit, nullptr shades them one by one
+		bool			m_wavefront;		//trace tiles with the wavefront renderer instead of TraceScene
+		bool			m_materialSorting;	//shade the wavefront hits grouped by material
+		Real			m_pixelSpread;		//angle between neighbouring camera rays this frame, see ShadeSurface
+		bool			m_rayCones;			//pick texture mip levels from ray cones, see SetRayCones
+
+		//The per-frame view plane shared by all tiles
+		struct ViewPlane
+		{
+			Vec3	start;				//bottom left corner of the view plane
+			Vec3	camUpVector;
+			Vec3	camRightVector;
+			Vec3	camPosition;
+			Real		pixelDX;
+			Real		pixelDY;
+			Colour		background;
+		};
+
+		//A ray waiting on the TraceScene stack, the trace level it has left and the width of its
+		//cone where it starts
+		struct RayStackEntry
+		{
+			Ray		ray;
+			int		tracelevel;
+			Real	cone;
+		};
+
+		//A ray of the wavefront renderer's ray trees: the colour TraceScene would give the ray
+		//on its own and the rays it spawned, -1 for none
+		struct WavefrontNode
+		{
+			Colour	colour;
+			int		reflection;
+			int		refraction;
+			bool	pending;		//the ray waits in a queue, its colour is not known yet
+		};
+
+		//The rays of one bounce, with the tree node, the trace level left, the pixel and the
+		//width of the cone where it starts of each
+		struct WavefrontQueue
+		{
+			RayStream			rays;
+			std::vector<int>	node;
+			std::vector<int>	level;
+			std::vector<int>	pixel;
+			std::vector<Real>	cone;
+
+			inline void Clear()
+			{
+				rays.Clear();
+				node.clear();
+				level.clear();
+				pixel.clear();
+				cone.clear();
+			}
+
+			inline void Push(Ray& ray, int rayNode, int rayLevel, int rayPixel, Real rayCone)
+			{
+				rays.Push(ray.GetRayStart(), ray.GetRay(), ray.GetInvRay());
+				node.push_back(rayNode);
+				level.push_back(rayLevel);
+				pixel.push_back(rayPixel);
+				cone.push_back(rayCone);
+			}
+
+			inline void Push(const Vec3& start, const Vec3& dir, int rayNode, int rayLevel, int rayPixel, Real rayCone)
+			{
+				rays.Push(start, dir);
+				node.push_back(rayNode);
+				level.push_back(rayLevel);
+				pixel.push_back(rayPixel);
+				cone.push_back(rayCone);
+			}
+
+			//Compaction: ray from takes the place of ray to, then the queue ends at count
+			inline void Move(int from, int to)
+			{
+				rays.Move(from, to);
+				node[to] = node[from];
+				level[to] = level[from];
+				pixel[to] = pixel[from];
+				cone[to] = cone[from];
+			}
+
+			inline void Truncate(int count)
+			{
+				rays.count = count;
+				node.resize(count);
+				level.resize(count);
+				pixel.resize(count);
+				cone.resize(count);
+			}
+		};
+
+		//Everything the wavefront renderer keeps for a tile. Each thread has its own,
+		//reused from tile to tile.
+		struct WavefrontBuffers
+		{
+			WavefrontQueue				queue;			//the rays of the current bounce
+			WavefrontQueue				next;			//the rays they spawn
+			std::vector<RayHit>			hits;			//the closest hit of every ray in queue
+			std::vector<int>			hitRays;		//the rays of queue that hit something
+			std::vector<RayHitResult>	surfaces;		//their hit points and normals
+			RayStream					shadowRays;
+			std::vector<Real>			shadowDistance;	//how far each shadow ray has to be clear
+			std::vector<int>			shadowLight;	//the entry of lightVisible it decides
+			std::vector<char>			lightVisible;	//per hit ray and light it selects, see Scene::SelectLights
+			std::vector<uint64_t>		shadeOrder;		//the hits in shading order, see SetMaterialSorting
+			std::vector<WavefrontNode>	nodes;			//the ray trees, node i is the camera ray of pixel i
+			std::vector<int>			pixelState;		//per pixel, for CullWavefront
+		};
+
+		//The camera ray through the centre of pixel (j, i)
+		void MakeViewRay(const ViewPlane& view, int i, int j, Ray& viewray);
+
+		//The functions below that take FLAGS are compiled once per TraceFlag set, with every
+		//test of a flag resolved at compile time; DoRayTrace picks the set for the whole frame.
+
+		//Trace the m_tileSize x m_tileSize block of pixels whose bottom left corner is (x0, y0)
+		template<int FLAGS>
+		void TraceTile(Scene* pScene, const ViewPlane& view, int x0, int y0);
+
+		//TraceTile for the wavefront renderer, see SetWavefront
+		template<int FLAGS>
+		void TraceTileWavefront(Scene* pScene, const ViewPlane& view, int x0, int y0);
+
+		//The stages of one wavefront bounce, each runs over the whole queue
+		void IntersectWavefront(Scene* pScene, WavefrontBuffers& buffers);
+		void ShadowWavefront(Scene* pScene, WavefrontBuffers& buffers);
+		template<int FLAGS>
+		void ShadeWavefront(Scene* pScene, WavefrontBuffers& buffers);
+		template<int FLAGS>
+		void SpawnWavefront(WavefrontBuffers& buffers, const Colour& background);
+		void CullWavefront(WavefrontBuffers& buffers, const Colour& background);
+
+		//TraceScene and CalculateLighting for one flag set
+		template<int FLAGS>
+		Colour TraceSceneKernel(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, int* raycount,
+			const RayHit* primaryhit);
+		template<int FLAGS>
+		Colour CalculateLightingKernel(Scene* pScene, Vec3* campos, RayHitResult* hitresult,
+			const char* lightVisible = nullptr);
+
+		//CalculateLightingKernel with the material of the hit already looked up
+		template<int FLAGS>
+		Colour ShadeSurface(Scene* pScene, const MaterialRecord& mat, Vec3* campos, RayHitResult* hitresult,
+			const char* lightVisible);
+
+		typedef void (RayTracer::*TraceTileFunc)(Scene* pScene, const ViewPlane& view, int x0, int y0);
+
+		//The instantiations for one flag set
+		struct TraceKernels
+		{
+			TraceTileFunc	traceTile;
+			TraceTileFunc	traceTileWavefront;
+			Colour			(RayTracer::*traceScene)(Scene*, Ray&, Colour, int, int*, const RayHit*);
+			Colour			(RayTracer::*calculateLighting)(Scene*, Vec3*, RayHitResult*, const char*);
+		};
+
+		static const TraceKernels& GetTraceKernels(int flags);
+
+		template<int... FLAGS>
+		static const TraceKernels* BuildTraceKernels(std::integer_sequence<int, FLAGS...>);
+
+		//The colour of the ray tree below root, combined like TraceScene does. Returns false if
+		//the walk runs into a pending ray before the colour is decided.
+		bool FoldRayTree(const std::vector<WavefrontNode>& nodes, int root, Colour incolour, Colour& outcolour);
 
 	public:
 		
@@ -34,13 +226,34 @@ class RayTracer
 
 		TraceFlag m_traceflag;
 
+		//The trace flags for the F1 - F6 complexity presets
+		static TraceFlag GetPresetTraceFlag(int preset);
+
 		RayTracer();
 		RayTracer(int width, int height);
 		~RayTracer();
 
 		inline void SetTraceLevel(int level)
 		{
-			m_traceLevel = level;
+			m_traceLevel = level < RAY_STACK_SIZE ? level : RAY_STACK_SIZE - 1;
+		}
+
+		//Secondary rays are skipped once every channel of a pixel's colour so far is below
+		//threshold, 0 always traces the full ray tree up to the trace level
+		inline void SetThroughputThreshold(float threshold)
+		{
+			m_throughputThreshold = threshold > 0.0f ? threshold : 0.0f;
+		}
+
+		inline float GetThroughputThreshold() const
+		{
+			return m_throughputThreshold;
+		}
+
+		//Number of camera, reflection and refraction rays the last DoRayTrace intersected with the scene
+		inline long long GetRayCount() const
+		{
+			return m_rayCount;
 		}
 
 		inline void ResetRenderCount()
@@ -48,8 +261,108 @@ class RayTracer
 			m_renderCount = 0;
 		}
 
-		void DoRayTrace( Scene* pScene );
-		Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, bool shadowray = false);
-		Colour CalculateLighting(std::vector<Light*>* lights, Vector4D* campos, RayHitResult* hitresult);
+		inline int GetBufferWidth() const
+		{
+			return m_buffWidth;
+		}
+
+		inline int GetBufferHeight() const
+		{
+			return m_buffHeight;
+		}
+
+		//The traced image, tightly packed float RGB in OpenGL (bottom-up) row order
+		inline const float* GetFramebuffer() const
+		{
+			return m_framebuffer.data();
+		}
+
+		void SetBufferSize(int width, int height);
+
+		//Number of threads tracing tiles, 0 uses every hardware thread
+		void SetThreadCount(int count);
+
+		inline int GetThreadCount() const
+		{
+			return m_threadCount;
+		}
+
+		inline void SetTileSize(int size)
+		{
+			m_tileSize = size > 0 ? size : 1;
+		}
+
+		//Intersect the camera rays in SIMD packets with the widest kernel the CPU supports.
+		//Reflection, refraction and shadow rays always take the single ray path.
+		void SetPacketTracing(bool enable);
+
+		//The kernel in use, nullptr if packet tracing is off or the CPU has none
+		inline const PacketKernel* GetPacketKernel() const
+		{
+			return m_pPacketKernel;
+		}
+
+		//Work out the light directions and the diffuse and specular factors of a hit for a
+		//register of lights at a time, with the widest kernel the CPU supports, instead of one
+		//light at a time. Both take the same arithmetic and give the same image.
+		void SetSimdShading(bool enable);
+
+		inline bool IsSimdShading() const
+		{
+			return m_pLightKernel != nullptr;
+		}
+
+		//Trace each tile breadth first: all of its camera rays are intersected, then shaded,
+		//then their shadow rays tested and their reflection and refraction rays queued, one
+		//bounce at a time over SoA ray queues. With packet tracing on, every bounce goes
+		//through the SIMD kernel. The image is the same as TraceScene's, but the throughput
+		//threshold can only be applied once a tree is complete, so no rays are saved by it.
+		inline void SetWavefront(bool enable)
+		{
+			m_wavefront = enable;
+		}
+
+		inline bool IsWavefront() const
+		{
+			return m_wavefront;
+		}
+
+		//Shade the hits of each wavefront bounce sorted by material id, in batches that share
+		//one material record, instead of in ray order. The image is the same either way.
+		inline void SetMaterialSorting(bool enable)
+		{
+			m_materialSorting = enable;
+		}
+
+		inline bool IsMaterialSorting() const
+		{
+			return m_materialSorting;
+		}
+
+		//Follow every ray as a cone that starts one pixel wide at the camera and grows with
+		//the distance it travels, over reflections and refractions too, and read textures at the
+		//mip level whose texels are as wide as the cone where it meets the surface. Off, every
+		//texture is read at full resolution, which aliases and touches far more tiles.
+		inline void SetRayCones(bool enable)
+		{
+			m_rayCones = enable;
+		}
+
+		inline bool IsRayCones() const
+		{
+			return m_rayCones;
+		}
+
+		//Trace the scene into the framebuffer, returns false if the current image is still valid
+		bool DoRayTrace( Scene* pScene );
+		//TraceScene and CalculateLighting only read the tracer and the scene, the tiles call them concurrently.
+		//Both dispatch on m_traceflag per call, the renderers use the kernels for the frame's flags directly.
+		//raycount, if given, is increased by the number of rays intersected with the scene.
+		//primaryhit, if given, is the closest hit of ray that is already known.
+		Colour TraceScene(Scene* pScene, Ray& ray, Colour incolour, int tracelevel, int* raycount = nullptr,
+			const RayHit* primaryhit = nullptr);
+		//lightVisible, if given, holds for every light Scene::SelectLights gives the hit point
+		//whether it is visible from there with TRACE_SHADOW on, instead of tracing the shadow rays here
+		Colour CalculateLighting(Scene* pScene, Vec3* campos, RayHitResult* hitresult, const char* lightVisible = nullptr);
 };
 
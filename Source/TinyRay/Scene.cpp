@@ -7,13 +7,24 @@
 * to use and extend the functionality. The code provided here is functional
 * however the author does not guarantee its performance.
 ---------------------------------------------------------------------*/
+#include <string.h>
+
 #include "Scene.h"
 #include "Sphere.h"
 #include "Plane.h"
 #include "Box.h"
+#include "UniformGrid.h"
+#include "KDTree.h"
 
 Scene::Scene()
 {
+	m_accelDirty = true;
+	m_rebuildThreshold = 1.3;
+	m_wideFormat = WIDEBVH_NONE;
+	m_triangleTest = TRIANGLE_TEST_REAL;
+	m_acceleratorType = ACCELERATOR_BVH;
+	m_accelerator = nullptr;
+	m_lightSamples = 0;
 	InitDefaultScene();
 }
 
@@ -28,7 +39,7 @@ void Scene::InitDefaultScene()
 	//the default scene consists of 3 spheres and a plane as the ground
 	
 	//Create a box and its material
-	Primitive* newobj = new Box(Vector4D(-2.0, 4.0, -8.0), 3.0, 10.0, 4.0);
+	Primitive* newobj = new Box(Vec3(-2.0, 4.0, -8.0), 3.0, 10.0, 4.0);
 	Material* newmat = new Material();
 	//mat for the box
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
@@ -62,8 +73,8 @@ void Scene::InitDefaultScene()
 	m_objectMaterials.push_back(newmat);
 
 
-	newobj = new Plane(); //an xz plane at the origin, floor
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(0.0, 1.0, 0.0), 0.0);
+	newobj = new Plane(); //an xz plane 1 unit below the origin, floor
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(0.0, 1.0, 0.0), -1.0);
 	newmat = new Material();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(1.0, 0.0, 0.0);
@@ -74,14 +85,14 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 	
-	newobj = new Plane(); //an xz plane 40 units above, ceiling
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(0.0, -1.0, 0.0), -40.0);
+	newobj = new Plane(); //an xz plane 41 units above, ceiling
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(0.0, -1.0, 0.0), -41.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 	
 
-	newobj = new Plane(); //an xy plane 40 units along -z axis, 
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(0.0, 0.0, 1.0), -40.0);
+	newobj = new Plane(); //an xy plane 41 units along -z axis, 
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(0.0, 0.0, 1.0), -41.0);
 	newmat = new Material();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 1.0, 0.0);
@@ -92,13 +103,13 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 	
-	newobj = new Plane(); //an xy plane 40 units along the z axis
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(0.0, 0.0, -1.0), -40.0);
+	newobj = new Plane(); //an xy plane 41 units along the z axis
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(0.0, 0.0, -1.0), -41.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 	
-	newobj = new Plane(); //an yz plane 20 units along -x axis
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(1.0, 0.0, 0.0), -20.0);
+	newobj = new Plane(); //an yz plane 21 units along -x axis
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(1.0, 0.0, 0.0), -21.0);
 	newmat = new Material();
 	newmat->SetAmbientColour(0.0, 0.0, 0.0);
 	newmat->SetDiffuseColour(0.0, 0.0, 1.0);
@@ -109,8 +120,8 @@ void Scene::InitDefaultScene()
 	m_sceneObjects.push_back(newobj);
 	m_objectMaterials.push_back(newmat);
 
-	newobj = new Plane(); //an yz plane 20 units along +x axis
-	static_cast<Plane*>(newobj)->SetPlane(Vector4D(-1.0, 0.0, 0.0), -20.0);
+	newobj = new Plane(); //an yz plane 21 units along +x axis
+	static_cast<Plane*>(newobj)->SetPlane(Vec3(-1.0, 0.0, 0.0), -21.0);
 	newobj->SetMaterial(newmat);
 	m_sceneObjects.push_back(newobj);
 
@@ -129,7 +140,226 @@ void Scene::InitDefaultScene()
 	m_sceneHeight = 1.0;
 
 	//default camera position and look at
-	m_activeCamera.SetPositionAndLookAt(Vector4D(3.0, 7.0, 13.0), Vector4D(0.0, 7.0, 0.0));
+	m_activeCamera.SetPositionAndLookAt(Vec3(3.0, 7.0, 13.0), Vec3(0.0, 7.0, 0.0));
+
+	m_accelDirty = true;
+}
+
+void Scene::AddObject(Primitive* obj, Material* mat)
+{
+	m_sceneObjects.push_back(obj);
+
+	if (mat)
+	{
+		obj->SetMaterial(mat);
+		m_objectMaterials.push_back(mat);
+	}
+
+	m_accelDirty = true;
+}
+
+void Scene::AddGeometry(TriangleMesh* mesh)
+{
+	m_sharedGeometry.push_back(mesh);
+}
+
+void Scene::SetWideBVH(WideBVHFormat format)
+{
+	if (format != m_wideFormat)
+	{
+		m_wideFormat = format;
+		m_accelDirty = true;
+	}
+}
+
+void Scene::SetTriangleTest(TriangleTest test)
+{
+	if (test != m_triangleTest)
+	{
+		m_triangleTest = test;
+		m_accelDirty = true;
+	}
+}
+
+void Scene::SetAccelerator(AcceleratorType type)
+{
+	if (type != m_acceleratorType)
+	{
+		delete m_accelerator;
+		m_accelerator = nullptr;
+		m_acceleratorType = type;
+		m_accelDirty = true;
+	}
+}
+
+void Scene::SetLightSamples(int count)
+{
+	m_lightSamples = count < 0 ? 0 : (count < LIGHT_TREE_MAX_SAMPLES ? count : LIGHT_TREE_MAX_SAMPLES);
+}
+
+void Scene::SampleLights(const Vec3& point, const Vec3& normal, LightSelection& selection) const
+{
+	//the seed is the bits of the point, the same hit draws the same lights in every renderer
+	uint64_t seed = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real coordinate = point[axis];
+		uint64_t bits = 0;
+		memcpy(&bits, &coordinate, sizeof(Real));
+
+		seed = (seed ^ bits) * 0x100000001b3ull;
+		seed ^= seed >> 29;
+	}
+
+	selection.count = m_lightTree.Sample(point, normal, m_lightSamples, seed, selection.samples);
+	selection.sampled = true;
+}
+
+void Scene::UpdateObject(Primitive* obj)
+{
+	std::unordered_map<Primitive*, int>::iterator found = m_objectIndex.find(obj);
+
+	//an object added since the last rebuild is copied by the next one anyway
+	if (found != m_objectIndex.end())
+	{
+		m_changedObjects.push_back(found->second);
+	}
+}
+
+void Scene::UpdateAccelerationStructure(ThreadPool* pool)
+{
+	//lights can be moved without telling the scene, and copying thousands of them or building
+	//a tree over them takes well under a millisecond, so both are done every time
+	m_lightBuffer.Build(m_lights);
+
+	if (m_lightSamples > 0 && (int)m_lights.size() > m_lightSamples)
+	{
+		m_lightTree.Build(m_lights);
+	}
+	else
+	{
+		m_lightTree.Clear();
+	}
+
+	if (!m_accelDirty)
+	{
+		if (m_changedObjects.empty())
+		{
+			return;
+		}
+
+		std::vector<int> items;
+
+		for (int index : m_changedObjects)
+		{
+			Primitive* obj = m_sceneObjects[index];
+
+			if (obj->m_primtype == Primitive::PRIMTYPE_Mesh)
+			{
+				static_cast<TriangleMesh*>(obj)->Build(pool);
+			}
+
+			m_primitives.Update(m_objectHandles[index], obj);
+
+			if (m_objectItems[index] >= 0)
+			{
+				m_itemBounds[m_objectItems[index]] = obj->GetBoundingBox();
+				items.push_back(m_objectItems[index]);
+			}
+		}
+
+		m_changedObjects.clear();
+
+		std::vector<int> changedNodes;
+		m_bvh.Refit(m_itemBounds, items, &changedNodes);
+
+		if (m_bvh.GetSAHCost() > m_rebuildThreshold * m_bvh.GetBuildReport().sahCost)
+		{
+			m_bvh.Build(m_itemBounds, pool);
+			m_wideBvh.Build(m_bvh, m_wideFormat);
+		}
+		else
+		{
+			m_wideBvh.Refit(m_bvh, changedNodes);
+		}
+
+		if (m_accelerator)
+		{
+			m_accelerator->Build(m_itemBounds, pool);
+		}
+
+		return;
+	}
+
+	//the meshes one after the other, each with all threads; PrimitiveStore::Add finds them built
+	for (Primitive* obj : m_sceneObjects)
+	{
+		if (obj->m_primtype == Primitive::PRIMTYPE_Mesh)
+		{
+			TriangleMesh* mesh = static_cast<TriangleMesh*>(obj);
+			mesh->SetWideBVH(m_wideFormat);
+			mesh->SetTriangleTest(m_triangleTest);
+			mesh->Build(pool);
+		}
+	}
+
+	for (TriangleMesh* mesh : m_sharedGeometry)
+	{
+		mesh->SetWideBVH(m_wideFormat);
+		mesh->SetTriangleTest(m_triangleTest);
+		mesh->Build(pool);
+	}
+
+	m_primitives.Clear();
+	m_boundedObjects.clear();
+	m_objectIndex.clear();
+	m_objectHandles.clear();
+	m_objectItems.clear();
+	m_itemBounds.clear();
+	m_changedObjects.clear();
+
+	//the BVH is built over the objects in the order they were added, whatever their type
+	for (int index = 0; index < (int)m_sceneObjects.size(); index++)
+	{
+		Primitive* obj = m_sceneObjects[index];
+		PrimHandle handle = m_primitives.Add(obj);
+
+		m_objectIndex[obj] = index;
+		m_objectHandles.push_back(handle);
+		m_objectItems.push_back(obj->IsBounded() ? (int)m_boundedObjects.size() : -1);
+
+		if (obj->IsBounded())
+		{
+			m_boundedObjects.push_back(handle);
+			m_itemBounds.push_back(obj->GetBoundingBox());
+		}
+	}
+
+	m_bvh.Build(m_itemBounds, pool);
+	m_wideBvh.Build(m_bvh, m_wideFormat);
+
+	if (!m_accelerator)
+	{
+		switch (m_acceleratorType)
+		{
+			case ACCELERATOR_GRID:
+				m_accelerator = new UniformGrid();
+				break;
+			case ACCELERATOR_KDTREE:
+				m_accelerator = new KDTree();
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (m_accelerator)
+	{
+		m_accelerator->Build(m_itemBounds, pool);
+	}
+
+	m_accelDirty = false;
 }
 
 void Scene::CleanupScene()
@@ -145,6 +375,17 @@ void Scene::CleanupScene()
 
 	m_sceneObjects.clear();
 
+	//the meshes go after the instances that use them
+	std::vector<TriangleMesh*>::iterator mesh_iter = m_sharedGeometry.begin();
+
+	while (mesh_iter != m_sharedGeometry.end())
+	{
+		delete *mesh_iter;
+		mesh_iter++;
+	}
+
+	m_sharedGeometry.clear();
+
 	//Cleanup material list
 	std::vector<Material*>::iterator mat_iter = m_objectMaterials.begin();
 
@@ -165,62 +406,135 @@ void Scene::CleanupScene()
 	}
 
 	m_lights.clear();
+	m_lightBuffer.Clear();
+	m_lightTree.Clear();
+
+	m_primitives.Clear();
+	m_bvh.Clear();
+	m_wideBvh.Clear();
+	delete m_accelerator;
+	m_accelerator = nullptr;
+	m_boundedObjects.clear();
+	m_objectIndex.clear();
+	m_objectHandles.clear();
+	m_objectItems.clear();
+	m_itemBounds.clear();
+	m_changedObjects.clear();
+	m_accelDirty = true;
+}
+
+RayHitResult Scene::IntersectByRay(Ray& ray)
+{
+	RayHit hit = Ray::s_defaultHit;
+
+	Intersect(ray, hit);
+
+	return GetSurface(ray, hit);
 }
 
-RayHitResult Scene::IntersectByRay(Ray& ray, bool isShadowRay)
+RayHitResult Scene::GetSurface(Ray& ray, const RayHit& hit)
 {
 	RayHitResult result = Ray::s_defaultHitResult;
-	
-	std::vector<Primitive*>::iterator prim_iter = m_sceneObjects.begin();
-	
-	if (!isShadowRay)
+
+	//only the closest object gets its hit point and normal
+	if (hit.prim.IsValid())
+	{
+		m_primitives.ComputeSurface(ray, hit, result);
+	}
+
+	return result;
+}
+
+bool Scene::Intersect(Ray& ray, RayHit& hit)
+{
+	//a ray without a direction, like the refraction ray past the critical angle, hits nothing;
+	//its NaNs would pass every slab test and walk the whole BVH
+	const Vec3& dir = ray.GetRay();
+
+	if (dir[0] != dir[0] || dir[1] != dir[1] || dir[2] != dir[2])
 	{
-		while (prim_iter != m_sceneObjects.end())
+		return hit.prim.IsValid();
+	}
+
+	//the planes go first, the closest of them bounds the BVH traversal
+	const PlaneArray& planes = m_primitives.planes;
+
+	for (int i = 0; i < planes.Size(); i++)
+	{
+		Real t = planes.IntersectDistance(i, ray);
+
+		if (t < hit.t)
 		{
-			RayHitResult current;
+			hit.t = t;
+			hit.u = hit.v = 0.0;
+			hit.face = 0;
+			hit.prim.type = Primitive::PRIMTYPE_Plane;
+			hit.prim.index = i;
+		}
+	}
 
-			current = (*prim_iter)->IntersectByRay(ray);
+	if (m_accelerator)
+	{
+		m_accelerator->Intersect(m_primitives, m_boundedObjects, ray, hit);
 
-			if (current.t > 0.0 && current.t < result.t)
-			{
-				result = current;
-			}
+		return hit.prim.IsValid();
+	}
 
-			prim_iter++;
+	//the far end of the ray's interval bounds the walk like a closer hit
+	Real tmax = hit.t < ray.GetTMax() ? hit.t : ray.GetTMax();
+
+	auto intersectItem = [this, &ray, &hit, &tmax](int item)
+	{
+		if (m_primitives.Intersect(m_boundedObjects[item], ray, hit))
+		{
+			tmax = hit.t;
 		}
+	};
+
+	if (m_wideBvh.IsEmpty())
+	{
+		m_bvh.Traverse(ray, tmax, intersectItem);
 	}
 	else
 	{
-		while (prim_iter != m_sceneObjects.end())
-		{
-			RayHitResult current = result;
-			bool castShadow = (*prim_iter)->GetMaterial()->CastShadow();
+		m_wideBvh.Traverse(ray, tmax, intersectItem);
+	}
 
-			current = (*prim_iter)->IntersectByRay(ray);
+	return hit.prim.IsValid();
+}
 
-			if (castShadow && current.t > 0.0 && current.t < result.t)
-			{
-				std::vector<Light*>::iterator iter = m_lights.begin();
-
-				while (iter != m_lights.end())
-				{
-					Vector4D r = ray.GetRay();
-					double ldotr = (*iter)->GetLightPosition().DotProduct(r);
-					double pdotr = result.point.DotProduct(r);
-					
-					if (pdotr < ldotr)
-					{
-						result = current;
-					}
-
-					iter++;
-				}
-				
-			}
+bool Scene::Occluded(Ray& ray, Real maxDistance)
+{
+	maxDistance = maxDistance < ray.GetTMax() ? maxDistance : ray.GetTMax();
+
+	const PlaneArray& planes = m_primitives.planes;
 
-			prim_iter++;
+	for (int i = 0; i < planes.Size(); i++)
+	{
+		PrimHandle prim = { Primitive::PRIMTYPE_Plane, i };
+
+		if (m_primitives.GetMaterial(prim).castShadow && planes.IntersectDistance(i, ray) < maxDistance)
+		{
+			return true;
 		}
 	}
 
-	return result;
+	if (m_accelerator)
+	{
+		return m_accelerator->Occluded(m_primitives, m_boundedObjects, ray, maxDistance);
+	}
+
+	auto blocksRay = [this, &ray, maxDistance](int item)
+	{
+		PrimHandle prim = m_boundedObjects[item];
+
+		return m_primitives.GetMaterial(prim).castShadow && m_primitives.Occludes(prim, ray, maxDistance);
+	};
+
+	if (m_wideBvh.IsEmpty())
+	{
+		return m_bvh.TraverseAny(ray, maxDistance, blocksRay);
+	}
+
+	return m_wideBvh.TraverseAny(ray, maxDistance, blocksRay);
 }
@@ -11,9 +11,18 @@
 
 #include "Camera.h"
 #include "Primitive.h"
+#include "PrimitiveStore.h"
+#include "TriangleMesh.h"
 #include "Material.h"
 #include "Light.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Accelerator.h"
+#include "LightTree.h"
+#include "LightBuffer.h"
+#include "Texture.h"
 #include <vector>
+#include <unordered_map>
 
 class Scene
 {
@@ -22,7 +31,36 @@ class Scene
 		
 		std::vector<Primitive*>			m_sceneObjects;
 		std::vector<Material*>			m_objectMaterials;
+		TextureCache					m_textures;				//of the materials, see Material::SetDiffuseTexture
+		std::vector<TriangleMesh*>		m_sharedGeometry;		//the meshes of the instances
 		std::vector<Light*>				m_lights;
+		LightBuffer						m_lightBuffer;			//m_lights as the tracer shades with them
+		LightTree						m_lightTree;			//over m_lights while they are sampled, see SetLightSamples
+		int								m_lightSamples;
+
+		void SampleLights(const Vec3& point, const Vec3& normal, LightSelection& selection) const;
+
+		//The objects as the tracer sees them, and the acceleration structure over them. Both are
+		//rebuilt by UpdateAccelerationStructure() after the object list changed.
+		PrimitiveStore					m_primitives;
+		BVH								m_bvh;
+		WideBVH							m_wideBvh;				//m_bvh collapsed for single rays, see SetWideBVH
+		WideBVHFormat					m_wideFormat;
+		TriangleTest					m_triangleTest;			//of the meshes, see SetTriangleTest
+		std::vector<PrimHandle>			m_boundedObjects;		//the items of m_bvh
+		AcceleratorType					m_acceleratorType;
+		Accelerator*					m_accelerator;			//over the same items, nullptr for ACCELERATOR_BVH
+		bool							m_accelDirty;
+
+		//What UpdateObject needs to find an object again: its index in m_sceneObjects, and per
+		//object where the last rebuild put it, in m_primitives and among the items of m_bvh (-1
+		//for a plane). The bounds are those of the items as m_bvh was last built or refit with.
+		std::unordered_map<Primitive*, int>	m_objectIndex;
+		std::vector<PrimHandle>			m_objectHandles;
+		std::vector<int>				m_objectItems;
+		std::vector<AABB>				m_itemBounds;
+		std::vector<int>				m_changedObjects;		//since the last update
+		double							m_rebuildThreshold;
 
 		Colour							m_background;
 		double							m_sceneWidth;
@@ -59,12 +97,197 @@ class Scene
 			return m_background;
 		}
 
-		RayHitResult IntersectByRay(Ray& ray, bool isShadowRay = false);
+		//Closest hit along the ray with its point and normal
+		RayHitResult IntersectByRay(Ray& ray);
+
+		//The intersection pass of IntersectByRay on its own. hit.prim is the closest primitive
+		//and stays invalid if nothing is hit. Only hits within the ray's interval count, see
+		//Ray::SetInterval.
+		bool Intersect(Ray& ray, RayHit& hit);
+
+		//The point and normal of a hit found by Intersect, or the default result if it is a miss
+		RayHitResult GetSurface(Ray& ray, const RayHit& hit);
+
+		//True if an object that casts shadows lies on the ray within its interval and before maxDistance.
+		//Stops at the first such object and never computes hit points or normals.
+		bool Occluded(Ray& ray, Real maxDistance);
+
+		//Add an object to the scene, the scene takes ownership of the object and of mat (if given).
+		//The object is copied into the scene's PrimitiveStore by UpdateAccelerationStructure().
+		void AddObject(Primitive* obj, Material* mat = nullptr);
+
+		//Hand the scene a mesh that is only traced through Instances of it. The scene takes
+		//ownership of the mesh, but unlike an object the mesh itself is not placed in the scene.
+		void AddGeometry(TriangleMesh* mesh);
+
+		inline std::vector<Primitive*>* GetObjectList()
+		{
+			return &m_sceneObjects;
+		}
+
+		//Rebuild the BVH if objects were added since the last build, on the threads of pool
+		//if one is given. This is not thread safe and has to happen before any ray is traced.
+		void UpdateAccelerationStructure(ThreadPool* pool = nullptr);
+
+		//Objects changed after they were added, e.g. an Instance was moved: the next
+		//UpdateAccelerationStructure() rebuilds the BVH over the objects. The BVH of a mesh
+		//whose triangles did not change is kept, so moving instances only costs the top level.
+		inline void InvalidateAccelerationStructure()
+		{
+			m_accelDirty = true;
+		}
+
+		//obj, an object of the scene, moved or changed otherwise, e.g. with Box::SetBox or
+		//Instance::SetTransform. The next UpdateAccelerationStructure() copies it again and refits
+		//the BVH around its new bounds, which costs time in the number of changed objects only.
+		//A mesh whose triangles changed has its own BVH rebuilt.
+		void UpdateObject(Primitive* obj);
+
+		//A refit keeps the shape of the tree, which suits the objects less the further they move.
+		//Once its SAH cost exceeds threshold times the cost it was built with, the BVH is rebuilt
+		//instead; 0 rebuilds it on every update.
+		inline void SetRebuildThreshold(double threshold)
+		{
+			m_rebuildThreshold = threshold;
+		}
+
+		inline double GetRebuildThreshold() const
+		{
+			return m_rebuildThreshold;
+		}
+
+		//Trace single rays through WideBVHs in format, the scene's own and those of its meshes,
+		//from the next UpdateAccelerationStructure() on. WIDEBVH_NONE, the default, traces them
+		//through the binary BVHs; packets always take those.
+		void SetWideBVH(WideBVHFormat format);
+
+		inline WideBVHFormat GetWideBVHFormat() const
+		{
+			return m_wideFormat;
+		}
+
+		//Test single rays against the triangles of the meshes, also those of instances, with test
+		//from the next UpdateAccelerationStructure() on
+		void SetTriangleTest(TriangleTest test);
+
+		inline TriangleTest GetTriangleTest() const
+		{
+			return m_triangleTest;
+		}
+
+		//Find the objects for Intersect and Occluded through a structure of type, built by the
+		//next UpdateAccelerationStructure(). The BVH is built whatever the type, packets are
+		//traced through it; a grid or kd-tree is built again instead of refit when objects move.
+		void SetAccelerator(AcceleratorType type);
+
+		inline AcceleratorType GetAcceleratorType() const
+		{
+			return m_acceleratorType;
+		}
+
+		//The structure chosen by SetAccelerator, nullptr for ACCELERATOR_BVH
+		inline const Accelerator* GetAccelerator() const
+		{
+			return m_accelerator;
+		}
+
+		//The primitives and the acceleration structure as of the last UpdateAccelerationStructure(),
+		//for tracers that walk them themselves. The items of the BVH index GetBoundedObjects();
+		//the planes are not in it and have to be tested separately.
+		inline const PrimitiveStore& GetPrimitives() const
+		{
+			return m_primitives;
+		}
+
+		//The top level BVH, GetBVH().GetBuildReport() tells how long it took
+		inline const BVH& GetBVH() const
+		{
+			return m_bvh;
+		}
+
+		//The top level WideBVH, empty unless SetWideBVH chose a format
+		inline const WideBVH& GetWideBVH() const
+		{
+			return m_wideBvh;
+		}
+
+		inline const std::vector<PrimHandle>& GetBoundedObjects() const
+		{
+			return m_boundedObjects;
+		}
+
+		//The parameters of a material as of the last UpdateAccelerationStructure(), see MaterialTable
+		inline const MaterialRecord& GetMaterial(MaterialId id) const
+		{
+			return m_primitives.GetMaterial(id);
+		}
+
+		inline const MaterialRecord& GetMaterial(PrimHandle prim) const
+		{
+			return m_primitives.GetMaterial(prim);
+		}
 
 		inline std::vector<Light*>* GetLightList()
 		{
 			return &m_lights;
 		}
+
+		//Where the textures of the scene's materials are opened and their tiles kept
+		inline TextureCache& GetTextureCache()
+		{
+			return m_textures;
+		}
+
+		//The positions and colours of the lights as of the last UpdateAccelerationStructure(),
+		//in the order of GetLightList()
+		inline const LightBuffer& GetLightBuffer() const
+		{
+			return m_lightBuffer;
+		}
+
+		//Light each shading point by count lights drawn by importance from a light tree, built by
+		//UpdateAccelerationStructure(), instead of by every light. Rigs of count lights or fewer
+		//are still lit by every light; 0, the default, always takes every light. The lights are
+		//drawn with random numbers from the shading point, so every renderer draws the same ones.
+		//A light behind the surface, which the tree never draws, lights it neither way.
+		void SetLightSamples(int count);
+
+		inline int GetLightSamples() const
+		{
+			return m_lightSamples;
+		}
+
+		//True if the lights are sampled rather than all taken
+		inline bool IsSamplingLights() const
+		{
+			return m_lightSamples > 0 && (int)m_lights.size() > m_lightSamples && !m_lightTree.IsEmpty();
+		}
+
+		//Most lights SelectLights picks for one shading point
+		inline int GetLightSlotCount() const
+		{
+			return IsSamplingLights() ? m_lightSamples : m_lightBuffer.count;
+		}
+
+		inline const LightTree& GetLightTree() const
+		{
+			return m_lightTree;
+		}
+
+		//The lights that light the surface at point with normal, as indices into GetLightBuffer(),
+		//see SetLightSamples
+		inline void SelectLights(const Vec3& point, const Vec3& normal, LightSelection& selection) const
+		{
+			if (IsSamplingLights())
+			{
+				SampleLights(point, normal, selection);
+			}
+			else
+			{
+				selection.count = m_lightBuffer.count;
+				selection.sampled = false;
+			}
+		}
 		
 		void		CleanupScene();
 		
@@ -0,0 +1,201 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include "Vec3.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+//Thin wrappers around the SIMD registers of one instruction set, used by the packet tracer.
+//A wrapper holds WIDTH Reals: 4/8/16 lanes in single precision and 2/4/8 in double.
+//Each one only exists where the translation unit is compiled for its instruction set,
+//see PacketSSE.cpp, PacketAVX2.cpp and PacketAVX512.cpp.
+//
+//Comparisons are ordered: a NaN lane compares false, like the scalar code does.
+//
+//Everything here has internal linkage. The same inline function compiled with and without
+//AVX must never be merged by the linker, or a baseline caller could end up in AVX code.
+
+#ifdef TINYRAY_SINGLE_PRECISION
+#define SIMD_SSE(op)	_mm_##op##_ps
+#define SIMD_AVX(op)	_mm256_##op##_ps
+#define SIMD_AVX512(op)	_mm512_##op##_ps
+#define SIMD_AVX512_CMP	_mm512_cmp_ps_mask
+#else
+#define SIMD_SSE(op)	_mm_##op##_pd
+#define SIMD_AVX(op)	_mm256_##op##_pd
+#define SIMD_AVX512(op)	_mm512_##op##_pd
+#define SIMD_AVX512_CMP	_mm512_cmp_pd_mask
+#endif
+
+namespace
+{
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct SimdSSE
+{
+#ifdef TINYRAY_SINGLE_PRECISION
+	typedef __m128 Reg;
+#else
+	typedef __m128d Reg;
+#endif
+	enum { WIDTH = sizeof(Reg) / sizeof(Real) };
+
+	struct VMask
+	{
+		Reg m;
+
+		inline VMask operator & (VMask rhs) const { VMask r = { SIMD_SSE(and)(m, rhs.m) }; return r; }
+		inline VMask operator | (VMask rhs) const { VMask r = { SIMD_SSE(or)(m, rhs.m) }; return r; }
+		inline bool Any() const { return SIMD_SSE(movemask)(m) != 0; }
+		inline int Bits() const { return SIMD_SSE(movemask)(m); }
+	};
+
+	struct VReal
+	{
+		Reg r;
+
+		inline VReal operator + (VReal rhs) const { VReal v = { SIMD_SSE(add)(r, rhs.r) }; return v; }
+		inline VReal operator - (VReal rhs) const { VReal v = { SIMD_SSE(sub)(r, rhs.r) }; return v; }
+		inline VReal operator * (VReal rhs) const { VReal v = { SIMD_SSE(mul)(r, rhs.r) }; return v; }
+		inline VReal operator / (VReal rhs) const { VReal v = { SIMD_SSE(div)(r, rhs.r) }; return v; }
+		inline VReal operator - () const { VReal v = { SIMD_SSE(xor)(r, SIMD_SSE(set1)(-0.0)) }; return v; }
+
+		inline VMask operator < (VReal rhs) const { VMask m = { SIMD_SSE(cmplt)(r, rhs.r) }; return m; }
+		inline VMask operator > (VReal rhs) const { VMask m = { SIMD_SSE(cmpgt)(r, rhs.r) }; return m; }
+		inline VMask operator <= (VReal rhs) const { VMask m = { SIMD_SSE(cmple)(r, rhs.r) }; return m; }
+		inline VMask operator >= (VReal rhs) const { VMask m = { SIMD_SSE(cmpge)(r, rhs.r) }; return m; }
+		inline VMask operator == (VReal rhs) const { VMask m = { SIMD_SSE(cmpeq)(r, rhs.r) }; return m; }
+	};
+
+	static inline VReal Set1(Real s) { VReal v = { SIMD_SSE(set1)(s) }; return v; }
+	static inline VReal Load(const Real* p) { VReal v = { SIMD_SSE(loadu)(p) }; return v; }
+	static inline void Store(Real* p, VReal v) { SIMD_SSE(storeu)(p, v.r); }
+	static inline VReal Sqrt(VReal a) { VReal v = { SIMD_SSE(sqrt)(a.r) }; return v; }
+	static inline VReal Abs(VReal a) { VReal v = { SIMD_SSE(andnot)(SIMD_SSE(set1)(-0.0), a.r) }; return v; }
+
+	//mask ? a : b, per lane
+	static inline VReal Select(VMask mask, VReal a, VReal b)
+	{
+		VReal v = { SIMD_SSE(or)(SIMD_SSE(and)(mask.m, a.r), SIMD_SSE(andnot)(mask.m, b.r)) };
+		return v;
+	}
+};
+#endif
+
+#if defined(__AVX2__)
+struct SimdAVX2
+{
+#ifdef TINYRAY_SINGLE_PRECISION
+	typedef __m256 Reg;
+#else
+	typedef __m256d Reg;
+#endif
+	enum { WIDTH = sizeof(Reg) / sizeof(Real) };
+
+	struct VMask
+	{
+		Reg m;
+
+		inline VMask operator & (VMask rhs) const { VMask r = { SIMD_AVX(and)(m, rhs.m) }; return r; }
+		inline VMask operator | (VMask rhs) const { VMask r = { SIMD_AVX(or)(m, rhs.m) }; return r; }
+		inline bool Any() const { return SIMD_AVX(movemask)(m) != 0; }
+		inline int Bits() const { return SIMD_AVX(movemask)(m); }
+	};
+
+	struct VReal
+	{
+		Reg r;
+
+		inline VReal operator + (VReal rhs) const { VReal v = { SIMD_AVX(add)(r, rhs.r) }; return v; }
+		inline VReal operator - (VReal rhs) const { VReal v = { SIMD_AVX(sub)(r, rhs.r) }; return v; }
+		inline VReal operator * (VReal rhs) const { VReal v = { SIMD_AVX(mul)(r, rhs.r) }; return v; }
+		inline VReal operator / (VReal rhs) const { VReal v = { SIMD_AVX(div)(r, rhs.r) }; return v; }
+		inline VReal operator - () const { VReal v = { SIMD_AVX(xor)(r, SIMD_AVX(set1)(-0.0)) }; return v; }
+
+		inline VMask operator < (VReal rhs) const { VMask m = { SIMD_AVX(cmp)(r, rhs.r, _CMP_LT_OQ) }; return m; }
+		inline VMask operator > (VReal rhs) const { VMask m = { SIMD_AVX(cmp)(r, rhs.r, _CMP_GT_OQ) }; return m; }
+		inline VMask operator <= (VReal rhs) const { VMask m = { SIMD_AVX(cmp)(r, rhs.r, _CMP_LE_OQ) }; return m; }
+		inline VMask operator >= (VReal rhs) const { VMask m = { SIMD_AVX(cmp)(r, rhs.r, _CMP_GE_OQ) }; return m; }
+		inline VMask operator == (VReal rhs) const { VMask m = { SIMD_AVX(cmp)(r, rhs.r, _CMP_EQ_OQ) }; return m; }
+	};
+
+	static inline VReal Set1(Real s) { VReal v = { SIMD_AVX(set1)(s) }; return v; }
+	static inline VReal Load(const Real* p) { VReal v = { SIMD_AVX(loadu)(p) }; return v; }
+	static inline void Store(Real* p, VReal v) { SIMD_AVX(storeu)(p, v.r); }
+	static inline VReal Sqrt(VReal a) { VReal v = { SIMD_AVX(sqrt)(a.r) }; return v; }
+	static inline VReal Abs(VReal a) { VReal v = { SIMD_AVX(andnot)(SIMD_AVX(set1)(-0.0), a.r) }; return v; }
+
+	//mask ? a : b, per lane
+	static inline VReal Select(VMask mask, VReal a, VReal b)
+	{
+		VReal v = { SIMD_AVX(blendv)(b.r, a.r, mask.m) };
+		return v;
+	}
+};
+#endif
+
+#if defined(__AVX512F__)
+struct SimdAVX512
+{
+#ifdef TINYRAY_SINGLE_PRECISION
+	typedef __m512 Reg;
+	typedef __mmask16 Mask;
+#else
+	typedef __m512d Reg;
+	typedef __mmask8 Mask;
+#endif
+	enum { WIDTH = sizeof(Reg) / sizeof(Real) };
+
+	struct VMask
+	{
+		Mask m;
+
+		inline VMask operator & (VMask rhs) const { VMask r = { (Mask)(m & rhs.m) }; return r; }
+		inline VMask operator | (VMask rhs) const { VMask r = { (Mask)(m | rhs.m) }; return r; }
+		inline bool Any() const { return m != 0; }
+		inline int Bits() const { return (int)m; }
+	};
+
+	struct VReal
+	{
+		Reg r;
+
+		inline VReal operator + (VReal rhs) const { VReal v = { SIMD_AVX512(add)(r, rhs.r) }; return v; }
+		inline VReal operator - (VReal rhs) const { VReal v = { SIMD_AVX512(sub)(r, rhs.r) }; return v; }
+		inline VReal operator * (VReal rhs) const { VReal v = { SIMD_AVX512(mul)(r, rhs.r) }; return v; }
+		inline VReal operator / (VReal rhs) const { VReal v = { SIMD_AVX512(div)(r, rhs.r) }; return v; }
+		inline VReal operator - () const { VReal v = { SIMD_AVX512(sub)(SIMD_AVX512(setzero)(), r) }; return v; }
+
+		inline VMask operator < (VReal rhs) const { VMask m = { SIMD_AVX512_CMP(r, rhs.r, _CMP_LT_OQ) }; return m; }
+		inline VMask operator > (VReal rhs) const { VMask m = { SIMD_AVX512_CMP(r, rhs.r, _CMP_GT_OQ) }; return m; }
+		inline VMask operator <= (VReal rhs) const { VMask m = { SIMD_AVX512_CMP(r, rhs.r, _CMP_LE_OQ) }; return m; }
+		inline VMask operator >= (VReal rhs) const { VMask m = { SIMD_AVX512_CMP(r, rhs.r, _CMP_GE_OQ) }; return m; }
+		inline VMask operator == (VReal rhs) const { VMask m = { SIMD_AVX512_CMP(r, rhs.r, _CMP_EQ_OQ) }; return m; }
+	};
+
+	static inline VReal Set1(Real s) { VReal v = { SIMD_AVX512(set1)(s) }; return v; }
+	static inline VReal Load(const Real* p) { VReal v = { SIMD_AVX512(loadu)(p) }; return v; }
+	static inline void Store(Real* p, VReal v) { SIMD_AVX512(storeu)(p, v.r); }
+	static inline VReal Sqrt(VReal a) { VReal v = { SIMD_AVX512(sqrt)(a.r) }; return v; }
+	static inline VReal Abs(VReal a) { VReal v = { SIMD_AVX512(abs)(a.r) }; return v; }
+
+	//mask ? a : b, per lane
+	static inline VReal Select(VMask mask, VReal a, VReal b)
+	{
+		VReal v = { SIMD_AVX512(mask_blend)(mask.m, b.r, a.r) };
+		return v;
+	}
+};
+#endif
+
+}
@@ -9,30 +9,36 @@
 ---------------------------------------------------------------------*/
 #pragma once
 #include "Primitive.h"
-#include "Vector4D.h"
+#include "Vec3.h"
 #include "Ray.h"
 
 class Sphere : public Primitive
 {
 	private:
-		Vector4D				m_centre;
-		double				m_radius;
+		Vec3				m_centre;
+		Real				m_radius;
 
 	public:
 		Sphere();
-		Sphere(double x, double y, double z, double r);
+		Sphere(Real x, Real y, Real z, Real r);
 		~Sphere();
 
-		inline Vector4D&		GetCentre()
+		inline void		SetSphere(Real x, Real y, Real z, Real r)
+		{
+			m_centre.SetVector(x, y, z);
+			m_radius = r;
+		}
+
+		inline Vec3&		GetCentre()
 		{
 			return m_centre;
 		}
 
-		inline double		GetRadius()
+		inline Real		GetRadius()
 		{
 			return m_radius;
 		}
 
-		RayHitResult		IntersectByRay(Ray& ray);
+		AABB				GetBoundingBox();
 };
 
@@ -0,0 +1,713 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Texture.h"
+#include "ImageIO.h"
+#include "FileUtil.h"
+
+#define TEXTURE_FILE_VERSION	1
+
+//The tiles start at a multiple of this from the start of the file
+#define TEXTURE_FILE_ALIGNMENT	64
+
+static const char s_textureMagic[8] = { 'T', 'R', 'T', 'E', 'X', '\0', '\0', '\0' };
+
+struct TextureFileHeader
+{
+	char		magic[8];
+	uint32_t	version;
+	int32_t		width;
+	int32_t		height;
+	int32_t		levelCount;
+	int32_t		tileSize;
+	uint32_t	reserved;
+	uint64_t	fileSize;
+};
+
+static const uint64_t s_tileOffset = (sizeof(TextureFileHeader) + TEXTURE_FILE_ALIGNMENT - 1) /
+	TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+
+//Read size bytes at offset without moving the file position, so that several threads can
+//read the same file at once
+static bool ReadFileAt(FILE* fp, uint64_t offset, void* data, size_t size)
+{
+#ifdef _WIN32
+	HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+	OVERLAPPED overlapped;
+	DWORD read = 0;
+
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	return ReadFile(file, data, (DWORD)size, &read, &overlapped) && read == size;
+#else
+	return pread(fileno(fp), data, size, (off_t)offset) == (ssize_t)size;
+#endif
+}
+
+static uint64_t GetFileSize(FILE* fp)
+{
+#ifdef _WIN32
+	_fseeki64(fp, 0, SEEK_END);
+	return (uint64_t)_ftelli64(fp);
+#else
+	fseeko(fp, 0, SEEK_END);
+	return (uint64_t)ftello(fp);
+#endif
+}
+
+//The size of the mip level below one of size, which halves it rounding up so that no texel
+//is left out of the average
+static inline int NextLevelSize(int size)
+{
+	return size > 1 ? (size + 1) / 2 : 1;
+}
+
+static int CountLevels(int width, int height)
+{
+	int levels = 1;
+
+	while (width > 1 || height > 1)
+	{
+		width = NextLevelSize(width);
+		height = NextLevelSize(height);
+		levels++;
+	}
+
+	return levels;
+}
+
+static inline int TileCount(int size)
+{
+	return (size + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+}
+
+Texture::Texture(TextureCache* cache, int id)
+{
+	m_cache = cache;
+	m_id = id;
+	m_file = nullptr;
+	m_tileOffset = s_tileOffset;
+}
+
+Texture::~Texture()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+	}
+}
+
+bool Texture::Open(const char* filename)
+{
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	TextureFileHeader header;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, s_textureMagic, sizeof(header.magic)) != 0 ||
+		header.version != TEXTURE_FILE_VERSION || header.tileSize != TEXTURE_TILE_SIZE || header.width <= 0 ||
+		header.height <= 0 || header.levelCount != CountLevels(header.width, header.height) ||
+		header.fileSize != GetFileSize(fp))
+	{
+		fclose(fp);
+		return false;
+	}
+
+	m_levels.clear();
+
+	int width = header.width;
+	int height = header.height;
+	int tiles = 0;
+
+	for (int l = 0; l < header.levelCount; l++)
+	{
+		Level level;
+		level.width = width;
+		level.height = height;
+		level.tilesX = TileCount(width);
+		level.tilesY = TileCount(height);
+		level.firstTile = tiles;
+
+		m_levels.push_back(level);
+
+		tiles += level.tilesX * level.tilesY;
+		width = NextLevelSize(width);
+		height = NextLevelSize(height);
+	}
+
+	if (header.fileSize != m_tileOffset + (uint64_t)tiles * TEXTURE_TILE_BYTES)
+	{
+		fclose(fp);
+		m_levels.clear();
+		return false;
+	}
+
+	if (m_file)
+	{
+		fclose(m_file);
+	}
+
+	m_file = fp;
+	m_filename = filename;
+
+	return true;
+}
+
+int Texture::GetTileCount() const
+{
+	const Level& last = m_levels.back();
+
+	return last.firstTile + last.tilesX * last.tilesY;
+}
+
+Colour Texture::SampleLevel(int level, Real u, Real v) const
+{
+	const Level& lv = m_levels[level];
+
+	//the texel centres are at half texels, the four around (u, v) wrap around the edges
+	Real x = (u - floor(u)) * lv.width - (Real)0.5;
+	Real y = (v - floor(v)) * lv.height - (Real)0.5;
+	Real fx = floor(x);
+	Real fy = floor(y);
+	float ax = (float)(x - fx);
+	float ay = (float)(y - fy);
+
+	int x0 = (int)fx < 0 ? lv.width - 1 : (int)fx;
+	int y0 = (int)fy < 0 ? lv.height - 1 : (int)fy;
+	int x1 = x0 + 1 < lv.width ? x0 + 1 : 0;
+	int y1 = y0 + 1 < lv.height ? y0 + 1 : 0;
+
+	int xs[4] = { x0, x1, x0, x1 };
+	int ys[4] = { y0, y0, y1, y1 };
+	unsigned char rgb[12];
+
+	m_cache->FetchTexels(*this, level, xs, ys, 4, rgb);
+
+	float weights[4] = { (1.0f - ax) * (1.0f - ay), ax * (1.0f - ay), (1.0f - ax) * ay, ax * ay };
+	float sum[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i = 0; i < 4; i++)
+	{
+		sum[0] += weights[i] * rgb[i * 3];
+		sum[1] += weights[i] * rgb[i * 3 + 1];
+		sum[2] += weights[i] * rgb[i * 3 + 2];
+	}
+
+	Colour colour = { sum[0] / 255.0f, sum[1] / 255.0f, sum[2] / 255.0f };
+
+	return colour;
+}
+
+Colour Texture::Sample(Real u, Real v, Real width) const
+{
+	//the level whose texels are as wide as the footprint
+	Real texels = width * (Real)std::max(m_levels[0].width, m_levels[0].height);
+	Real lod = texels > (Real)1.0 ? log2(texels) : (Real)0.0;
+	int last = (int)m_levels.size() - 1;
+
+	if (lod >= last)
+	{
+		return SampleLevel(last, u, v);
+	}
+
+	int level = (int)lod;
+	float blend = (float)(lod - level);
+	Colour fine = SampleLevel(level, u, v);
+
+	if (blend <= 0.0f)
+	{
+		return fine;
+	}
+
+	Colour coarse = SampleLevel(level + 1, u, v);
+
+	fine.red += (coarse.red - fine.red) * blend;
+	fine.green += (coarse.green - fine.green) * blend;
+	fine.blue += (coarse.blue - fine.blue) * blend;
+
+	return fine;
+}
+
+TextureCache::TextureCache(size_t budget)
+{
+	for (Shard& shard : m_shards)
+	{
+		shard.head = shard.tail = -1;
+		shard.maxSlots = 0;
+		shard.loadingCount = 0;
+	}
+
+	m_shardCount = 1;
+	m_residentBytes = 0;
+	m_peakBytes = 0;
+	SetBudget(budget);
+	ResetStats();
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+Texture* TextureCache::Open(const char* filename)
+{
+	for (const std::unique_ptr<Texture>& texture : m_textures)
+	{
+		if (texture->GetFilename() == filename)
+		{
+			return texture.get();
+		}
+	}
+
+	std::unique_ptr<Texture> texture(new Texture(this, (int)m_textures.size()));
+
+	if (!texture->Open(filename))
+	{
+		return nullptr;
+	}
+
+	m_textures.push_back(std::move(texture));
+
+	return m_textures.back().get();
+}
+
+Texture* TextureCache::OpenImage(const char* filename)
+{
+	Texture* texture = Open(filename);
+
+	if (texture)
+	{
+		return texture;
+	}
+
+	std::string tiled = std::string(filename) + ".tex";
+	texture = Open(tiled.c_str());
+
+	if (texture)
+	{
+		return texture;
+	}
+
+	std::vector<float> rgb;
+	int width, height;
+
+	if (!ReadImage(filename, rgb, width, height) || !SaveTexture(tiled.c_str(), rgb.data(), width, height))
+	{
+		return nullptr;
+	}
+
+	return Open(tiled.c_str());
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+	ResetShards(bytes, false);
+}
+
+void TextureCache::Flush()
+{
+	ResetShards(m_budget, true);
+}
+
+void TextureCache::ResetShards(size_t budget, bool drop)
+{
+	//one after the other in order, so that two callers cannot hold each a shard the other one
+	//waits for; no tile of a held shard starts on its way in, those already are waited for
+	std::unique_lock<std::mutex> locks[TEXTURE_CACHE_SHARDS];
+
+	for (int s = 0; s < TEXTURE_CACHE_SHARDS; s++)
+	{
+		Shard& shard = m_shards[s];
+
+		locks[s] = std::unique_lock<std::mutex>(shard.lock);
+		shard.loaded.wait(locks[s], [&shard] { return shard.loadingCount == 0; });
+	}
+
+	//a budget of fewer tiles than shards uses fewer shards
+	size_t maxSlots = std::max(budget / TEXTURE_TILE_BYTES, (size_t)1);
+	int count = (int)std::min(maxSlots, (size_t)TEXTURE_CACHE_SHARDS);
+	size_t shardSlots[TEXTURE_CACHE_SHARDS];
+
+	for (int s = 0; s < TEXTURE_CACHE_SHARDS; s++)
+	{
+		shardSlots[s] = s < count ? maxSlots / count + ((size_t)s < maxSlots % count ? 1 : 0) : 0;
+		drop = drop || m_shards[s].slotKey.size() > shardSlots[s];
+	}
+
+	m_budget = budget;
+
+	//the slots are not moved from one shard to another: the tiles stay only if each shard
+	//keeps every one of its own
+	if (!drop && count == m_shardCount)
+	{
+		for (int s = 0; s < TEXTURE_CACHE_SHARDS; s++)
+		{
+			m_shards[s].maxSlots = shardSlots[s];
+		}
+
+		return;
+	}
+
+	for (int s = 0; s < TEXTURE_CACHE_SHARDS; s++)
+	{
+		Shard& shard = m_shards[s];
+
+		shard.slotData.clear();
+		shard.slotKey.clear();
+		shard.slotPrev.clear();
+		shard.slotNext.clear();
+		shard.slotLoading.clear();
+		shard.slots.clear();
+		shard.head = shard.tail = -1;
+		shard.maxSlots = shardSlots[s];
+	}
+
+	m_shardCount = count;
+	m_residentBytes = 0;
+}
+
+TextureCacheStats TextureCache::GetStats()
+{
+	TextureCacheStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	for (Shard& shard : m_shards)
+	{
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		stats.lookups += shard.stats.lookups;
+		stats.misses += shard.stats.misses;
+		stats.evictions += shard.stats.evictions;
+		stats.failedReads += shard.stats.failedReads;
+	}
+
+	stats.residentBytes = m_residentBytes;
+	stats.peakBytes = m_peakBytes;
+
+	return stats;
+}
+
+void TextureCache::ResetStats()
+{
+	for (Shard& shard : m_shards)
+	{
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		memset(&shard.stats, 0, sizeof(shard.stats));
+	}
+
+	m_peakBytes = m_residentBytes.load();
+}
+
+void TextureCache::Shard::Unlink(int slot)
+{
+	int prev = slotPrev[slot];
+	int next = slotNext[slot];
+
+	(prev >= 0 ? slotNext[prev] : head) = next;
+	(next >= 0 ? slotPrev[next] : tail) = prev;
+}
+
+void TextureCache::Shard::PushFront(int slot)
+{
+	slotPrev[slot] = -1;
+	slotNext[slot] = head;
+
+	(head >= 0 ? slotPrev[head] : tail) = slot;
+	head = slot;
+}
+
+TextureCache::Shard& TextureCache::LockShard(uint64_t key, std::unique_lock<std::mutex>& lock)
+{
+	for (;;)
+	{
+		int count = m_shardCount;
+		Shard& shard = m_shards[ShardOf(key, count)];
+
+		if (lock.mutex() != &shard.lock)
+		{
+			if (lock.owns_lock())
+			{
+				lock.unlock();
+			}
+
+			lock = std::unique_lock<std::mutex>(shard.lock);
+		}
+
+		//the count cannot change while a shard is held, but may have before it was
+		if (m_shardCount == count)
+		{
+			return shard;
+		}
+	}
+}
+
+int TextureCache::AcquireTile(Shard& shard, const Texture& texture, int tile, std::unique_lock<std::mutex>& lock)
+{
+	uint64_t key = TileKey(texture.m_id, tile);
+
+	for (;;)
+	{
+		std::unordered_map<uint64_t, int>::iterator found = shard.slots.find(key);
+
+		if (found != shard.slots.end())
+		{
+			int slot = found->second;
+
+			//another thread is reading the tile; once it is in, it may already have been evicted
+			//again, so it is looked up anew
+			if (shard.slotLoading[slot])
+			{
+				shard.loaded.wait(lock);
+				continue;
+			}
+
+			if (slot != shard.head)
+			{
+				shard.Unlink(slot);
+				shard.PushFront(slot);
+			}
+
+			return slot;
+		}
+
+		int slot = -1;
+
+		if (shard.slotKey.size() < shard.maxSlots)
+		{
+			slot = (int)shard.slotKey.size();
+
+			shard.slotData.emplace_back(new unsigned char[TEXTURE_TILE_BYTES]);
+			shard.slotKey.push_back(key);
+			shard.slotPrev.push_back(-1);
+			shard.slotNext.push_back(-1);
+			shard.slotLoading.push_back(0);
+
+			size_t resident = m_residentBytes += TEXTURE_TILE_BYTES;
+			size_t peak = m_peakBytes;
+
+			while (resident > peak && !m_peakBytes.compare_exchange_weak(peak, resident))
+			{
+			}
+		}
+		else
+		{
+			//the least recently used tile that is not on its way in
+			slot = shard.tail;
+
+			while (slot >= 0 && shard.slotLoading[slot])
+			{
+				slot = shard.slotPrev[slot];
+			}
+
+			if (slot < 0)
+			{
+				//every slot is being read, wait for one and look again
+				shard.loaded.wait(lock);
+				continue;
+			}
+
+			shard.Unlink(slot);
+			shard.slots.erase(shard.slotKey[slot]);
+			shard.stats.evictions++;
+		}
+
+		shard.slotKey[slot] = key;
+		shard.slots[key] = slot;
+		shard.slotLoading[slot] = 1;
+		shard.loadingCount++;
+		shard.PushFront(slot);
+
+		//nothing else touches a loading slot, its data is read without the lock
+		unsigned char* data = shard.slotData[slot].get();
+
+		lock.unlock();
+
+		bool ok = ReadFileAt(texture.m_file, texture.m_tileOffset + (uint64_t)tile * TEXTURE_TILE_BYTES, data,
+			TEXTURE_TILE_BYTES);
+
+		if (!ok)
+		{
+			memset(data, 0, TEXTURE_TILE_BYTES);
+		}
+
+		lock.lock();
+
+		shard.slotLoading[slot] = 0;
+		shard.loadingCount--;
+		shard.stats.misses++;
+		shard.stats.failedReads += ok ? 0 : 1;
+		shard.loaded.notify_all();
+
+		return slot;
+	}
+}
+
+void TextureCache::FetchTexels(const Texture& texture, int level, const int* x, const int* y, int count, unsigned char* rgb)
+{
+	const Texture::Level& lv = texture.m_levels[level];
+
+	//the texels of a sample mostly share a tile, which is then looked up once; the lock of its
+	//shard may be let go while a tile is read or for that of another tile, but the texels
+	//before it are copied by then
+	std::unique_lock<std::mutex> lock;
+	Shard* shard = nullptr;
+	int lastTile = -1;
+	const unsigned char* data = nullptr;
+
+	for (int i = 0; i < count; i++)
+	{
+		int tile = lv.firstTile + (y[i] / TEXTURE_TILE_SIZE) * lv.tilesX + x[i] / TEXTURE_TILE_SIZE;
+
+		if (tile != lastTile)
+		{
+			shard = &LockShard(TileKey(texture.m_id, tile), lock);
+			data = shard->slotData[AcquireTile(*shard, texture, tile, lock)].get();
+			lastTile = tile;
+		}
+
+		const unsigned char* texel = data + ((y[i] % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE + x[i] % TEXTURE_TILE_SIZE) * 3;
+
+		rgb[i * 3] = texel[0];
+		rgb[i * 3 + 1] = texel[1];
+		rgb[i * 3 + 2] = texel[2];
+		shard->stats.lookups++;
+	}
+}
+
+bool SaveTexture(const char* filename, const float* rgb, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		return false;
+	}
+
+	TextureFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, s_textureMagic, sizeof(header.magic));
+	header.version = TEXTURE_FILE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.levelCount = CountLevels(width, height);
+	header.tileSize = TEXTURE_TILE_SIZE;
+
+	uint64_t tiles = 0;
+
+	for (int l = 0, w = width, h = height; l < header.levelCount; l++)
+	{
+		tiles += (uint64_t)TileCount(w) * TileCount(h);
+		w = NextLevelSize(w);
+		h = NextLevelSize(h);
+	}
+
+	header.fileSize = s_tileOffset + tiles * TEXTURE_TILE_BYTES;
+
+	std::string temp = MakeTempPath(filename);
+	FILE* fp = fopen(temp.c_str(), "wb");
+
+	if (!fp)
+	{
+		return false;
+	}
+
+	static const char zeros[TEXTURE_FILE_ALIGNMENT] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(zeros, 1, (size_t)(s_tileOffset - sizeof(header)), fp) == s_tileOffset - sizeof(header);
+
+	//each level is made from the one above in float, and only rounded to 8 bits in the tiles
+	std::vector<float> level(rgb, rgb + (size_t)width * height * 3);
+	std::vector<float> next;
+	std::vector<unsigned char> tile(TEXTURE_TILE_BYTES);
+
+	int w = width;
+	int h = height;
+
+	for (int l = 0; l < header.levelCount && ok; l++)
+	{
+		//the tiles over the edge of the level repeat its last texels
+		for (int ty = 0; ty < TileCount(h) && ok; ty++)
+		{
+			for (int tx = 0; tx < TileCount(w) && ok; tx++)
+			{
+				for (int y = 0; y < TEXTURE_TILE_SIZE; y++)
+				{
+					int sy = std::min(ty * TEXTURE_TILE_SIZE + y, h - 1);
+
+					for (int x = 0; x < TEXTURE_TILE_SIZE; x++)
+					{
+						int sx = std::min(tx * TEXTURE_TILE_SIZE + x, w - 1);
+						const float* texel = &level[((size_t)sy * w + sx) * 3];
+						unsigned char* out = &tile[(y * TEXTURE_TILE_SIZE + x) * 3];
+
+						for (int c = 0; c < 3; c++)
+						{
+							float value = std::min(std::max(texel[c], 0.0f), 1.0f);
+							out[c] = (unsigned char)(value * 255.0f + 0.5f);
+						}
+					}
+				}
+
+				ok = fwrite(tile.data(), 1, tile.size(), fp) == tile.size();
+			}
+		}
+
+		int nw = NextLevelSize(w);
+		int nh = NextLevelSize(h);
+		next.resize((size_t)nw * nh * 3);
+
+		for (int y = 0; y < nh; y++)
+		{
+			int y0 = std::min(y * 2, h - 1);
+			int y1 = std::min(y * 2 + 1, h - 1);
+
+			for (int x = 0; x < nw; x++)
+			{
+				int x0 = std::min(x * 2, w - 1);
+				int x1 = std::min(x * 2 + 1, w - 1);
+
+				for (int c = 0; c < 3; c++)
+				{
+					next[((size_t)y * nw + x) * 3 + c] = 0.25f * (level[((size_t)y0 * w + x0) * 3 + c] +
+						level[((size_t)y0 * w + x1) * 3 + c] + level[((size_t)y1 * w + x0) * 3 + c] +
+						level[((size_t)y1 * w + x1) * 3 + c]);
+				}
+			}
+		}
+
+		level.swap(next);
+		w = nw;
+		h = nh;
+	}
+
+	ok = fclose(fp) == 0 && ok;
+
+	if (!ok)
+	{
+		remove(temp.c_str());
+		return false;
+	}
+
+	return ReplaceWithTemp(temp, filename);
+}
@@ -0,0 +1,225 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Material.h"
+
+//Texels per side of a tile, the unit textures are read from disk and kept in memory in
+#define TEXTURE_TILE_SIZE		64
+#define TEXTURE_TILE_BYTES		(TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * 3)
+
+//The default budget of a TextureCache
+#define TEXTURE_CACHE_DEFAULT_BUDGET	((size_t)256 << 20)
+
+//Shards of a TextureCache, each with a lock of its own
+#define TEXTURE_CACHE_SHARDS			16
+
+class TextureCache;
+
+//An image texture in a tiled file: the image and its mip levels down to 1x1, each cut into
+//TEXTURE_TILE_SIZE tiles of 8-bit RGB stored one after the other, level 0 first and each
+//level row by row from the bottom. A texture holds nothing but the file's header, its
+//tiles are read by the TextureCache it was opened with when a sample first needs them.
+//
+//Texture coordinates repeat outside [0, 1], v = 0 is the bottom row like in the framebuffer.
+class Texture
+{
+	private:
+		struct Level
+		{
+			int		width;
+			int		height;
+			int		tilesX;
+			int		tilesY;
+			int		firstTile;		//of the level among all tiles of the file
+		};
+
+		TextureCache*		m_cache;
+		int					m_id;			//in m_cache
+		std::string			m_filename;
+		FILE*				m_file;			//read by m_cache at tile offsets, from any thread at once
+		uint64_t			m_tileOffset;	//of the first tile in the file
+		std::vector<Level>	m_levels;
+
+		friend class TextureCache;
+
+		//Bilinear filtering of level at (u, v)
+		Colour SampleLevel(int level, Real u, Real v) const;
+
+	public:
+		Texture(TextureCache* cache, int id);
+		~Texture();
+
+		//Read the header of a tiled file, false if it is not one
+		bool Open(const char* filename);
+
+		//The colour at (u, v) for a footprint width wide in texture coordinates: trilinear
+		//filtering between the two mip levels whose texels are closest to that wide, 0 takes
+		//the full resolution image
+		Colour Sample(Real u, Real v, Real width) const;
+
+		inline int GetWidth() const
+		{
+			return m_levels[0].width;
+		}
+
+		inline int GetHeight() const
+		{
+			return m_levels[0].height;
+		}
+
+		inline int GetLevelCount() const
+		{
+			return (int)m_levels.size();
+		}
+
+		//Tiles of all levels together
+		int GetTileCount() const;
+
+		inline const std::string& GetFilename() const
+		{
+			return m_filename;
+		}
+};
+
+//What a TextureCache did since it was made or its counters were reset
+struct TextureCacheStats
+{
+	uint64_t	lookups;			//texels fetched
+	uint64_t	misses;				//tiles read from disk
+	uint64_t	evictions;			//tiles dropped to make room for another
+	uint64_t	failedReads;		//tiles that could not be read, their texels are black
+	size_t		residentBytes;		//tile memory in use now
+	size_t		peakBytes;			//and at most
+};
+
+//The tiles of any number of textures in a fixed memory budget. Tiles are read from their
+//files the first time a sample touches them and stay until the budget is spent, then the
+//least recently used tile makes room for the next one, so the textures of a scene may be
+//far larger than the memory they are rendered in. The textures are owned by the cache.
+//
+//Samples may be taken from any number of threads. The tiles are spread over shards by their
+//key, each with its own lock, slots and share of the budget, so threads reading different
+//tiles seldom wait for each other; the least recently used tile is that of its shard. A tile
+//is read from disk outside its shard's lock: it is marked so that nothing evicts it, and
+//threads that need it wait for it alone.
+class TextureCache
+{
+	private:
+		//The slots of one shard's tiles, at most maxSlots, linked into a list from the most
+		//recently used one at head to the least at tail
+		struct Shard
+		{
+			std::vector<std::unique_ptr<unsigned char[]>>	slotData;
+			std::vector<uint64_t>					slotKey;
+			std::vector<int>						slotPrev;
+			std::vector<int>						slotNext;
+			std::vector<char>						slotLoading;	//read from disk outside lock, not to be used or evicted
+			int										head;
+			int										tail;
+			std::unordered_map<uint64_t, int>		slots;			//tile key to slot
+			size_t									maxSlots;
+
+			std::mutex								lock;
+			std::condition_variable					loaded;			//signalled when a slot has been read
+			int										loadingCount;
+			TextureCacheStats						stats;			//but the bytes, which are the cache's
+
+			void Unlink(int slot);
+			void PushFront(int slot);
+		};
+
+		std::vector<std::unique_ptr<Texture>>	m_textures;
+		size_t									m_budget;
+
+		//The first m_shardCount shards are in use, fewer than TEXTURE_CACHE_SHARDS for a budget
+		//of fewer tiles; the count only changes with every shard locked
+		Shard									m_shards[TEXTURE_CACHE_SHARDS];
+		std::atomic<int>						m_shardCount;
+		std::atomic<size_t>						m_residentBytes;
+		std::atomic<size_t>						m_peakBytes;
+
+		friend class Texture;
+
+		static inline uint64_t TileKey(int texture, int tile)
+		{
+			return ((uint64_t)texture << 32) | (uint32_t)tile;
+		}
+
+		//The shard of key among count shards
+		static inline int ShardOf(uint64_t key, int count)
+		{
+			return (int)(((key * 0x9e3779b97f4a7c15ull) >> 32) % (uint32_t)count);
+		}
+
+		//Lock the shard of key into lock, which holds no lock or that of another shard
+		Shard& LockShard(uint64_t key, std::unique_lock<std::mutex>& lock);
+
+		//The slot of shard holding tile of texture, read into the shard's least recently used
+		//slot, or a new one while its budget allows, if it is not in memory. Called with lock
+		//held on the shard's lock; it is let go while the tile is read from disk and while
+		//another thread reads it, so that one thread's read does not hold up the others.
+		int AcquireTile(Shard& shard, const Texture& texture, int tile, std::unique_lock<std::mutex>& lock);
+
+		//Lock every shard once no tile is being read and share budget out among them. The tiles
+		//are dropped if drop is set or the shards can no longer keep them.
+		void ResetShards(size_t budget, bool drop);
+
+		//The 8-bit texels (x[i], y[i]) of level of texture, count at most 4, into rgb
+		void FetchTexels(const Texture& texture, int level, const int* x, const int* y, int count, unsigned char* rgb);
+
+	public:
+		TextureCache(size_t budget = TEXTURE_CACHE_DEFAULT_BUDGET);
+		~TextureCache();
+
+		//Open the tiled file filename as a texture of the cache, nullptr if it cannot be read
+		//or is not a tiled file. A file opened before is given again.
+		Texture* Open(const char* filename);
+
+		//The tiled file of an image: filename as it is if it is one, otherwise a .ppm or .pfm
+		//image converted into filename + ".tex" unless that exists already
+		Texture* OpenImage(const char* filename);
+
+		//Bytes of tiles kept in memory at most, at least one tile. A budget that takes a shard
+		//below the tiles it holds, or spreads the tiles over another number of shards, drops
+		//every tile.
+		void SetBudget(size_t bytes);
+
+		inline size_t GetBudget() const
+		{
+			return m_budget;
+		}
+
+		//Drop every tile, the textures stay open
+		void Flush();
+
+		TextureCacheStats GetStats();
+		void ResetStats();
+
+		inline int GetTextureCount() const
+		{
+			return (int)m_textures.size();
+		}
+};
+
+//Write an image, rgb as the framebuffer stores it with the bottom row first, as a tiled file
+//with its mip levels, each made by averaging 2x2 texels of the one above. The file is written
+//under a name of its own next to filename first and then renamed over it, like a mesh cache.
+bool SaveTexture(const char* filename, const float* rgb, int width, int height);
@@ -0,0 +1,198 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "ThreadPool.h"
+
+//The pool a worker thread belongs to and its index there; the index only means something to
+//that pool, every other pool sees the thread as one from outside
+static thread_local const ThreadPool* s_pool = nullptr;
+static thread_local int s_threadIndex = 0;
+
+ThreadPool::ThreadPool(int numThreads)
+{
+	if (numThreads <= 0)
+	{
+		numThreads = (int)std::thread::hardware_concurrency();
+
+		if (numThreads <= 0)
+			numThreads = 1;
+	}
+
+	m_queuedCount = 0;
+	m_nextQueue = 0;
+	m_stealCount = 0;
+	m_shutdown = false;
+
+	for (int i = 0; i < numThreads; i++)
+	{
+		m_queues.push_back(new WorkQueue());
+	}
+
+	//the calling thread does its share of the work in Wait(), so spawn one thread less
+	for (int i = 1; i < numThreads; i++)
+	{
+		m_workers.push_back(std::thread(&ThreadPool::WorkerMain, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_shutdown = true;
+	}
+	m_wakeUp.notify_all();
+
+	std::vector<std::thread>::iterator thread_iter = m_workers.begin();
+
+	while (thread_iter != m_workers.end())
+	{
+		thread_iter->join();
+		thread_iter++;
+	}
+
+	std::vector<WorkQueue*>::iterator queue_iter = m_queues.begin();
+
+	while (queue_iter != m_queues.end())
+	{
+		delete *queue_iter;
+		queue_iter++;
+	}
+}
+
+int ThreadPool::GetCurrentThreadIndex() const
+{
+	return s_pool == this ? s_threadIndex : 0;
+}
+
+void ThreadPool::Submit(TaskGroup& group, Task task)
+{
+	group.m_pending++;
+
+	TaskGroup* pGroup = &group;
+	Task wrapped = [task, pGroup]()
+	{
+		task();
+		pGroup->m_pending--;
+	};
+
+	int index = GetCurrentThreadIndex();
+
+	if (index == 0)
+	{
+		index = (int)(m_nextQueue++ % m_queues.size());
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_queues[index]->lock);
+		m_queues[index]->tasks.push_back(wrapped);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_queuedCount++;
+	}
+	m_wakeUp.notify_one();
+}
+
+bool ThreadPool::PopOrSteal(int index, Task& task)
+{
+	int numQueues = (int)m_queues.size();
+
+	//newest task of our own deque first, it is the most likely to be warm in the cache
+	{
+		WorkQueue* queue = m_queues[index];
+		std::lock_guard<std::mutex> guard(queue->lock);
+
+		if (!queue->tasks.empty())
+		{
+			task = queue->tasks.back();
+			queue->tasks.pop_back();
+			m_queuedCount--;
+			return true;
+		}
+	}
+
+	//otherwise steal the oldest task of someone else
+	for (int i = 1; i < numQueues; i++)
+	{
+		WorkQueue* victim = m_queues[(index + i) % numQueues];
+		std::lock_guard<std::mutex> guard(victim->lock);
+
+		if (!victim->tasks.empty())
+		{
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			m_queuedCount--;
+			m_stealCount++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::WorkerMain(int index)
+{
+	s_pool = this;
+	s_threadIndex = index;
+
+	while (true)
+	{
+		Task task;
+
+		if (PopOrSteal(index, task))
+		{
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(m_sleepLock);
+		m_wakeUp.wait(guard, [this]() { return m_shutdown || m_queuedCount > 0; });
+
+		if (m_shutdown)
+			return;
+	}
+}
+
+void ThreadPool::Wait(TaskGroup& group)
+{
+	while (group.m_pending > 0)
+	{
+		Task task;
+
+		if (PopOrSteal(GetCurrentThreadIndex(), task))
+		{
+			task();
+		}
+		else
+		{
+			//the remaining tasks of the group are running on other threads
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+	if (grain < 1)
+		grain = 1;
+
+	TaskGroup group;
+	const std::function<void(int, int)>* pBody = &body;
+
+	for (int i = begin; i < end; i += grain)
+	{
+		int chunkEnd = (i + grain < end) ? i + grain : end;
+
+		Submit(group, [pBody, i, chunkEnd]() { (*pBody)(i, chunkEnd); });
+	}
+
+	Wait(group);
+}
@@ -0,0 +1,98 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A persistent pool of worker threads with one task deque per thread.
+//A thread pushes and pops its own work at the back of its deque, idle threads
+//steal from the front of the other deques, so a few expensive tasks never
+//leave the rest of the pool waiting.
+class ThreadPool
+{
+	public:
+		typedef std::function<void()> Task;
+
+		//Tracks the outstanding tasks of one batch of work, see Wait()
+		class TaskGroup
+		{
+			friend class ThreadPool;
+
+			private:
+				std::atomic<int>	m_pending;
+
+			public:
+				TaskGroup() { m_pending = 0; }
+		};
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex			lock;
+			std::deque<Task>	tasks;
+		};
+
+		//m_queues[0] is shared by all threads outside the pool, the workers own the rest
+		std::vector<WorkQueue*>			m_queues;
+		std::vector<std::thread>		m_workers;
+
+		std::mutex						m_sleepLock;
+		std::condition_variable			m_wakeUp;
+		std::atomic<int>				m_queuedCount;
+		std::atomic<unsigned int>		m_nextQueue;
+		bool							m_shutdown;
+
+		std::atomic<unsigned int>		m_stealCount;
+
+		void		WorkerMain(int index);
+		bool		PopOrSteal(int index, Task& task);
+
+	public:
+		//numThreads is the total number of threads taking part in the work, including
+		//the thread that calls Wait(). 0 picks the hardware concurrency.
+		ThreadPool(int numThreads = 0);
+		~ThreadPool();
+
+		inline int GetThreadCount() const
+		{
+			return (int)m_workers.size() + 1;
+		}
+
+		//Number of tasks executed by a thread other than the one whose deque held them
+		inline unsigned int GetStealCount() const
+		{
+			return m_stealCount;
+		}
+
+		inline void ResetStealCount()
+		{
+			m_stealCount = 0;
+		}
+
+		//Queue a task as part of group. Called from a worker, the task goes to the back of
+		//its own deque; from any other thread the tasks are dealt round robin to all deques.
+		void		Submit(TaskGroup& group, Task task);
+
+		//Execute and steal tasks until every task of group has finished
+		void		Wait(TaskGroup& group);
+
+		//Run body(i) for i in [begin, end) in chunks of grain iterations and wait for it
+		void		ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+		//Index of the calling thread in [0, GetThreadCount()), 0 for threads outside the pool,
+		//workers of other pools included
+		int			GetCurrentThreadIndex() const;
+};
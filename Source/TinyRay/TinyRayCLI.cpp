@@ -0,0 +1,415 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+// TinyRayCLI.cpp : Entry point of the headless renderer.
+// Traces the default scene without a window and writes the image to disk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+
+#include "RayTracer.h"
+#include "Scene.h"
+#include "ImageIO.h"
+#include "MeshIO.h"
+#include "MeshCache.h"
+#include "Instance.h"
+#include "Benchmark.h"
+
+void PrintBuildReport(const char* what, const BVHBuildReport& report)
+{
+	printf("%s BVH: %d items, %d nodes, depth %d, SAH cost %.2f, built in %.1f ms on %d thread(s)\n", what,
+		report.items, report.nodes, report.maxDepth, report.sahCost, report.seconds * 1000.0, report.threads);
+}
+
+void PrintUsage()
+{
+	printf("Usage: tinyray [options]\n");
+	printf("  -w <width>     image width in pixels (default 800)\n");
+	printf("  -h <height>    image height in pixels (default 600)\n");
+	printf("  -f <1-6>       ray trace complexity, same as the F1 - F6 keys (default 6)\n");
+	printf("                 1: Ambient only\n");
+	printf("                 2: Full lighting no shadow, reflection and transmission\n");
+	printf("                 3: Full lighting with shadow\n");
+	printf("                 4: Full lighting  reflection\n");
+	printf("                 5: Full lighting  refraction\n");
+	printf("                 6: Ray trace everything\n");
+	printf("  -l <level>     maximum trace level (default 5)\n");
+	printf("  -c <cutoff>    stop tracing secondary rays once a pixel's colour is below this in\n");
+	printf("                 every channel, 0 traces every ray up to the trace level (default 1/512)\n");
+	printf("  -p <0|1>       intersect the camera rays in SIMD packets (default 1)\n");
+	printf("  -r <renderer>  recursive: trace each pixel's ray tree depth first (default)\n");
+	printf("                 wavefront: trace each tile bounce by bounce in SoA ray queues\n");
+	printf("  -t <threads>   number of render threads, 0 uses every hardware thread (default 0)\n");
+	printf("  -s <size>      tile size in pixels (default 16)\n");
+	printf("  -m <file>      add a Wavefront OBJ model to the scene, scaled into a 5 unit box on\n");
+	printf("                 the floor to the right of the spheres\n");
+	printf("  -i <n>         with -m, fill the same box with n x n instances of the model (default 0:\n");
+	printf("                 the model itself, once)\n");
+	printf("  -b <layout>    BVH nodes single rays are traced through, the packets always take binary:\n");
+	printf("                 binary: two children per node (default)\n");
+	printf("                 wide, wide16, wide8: four children per node with float, 16-bit or 8-bit\n");
+	printf("                 quantised boxes\n");
+	printf("  -k <test>      how single rays test the triangles of meshes, the packets always take real:\n");
+	printf("                 real: Moller-Trumbore in the tracer's precision (default)\n");
+	printf("                 float: the watertight test in float with bounded rounding errors\n");
+	printf("  -x <structure> how single rays find the objects of the scene, the packets always take the BVH:\n");
+	printf("                 bvh: the BVH of -b (default)\n");
+	printf("                 grid: a uniform grid stepped through cell by cell\n");
+	printf("                 kdtree: a kd-tree built with the surface area heuristic\n");
+	printf("  -n <count>     light each point by count lights drawn from a light tree once the scene\n");
+	printf("                 has more than count lights, 0 takes every light (default 0)\n");
+	printf("  -d <image>     with -m, a diffuse texture laid on the model by its texture coordinates: a\n");
+	printf("                 .ppm or .pfm image, made into a tiled mip-mapped file next to it on the\n");
+	printf("                 first run, or such a file\n");
+	printf("  -e <MB>        memory the texture tiles are kept in at most (default 256)\n");
+	printf("  -a <dir>       with -m, keep the model and its BVH in a cache file in dir, made on the\n");
+	printf("                 first run and mapped from disk instead of loaded and built on later ones\n");
+	printf("  -o <file>      output image, .ppm or .pfm (default tinyray.ppm)\n");
+	printf("  --bench <name> run a benchmark instead of rendering:\n");
+	PrintBenchmarkList();
+}
+
+int main(int argc, char** argv)
+{
+	int width = 800;
+	int height = 600;
+	int preset = 6;
+	int tracelevel = 5;
+	int threads = 0;
+	int tilesize = 16;
+	float cutoff = 1.0f / 512.0f;
+	int packets = 1;
+	const char* renderer = "recursive";
+	const char* model = nullptr;
+	int instances = 0;
+	int lightSamples = 0;
+	const char* cacheDir = nullptr;
+	const char* texture = nullptr;
+	int textureBudget = 256;
+	const char* layout = "binary";
+	const char* accelerator = "bvh";
+	const char* triangleTest = "real";
+	const char* output = "tinyray.ppm";
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--help") == 0)
+		{
+			PrintUsage();
+			return 0;
+		}
+
+		if (!value)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			PrintUsage();
+			return 1;
+		}
+
+		if (strcmp(arg, "--bench") == 0)
+			return RunBenchmark(value);
+
+		if (strcmp(arg, "-w") == 0)
+			width = atoi(value);
+		else if (strcmp(arg, "-h") == 0)
+			height = atoi(value);
+		else if (strcmp(arg, "-f") == 0)
+			preset = atoi(value);
+		else if (strcmp(arg, "-l") == 0)
+			tracelevel = atoi(value);
+		else if (strcmp(arg, "-c") == 0)
+			cutoff = (float)atof(value);
+		else if (strcmp(arg, "-p") == 0)
+			packets = atoi(value);
+		else if (strcmp(arg, "-r") == 0)
+			renderer = value;
+		else if (strcmp(arg, "-t") == 0)
+			threads = atoi(value);
+		else if (strcmp(arg, "-s") == 0)
+			tilesize = atoi(value);
+		else if (strcmp(arg, "-m") == 0)
+			model = value;
+		else if (strcmp(arg, "-i") == 0)
+			instances = atoi(value);
+		else if (strcmp(arg, "-n") == 0)
+			lightSamples = atoi(value);
+		else if (strcmp(arg, "-a") == 0)
+			cacheDir = value;
+		else if (strcmp(arg, "-d") == 0)
+			texture = value;
+		else if (strcmp(arg, "-e") == 0)
+			textureBudget = atoi(value);
+		else if (strcmp(arg, "-b") == 0)
+			layout = value;
+		else if (strcmp(arg, "-x") == 0)
+			accelerator = value;
+		else if (strcmp(arg, "-k") == 0)
+			triangleTest = value;
+		else if (strcmp(arg, "-o") == 0)
+			output = value;
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg);
+			PrintUsage();
+			return 1;
+		}
+
+		i++;
+	}
+
+	if (width <= 0 || height <= 0 || preset < 1 || preset > 6 || tracelevel < 0 || cutoff < 0.0f || threads < 0 || tilesize <= 0 || instances < 0 ||
+		lightSamples < 0 || lightSamples > LIGHT_TREE_MAX_SAMPLES || textureBudget <= 0)
+	{
+		fprintf(stderr, "Invalid image size, complexity, trace level, cutoff, thread count, tile size, instance count, light count or texture memory\n");
+		return 1;
+	}
+
+	bool wavefront = strcmp(renderer, "wavefront") == 0;
+
+	if (!wavefront && strcmp(renderer, "recursive") != 0)
+	{
+		fprintf(stderr, "Unknown renderer %s\n", renderer);
+		return 1;
+	}
+
+	const char* layouts[] = { "binary", "wide", "wide16", "wide8" };
+	const WideBVHFormat formats[] = { WIDEBVH_NONE, WIDEBVH_FLOAT, WIDEBVH_QUANT16, WIDEBVH_QUANT8 };
+	int layoutIndex = 0;
+
+	while (layoutIndex < 4 && strcmp(layout, layouts[layoutIndex]) != 0)
+	{
+		layoutIndex++;
+	}
+
+	if (layoutIndex == 4)
+	{
+		fprintf(stderr, "Unknown BVH layout %s\n", layout);
+		return 1;
+	}
+
+	if (strcmp(triangleTest, "real") != 0 && strcmp(triangleTest, "float") != 0)
+	{
+		fprintf(stderr, "Unknown triangle test %s\n", triangleTest);
+		return 1;
+	}
+
+	const char* accelerators[] = { "bvh", "grid", "kdtree" };
+	const AcceleratorType acceleratorTypes[] = { ACCELERATOR_BVH, ACCELERATOR_GRID, ACCELERATOR_KDTREE };
+	int acceleratorIndex = 0;
+
+	while (acceleratorIndex < 3 && strcmp(accelerator, accelerators[acceleratorIndex]) != 0)
+	{
+		acceleratorIndex++;
+	}
+
+	if (acceleratorIndex == 3)
+	{
+		fprintf(stderr, "Unknown acceleration structure %s\n", accelerator);
+		return 1;
+	}
+
+	RayTracer raytracer(width, height);
+	raytracer.m_traceflag = RayTracer::GetPresetTraceFlag(preset);
+	raytracer.SetTraceLevel(tracelevel);
+	raytracer.SetThroughputThreshold(cutoff);
+	raytracer.SetPacketTracing(packets != 0);
+	raytracer.SetWavefront(wavefront);
+	raytracer.SetThreadCount(threads);
+	raytracer.SetTileSize(tilesize);
+
+	Scene scene;
+	scene.SetSceneWidth((float)width / (float)height);
+	scene.SetWideBVH(formats[layoutIndex]);
+	scene.SetAccelerator(acceleratorTypes[acceleratorIndex]);
+	scene.SetTriangleTest(strcmp(triangleTest, "float") == 0 ? TRIANGLE_TEST_FLOAT : TRIANGLE_TEST_REAL);
+	scene.SetLightSamples(lightSamples);
+	scene.GetTextureCache().SetBudget((size_t)textureBudget << 20);
+
+	TriangleMesh* modelMesh = nullptr;
+	std::string cacheFile;
+	uint64_t cacheKey = 0;
+
+	if (model)
+	{
+		TriangleMesh* mesh = new TriangleMesh();
+		modelMesh = mesh;
+
+		AABB spot;
+		spot.min.SetVector(3.0, -1.0, -4.0);
+		spot.max.SetVector(8.0, 4.0, 1.0);
+
+		//the model in a unit box at the origin for the instances, see below
+		AABB unit;
+		unit.min.SetVector(-0.5, -0.5, -0.5);
+		unit.max.SetVector(0.5, 0.5, 0.5);
+
+		const AABB& fit = instances == 0 ? spot : unit;
+
+		//the cached mesh is the model after FitToBox, so the box is part of the key
+		if (cacheDir)
+		{
+			double box[6] = { fit.min[0], fit.min[1], fit.min[2], fit.max[0], fit.max[1], fit.max[2] };
+
+			if (HashFile(model, cacheKey))
+			{
+				cacheKey = HashBytes(box, sizeof(box), cacheKey);
+				cacheFile = MeshCachePath(cacheDir, cacheKey);
+			}
+		}
+
+		std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+		if (!cacheFile.empty() && LoadMeshCache(cacheFile.c_str(), cacheKey, mesh))
+		{
+			printf("Mapped %s for %s in %.1f ms\n", cacheFile.c_str(), model,
+				std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count() * 1000.0);
+		}
+		else if (LoadOBJ(model, mesh))
+		{
+			mesh->FitToBox(fit);
+		}
+		else
+		{
+			fprintf(stderr, "Failed to read %s\n", model);
+			delete mesh;
+			return 1;
+		}
+
+		Material* mat = new Material();
+		mat->SetAmbientColour(0.0, 0.0, 0.0);
+		mat->SetDiffuseColour(0.8, 0.8, 0.8);
+		mat->SetSpecularColour(1.0, 1.0, 1.0);
+		mat->SetSpecPower(20);
+
+		if (texture)
+		{
+			Texture* map = scene.GetTextureCache().OpenImage(texture);
+
+			if (!map)
+			{
+				fprintf(stderr, "Failed to read %s\n", texture);
+				delete mat;
+				delete mesh;
+				return 1;
+			}
+
+			if (!mesh->HasTexCoords())
+			{
+				fprintf(stderr, "%s has no texture coordinates, %s is not shown\n", model, texture);
+			}
+
+			mat->SetDiffuseTexture(map);
+			printf("Texture %s: %dx%d, %d mip levels, %d tiles\n", map->GetFilename().c_str(), map->GetWidth(),
+				map->GetHeight(), map->GetLevelCount(), map->GetTileCount());
+		}
+
+		printf("Loaded %s: %d vertices, %d triangles\n", model, mesh->GetVertexCount(), mesh->GetTriangleCount());
+
+		if (instances == 0)
+		{
+			scene.AddObject(mesh, mat);
+		}
+		else
+		{
+			//each instance scaled into its cell of the box and turned about the vertical a
+			//little further than the one before
+			scene.AddGeometry(mesh);
+
+			Real cell = (spot.max[0] - spot.min[0]) / instances;
+
+			for (int i = 0; i < instances * instances; i++)
+			{
+				Vec3 centre(spot.min[0] + cell * (i % instances + 0.5), spot.min[1] + cell * 0.5,
+					spot.min[2] + cell * (i / instances + 0.5));
+
+				Transform place = Transform::Translation(centre) * Transform::Scaling(Vec3(cell, cell, cell)) *
+					Transform::RotationY((Real)(0.7 * i));
+
+				Instance* instance = new Instance(mesh, place);
+				instance->SetMaterial(mat);
+
+				//the scene takes ownership of the material once, with the first instance
+				scene.AddObject(instance, i == 0 ? mat : nullptr);
+			}
+
+			printf("Placed %d instances, %lld triangles in all\n", instances * instances,
+				(long long)instances * instances * mesh->GetTriangleCount());
+		}
+	}
+
+	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+	raytracer.DoRayTrace(&scene);
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	printf("Traced %dx%d in %.3f s (%.1f ns/pixel) on %d thread(s)\n", width, height, seconds,
+		seconds * 1.0e9 / ((double)width * height), raytracer.GetThreadCount());
+	printf("%.2f rays/pixel\n", (double)raytracer.GetRayCount() / ((double)width * height));
+
+	//the builds are part of the trace time above
+	if (modelMesh && modelMesh->IsAttached())
+	{
+		printf("Model BVH: %d nodes, mapped from the cache\n", modelMesh->GetBVH().GetNodeCount());
+	}
+	else if (modelMesh)
+	{
+		PrintBuildReport("Model", modelMesh->GetBVH().GetBuildReport());
+
+		if (!cacheFile.empty())
+		{
+			if (SaveMeshCache(cacheFile.c_str(), cacheKey, *modelMesh))
+			{
+				printf("Wrote %s\n", cacheFile.c_str());
+			}
+			else
+			{
+				fprintf(stderr, "Failed to write %s\n", cacheFile.c_str());
+			}
+		}
+	}
+
+	PrintBuildReport("Scene", scene.GetBVH().GetBuildReport());
+
+	if (scene.GetTextureCache().GetTextureCount() > 0)
+	{
+		TextureCacheStats stats = scene.GetTextureCache().GetStats();
+
+		printf("Texture cache: %llu texel lookups, %llu tiles read, %llu evicted, %.1f MB at most of %d MB\n",
+			(unsigned long long)stats.lookups, (unsigned long long)stats.misses, (unsigned long long)stats.evictions,
+			stats.peakBytes / 1048576.0, textureBudget);
+	}
+
+	if (scene.GetAccelerator())
+	{
+		printf("Scene %s: built in %.2f ms, %.1f KB\n", scene.GetAccelerator()->GetName(),
+			scene.GetAccelerator()->GetBuildSeconds() * 1000.0, scene.GetAccelerator()->GetMemoryUsage() / 1024.0);
+	}
+
+	if (raytracer.GetPacketKernel())
+	{
+		printf("%s rays in %d-wide %s packets\n", wavefront ? "All" : "Camera",
+			raytracer.GetPacketKernel()->width, raytracer.GetPacketKernel()->name);
+	}
+
+	if (!WriteImage(output, raytracer.GetFramebuffer(), width, height))
+	{
+		fprintf(stderr, "Failed to write %s\n", output);
+		return 1;
+	}
+
+	printf("Wrote %s\n", output);
+
+	return 0;
+}
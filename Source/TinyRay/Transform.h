@@ -0,0 +1,181 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <math.h>
+
+#include "Vec3.h"
+#include "AABB.h"
+
+//An affine transform as a 3x4 matrix: a 3x3 linear part and a translation in the last
+//column. Points are transformed with the translation, direction vectors without.
+struct Transform
+{
+	Real	m[3][4];
+
+	//The identity
+	inline Transform()
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 4; col++)
+			{
+				m[row][col] = row == col ? (Real)1.0 : (Real)0.0;
+			}
+		}
+	}
+
+	static inline Transform Translation(const Vec3& offset)
+	{
+		Transform t;
+		t.m[0][3] = offset[0];
+		t.m[1][3] = offset[1];
+		t.m[2][3] = offset[2];
+
+		return t;
+	}
+
+	static inline Transform Scaling(const Vec3& scale)
+	{
+		Transform t;
+		t.m[0][0] = scale[0];
+		t.m[1][1] = scale[1];
+		t.m[2][2] = scale[2];
+
+		return t;
+	}
+
+	//Rotation by angle radians about the y axis, counter-clockwise looking down the axis
+	static inline Transform RotationY(Real angle)
+	{
+		Real c = cos(angle);
+		Real s = sin(angle);
+
+		Transform t;
+		t.m[0][0] = c;  t.m[0][2] = s;
+		t.m[2][0] = -s; t.m[2][2] = c;
+
+		return t;
+	}
+
+	//Rotation by angle radians about a unit length axis
+	static inline Transform Rotation(const Vec3& axis, Real angle)
+	{
+		Real c = cos(angle);
+		Real s = sin(angle);
+		Real k = (Real)1.0 - c;
+		Real x = axis[0], y = axis[1], z = axis[2];
+
+		Transform t;
+		t.m[0][0] = x * x * k + c;     t.m[0][1] = x * y * k - z * s; t.m[0][2] = x * z * k + y * s;
+		t.m[1][0] = y * x * k + z * s; t.m[1][1] = y * y * k + c;     t.m[1][2] = y * z * k - x * s;
+		t.m[2][0] = z * x * k - y * s; t.m[2][1] = z * y * k + x * s; t.m[2][2] = z * z * k + c;
+
+		return t;
+	}
+
+	//This transform applied after rhs
+	inline Transform operator * (const Transform& rhs) const
+	{
+		Transform t;
+
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 4; col++)
+			{
+				t.m[row][col] = m[row][0] * rhs.m[0][col] + m[row][1] * rhs.m[1][col] + m[row][2] * rhs.m[2][col];
+			}
+
+			t.m[row][3] += m[row][3];
+		}
+
+		return t;
+	}
+
+	inline Vec3 TransformPoint(const Vec3& p) const
+	{
+		return Vec3(
+			m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+			m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+			m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+	}
+
+	inline Vec3 TransformVector(const Vec3& v) const
+	{
+		return Vec3(
+			m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+			m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+			m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+	}
+
+	//A normal is transformed by the transpose of the inverse: called on the inverse of a
+	//transform, this takes a normal through the transform itself. The result is not normalised.
+	inline Vec3 TransformNormalByInverse(const Vec3& n) const
+	{
+		return Vec3(
+			m[0][0] * n[0] + m[1][0] * n[1] + m[2][0] * n[2],
+			m[0][1] * n[0] + m[1][1] * n[1] + m[2][1] * n[2],
+			m[0][2] * n[0] + m[1][2] * n[1] + m[2][2] * n[2]);
+	}
+
+	//The bounds of box after the transform, from its eight corners
+	inline AABB TransformBox(const AABB& box) const
+	{
+		AABB result;
+		result.Reset();
+
+		for (int corner = 0; corner < 8; corner++)
+		{
+			Vec3 p((corner & 1) ? box.max[0] : box.min[0], (corner & 2) ? box.max[1] : box.min[1],
+				(corner & 4) ? box.max[2] : box.min[2]);
+
+			result.Grow(TransformPoint(p));
+		}
+
+		return result;
+	}
+
+	//The inverse, by the adjugate of the linear part. A singular transform gives the identity.
+	inline Transform Inverse() const
+	{
+		Real c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		Real c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		Real c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+
+		Real det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+
+		Transform t;
+
+		if (det == 0.0)
+		{
+			return t;
+		}
+
+		Real invDet = (Real)1.0 / det;
+
+		t.m[0][0] = c00 * invDet;
+		t.m[1][0] = c01 * invDet;
+		t.m[2][0] = c02 * invDet;
+		t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+		t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+		t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+		t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+		t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+		t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+		//the translation undone: -R^-1 * offset
+		for (int row = 0; row < 3; row++)
+		{
+			t.m[row][3] = -(t.m[row][0] * m[0][3] + t.m[row][1] * m[1][3] + t.m[row][2] * m[2][3]);
+		}
+
+		return t;
+	}
+};
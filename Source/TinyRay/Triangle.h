@@ -9,23 +9,103 @@
 ---------------------------------------------------------------------*/
 #pragma once
 #include "Primitive.h"
-#include "Vector4D.h"
+#include "Vec3.h"
 #include "Ray.h"
+#include <math.h>
 #include <vector>
 
+//Moller-Trumbore: solve start + t*dir = v0 + u*edge1 + v*edge2 with Cramer's rule. Returns t if
+//it lies within tmin to tmax, otherwise FARFAR_AWAY, and the barycentric coordinates (u, v) of
+//the hit. Shared by the triangles and the meshes of a PrimitiveStore.
+inline Real IntersectTriangleMT(const Vec3& start, const Vec3& dir, const Real v0[3], const Real edge1[3],
+	const Real edge2[3], Real tmin, Real tmax, Real& u, Real& v)
+{
+	//p = dir x edge2
+	Real px = dir[1] * edge2[2] - dir[2] * edge2[1];
+	Real py = dir[2] * edge2[0] - dir[0] * edge2[2];
+	Real pz = dir[0] * edge2[1] - dir[1] * edge2[0];
+
+	Real det = edge1[0] * px + edge1[1] * py + edge1[2] * pz;
+
+	//the ray is parallel to the triangle; both faces of the triangle can be hit
+	if (fabs(det) < (Real)1.0e-12)
+	{
+		return FARFAR_AWAY;
+	}
+
+	Real invDet = (Real)1.0 / det;
+
+	Real sx = start[0] - v0[0];
+	Real sy = start[1] - v0[1];
+	Real sz = start[2] - v0[2];
+
+	u = (sx * px + sy * py + sz * pz) * invDet;
+
+	if (u < 0.0 || u > 1.0)
+	{
+		return FARFAR_AWAY;
+	}
+
+	//q = s x edge1
+	Real qx = sy * edge1[2] - sz * edge1[1];
+	Real qy = sz * edge1[0] - sx * edge1[2];
+	Real qz = sx * edge1[1] - sy * edge1[0];
+
+	v = (dir[0] * qx + dir[1] * qy + dir[2] * qz) * invDet;
+
+	if (v < 0.0 || u + v > 1.0)
+	{
+		return FARFAR_AWAY;
+	}
+
+	Real t = (edge2[0] * qx + edge2[1] * qy + edge2[2] * qz) * invDet;
+
+	if (t > tmin && t < tmax)
+	{
+		return t;
+	}
+
+	return FARFAR_AWAY;
+}
+
 class Triangle : public Primitive
 {
 private:
-	Vector4D m_vertices[3];
-	Vector4D m_normal;
+	Vec3 m_vertices[3];
+	Vec3 m_normal;
+
+	//edges v1 - v0 and v2 - v0, set up once by SetTriangle for the Moller-Trumbore test
+	Vec3 m_edge1;
+	Vec3 m_edge2;
 
 public:
 	Triangle();
-	Triangle(Vector4D pos1, Vector4D pos2, Vector4D pos3);
+	Triangle(Vec3 pos1, Vec3 pos2, Vec3 pos3);
 	~Triangle();
 	
-	void SetTriangle(Vector4D v0, Vector4D v1, Vector4D v2);
+	void SetTriangle(Vec3 v0, Vec3 v1, Vec3 v2);
+
+	inline const Vec3& GetVertex(int i) const
+	{
+		return m_vertices[i];
+	}
+
+	//v1 - v0 and v2 - v0
+	inline const Vec3& GetEdge1() const
+	{
+		return m_edge1;
+	}
+
+	inline const Vec3& GetEdge2() const
+	{
+		return m_edge2;
+	}
+
+	inline const Vec3& GetNormal() const
+	{
+		return m_normal;
+	}
 
-	RayHitResult IntersectByRay(Ray& ray);
+	AABB GetBoundingBox();
 };
 
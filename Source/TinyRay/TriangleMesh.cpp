@@ -0,0 +1,457 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include "TriangleMesh.h"
+#include "Triangle.h"
+
+TriangleMesh::TriangleMesh()
+{
+	m_primtype = PRIMTYPE_Mesh;
+	m_bounds.Reset();
+	m_wideFormat = WIDEBVH_NONE;
+	m_triangleTest = TRIANGLE_TEST_REAL;
+	m_dirty = false;
+	UseOwnArrays();
+}
+
+TriangleMesh::~TriangleMesh()
+{
+}
+
+void TriangleMesh::UseOwnArrays()
+{
+	m_arrays.vertexCount = (int)m_px.size();
+	m_arrays.triangleCount = (int)m_indices.size() / 3;
+	m_arrays.px = m_px.data();
+	m_arrays.py = m_py.data();
+	m_arrays.pz = m_pz.data();
+	m_arrays.nx = m_nx.empty() ? nullptr : m_nx.data();
+	m_arrays.ny = m_ny.empty() ? nullptr : m_ny.data();
+	m_arrays.nz = m_nz.empty() ? nullptr : m_nz.data();
+	m_arrays.tu = m_tu.empty() ? nullptr : m_tu.data();
+	m_arrays.tv = m_tv.empty() ? nullptr : m_tv.data();
+	m_arrays.indices = m_indices.data();
+}
+
+//Before the first change to an attached mesh: its arrays become vectors of its own, the BVH
+//goes with the memory it was attached to and is built again
+void TriangleMesh::CopyAttachedArrays()
+{
+	if (!m_storage)
+	{
+		return;
+	}
+
+	const TriangleMeshArrays& a = m_arrays;
+	int vertices = a.vertexCount;
+
+	m_px.assign(a.px, a.px + vertices);
+	m_py.assign(a.py, a.py + vertices);
+	m_pz.assign(a.pz, a.pz + vertices);
+
+	if (a.nx)
+	{
+		m_nx.assign(a.nx, a.nx + vertices);
+		m_ny.assign(a.ny, a.ny + vertices);
+		m_nz.assign(a.nz, a.nz + vertices);
+	}
+
+	if (a.tu)
+	{
+		m_tu.assign(a.tu, a.tu + vertices);
+		m_tv.assign(a.tv, a.tv + vertices);
+	}
+
+	m_indices.assign(a.indices, a.indices + a.triangleCount * 3);
+
+	m_bvh.Clear();
+	m_wideBvh.Clear();
+	m_storage.reset();
+	m_dirty = true;
+	UseOwnArrays();
+}
+
+void TriangleMesh::Clear()
+{
+	m_px.clear(); m_py.clear(); m_pz.clear();
+	m_nx.clear(); m_ny.clear(); m_nz.clear();
+	m_tu.clear(); m_tv.clear();
+	m_indices.clear();
+
+	m_bvh.Clear();
+	m_wideBvh.Clear();
+	m_floatPositions.clear();
+	m_storage.reset();
+	m_bounds.Reset();
+	m_dirty = false;
+	UseOwnArrays();
+}
+
+void TriangleMesh::Attach(const TriangleMeshArrays& arrays, const AABB& bounds, const BVHNode* nodes, int nodeCount,
+	const int* items, const BVHBuildReport& report, std::shared_ptr<const void> storage)
+{
+	Clear();
+
+	m_arrays = arrays;
+	m_storage = storage;
+	m_bounds = bounds;
+	m_bvh.Attach(nodes, nodeCount, items, arrays.triangleCount, report);
+}
+
+int TriangleMesh::AddVertex(const Vec3& position)
+{
+	CopyAttachedArrays();
+
+	m_px.push_back(position[0]);
+	m_py.push_back(position[1]);
+	m_pz.push_back(position[2]);
+	m_dirty = true;
+	UseOwnArrays();
+
+	return (int)m_px.size() - 1;
+}
+
+int TriangleMesh::AddVertex(const Vec3& position, const Vec3& normal)
+{
+	CopyAttachedArrays();
+
+	m_nx.push_back(normal[0]);
+	m_ny.push_back(normal[1]);
+	m_nz.push_back(normal[2]);
+
+	return AddVertex(position);
+}
+
+int TriangleMesh::AddVertex(const Vec3& position, Real u, Real v)
+{
+	CopyAttachedArrays();
+
+	m_tu.push_back(u);
+	m_tv.push_back(v);
+
+	return AddVertex(position);
+}
+
+int TriangleMesh::AddVertex(const Vec3& position, const Vec3& normal, Real u, Real v)
+{
+	CopyAttachedArrays();
+
+	m_tu.push_back(u);
+	m_tv.push_back(v);
+
+	return AddVertex(position, normal);
+}
+
+void TriangleMesh::AddTriangle(int v0, int v1, int v2)
+{
+	CopyAttachedArrays();
+
+	m_indices.push_back(v0);
+	m_indices.push_back(v1);
+	m_indices.push_back(v2);
+	m_dirty = true;
+	UseOwnArrays();
+}
+
+void TriangleMesh::FitToBox(const AABB& box)
+{
+	CopyAttachedArrays();
+
+	AABB bounds;
+	bounds.Reset();
+
+	for (int i = 0; i < GetVertexCount(); i++)
+	{
+		bounds.Grow(Vec3(m_px[i], m_py[i], m_pz[i]));
+	}
+
+	if (bounds.IsEmpty())
+	{
+		return;
+	}
+
+	//the largest scale at which every axis still fits
+	Real scale = FARFAR_AWAY;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real extent = bounds.max[axis] - bounds.min[axis];
+
+		if (extent > 0.0 && (box.max[axis] - box.min[axis]) / extent < scale)
+		{
+			scale = (box.max[axis] - box.min[axis]) / extent;
+		}
+	}
+
+	if (scale == FARFAR_AWAY)
+	{
+		scale = 1.0;
+	}
+
+	Vec3 from = bounds.Centroid();
+	Vec3 to = box.Centroid();
+
+	for (int i = 0; i < GetVertexCount(); i++)
+	{
+		m_px[i] = (m_px[i] - from[0]) * scale + to[0];
+		m_py[i] = (m_py[i] - from[1]) * scale + to[1];
+		m_pz[i] = (m_pz[i] - from[2]) * scale + to[2];
+	}
+
+	m_dirty = true;
+}
+
+void TriangleMesh::Build(ThreadPool* pool)
+{
+	//the float positions are the vertices rounded, the BVH is built again to take them in
+	if (m_triangleTest == TRIANGLE_TEST_FLOAT && m_floatPositions.empty() && GetTriangleCount() > 0)
+	{
+		CopyAttachedArrays();
+		m_dirty = true;
+	}
+
+	if (m_dirty)
+	{
+		BuildBVH(pool);
+	}
+
+	if (m_wideBvh.GetFormat() != m_wideFormat)
+	{
+		m_wideBvh.Build(m_bvh, m_wideFormat);
+	}
+
+	if (m_triangleTest != TRIANGLE_TEST_FLOAT)
+	{
+		std::vector<float>().swap(m_floatPositions);
+	}
+}
+
+void TriangleMesh::BuildBVH(ThreadPool* pool)
+{
+	int count = GetTriangleCount();
+	std::vector<AABB> bounds(count);
+	bool floats = m_triangleTest == TRIANGLE_TEST_FLOAT;
+
+	m_bounds.Reset();
+	m_floatPositions.clear();
+
+	if (floats)
+	{
+		m_floatPositions.resize(m_px.size() * 3);
+
+		for (size_t i = 0; i < m_px.size(); i++)
+		{
+			m_floatPositions[i * 3] = (float)m_px[i];
+			m_floatPositions[i * 3 + 1] = (float)m_py[i];
+			m_floatPositions[i * 3 + 2] = (float)m_pz[i];
+		}
+	}
+
+	for (int tri = 0; tri < count; tri++)
+	{
+		bounds[tri].Reset();
+
+		for (int k = 0; k < 3; k++)
+		{
+			int i = m_indices[tri * 3 + k];
+			bounds[tri].Grow(Vec3(m_px[i], m_py[i], m_pz[i]));
+
+			//the float test sees the rounded vertices, the boxes hold both
+			if (floats)
+			{
+				const float* p = &m_floatPositions[i * 3];
+				bounds[tri].Grow(Vec3(p[0], p[1], p[2]));
+			}
+		}
+
+		m_bounds.Grow(bounds[tri]);
+	}
+
+	m_bvh.Build(bounds, pool);
+	m_wideBvh.Clear();
+	m_dirty = false;
+}
+
+Real TriangleMesh::IntersectTriangle(int tri, Ray& ray, Real& u, Real& v) const
+{
+	Real v0[3], edge1[3], edge2[3];
+	GetTriangle(tri, v0, edge1, edge2);
+
+	return IntersectTriangleMT(ray.GetRayStart(), ray.GetRay(), v0, edge1, edge2, ray.GetTMin(), ray.GetTMax(), u, v);
+}
+
+bool TriangleMesh::Intersect(Ray& ray, RayHit& hit) const
+{
+	Real tmax = hit.t;
+	bool found = false;
+
+	if (m_triangleTest == TRIANGLE_TEST_FLOAT)
+	{
+		WatertightRay<float> floatRay(ray);
+
+		auto intersectFloat = [this, &floatRay, &hit, &tmax, &found](int tri)
+		{
+			float t, u, v;
+
+			//the float distance is compared again in Real, it may round past hit.t
+			if (IntersectTriangleFloat(tri, floatRay, (float)hit.t, t, u, v) && t < hit.t)
+			{
+				hit.t = t;
+				hit.u = u;
+				hit.v = v;
+				hit.face = tri;
+				tmax = t;
+				found = true;
+			}
+		};
+
+		if (m_wideBvh.IsEmpty())
+		{
+			m_bvh.Traverse(ray, tmax, intersectFloat);
+		}
+		else
+		{
+			m_wideBvh.Traverse(ray, tmax, intersectFloat);
+		}
+
+		return found;
+	}
+
+	auto intersectTriangle = [this, &ray, &hit, &tmax, &found](int tri)
+	{
+		Real u, v;
+		Real t = IntersectTriangle(tri, ray, u, v);
+
+		if (t < hit.t)
+		{
+			hit.t = t;
+			hit.u = u;
+			hit.v = v;
+			hit.face = tri;
+			tmax = t;
+			found = true;
+		}
+	};
+
+	if (m_wideBvh.IsEmpty())
+	{
+		m_bvh.Traverse(ray, tmax, intersectTriangle);
+	}
+	else
+	{
+		m_wideBvh.Traverse(ray, tmax, intersectTriangle);
+	}
+
+	return found;
+}
+
+bool TriangleMesh::Occluded(Ray& ray, Real maxDistance) const
+{
+	if (m_triangleTest == TRIANGLE_TEST_FLOAT)
+	{
+		WatertightRay<float> floatRay(ray);
+
+		auto blocksRayFloat = [this, &floatRay, maxDistance](int tri)
+		{
+			float t, u, v;
+
+			return IntersectTriangleFloat(tri, floatRay, (float)maxDistance, t, u, v) && t < maxDistance;
+		};
+
+		if (m_wideBvh.IsEmpty())
+		{
+			return m_bvh.TraverseAny(ray, maxDistance, blocksRayFloat);
+		}
+
+		return m_wideBvh.TraverseAny(ray, maxDistance, blocksRayFloat);
+	}
+
+	auto blocksRay = [this, &ray, maxDistance](int tri)
+	{
+		Real u, v;
+
+		return IntersectTriangle(tri, ray, u, v) < maxDistance;
+	};
+
+	if (m_wideBvh.IsEmpty())
+	{
+		return m_bvh.TraverseAny(ray, maxDistance, blocksRay);
+	}
+
+	return m_wideBvh.TraverseAny(ray, maxDistance, blocksRay);
+}
+
+void TriangleMesh::ComputeSurface(Ray& ray, const RayHit& hit, RayHitResult& result) const
+{
+	const TriangleMeshArrays& a = m_arrays;
+	const int* tri = &a.indices[hit.face * 3];
+	Real w = (Real)1.0 - hit.u - hit.v;
+
+	if (m_triangleTest == TRIANGLE_TEST_FLOAT)
+	{
+		//on the float triangle the hit was found on, from its barycentric coordinates: the
+		//distance carries the rounding error of the float test, which would put the point off the
+		//triangle by far more than a ray leaving it can tell from a hit
+		const float* p0 = &m_floatPositions[tri[0] * 3];
+		const float* p1 = &m_floatPositions[tri[1] * 3];
+		const float* p2 = &m_floatPositions[tri[2] * 3];
+
+		result.point = Vec3(p0[0] * w + p1[0] * hit.u + p2[0] * hit.v, p0[1] * w + p1[1] * hit.u + p2[1] * hit.v,
+			p0[2] * w + p1[2] * hit.u + p2[2] * hit.v);
+	}
+	else
+	{
+		result.point = ray.GetRayStart() + ray.GetRay()*hit.t;
+	}
+
+	if (HasNormals())
+	{
+		Vec3 n0(a.nx[tri[0]], a.ny[tri[0]], a.nz[tri[0]]);
+		Vec3 n1(a.nx[tri[1]], a.ny[tri[1]], a.nz[tri[1]]);
+		Vec3 n2(a.nx[tri[2]], a.ny[tri[2]], a.nz[tri[2]]);
+
+		result.normal = (n0 * w + n1 * hit.u + n2 * hit.v).Normalise();
+	}
+	else
+	{
+		Real v0[3], edge1[3], edge2[3];
+		GetTriangle(hit.face, v0, edge1, edge2);
+
+		result.normal = Vec3(edge1[0], edge1[1], edge1[2]).CrossProduct(Vec3(edge2[0], edge2[1], edge2[2])).Normalise();
+	}
+
+	if (HasTexCoords())
+	{
+		result.u = a.tu[tri[0]] * w + a.tu[tri[1]] * hit.u + a.tu[tri[2]] * hit.v;
+		result.v = a.tv[tri[0]] * w + a.tv[tri[1]] * hit.u + a.tv[tri[2]] * hit.v;
+
+		//the ratio of the triangle's area in texture space to its area on the surface
+		Real v0[3], edge1[3], edge2[3];
+		GetTriangle(hit.face, v0, edge1, edge2);
+
+		Real area = Vec3(edge1[0], edge1[1], edge1[2]).CrossProduct(Vec3(edge2[0], edge2[1], edge2[2])).Length();
+		Real du1 = a.tu[tri[1]] - a.tu[tri[0]], dv1 = a.tv[tri[1]] - a.tv[tri[0]];
+		Real du2 = a.tu[tri[2]] - a.tu[tri[0]], dv2 = a.tv[tri[2]] - a.tv[tri[0]];
+		Real uvArea = fabs(du1 * dv2 - du2 * dv1);
+
+		result.uvDensity = area > 0.0 ? sqrt(uvArea / area) : 0.0;
+	}
+}
+
+size_t TriangleMesh::GetMemoryUsage() const
+{
+	size_t bytes = (m_px.capacity() + m_py.capacity() + m_pz.capacity()) * sizeof(Real);
+
+	bytes += (m_nx.capacity() + m_ny.capacity() + m_nz.capacity()) * sizeof(Real);
+	bytes += (m_tu.capacity() + m_tv.capacity()) * sizeof(Real);
+	bytes += m_indices.capacity() * sizeof(int);
+	bytes += m_floatPositions.capacity() * sizeof(float);
+
+	return bytes + m_bvh.GetMemoryUsage() + m_wideBvh.GetMemoryUsage();
+}
@@ -0,0 +1,224 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "Primitive.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Watertight.h"
+
+//The vertex and index arrays of a mesh as plain pointers, into the mesh's own vectors or into
+//memory it does not own, see TriangleMesh::Attach
+struct TriangleMeshArrays
+{
+	int			vertexCount;
+	int			triangleCount;
+	const Real*	px;
+	const Real*	py;
+	const Real*	pz;
+	const Real*	nx;				//nullptr without normals
+	const Real*	ny;
+	const Real*	nz;
+	const Real*	tu;				//nullptr without texture coordinates
+	const Real*	tv;
+	const int*	indices;
+};
+
+//How single rays are tested against the triangles of a mesh
+enum TriangleTest
+{
+	TRIANGLE_TEST_REAL,			//Moller-Trumbore in Real on the vertex arrays, the default
+	TRIANGLE_TEST_FLOAT,		//the watertight test of Watertight.h in float, on a float copy of the positions
+};
+
+//Many triangles sharing one indexed vertex buffer, seen by the scene as a single primitive.
+//The vertices are kept in structure of arrays layout with optional per-vertex normals and
+//texture coordinates, and the triangles are found through the mesh's own BVH, so a model
+//costs a few dozen bytes per triangle instead of a Triangle object each.
+//
+//Fill the mesh with AddVertex/AddTriangle or LoadOBJ from MeshIO.h. The BVH is built when the
+//scene rebuilds its acceleration structure. A mesh and its BVH can also be used straight from
+//a mapped cache file, see MeshCache.h.
+class TriangleMesh : public Primitive
+{
+	private:
+		std::vector<Real>	m_px, m_py, m_pz;		//positions
+		std::vector<Real>	m_nx, m_ny, m_nz;		//normals, empty or one per vertex
+		std::vector<Real>	m_tu, m_tv;				//texture coordinates, empty or one per vertex
+		std::vector<int>	m_indices;				//three vertices per triangle, counter-clockwise
+
+		TriangleMeshArrays	m_arrays;				//what the mesh reads, the vectors above or attached memory
+		std::shared_ptr<const void>	m_storage;		//keeps attached memory alive, empty otherwise
+
+		BVH					m_bvh;					//over the triangles
+		WideBVH				m_wideBvh;				//collapsed from m_bvh for single rays, see SetWideBVH
+		WideBVHFormat		m_wideFormat;
+		TriangleTest		m_triangleTest;
+		std::vector<float>	m_floatPositions;		//x, y, z per vertex for TRIANGLE_TEST_FLOAT, made with the BVH
+		AABB				m_bounds;
+		bool				m_dirty;				//changed since the last Build
+
+		void UseOwnArrays();
+		void CopyAttachedArrays();
+		void BuildBVH(ThreadPool* pool);
+
+	public:
+		TriangleMesh();
+		~TriangleMesh();
+
+		//Remove all vertices and triangles
+		void Clear();
+
+		//Append a vertex, returns its index. Either every vertex has a normal (or texture
+		//coordinates) or none has.
+		int AddVertex(const Vec3& position);
+		int AddVertex(const Vec3& position, const Vec3& normal);
+		int AddVertex(const Vec3& position, Real u, Real v);
+		int AddVertex(const Vec3& position, const Vec3& normal, Real u, Real v);
+
+		//Append the triangle v0, v1, v2, given as indices returned by AddVertex
+		void AddTriangle(int v0, int v1, int v2);
+
+		//Scale and move the vertices uniformly so that the mesh is centred in box and as large
+		//as fits, e.g. to place a model loaded from disk
+		void FitToBox(const AABB& box);
+
+		//Build the BVH over the triangles if the mesh changed since the last time, on the
+		//threads of pool if one is given
+		void Build(ThreadPool* pool = nullptr);
+
+		//Trace single rays through a WideBVH in format, made by the next Build; WIDEBVH_NONE
+		//traces them through the binary BVH. Packets always take the binary one.
+		inline void SetWideBVH(WideBVHFormat format)
+		{
+			m_wideFormat = format;
+		}
+
+		inline const WideBVH& GetWideBVH() const
+		{
+			return m_wideBvh;
+		}
+
+		//Test single rays against the triangles with test from the next Build on, which builds
+		//the BVH again the first time it switches to TRIANGLE_TEST_FLOAT. Packets always take
+		//Moller-Trumbore in Real.
+		inline void SetTriangleTest(TriangleTest test)
+		{
+			m_triangleTest = test;
+		}
+
+		inline TriangleTest GetTriangleTest() const
+		{
+			return m_triangleTest;
+		}
+
+		//Use vertex and index arrays and a BVH over their triangles that are stored elsewhere,
+		//e.g. in a mapped file, without copying them. storage keeps that memory alive for as
+		//long as the mesh uses it. The mesh counts as built; changing it copies the arrays.
+		void Attach(const TriangleMeshArrays& arrays, const AABB& bounds, const BVHNode* nodes, int nodeCount,
+			const int* items, const BVHBuildReport& report, std::shared_ptr<const void> storage);
+
+		inline bool IsAttached() const
+		{
+			return m_storage != nullptr;
+		}
+
+		inline const TriangleMeshArrays& GetArrays() const
+		{
+			return m_arrays;
+		}
+
+		inline int GetVertexCount() const
+		{
+			return m_arrays.vertexCount;
+		}
+
+		inline int GetTriangleCount() const
+		{
+			return m_arrays.triangleCount;
+		}
+
+		inline bool HasNormals() const
+		{
+			return m_arrays.nx != nullptr;
+		}
+
+		inline bool HasTexCoords() const
+		{
+			return m_arrays.tu != nullptr;
+		}
+
+		//True if the BVH is up to date with the triangles
+		inline bool IsBuilt() const
+		{
+			return !m_dirty;
+		}
+
+		inline const BVH& GetBVH() const
+		{
+			return m_bvh;
+		}
+
+		//The first vertex and the two edges of triangle tri, as IntersectTriangleMT takes them
+		inline void GetTriangle(int tri, Real v0[3], Real edge1[3], Real edge2[3]) const
+		{
+			const Real* px = m_arrays.px;
+			const Real* py = m_arrays.py;
+			const Real* pz = m_arrays.pz;
+			int i0 = m_arrays.indices[tri * 3];
+			int i1 = m_arrays.indices[tri * 3 + 1];
+			int i2 = m_arrays.indices[tri * 3 + 2];
+
+			v0[0] = px[i0]; v0[1] = py[i0]; v0[2] = pz[i0];
+
+			edge1[0] = px[i1] - v0[0]; edge1[1] = py[i1] - v0[1]; edge1[2] = pz[i1] - v0[2];
+			edge2[0] = px[i2] - v0[0]; edge2[1] = py[i2] - v0[1]; edge2[2] = pz[i2] - v0[2];
+		}
+
+		//Moller-Trumbore against triangle tri, see IntersectTriangleMT
+		Real IntersectTriangle(int tri, Ray& ray, Real& u, Real& v) const;
+
+		//The watertight test in float against triangle tri, see IntersectTriangleWatertight; the
+		//float positions have to be made by Build with TRIANGLE_TEST_FLOAT
+		inline bool IntersectTriangleFloat(int tri, const WatertightRay<float>& ray, float tmax, float& t, float& u, float& v) const
+		{
+			const int* index = &m_arrays.indices[tri * 3];
+
+			return IntersectTriangleWatertight(ray, &m_floatPositions[index[0] * 3], &m_floatPositions[index[1] * 3],
+				&m_floatPositions[index[2] * 3], tmax, t, u, v);
+		}
+
+		//Closest hit test through the BVH with the triangle test chosen by SetTriangleTest. If a
+		//triangle is hit closer than hit.t, hit receives
+		//the distance, the barycentric coordinates and the triangle as hit.face; hit.prim is
+		//left to the caller.
+		bool Intersect(Ray& ray, RayHit& hit) const;
+
+		//True if any triangle lies on the ray before maxDistance
+		bool Occluded(Ray& ray, Real maxDistance) const;
+
+		//The point and normal of a hit reported by Intersect. The normal is interpolated from
+		//the vertex normals if the mesh has them, and with texture coordinates these become
+		//result.u and result.v instead of the barycentric coordinates. With TRIANGLE_TEST_FLOAT
+		//the point is interpolated from the float vertices, so that a ray can leave it from there.
+		void ComputeSurface(Ray& ray, const RayHit& hit, RayHitResult& result) const;
+
+		//Bytes allocated for the vertex and index buffers and the BVH, nothing for attached ones
+		//but the float positions
+		size_t GetMemoryUsage() const;
+
+		inline AABB GetBoundingBox()
+		{
+			return m_bounds;
+		}
+};
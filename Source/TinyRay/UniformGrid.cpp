@@ -0,0 +1,301 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <math.h>
+#include <chrono>
+#include <limits>
+
+#include "UniformGrid.h"
+#include "Material.h"
+
+//About this many cells per item, and never more than GRID_MAX_RESOLUTION along an axis
+#define GRID_DENSITY			3.0
+#define GRID_MAX_RESOLUTION		512
+
+//Items are put into the cells within this fraction of a cell of their boxes, so that a ray the
+//stepping rounds into the neighbouring cell near a cell boundary still finds them
+#define GRID_CELL_PADDING		1e-4
+
+UniformGrid::UniformGrid()
+{
+	m_bounds.Reset();
+	m_resolution[0] = m_resolution[1] = m_resolution[2] = 0;
+	m_seconds = 0.0;
+}
+
+void UniformGrid::CellRange(int axis, Real lo, Real hi, int& first, int& last) const
+{
+	Real pad = m_cellSize[axis] * GRID_CELL_PADDING;
+	Real a = (lo - pad - m_bounds.min[axis]) * m_invCellSize[axis];
+	Real b = (hi + pad - m_bounds.min[axis]) * m_invCellSize[axis];
+	int cells = m_resolution[axis];
+
+	//clamped before the conversion, an item may reach beyond the padded grid
+	first = a <= 0.0 ? 0 : (a >= cells ? cells - 1 : (int)a);
+	last = b <= 0.0 ? 0 : (b >= cells ? cells - 1 : (int)b);
+}
+
+void UniformGrid::Build(const std::vector<AABB>& bounds, ThreadPool*)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int count = (int)bounds.size();
+
+	m_bounds.Reset();
+	m_cellItems.clear();
+
+	for (const AABB& box : bounds)
+	{
+		m_bounds.Grow(box);
+	}
+
+	if (m_bounds.IsEmpty())
+	{
+		m_resolution[0] = m_resolution[1] = m_resolution[2] = 0;
+		m_cellStart.assign(1, 0);
+		m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return;
+	}
+
+	//a flat or empty box is given some thickness, so that every axis has a cell to step through
+	Real maxExtent = 0.0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real extent = m_bounds.max[axis] - m_bounds.min[axis];
+		maxExtent = extent > maxExtent ? extent : maxExtent;
+	}
+
+	Real minExtent = maxExtent > 0.0 ? maxExtent * (Real)1e-3 : (Real)1.0;
+	Real volume = 1.0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real extent = m_bounds.max[axis] - m_bounds.min[axis];
+
+		if (extent < minExtent)
+		{
+			m_bounds.min[axis] -= (minExtent - extent) * (Real)0.5;
+			m_bounds.max[axis] += (minExtent - extent) * (Real)0.5;
+		}
+
+		volume *= m_bounds.max[axis] - m_bounds.min[axis];
+	}
+
+	//cubic cells, as many along each axis as its length allows
+	double cellsPerLength = cbrt(GRID_DENSITY * count / volume);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		Real extent = m_bounds.max[axis] - m_bounds.min[axis];
+		int cells = (int)(extent * cellsPerLength + 0.5);
+
+		m_resolution[axis] = cells < 1 ? 1 : (cells > GRID_MAX_RESOLUTION ? GRID_MAX_RESOLUTION : cells);
+		m_cellSize[axis] = extent / m_resolution[axis];
+		m_invCellSize[axis] = m_resolution[axis] / extent;
+	}
+
+	int rx = m_resolution[0];
+	int rxy = m_resolution[0] * m_resolution[1];
+
+	//count the items of every cell into the slot after it, then make the counts offsets
+	m_cellStart.assign(rxy * m_resolution[2] + 1, 0);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int item = 0; item < count; item++)
+		{
+			const AABB& box = bounds[item];
+			int first[3], last[3];
+
+			if (box.IsEmpty())
+			{
+				continue;
+			}
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				CellRange(axis, box.min[axis], box.max[axis], first[axis], last[axis]);
+			}
+
+			for (int z = first[2]; z <= last[2]; z++)
+			{
+				for (int y = first[1]; y <= last[1]; y++)
+				{
+					for (int x = first[0]; x <= last[0]; x++)
+					{
+						int cell = z * rxy + y * rx + x;
+
+						if (pass == 0)
+						{
+							m_cellStart[cell + 1]++;
+						}
+						else
+						{
+							//m_cellStart[cell] runs ahead through the cell's items here
+							m_cellItems[m_cellStart[cell]++] = item;
+						}
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (size_t cell = 1; cell < m_cellStart.size(); cell++)
+			{
+				m_cellStart[cell] += m_cellStart[cell - 1];
+			}
+
+			m_cellItems.resize(m_cellStart.back());
+		}
+		else
+		{
+			//each start went up to the next cell's, move them back one cell
+			for (size_t cell = m_cellStart.size() - 1; cell > 0; cell--)
+			{
+				m_cellStart[cell] = m_cellStart[cell - 1];
+			}
+
+			m_cellStart[0] = 0;
+		}
+	}
+
+	m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template<typename CellFunc>
+void UniformGrid::Walk(Ray& ray, const Real& tmax, CellFunc visitCell) const
+{
+	Real tnear;
+
+	if (m_cellItems.empty() || !m_bounds.IntersectByRay(ray, tmax, tnear))
+	{
+		return;
+	}
+
+	const Vec3& start = ray.GetRayStart();
+	const Vec3& dir = ray.GetRay();
+	const Vec3& invdir = ray.GetInvRay();
+
+	int cell[3], step[3], end[3], stride[3] = { 1, m_resolution[0], m_resolution[0] * m_resolution[1] };
+	Real tnext[3], tdelta[3];
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		//the cell the ray enters the grid in, clamped against the rounding of the entry point
+		Real p = ((start[axis] + dir[axis] * tnear) - m_bounds.min[axis]) * m_invCellSize[axis];
+		int cells = m_resolution[axis];
+		int c = !(p > 0.0) ? 0 : (p >= cells ? cells - 1 : (int)p);
+
+		cell[axis] = c;
+
+		if (dir[axis] > 0.0)
+		{
+			step[axis] = 1;
+			end[axis] = cells;
+			tnext[axis] = (m_bounds.min[axis] + (c + 1) * m_cellSize[axis] - start[axis]) * invdir[axis];
+			tdelta[axis] = m_cellSize[axis] * invdir[axis];
+		}
+		else if (dir[axis] < 0.0)
+		{
+			step[axis] = -1;
+			end[axis] = -1;
+			tnext[axis] = (m_bounds.min[axis] + c * m_cellSize[axis] - start[axis]) * invdir[axis];
+			tdelta[axis] = -m_cellSize[axis] * invdir[axis];
+		}
+		else
+		{
+			//never leaves its cells along this axis
+			step[axis] = 0;
+			end[axis] = -1;
+			tnext[axis] = std::numeric_limits<Real>::infinity();
+			tdelta[axis] = 0.0;
+		}
+	}
+
+	int index = cell[2] * stride[2] + cell[1] * stride[1] + cell[0];
+
+	while (true)
+	{
+		int first = m_cellStart[index];
+		int count = m_cellStart[index + 1] - first;
+
+		if (count > 0 && visitCell(first, count))
+		{
+			return;
+		}
+
+		//the side of the cell the ray leaves through; a hit before it is closer than anything
+		//in the cells further on
+		int axis = tnext[0] < tnext[1] ? (tnext[0] < tnext[2] ? 0 : 2) : (tnext[1] < tnext[2] ? 1 : 2);
+
+		if (tmax <= tnext[axis])
+		{
+			return;
+		}
+
+		cell[axis] += step[axis];
+
+		if (cell[axis] == end[axis])
+		{
+			return;
+		}
+
+		index += step[axis] * stride[axis];
+		tnext[axis] += tdelta[axis];
+	}
+}
+
+void UniformGrid::Intersect(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+	RayHit& hit) const
+{
+	RayMailbox mailbox;
+
+	Walk(ray, hit.t, [this, &store, &items, &ray, &hit, &mailbox](int first, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int item = m_cellItems[first + i];
+
+			if (!mailbox.TestedBefore(item))
+			{
+				store.Intersect(items[item], ray, hit);
+			}
+		}
+
+		return false;
+	});
+}
+
+bool UniformGrid::Occluded(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+	Real maxDistance) const
+{
+	RayMailbox mailbox;
+	bool blocked = false;
+
+	Walk(ray, maxDistance, [this, &store, &items, &ray, maxDistance, &mailbox, &blocked](int first, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			int item = m_cellItems[first + i];
+			PrimHandle prim = items[item];
+
+			if (!mailbox.TestedBefore(item) && store.GetMaterial(prim).castShadow &&
+				store.Occludes(prim, ray, maxDistance))
+			{
+				blocked = true;
+				return true;
+			}
+		}
+
+		return false;
+	});
+
+	return blocked;
+}
@@ -0,0 +1,74 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <vector>
+
+#include "Accelerator.h"
+
+//A regular grid of cells over the box of all items, each cell listing the items whose boxes
+//overlap it. Rays step from cell to cell in the order they pass them (3D-DDA) and stop in the
+//first cell that holds a hit closer than the cell's far side, so the cost follows the cells
+//crossed rather than the number of items. The resolution comes from the number of items and
+//the shape of their box, which suits evenly spread objects; a few large objects among many
+//small ones, or clusters in a large empty space, fill the cells unevenly and are better served
+//by the BVH or a KDTree.
+class UniformGrid : public Accelerator
+{
+	private:
+		AABB				m_bounds;
+		int					m_resolution[3];
+		Vec3				m_cellSize;
+		Vec3				m_invCellSize;
+		std::vector<int>	m_cellStart;		//one per cell and one past the last, into m_cellItems
+		std::vector<int>	m_cellItems;
+		double				m_seconds;
+
+		//The cells of axis that the range lo to hi overlaps, clamped to the grid
+		void CellRange(int axis, Real lo, Real hi, int& first, int& last) const;
+
+		//Walk the cells the ray passes within tmax. visitCell(first, count) tests the items
+		//m_cellItems[first] to [first + count) and returns true to stop the walk; tmax is read
+		//again after every cell so that a closer hit shortens it.
+		template<typename CellFunc>
+		void Walk(Ray& ray, const Real& tmax, CellFunc visitCell) const;
+
+	public:
+		UniformGrid();
+
+		inline const char* GetName() const
+		{
+			return "grid";
+		}
+
+		//Built on the calling thread, pool is not used
+		void Build(const std::vector<AABB>& bounds, ThreadPool* pool = nullptr);
+
+		void Intersect(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			RayHit& hit) const;
+
+		bool Occluded(const PrimitiveStore& store, const std::vector<PrimHandle>& items, Ray& ray,
+			Real maxDistance) const;
+
+		inline double GetBuildSeconds() const
+		{
+			return m_seconds;
+		}
+
+		inline size_t GetMemoryUsage() const
+		{
+			return (m_cellStart.capacity() + m_cellItems.capacity()) * sizeof(int);
+		}
+
+		inline int GetResolution(int axis) const
+		{
+			return m_resolution[axis];
+		}
+};
@@ -0,0 +1,135 @@
+#pragma once
+//Created for Graphics I and II
+//Author: Minsi Chen
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+//Every vector and distance in the tracer is a Real. Build with TINYRAY_SINGLE_PRECISION
+//defined to trace in float, which doubles the SIMD width; double is the default.
+#ifdef TINYRAY_SINGLE_PRECISION
+typedef float Real;
+#if defined(__SSE__) || defined(_M_X64)
+#define VEC3_SSE
+#endif
+#else
+typedef double Real;
+#if defined(__AVX__)
+#define VEC3_AVX
+#endif
+#endif
+
+//A 3 component vector padded to 4 lanes so that one vector fills exactly one SSE (float)
+//or AVX (double) register. The pad lane is kept at zero and never takes part in a dot
+//product or a length. The type is trivially copyable: no virtual functions, no user copy.
+struct alignas(4 * sizeof(Real)) Vec3
+{
+	Real		m_element[4];
+
+	inline Vec3()
+	{
+		m_element[0] = m_element[1] = m_element[2] = m_element[3] = 0;
+	}
+
+	inline Vec3(Real x, Real y, Real z)
+	{
+		m_element[0] = x; m_element[1] = y; m_element[2] = z;
+		m_element[3] = 0;
+	}
+
+	//accessor for each vector component
+	//e.g. Vec3 vec;
+	//		vec[0]
+	inline Real operator [] (const int i) const { return m_element[i]; }
+	inline Real& operator [] (const int i) { return m_element[i]; }
+
+	inline void SetVector(Real x, Real y, Real z) { m_element[0] = x; m_element[1] = y; m_element[2] = z; m_element[3] = 0; }
+	inline void SetZero() { m_element[0] = m_element[1] = m_element[2] = m_element[3] = 0; }
+
+#if defined(VEC3_SSE)
+	inline __m128 Load() const { return _mm_loadu_ps(m_element); }
+	static inline Vec3 Store(__m128 v) { Vec3 r; _mm_storeu_ps(r.m_element, v); return r; }
+	static inline __m128 Splat(Real s) { return _mm_set1_ps(s); }
+#define VEC3_ADD	_mm_add_ps
+#define VEC3_SUB	_mm_sub_ps
+#define VEC3_MUL	_mm_mul_ps
+#define VEC3_MIN	_mm_min_ps
+#define VEC3_MAX	_mm_max_ps
+#elif defined(VEC3_AVX)
+	inline __m256d Load() const { return _mm256_loadu_pd(m_element); }
+	static inline Vec3 Store(__m256d v) { Vec3 r; _mm256_storeu_pd(r.m_element, v); return r; }
+	static inline __m256d Splat(Real s) { return _mm256_set1_pd(s); }
+#define VEC3_ADD	_mm256_add_pd
+#define VEC3_SUB	_mm256_sub_pd
+#define VEC3_MUL	_mm256_mul_pd
+#define VEC3_MIN	_mm256_min_pd
+#define VEC3_MAX	_mm256_max_pd
+#endif
+
+	//some common vector operators
+#if defined(VEC3_ADD)
+	inline Vec3 operator + (const Vec3& rhs) const { return Store(VEC3_ADD(Load(), rhs.Load())); }
+	inline Vec3 operator - (const Vec3& rhs) const { return Store(VEC3_SUB(Load(), rhs.Load())); }
+	inline Vec3 operator * (const Vec3& rhs) const { return Store(VEC3_MUL(Load(), rhs.Load())); }
+	inline Vec3 operator * (Real scale) const { return Store(VEC3_MUL(Load(), Splat(scale))); }
+	inline Vec3 Min(const Vec3& rhs) const { return Store(VEC3_MIN(Load(), rhs.Load())); }
+	inline Vec3 Max(const Vec3& rhs) const { return Store(VEC3_MAX(Load(), rhs.Load())); }
+#else
+	inline Vec3 operator + (const Vec3& rhs) const { return Vec3(m_element[0] + rhs[0], m_element[1] + rhs[1], m_element[2] + rhs[2]); }
+	inline Vec3 operator - (const Vec3& rhs) const { return Vec3(m_element[0] - rhs[0], m_element[1] - rhs[1], m_element[2] - rhs[2]); }
+	inline Vec3 operator * (const Vec3& rhs) const { return Vec3(m_element[0] * rhs[0], m_element[1] * rhs[1], m_element[2] * rhs[2]); }
+	inline Vec3 operator * (Real scale) const { return Vec3(m_element[0] * scale, m_element[1] * scale, m_element[2] * scale); }
+	inline Vec3 Min(const Vec3& rhs) const { return Vec3(fmin(m_element[0], rhs[0]), fmin(m_element[1], rhs[1]), fmin(m_element[2], rhs[2])); }
+	inline Vec3 Max(const Vec3& rhs) const { return Vec3(fmax(m_element[0], rhs[0]), fmax(m_element[1], rhs[1]), fmax(m_element[2], rhs[2])); }
+#endif
+
+	inline Vec3 operator - () const { return Vec3(-m_element[0], -m_element[1], -m_element[2]); }
+	inline Vec3& operator += (const Vec3& rhs) { *this = *this + rhs; return *this; }
+	inline Vec3& operator -= (const Vec3& rhs) { *this = *this - rhs; return *this; }
+
+	inline Real DotProduct(const Vec3& rhs) const
+	{
+		return m_element[0] * rhs[0] + m_element[1] * rhs[1] + m_element[2] * rhs[2];
+	}
+
+	inline Vec3 CrossProduct(const Vec3& rhs) const
+	{
+		return Vec3(
+			m_element[1] * rhs[2] - m_element[2] * rhs[1],
+			m_element[2] * rhs[0] - m_element[0] * rhs[2],
+			m_element[0] * rhs[1] - m_element[1] * rhs[0]);
+	}
+
+	inline Real LengthSqr() const { return DotProduct(*this); }
+	inline Real Length() const { return sqrt(LengthSqr()); }
+
+	//Normalise in place, the normalised vector is also returned
+	inline Vec3 Normalise()
+	{
+		Real length = Length();
+
+		if (length > (Real)1.0e-8)
+		{
+			*this = *this * ((Real)1.0 / length);
+		}
+
+		return *this;
+	}
+
+	//Component-wise reciprocal, for slab tests
+	inline Vec3 Reciprocal() const
+	{
+		return Vec3((Real)1.0 / m_element[0], (Real)1.0 / m_element[1], (Real)1.0 / m_element[2]);
+	}
+};
+
+#undef VEC3_ADD
+#undef VEC3_SUB
+#undef VEC3_MUL
+#undef VEC3_MIN
+#undef VEC3_MAX
+
+inline Vec3 operator * (Real scale, const Vec3& v) { return v * scale; }
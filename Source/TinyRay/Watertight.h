@@ -0,0 +1,168 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <math.h>
+#include <limits>
+
+#include "Ray.h"
+
+//The watertight ray/triangle test of Woop, Benthin and Wald, in floats or doubles. The ray is
+//turned into the z axis by a permutation and a shear, after which a triangle is hit where its
+//projection onto the xy plane covers the origin. The three edge functions that decide this are
+//computed the same way for the two triangles sharing an edge, so a ray through an edge or a
+//vertex hits at least one of the triangles around it instead of slipping through a crack, and
+//an edge function that rounds to zero in float is computed again in double.
+//
+//Every distance comes with a bound on its rounding error; a hit that might lie at or behind the
+//start of the ray is rejected, so a ray leaving a surface does not find that surface again
+//without being moved away from it first.
+
+//The part of the test that only depends on the ray, worked out once for all triangles
+template<typename T>
+struct WatertightRay
+{
+	int		kx, ky, kz;			//the axes that become x, y and z, z the largest of the direction
+	T		shear[3];			//Sx, Sy and Sz that take the direction to (0, 0, 1)
+	T		start[3];
+	T		tmin, tmax;			//the interval of the ray
+
+	explicit inline WatertightRay(Ray& ray)
+	{
+		const Vec3& dir = ray.GetRay();
+		Real ax = fabs(dir[0]);
+		Real ay = fabs(dir[1]);
+		Real az = fabs(dir[2]);
+
+		kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+		kx = kz == 2 ? 0 : kz + 1;
+		ky = kx == 2 ? 0 : kx + 1;
+
+		T dz = (T)dir[kz];
+
+		shear[0] = -(T)dir[kx] / dz;
+		shear[1] = -(T)dir[ky] / dz;
+		shear[2] = (T)1.0 / dz;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			start[axis] = (T)ray.GetRayStart()[axis];
+		}
+
+		tmin = (T)ray.GetTMin();
+		tmax = (T)ray.GetTMax();
+	}
+};
+
+//Bound on the relative error of n operations rounded to T, gamma(n) in Pharr, Jakob and Humphreys
+template<typename T>
+inline T RoundingErrorBound(int n)
+{
+	const T halfEpsilon = std::numeric_limits<T>::epsilon() * (T)0.5;
+
+	return (n * halfEpsilon) / (1 - n * halfEpsilon);
+}
+
+//Test the triangle p0, p1, p2 against ray. True for a hit within the ray's interval and before
+//tmax, with t its distance and (u, v) its barycentric coordinates as IntersectTriangleMT gives them.
+template<typename T>
+inline bool IntersectTriangleWatertight(const WatertightRay<T>& ray, const T p0[3], const T p1[3], const T p2[3],
+	T tmax, T& t, T& u, T& v)
+{
+	const int kx = ray.kx, ky = ray.ky, kz = ray.kz;
+
+	//the vertices relative to the start of the ray, permuted and sheared in x and y
+	T z0 = p0[kz] - ray.start[kz];
+	T z1 = p1[kz] - ray.start[kz];
+	T z2 = p2[kz] - ray.start[kz];
+
+	T x0 = (p0[kx] - ray.start[kx]) + ray.shear[0] * z0;
+	T y0 = (p0[ky] - ray.start[ky]) + ray.shear[1] * z0;
+	T x1 = (p1[kx] - ray.start[kx]) + ray.shear[0] * z1;
+	T y1 = (p1[ky] - ray.start[ky]) + ray.shear[1] * z1;
+	T x2 = (p2[kx] - ray.start[kx]) + ray.shear[0] * z2;
+	T y2 = (p2[ky] - ray.start[ky]) + ray.shear[1] * z2;
+
+	//twice the signed areas of the triangles the origin makes with each edge
+	T e0 = x1 * y2 - y1 * x2;
+	T e1 = x2 * y0 - y2 * x0;
+	T e2 = x0 * y1 - y0 * x1;
+
+	if (sizeof(T) < sizeof(double) && (e0 == 0 || e1 == 0 || e2 == 0))
+	{
+		e0 = (T)((double)x1 * (double)y2 - (double)y1 * (double)x2);
+		e1 = (T)((double)x2 * (double)y0 - (double)y2 * (double)x0);
+		e2 = (T)((double)x0 * (double)y1 - (double)y0 * (double)x1);
+	}
+
+	//the origin is outside if the edges do not agree; both windings count
+	if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+	{
+		return false;
+	}
+
+	T det = e0 + e1 + e2;
+
+	if (det == 0)
+	{
+		return false;
+	}
+
+	//the distance scaled by det, compared against the interval without a division
+	z0 *= ray.shear[2];
+	z1 *= ray.shear[2];
+	z2 *= ray.shear[2];
+
+	T scaled = e0 * z0 + e1 * z1 + e2 * z2;
+	T far = tmax < ray.tmax ? tmax : ray.tmax;
+
+	if (det < 0 ? (scaled >= 0 || scaled < far * det) : (scaled <= 0 || scaled > far * det))
+	{
+		return false;
+	}
+
+	T invDet = (T)1.0 / det;
+
+	t = scaled * invDet;
+
+	//the largest rounding error t can have; anything closer may be behind the start
+	T maxZ = fmax(fabs(z0), fmax(fabs(z1), fabs(z2)));
+	T maxX = fmax(fabs(x0), fmax(fabs(x1), fabs(x2)));
+	T maxY = fmax(fabs(y0), fmax(fabs(y1), fabs(y2)));
+	T maxE = fmax(fabs(e0), fmax(fabs(e1), fabs(e2)));
+
+	T deltaZ = RoundingErrorBound<T>(3) * maxZ;
+	T deltaX = RoundingErrorBound<T>(5) * (maxX + maxZ);
+	T deltaY = RoundingErrorBound<T>(5) * (maxY + maxZ);
+	T deltaE = 2 * (RoundingErrorBound<T>(2) * maxX * maxY + deltaY * maxX + deltaX * maxY);
+	T deltaT = 3 * (RoundingErrorBound<T>(3) * maxE * maxZ + deltaE * maxZ + deltaZ * maxE) * fabs(invDet);
+
+	if (t <= deltaT || t <= ray.tmin || t >= far)
+	{
+		return false;
+	}
+
+	u = e1 * invDet;
+	v = e2 * invDet;
+
+	return true;
+}
+
+//Where a ray leaving point in direction dir has to start for the float test never to find the
+//surface point lies on again: moved off it along its geometric normal, to the side dir leaves
+//to, by more than rounding point to float can move it across (OffsetRayOrigin of Pharr, Jakob
+//and Humphreys). point has to be on the float triangles, as TriangleMesh::ComputeSurface gives it.
+inline Vec3 OffsetRayStart(const Vec3& point, const Vec3& normal, const Vec3& dir)
+{
+	Real error = RoundingErrorBound<float>(4) * (fabs(normal[0] * point[0]) + fabs(normal[1] * point[1]) +
+		fabs(normal[2] * point[2]));
+
+	return point + normal * (dir.DotProduct(normal) < 0.0 ? -error : error);
+}
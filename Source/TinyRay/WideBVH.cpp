@@ -0,0 +1,396 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "WideBVH.h"
+
+//The float nearest to x that is not above (RoundDown) or below (RoundUp) it
+static inline float RoundDown(Real x)
+{
+	float f = (float)x;
+
+	return (Real)f > x ? nextafterf(f, -FLT_MAX) : f;
+}
+
+static inline float RoundUp(Real x)
+{
+	float f = (float)x;
+
+	return (Real)f < x ? nextafterf(f, FLT_MAX) : f;
+}
+
+//Store the boxes of a node, every plane moved outwards to the next value the format can hold
+static void EncodeNode(const AABB bounds[4], const int child[4], WideFloatNode& node)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		node.child[c] = child[c];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bool empty = child[c] == WIDEBVH_EMPTY;
+
+			node.bounds[0][axis][c] = empty ? FLT_MAX : RoundDown(bounds[c].min[axis]);
+			node.bounds[1][axis][c] = empty ? -FLT_MAX : RoundUp(bounds[c].max[axis]);
+		}
+	}
+}
+
+template<typename Q>
+static void EncodeNode(const AABB bounds[4], const int child[4], WideQuantNode<Q>& node)
+{
+	const int levels = (Q)~(Q)0;
+
+	AABB box;
+	box.Reset();
+
+	for (int c = 0; c < 4; c++)
+	{
+		node.child[c] = child[c];
+
+		if (child[c] != WIDEBVH_EMPTY)
+		{
+			box.Grow(bounds[c]);
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		//the smallest grid from the origin that reaches the far side of the box
+		float origin = RoundDown(box.min[axis]);
+		float scale = RoundUp((box.max[axis] - origin) / levels);
+
+		if (scale == 0.0f && (Real)origin < box.max[axis])
+		{
+			scale = nextafterf(0.0f, FLT_MAX);
+		}
+
+		while ((Real)origin + levels * (Real)scale < box.max[axis])
+		{
+			scale = nextafterf(scale, FLT_MAX);
+		}
+
+		node.origin[axis] = origin;
+		node.scale[axis] = scale;
+
+		for (int c = 0; c < 4; c++)
+		{
+			if (child[c] == WIDEBVH_EMPTY || scale == 0.0f)
+			{
+				//nothing inside the grid: an empty slot spans the grid backwards
+				node.offsets[0][axis][c] = child[c] == WIDEBVH_EMPTY ? (Q)levels : 0;
+				node.offsets[1][axis][c] = 0;
+				continue;
+			}
+
+			Real lo = floor((bounds[c].min[axis] - origin) / scale);
+			Real hi = ceil((bounds[c].max[axis] - origin) / scale);
+			int qmin = lo < 0.0 ? 0 : (lo > levels ? levels : (int)lo);
+			int qmax = hi < 0.0 ? 0 : (hi > levels ? levels : (int)hi);
+
+			//the division rounds, so check against the planes the traversal will decode
+			while (qmin > 0 && (Real)origin + (Real)qmin * (Real)scale > bounds[c].min[axis])
+			{
+				qmin--;
+			}
+
+			while (qmax < levels && (Real)origin + (Real)qmax * (Real)scale < bounds[c].max[axis])
+			{
+				qmax++;
+			}
+
+			node.offsets[0][axis][c] = (Q)qmin;
+			node.offsets[1][axis][c] = (Q)qmax;
+		}
+	}
+}
+
+struct WideBVH::CollapsedNode
+{
+	AABB	bounds[4];
+	int		child[4];
+	int		binary[4];
+};
+
+WideBVH::WideBVH()
+{
+	m_format = WIDEBVH_NONE;
+	m_refitCount = 0;
+}
+
+WideBVH::~WideBVH()
+{
+}
+
+void WideBVH::Clear()
+{
+	m_format = WIDEBVH_NONE;
+	m_floatNodes.clear();
+	m_quant16Nodes.clear();
+	m_quant8Nodes.clear();
+	m_leaves.clear();
+	m_items.clear();
+	m_binarySlots.clear();
+	m_slotOwner.clear();
+	m_visited.clear();
+	m_refitCount = 0;
+}
+
+//The wide node over the binary node binaryIndex and its subtree, returns its index. The
+//children of the node are replaced by their own children, the one with the largest box first,
+//until there are four or only leaves.
+int WideBVH::CollapseNode(const BVH& bvh, int binaryIndex, std::vector<CollapsedNode>& nodes)
+{
+	const BVHNode* binary = bvh.GetNodes();
+	int slots[4];
+	int count = 0;
+
+	if (binary[binaryIndex].count > 0)
+	{
+		slots[count++] = binaryIndex;
+	}
+	else
+	{
+		slots[count++] = binary[binaryIndex].leftFirst;
+		slots[count++] = binary[binaryIndex].leftFirst + 1;
+	}
+
+	while (count < 4)
+	{
+		int widest = -1;
+		Real widestArea = -1.0;
+
+		for (int k = 0; k < count; k++)
+		{
+			const BVHNode& node = binary[slots[k]];
+
+			if (node.count == 0 && node.bounds.SurfaceArea() > widestArea)
+			{
+				widest = k;
+				widestArea = node.bounds.SurfaceArea();
+			}
+		}
+
+		if (widest < 0)
+		{
+			break;
+		}
+
+		//the children take the place of their parent, in order
+		int left = binary[slots[widest]].leftFirst;
+
+		for (int k = count; k > widest + 1; k--)
+		{
+			slots[k] = slots[k - 1];
+		}
+
+		slots[widest] = left;
+		slots[widest + 1] = left + 1;
+		count++;
+	}
+
+	//depth first: the subtree of each child follows its parent before the next child's
+	int index = (int)nodes.size();
+	nodes.push_back(CollapsedNode());
+
+	for (int k = 0; k < 4; k++)
+	{
+		int code = WIDEBVH_EMPTY;
+		int binaryIndex = -1;
+		AABB bounds;
+		bounds.Reset();
+
+		if (k < count)
+		{
+			const BVHNode& node = binary[slots[k]];
+			bounds = node.bounds;
+			binaryIndex = slots[k];
+
+			if (node.count > 0)
+			{
+				WideLeaf leaf = { node.leftFirst, node.count };
+				code = ~(int)m_leaves.size();
+				m_leaves.push_back(leaf);
+			}
+			else
+			{
+				code = CollapseNode(bvh, slots[k], nodes);
+			}
+		}
+
+		nodes[index].bounds[k] = bounds;
+		nodes[index].child[k] = code;
+		nodes[index].binary[k] = binaryIndex;
+	}
+
+	return index;
+}
+
+void WideBVH::Build(const BVH& bvh, WideBVHFormat format)
+{
+	Clear();
+
+	if (format == WIDEBVH_NONE || bvh.IsEmpty())
+	{
+		return;
+	}
+
+	m_format = format;
+	m_items.assign(bvh.GetItems(), bvh.GetItems() + bvh.GetItemCount());
+
+	std::vector<CollapsedNode> built;
+	built.reserve(bvh.GetNodeCount() / 2 + 1);
+	CollapseNode(bvh, 0, built);
+
+	auto encode = [this, &built](auto& nodes)
+	{
+		nodes.resize(built.size());
+		m_binarySlots.resize(built.size() * 4);
+
+		for (size_t i = 0; i < built.size(); i++)
+		{
+			EncodeNode(built[i].bounds, built[i].child, nodes[i]);
+			memcpy(&m_binarySlots[i * 4], built[i].binary, sizeof(built[i].binary));
+		}
+	};
+
+	switch (format)
+	{
+	case WIDEBVH_FLOAT:
+		encode(m_floatNodes);
+		break;
+	case WIDEBVH_QUANT16:
+		encode(m_quant16Nodes);
+		break;
+	case WIDEBVH_QUANT8:
+		encode(m_quant8Nodes);
+		break;
+	default:
+		break;
+	}
+}
+
+void WideBVH::Refit(const BVH& bvh, const std::vector<int>& changedNodes)
+{
+	if (m_leaves.empty())
+	{
+		return;
+	}
+
+	//the wide node each binary node is a slot of, if any
+	if (m_slotOwner.empty())
+	{
+		m_slotOwner.assign(bvh.GetNodeCount(), -1);
+		m_visited.assign(GetNodeCount(), 0);
+
+		for (size_t s = 0; s < m_binarySlots.size(); s++)
+		{
+			if (m_binarySlots[s] >= 0)
+			{
+				m_slotOwner[m_binarySlots[s]] = (int)(s / 4);
+			}
+		}
+	}
+
+	//a node is made from the boxes of the binary nodes in its slots alone: only the nodes with
+	//a changed one among them change, each is stored again once. A node was taken by this
+	//refit if its mark is this refit's number; the marks start over when the number wraps.
+	if (++m_refitCount == 0)
+	{
+		std::fill(m_visited.begin(), m_visited.end(), 0);
+		m_refitCount = 1;
+	}
+
+	std::vector<int>& dirty = m_dirty;
+	dirty.clear();
+
+	for (int binaryIndex : changedNodes)
+	{
+		int nodeIndex = m_slotOwner[binaryIndex];
+
+		if (nodeIndex >= 0 && m_visited[nodeIndex] != m_refitCount)
+		{
+			m_visited[nodeIndex] = m_refitCount;
+			dirty.push_back(nodeIndex);
+		}
+	}
+
+	//in the order they are stored, which walks the nodes and the binary ones mostly forwards
+	std::sort(dirty.begin(), dirty.end());
+
+	const BVHNode* binary = bvh.GetNodes();
+
+	auto encode = [this, binary, &dirty](auto& nodes)
+	{
+		for (int nodeIndex : dirty)
+		{
+			AABB bounds[4];
+			int child[4];
+
+			for (int c = 0; c < 4; c++)
+			{
+				int binaryIndex = m_binarySlots[nodeIndex * 4 + c];
+				child[c] = nodes[nodeIndex].child[c];
+				bounds[c].Reset();
+
+				if (binaryIndex >= 0)
+				{
+					bounds[c] = binary[binaryIndex].bounds;
+				}
+			}
+
+			EncodeNode(bounds, child, nodes[nodeIndex]);
+		}
+	};
+
+	switch (m_format)
+	{
+	case WIDEBVH_FLOAT:
+		encode(m_floatNodes);
+		break;
+	case WIDEBVH_QUANT16:
+		encode(m_quant16Nodes);
+		break;
+	case WIDEBVH_QUANT8:
+		encode(m_quant8Nodes);
+		break;
+	default:
+		break;
+	}
+}
+
+int WideBVH::GetNodeCount() const
+{
+	return (int)(m_floatNodes.size() + m_quant16Nodes.size() + m_quant8Nodes.size());
+}
+
+size_t WideBVH::GetNodeSize() const
+{
+	switch (m_format)
+	{
+	case WIDEBVH_FLOAT:
+		return sizeof(WideFloatNode);
+	case WIDEBVH_QUANT16:
+		return sizeof(WideQuant16Node);
+	case WIDEBVH_QUANT8:
+		return sizeof(WideQuant8Node);
+	default:
+		return 0;
+	}
+}
+
+size_t WideBVH::GetMemoryUsage() const
+{
+	return GetNodeCount() * GetNodeSize() + m_leaves.capacity() * sizeof(WideLeaf) +
+		(m_items.capacity() + m_binarySlots.capacity() + m_slotOwner.capacity() + m_visited.capacity() +
+		m_dirty.capacity()) * sizeof(int);
+}
@@ -0,0 +1,506 @@
+/*---------------------------------------------------------------------
+*
+* Copyright © 2015  Minsi Chen
+* E-mail: m.chen@derby.ac.uk
+*
+* The source is written for the Graphics I and II modules. You are free
+* to use and extend the functionality. The code provided here is functional
+* however the author does not guarantee its performance.
+---------------------------------------------------------------------*/
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+#include "BVH.h"
+
+#if defined(__SSE__) || defined(_M_X64) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+//How the child boxes of a WideBVH node are stored
+enum WideBVHFormat
+{
+	WIDEBVH_NONE,			//no wide tree, the binary one is traversed
+	WIDEBVH_FLOAT,			//floats, 128 bytes a node
+	WIDEBVH_QUANT16,		//16-bit offsets into the node's box, 128 bytes a node
+	WIDEBVH_QUANT8,			//8-bit offsets into the node's box, 64 bytes a node
+};
+
+//The child slot of a node without a child
+#define WIDEBVH_EMPTY	(-0x7fffffff - 1)
+
+//Four children per node, their boxes stored axis by axis so that one SIMD operation works on
+//a plane of all four. Child c is a node if child[c] >= 0, otherwise the leaf ~child[c].
+struct alignas(64) WideFloatNode
+{
+	float	bounds[2][3][4];		//[min, max][axis][child]
+	int		child[4];
+};
+
+//The same with the child boxes as offsets into the box origin to origin + levels * scale,
+//where levels is the largest Q
+template<typename Q>
+struct alignas(64) WideQuantNode
+{
+	float	origin[3];
+	float	scale[3];
+	Q		offsets[2][3][4];		//[min, max][axis][child]
+	int		child[4];
+};
+
+typedef WideQuantNode<unsigned short>	WideQuant16Node;
+typedef WideQuantNode<unsigned char>	WideQuant8Node;
+
+struct WideLeaf
+{
+	int		first;					//into the items of the tree
+	int		count;
+};
+
+namespace
+{
+
+//The four lanes of a node test in Reals, in the widest registers that hold them: SSE for float,
+//AVX for double, plain arrays otherwise. As in Simd.h this has internal linkage, so translation
+//units compiled for different instruction sets never share it.
+struct WideLanes
+{
+#if defined(TINYRAY_SINGLE_PRECISION) && (defined(__SSE__) || defined(_M_X64))
+	__m128 v;
+
+	static inline WideLanes Set1(Real s) { WideLanes r = { _mm_set1_ps(s) }; return r; }
+	static inline WideLanes Load(const float* p) { WideLanes r = { _mm_load_ps(p) }; return r; }
+	static inline WideLanes FromInts(__m128i i) { WideLanes r = { _mm_cvtepi32_ps(i) }; return r; }
+	inline void Store(Real* p) const { _mm_storeu_ps(p, v); }
+
+	inline WideLanes operator + (WideLanes rhs) const { WideLanes r = { _mm_add_ps(v, rhs.v) }; return r; }
+	inline WideLanes operator - (WideLanes rhs) const { WideLanes r = { _mm_sub_ps(v, rhs.v) }; return r; }
+	inline WideLanes operator * (WideLanes rhs) const { WideLanes r = { _mm_mul_ps(v, rhs.v) }; return r; }
+
+	//a is taken where it is the larger (smaller) one, b where either is a NaN
+	static inline WideLanes Max(WideLanes a, WideLanes b) { WideLanes r = { _mm_max_ps(a.v, b.v) }; return r; }
+	static inline WideLanes Min(WideLanes a, WideLanes b) { WideLanes r = { _mm_min_ps(a.v, b.v) }; return r; }
+
+	//a bit per lane in which a <= b
+	static inline int LessEqual(WideLanes a, WideLanes b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+#define WIDELANES_SIMD
+#elif !defined(TINYRAY_SINGLE_PRECISION) && defined(__AVX__)
+	__m256d v;
+
+	static inline WideLanes Set1(Real s) { WideLanes r = { _mm256_set1_pd(s) }; return r; }
+	static inline WideLanes Load(const float* p) { WideLanes r = { _mm256_cvtps_pd(_mm_load_ps(p)) }; return r; }
+	static inline WideLanes FromInts(__m128i i) { WideLanes r = { _mm256_cvtepi32_pd(i) }; return r; }
+	inline void Store(Real* p) const { _mm256_storeu_pd(p, v); }
+
+	inline WideLanes operator + (WideLanes rhs) const { WideLanes r = { _mm256_add_pd(v, rhs.v) }; return r; }
+	inline WideLanes operator - (WideLanes rhs) const { WideLanes r = { _mm256_sub_pd(v, rhs.v) }; return r; }
+	inline WideLanes operator * (WideLanes rhs) const { WideLanes r = { _mm256_mul_pd(v, rhs.v) }; return r; }
+
+	static inline WideLanes Max(WideLanes a, WideLanes b) { WideLanes r = { _mm256_max_pd(a.v, b.v) }; return r; }
+	static inline WideLanes Min(WideLanes a, WideLanes b) { WideLanes r = { _mm256_min_pd(a.v, b.v) }; return r; }
+
+	static inline int LessEqual(WideLanes a, WideLanes b) { return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ)); }
+#define WIDELANES_SIMD
+#else
+	Real v[4];
+
+	static inline WideLanes Set1(Real s) { WideLanes r = { { s, s, s, s } }; return r; }
+	static inline WideLanes Load(const float* p) { WideLanes r = { { p[0], p[1], p[2], p[3] } }; return r; }
+	inline void Store(Real* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+
+	inline WideLanes operator + (WideLanes rhs) const { WideLanes r; for (int i = 0; i < 4; i++) r.v[i] = v[i] + rhs.v[i]; return r; }
+	inline WideLanes operator - (WideLanes rhs) const { WideLanes r; for (int i = 0; i < 4; i++) r.v[i] = v[i] - rhs.v[i]; return r; }
+	inline WideLanes operator * (WideLanes rhs) const { WideLanes r; for (int i = 0; i < 4; i++) r.v[i] = v[i] * rhs.v[i]; return r; }
+
+	static inline WideLanes Max(WideLanes a, WideLanes b) { WideLanes r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+	static inline WideLanes Min(WideLanes a, WideLanes b) { WideLanes r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+
+	static inline int LessEqual(WideLanes a, WideLanes b)
+	{
+		int bits = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			bits |= (a.v[i] <= b.v[i] ? 1 : 0) << i;
+		}
+
+		return bits;
+	}
+#endif
+
+	template<typename Q>
+	static inline WideLanes Load(const Q* p)
+	{
+#if defined(WIDELANES_SIMD) && (defined(__SSE4_1__) || defined(__AVX__))
+		int packed[2] = { 0, 0 };
+		memcpy(packed, p, 4 * sizeof(Q));
+		__m128i q = _mm_loadl_epi64((const __m128i*)packed);
+
+		return FromInts(sizeof(Q) == 1 ? _mm_cvtepu8_epi32(q) : _mm_cvtepu16_epi32(q));
+#elif defined(WIDELANES_SIMD)
+		return FromInts(_mm_setr_epi32(p[0], p[1], p[2], p[3]));
+#else
+		WideLanes r = { { (Real)p[0], (Real)p[1], (Real)p[2], (Real)p[3] } };
+		return r;
+#endif
+	}
+};
+
+//What a ray brings to every node test: for each axis the start, the reciprocal direction and
+//which side of the child boxes it enters through
+struct WideRay
+{
+	WideLanes	start[3];
+	WideLanes	invDir[3];
+	WideLanes	tmin;
+	int			nearSide[3];		//0: the min planes, 1: the max planes
+
+	inline WideRay(Ray& ray)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			start[axis] = WideLanes::Set1(ray.GetRayStart()[axis]);
+			invDir[axis] = WideLanes::Set1(ray.GetInvRay()[axis]);
+			nearSide[axis] = ray.GetSign(axis);
+		}
+
+		tmin = WideLanes::Set1(ray.GetTMin());
+	}
+};
+
+inline WideLanes ChildPlanes(const WideFloatNode& node, int side, int axis)
+{
+	return WideLanes::Load(node.bounds[side][axis]);
+}
+
+//Decoded exactly as WideBVH::Build checked them against the boxes
+template<typename Q>
+inline WideLanes ChildPlanes(const WideQuantNode<Q>& node, int side, int axis)
+{
+	return WideLanes::Set1(node.origin[axis]) + WideLanes::Load(node.offsets[side][axis]) * WideLanes::Set1(node.scale[axis]);
+}
+
+//The slab test of AABB::IntersectByRay against the four children at once, choosing the near
+//plane of each axis by the sign of the direction instead of swapping; a NaN leaves the interval
+//untouched in the same way. Returns a bit per child the ray enters before tmax.
+template<typename Node>
+inline int IntersectChildren(const Node& node, const WideRay& ray, Real tmax, WideLanes& tnear)
+{
+	WideLanes t0 = ray.tmin;
+	WideLanes t1 = WideLanes::Set1(tmax);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int side = ray.nearSide[axis];
+		WideLanes tin = (ChildPlanes(node, side, axis) - ray.start[axis]) * ray.invDir[axis];
+		WideLanes tout = (ChildPlanes(node, 1 - side, axis) - ray.start[axis]) * ray.invDir[axis];
+
+		t0 = WideLanes::Max(tin, t0);
+		t1 = WideLanes::Min(tout, t1);
+	}
+
+	tnear = t0;
+
+	return WideLanes::LessEqual(t0, t1);
+}
+
+}
+
+//A BVH with four children per node, collapsed from a binary BVH by pulling the largest
+//children of each node up until it has four. The nodes are in depth first order, each on
+//its own cache lines, and their child boxes are stored in floats or quantised to 8 or 16 bits
+//relative to the node's box. Every stored box is rounded outwards, so a ray enters at least
+//the boxes it enters in the binary tree and finds the same closest hit. Items at the same
+//distance may be met in another order, and where an item test reports a grazing hit just
+//outside the item's own box, which the binary tree culls, the larger boxes may let it through.
+//
+//The wide tree is made for single rays, the packet tracer keeps walking the binary one.
+class WideBVH
+{
+	private:
+		WideBVHFormat					m_format;
+		std::vector<WideFloatNode>		m_floatNodes;
+		std::vector<WideQuant16Node>	m_quant16Nodes;
+		std::vector<WideQuant8Node>		m_quant8Nodes;
+		std::vector<WideLeaf>			m_leaves;
+		std::vector<int>				m_items;			//a copy of the binary tree's
+		std::vector<int>				m_binarySlots;		//per node and child the binary node it holds
+
+		//For Refit, made on its first call after a build: the node every binary node is a slot
+		//of (-1 for one collapsed away), and the last refit that took each node
+		std::vector<int>				m_slotOwner;
+		std::vector<unsigned int>		m_visited;
+		unsigned int					m_refitCount;
+		std::vector<int>				m_dirty;			//the nodes Refit stores again
+
+		struct CollapsedNode;		//a node before it is stored in the format
+
+		int			CollapseNode(const BVH& bvh, int binaryIndex, std::vector<CollapsedNode>& nodes);
+
+		template<typename Node, typename ItemFunc>
+		void		TraverseNodes(const Node* nodes, Ray& ray, Real& tmax, ItemFunc& intersectItem,
+						BVHTraversalStats* stats) const;
+
+		template<typename Node, typename ItemFunc>
+		bool		TraverseNodesAny(const Node* nodes, Ray& ray, Real tmax, ItemFunc& blocksRay,
+						BVHTraversalStats* stats) const;
+
+	public:
+		WideBVH();
+		~WideBVH();
+
+		//Collapse bvh into a wide tree in format, WIDEBVH_NONE only clears it. The wide tree
+		//does not follow later builds of bvh, collapse it again after them; refits are followed
+		//by Refit.
+		void		Build(const BVH& bvh, WideBVHFormat format);
+		void		Clear();
+
+		//Store again the boxes of the nodes with one of changedNodes in their slots, after bvh,
+		//the tree this one was collapsed from, was refit and changed the boxes of those nodes,
+		//see BVH::Refit. Only those nodes are visited.
+		void		Refit(const BVH& bvh, const std::vector<int>& changedNodes);
+
+		inline WideBVHFormat GetFormat() const
+		{
+			return m_format;
+		}
+
+		inline bool IsEmpty() const
+		{
+			return m_leaves.empty();
+		}
+
+		int			GetNodeCount() const;
+
+		//Bytes of one node in the format
+		size_t		GetNodeSize() const;
+
+		size_t		GetMemoryUsage() const;
+
+		//The same traversals as BVH::Traverse and BVH::TraverseAny
+		template<typename ItemFunc>
+		void		Traverse(Ray& ray, Real& tmax, ItemFunc intersectItem, BVHTraversalStats* stats = nullptr) const;
+
+		template<typename ItemFunc>
+		bool		TraverseAny(Ray& ray, Real tmax, ItemFunc blocksRay, BVHTraversalStats* stats = nullptr) const;
+};
+
+template<typename ItemFunc>
+void WideBVH::Traverse(Ray& ray, Real& tmax, ItemFunc intersectItem, BVHTraversalStats* stats) const
+{
+	switch (m_format)
+	{
+	case WIDEBVH_FLOAT:
+		TraverseNodes(m_floatNodes.data(), ray, tmax, intersectItem, stats);
+		break;
+	case WIDEBVH_QUANT16:
+		TraverseNodes(m_quant16Nodes.data(), ray, tmax, intersectItem, stats);
+		break;
+	case WIDEBVH_QUANT8:
+		TraverseNodes(m_quant8Nodes.data(), ray, tmax, intersectItem, stats);
+		break;
+	default:
+		break;
+	}
+}
+
+template<typename ItemFunc>
+bool WideBVH::TraverseAny(Ray& ray, Real tmax, ItemFunc blocksRay, BVHTraversalStats* stats) const
+{
+	switch (m_format)
+	{
+	case WIDEBVH_FLOAT:
+		return TraverseNodesAny(m_floatNodes.data(), ray, tmax, blocksRay, stats);
+	case WIDEBVH_QUANT16:
+		return TraverseNodesAny(m_quant16Nodes.data(), ray, tmax, blocksRay, stats);
+	case WIDEBVH_QUANT8:
+		return TraverseNodesAny(m_quant8Nodes.data(), ray, tmax, blocksRay, stats);
+	default:
+		return false;
+	}
+}
+
+template<typename Node, typename ItemFunc>
+void WideBVH::TraverseNodes(const Node* nodes, Ray& ray, Real& tmax, ItemFunc& intersectItem, BVHTraversalStats* stats) const
+{
+	struct StackEntry
+	{
+		int		child;
+		Real	tnear;
+	};
+
+	if (m_leaves.empty())
+	{
+		return;
+	}
+
+	WideRay wideRay(ray);
+
+	//every node on the way down leaves at most three children behind
+	StackEntry stack[BVH_MAX_DEPTH * 3];
+	int stackSize = 0;
+	int child = 0;
+
+	while (true)
+	{
+		if (child >= 0)
+		{
+			const Node& node = nodes[child];
+			WideLanes tnear;
+			int hits = IntersectChildren(node, wideRay, tmax, tnear);
+
+			if (stats)
+			{
+				stats->nodes++;
+				stats->boxes += 4;
+				stats->bytes += sizeof(Node);
+			}
+
+			Real t[4];
+			tnear.Store(t);
+
+			//the children entered, nearest first
+			int order[4];
+			int count = 0;
+
+			for (int c = 0; c < 4; c++)
+			{
+				if ((hits & (1 << c)) && node.child[c] != WIDEBVH_EMPTY)
+				{
+					int k = count++;
+
+					for (; k > 0 && t[order[k - 1]] > t[c]; k--)
+					{
+						order[k] = order[k - 1];
+					}
+
+					order[k] = c;
+				}
+			}
+
+			if (count > 0)
+			{
+				for (int k = count - 1; k > 0; k--)
+				{
+					stack[stackSize].child = node.child[order[k]];
+					stack[stackSize].tnear = t[order[k]];
+					stackSize++;
+				}
+
+				child = node.child[order[0]];
+				continue;
+			}
+		}
+		else
+		{
+			const WideLeaf& leaf = m_leaves[~child];
+
+			if (stats)
+			{
+				stats->items += leaf.count;
+				stats->bytes += sizeof(WideLeaf);
+			}
+
+			for (int i = 0; i < leaf.count; i++)
+			{
+				intersectItem(m_items[leaf.first + i]);
+			}
+		}
+
+		//pop the next subtree that can still contain a closer hit
+		while (stackSize > 0 && stack[stackSize - 1].tnear > tmax)
+		{
+			stackSize--;
+		}
+
+		if (stackSize == 0)
+		{
+			return;
+		}
+
+		child = stack[--stackSize].child;
+	}
+}
+
+template<typename Node, typename ItemFunc>
+bool WideBVH::TraverseNodesAny(const Node* nodes, Ray& ray, Real tmax, ItemFunc& blocksRay, BVHTraversalStats* stats) const
+{
+	if (m_leaves.empty())
+	{
+		return false;
+	}
+
+	WideRay wideRay(ray);
+
+	int stack[BVH_MAX_DEPTH * 3];
+	int stackSize = 0;
+	int child = 0;
+
+	while (true)
+	{
+		if (child >= 0)
+		{
+			const Node& node = nodes[child];
+			WideLanes tnear;
+			int hits = IntersectChildren(node, wideRay, tmax, tnear);
+
+			if (stats)
+			{
+				stats->nodes++;
+				stats->boxes += 4;
+				stats->bytes += sizeof(Node);
+			}
+
+			int next = WIDEBVH_EMPTY;
+
+			for (int c = 0; c < 4; c++)
+			{
+				if ((hits & (1 << c)) && node.child[c] != WIDEBVH_EMPTY)
+				{
+					if (next != WIDEBVH_EMPTY)
+					{
+						stack[stackSize++] = next;
+					}
+
+					next = node.child[c];
+				}
+			}
+
+			if (next != WIDEBVH_EMPTY)
+			{
+				child = next;
+				continue;
+			}
+		}
+		else
+		{
+			const WideLeaf& leaf = m_leaves[~child];
+
+			if (stats)
+			{
+				stats->bytes += sizeof(WideLeaf);
+			}
+
+			for (int i = 0; i < leaf.count; i++)
+			{
+				if (stats)
+				{
+					stats->items++;
+				}
+
+				if (blocksRay(m_items[leaf.first + i]))
+				{
+					return true;
+				}
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return false;
+		}
+
+		child = stack[--stackSize];
+	}
+}